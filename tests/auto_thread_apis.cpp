@@ -0,0 +1,286 @@
+/*
+* The Sleuth Kit
+*
+* Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2013 Brian Carrier.  All Rights reserved
+*
+*
+* This software is distributed under the Common Public License 1.0
+*
+*/
+
+/* Test that TskAuto finds the same files when the volumes of an image
+ * are processed on several threads as when they are processed on one
+ * and that setStopProcessing() stops all of the threads. */
+
+#include "tsk/tsk_tools_i.h"
+#include <string>
+#include <map>
+
+static char *s_root;
+
+static const char *s_disk = "auto_thread.tmp";
+
+static const int s_nthreads = 4;
+static const int s_niters = 5;
+
+
+/* Make a listing of each volume in an image */
+class TskAutoList:public TskAuto {
+  public:
+    TskAutoList(bool a_stop) {
+        m_stop = a_stop;
+        m_late = 0;
+        tsk_init_lock(&m_listLock);
+    }
+    ~TskAutoList() {
+        tsk_deinit_lock(&m_listLock);
+    }
+
+    virtual TSK_RETVAL_ENUM processFile(TSK_FS_FILE * fs_file,
+        const char *path);
+    virtual TSK_RETVAL_ENUM processAttribute(TSK_FS_FILE * fs_file,
+        const TSK_FS_ATTR * fs_attr, const char *path);
+
+    std::map < TSK_PNUM_T, std::string > m_lists;
+    int m_late;                 // files started after the stop was set
+
+  private:
+    tsk_lock_t m_listLock;      // protects m_lists and m_late
+    bool m_stop;                // stop after the first file
+
+    void add(TSK_FS_FILE * fs_file, const std::string & a_line);
+};
+
+void
+TskAutoList::add(TSK_FS_FILE * fs_file, const std::string & a_line)
+{
+    const vol_context *vol = getVolContext(fs_file->fs_info);
+    TSK_PNUM_T addr = vol ? vol->addr : (TSK_PNUM_T) - 1;
+
+    // the callbacks for a volume are all made by one thread, so each
+    // list is in the same order as with one thread
+    tsk_take_lock(&m_listLock);
+    m_lists[addr] += a_line;
+    tsk_release_lock(&m_listLock);
+}
+
+TSK_RETVAL_ENUM
+TskAutoList::processFile(TSK_FS_FILE * fs_file, const char *path)
+{
+    char buf[64];
+
+    if (getStopProcessing()) {
+        tsk_take_lock(&m_listLock);
+        m_late++;
+        tsk_release_lock(&m_listLock);
+    }
+
+    snprintf(buf, 64, " %" PRIuINUM " %d\n", fs_file->name->meta_addr,
+        fs_file->name->flags);
+    add(fs_file, std::string(path) + fs_file->name->name + buf);
+
+    if (m_stop) {
+        setStopProcessing();
+        return TSK_OK;
+    }
+    return processAttributes(fs_file, path);
+}
+
+TSK_RETVAL_ENUM
+TskAutoList::processAttribute(TSK_FS_FILE * fs_file,
+    const TSK_FS_ATTR * fs_attr, const char *path)
+{
+    char buf[64];
+
+    snprintf(buf, 64, "  %d-%d %" PRIuOFF "\n", fs_attr->type,
+        fs_attr->id, fs_attr->size);
+    add(fs_file, buf);
+    return TSK_OK;
+}
+
+
+/* Make a disk image with a DOS partition table and one partition for
+ * each of the images.
+ * @returns 1 on error */
+static int
+make_disk(const char **a_names, int a_cnt)
+{
+    unsigned char mbr[512];
+    char fname[512], buf[4096];
+    FILE *hOut, *hIn;
+    uint32_t sect = 64;
+    size_t len;
+
+    if ((hOut = fopen(s_disk, "wb")) == NULL) {
+        fprintf(stderr, "Error creating %s\n", s_disk);
+        return 1;
+    }
+
+    memset(mbr, 0, sizeof(mbr));
+    mbr[510] = 0x55;
+    mbr[511] = 0xaa;
+    for (int i = 0; i < a_cnt; i++) {
+        uint32_t start = sect, size = 0;
+
+        snprintf(fname, 512, "%s/%s", s_root, a_names[i]);
+        if ((hIn = fopen(fname, "rb")) == NULL) {
+            fprintf(stderr, "Error opening %s\n", fname);
+            fclose(hOut);
+            return 1;
+        }
+
+        // copy the image in whole sectors
+        if (fseek(hOut, (long) start * 512, SEEK_SET)) {
+            fclose(hIn);
+            fclose(hOut);
+            return 1;
+        }
+        memset(buf, 0, sizeof(buf));
+        while ((len = fread(buf, 1, sizeof(buf), hIn)) > 0) {
+            len = (len + 511) / 512 * 512;
+            if (fwrite(buf, len, 1, hOut) != 1) {
+                fprintf(stderr, "Error writing %s\n", s_disk);
+                fclose(hIn);
+                fclose(hOut);
+                return 1;
+            }
+            size += (uint32_t) (len / 512);
+            memset(buf, 0, sizeof(buf));
+        }
+        fclose(hIn);
+
+        // partition table entry (the type is not used to find the
+        // file system)
+        unsigned char *ent = &mbr[446 + 16 * i];
+        ent[4] = 0x83;
+        ent[8] = start & 0xff;
+        ent[9] = (start >> 8) & 0xff;
+        ent[10] = (start >> 16) & 0xff;
+        ent[11] = (start >> 24) & 0xff;
+        ent[12] = size & 0xff;
+        ent[13] = (size >> 8) & 0xff;
+        ent[14] = (size >> 16) & 0xff;
+        ent[15] = (size >> 24) & 0xff;
+
+        sect = (start + size + 63) / 64 * 64;
+    }
+
+    if (fseek(hOut, 0, SEEK_SET) || (fwrite(mbr, 512, 1, hOut) != 1)) {
+        fprintf(stderr, "Error writing %s\n", s_disk);
+        fclose(hOut);
+        return 1;
+    }
+    fclose(hOut);
+    return 0;
+}
+
+
+/* Process the disk image with the given number of threads.
+ * @returns 1 on error */
+static int
+list_disk(TskAutoList & a_auto, unsigned int a_threads)
+{
+    a_auto.setThreadCount(a_threads);
+    a_auto.setFileFilterFlags((TSK_FS_DIR_WALK_FLAG_ENUM)
+        (TSK_FS_DIR_WALK_FLAG_ALLOC | TSK_FS_DIR_WALK_FLAG_UNALLOC));
+    if (a_auto.openImageUtf8(1, &s_disk, TSK_IMG_TYPE_DETECT, 0)) {
+        fprintf(stderr, "Error opening %s\n", s_disk);
+        tsk_error_print(stderr);
+        return 1;
+    }
+    a_auto.findFilesInImg();
+    a_auto.closeImage();
+    return 0;
+}
+
+
+static int
+test_threads(int a_cnt)
+{
+    TskAutoList base(false);
+
+    if (list_disk(base, 1))
+        return 1;
+    if ((int) base.m_lists.size() != a_cnt) {
+        fprintf(stderr, "Found %d volumes instead of %d\n",
+            (int) base.m_lists.size(), a_cnt);
+        return 1;
+    }
+    size_t base_errors = base.getErrorList().size();
+
+    for (int i = 0; i < s_niters; i++) {
+        TskAutoList threads(false);
+
+        if (list_disk(threads, s_nthreads))
+            return 1;
+        if (threads.m_lists != base.m_lists) {
+            fprintf(stderr,
+                "Listing with %d threads is different (iteration %d)\n",
+                s_nthreads, i);
+            return 1;
+        }
+        if (threads.getErrorList().size() != base_errors) {
+            fprintf(stderr,
+                "Errors with %d threads are different (iteration %d)\n",
+                s_nthreads, i);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+static int
+test_stop()
+{
+    for (int i = 0; i < s_niters; i++) {
+        TskAutoList stop(true);
+
+        if (list_disk(stop, s_nthreads))
+            return 1;
+
+        // each thread can be starting one more file when the stop is set
+        if (stop.m_late > s_nthreads) {
+            fprintf(stderr,
+                "%d files were processed after the stop (iteration %d)\n",
+                stop.m_late, i);
+            return 1;
+        }
+        if (stop.getStopProcessing() == false) {
+            fprintf(stderr, "Stop was not set (iteration %d)\n", i);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+int
+main(int argc, char **argv)
+{
+    const char *names[] = { "fat12.dd", "ext2fs.dd", "ntfs-img-kw-1.dd",
+        "misc-ufs1.dd"
+    };
+    int retval = 0;
+
+    if (argc != 2) {
+        fprintf(stderr, "missing image root directory\n");
+        return 1;
+    }
+    s_root = argv[1];
+
+    if (make_disk(names, 4))
+        retval = 1;
+    else if (test_threads(4))
+        retval = 1;
+    else if (test_stop())
+        retval = 1;
+
+    remove(s_disk);
+    if (retval)
+        return 1;
+
+    printf("Tests Passed\n");
+    return 0;
+}
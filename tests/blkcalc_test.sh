@@ -0,0 +1,90 @@
+#!/bin/sh
+#
+# Test that blkcalc -u and -d convert between the addresses of an image
+# and of the blkls image of its unallocated blocks.
+#
+# usage: blkcalc_test.sh image_dir
+#
+# For several blkls addresses of each image, blkcalc -u must give the
+# block with the same content in the image and blkcalc -d must give the
+# blkls address back.  blkcalc -u must also give the same addresses for
+# a partial copy of a FAT image, because it does not read the blocks and
+# the FAT is at the start of the image.  (The allocation bitmaps of the
+# other file systems are spread out, so part of them would be missing.)
+
+if [ $# -ne 1 ]; then
+    echo "usage: $0 image_dir" >&2
+    exit 1
+fi
+IMAGE_DIR=$1
+
+BLKCALC=../tools/fstools/blkcalc
+BLKCAT=../tools/fstools/blkcat
+BLKLS=../tools/fstools/blkls
+TMP=blkcalc_test.tmp
+
+IMAGES="fat12.dd fat32.dd ext2fs.dd misc-ufs1.dd ntfs-img-kw-1.dd"
+PARTIAL_IMAGES="fat12.dd fat32.dd"
+
+rm -rf $TMP
+mkdir $TMP || exit 1
+
+for i in $IMAGES; do
+    echo $i
+    img=$IMAGE_DIR/$i
+    bsize=`$BLKCAT -s $img | cut -d: -f1`
+    if ! $BLKLS $img > $TMP/blkls.raw; then
+        echo "Error running blkls on $i"
+        exit 1
+    fi
+    ucnt=`wc -c < $TMP/blkls.raw`
+    ucnt=`expr $ucnt / $bsize`
+    if [ $ucnt -lt 2 ]; then
+        echo "$i has no unallocated blocks"
+        exit 1
+    fi
+
+    # half of the image, which is missing some of the blocks
+    rm -f $TMP/partial.img
+    for p in $PARTIAL_IMAGES; do
+        if [ $p = $i ]; then
+            isize=`wc -c < $img`
+            dd if=$img of=$TMP/partial.img bs=$bsize \
+                count=`expr $isize / $bsize / 2` 2> /dev/null
+        fi
+    done
+
+    for u in 0 1 `expr $ucnt / 3` `expr $ucnt / 2` `expr $ucnt - 1`; do
+        d=`$BLKCALC -u $u $img`
+        if [ -z "$d" ]; then
+            echo "blkcalc -u $u failed for $i"
+            exit 1
+        fi
+
+        back=`$BLKCALC -d $d $img`
+        if [ "$back" != "$u" ]; then
+            echo "blkcalc -d $d gave $back instead of $u for $i"
+            exit 1
+        fi
+
+        $BLKCAT $img $d > $TMP/img.blk
+        dd if=$TMP/blkls.raw of=$TMP/blkls.blk bs=$bsize skip=$u count=1 \
+            2> /dev/null
+        if ! cmp -s $TMP/img.blk $TMP/blkls.blk; then
+            echo "Block $d of $i is not block $u of its blkls image"
+            exit 1
+        fi
+
+        if [ -f $TMP/partial.img ]; then
+            partial=`$BLKCALC -u $u $TMP/partial.img`
+            if [ "$partial" != "$d" ]; then
+                echo "blkcalc -u $u gave $partial instead of $d for partial $i"
+                exit 1
+            fi
+        fi
+    done
+done
+
+rm -rf $TMP
+echo "Tests Passed"
+exit 0
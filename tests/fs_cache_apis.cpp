@@ -0,0 +1,366 @@
+/*
+* The Sleuth Kit
+*
+* Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2013 Brian Carrier.  All Rights reserved
+*
+*
+* This software is distributed under the Common Public License 1.0
+*
+*/
+
+/* Test that the metadata cache, the directory cache, and the blocks that
+ * directory names are allocated from do not change the results.  The
+ * files in each image are listed (with their metadata, attributes, and
+ * some content) without the caches and then compared to listings that
+ * are made with large caches (that get hits) and tiny caches (that
+ * evict entries). */
+
+#include "tsk_test_util.h"
+#include <vector>
+
+typedef struct {
+    std::string *list;
+    std::vector < TSK_INUM_T > *dirs;
+} LIST_DATA;
+
+
+static TSK_WALK_RET_ENUM
+list_attr_act(TSK_FS_FILE * a_fs_file, TSK_OFF_T a_off, TSK_DADDR_T a_addr,
+    char *a_buf, size_t a_len, TSK_FS_BLOCK_FLAG_ENUM a_flags, void *a_ptr)
+{
+    std::string * list = (std::string *) a_ptr;
+    char buf[64];
+
+    snprintf(buf, 64, " %" PRIuDADDR, a_addr);
+    *list += buf;
+    return TSK_WALK_CONT;
+}
+
+/* Add the metadata, the attributes, and a checksum of the start of the
+ * content of a file to a listing */
+static void
+list_meta(TSK_FS_FILE * a_fs_file, std::string & a_list)
+{
+    TSK_FS_META *fs_meta = a_fs_file->meta;
+    char buf[512];
+    int cnt, i;
+
+    snprintf(buf, 512,
+        " meta: %" PRIuINUM " %d %d %d %" PRIuOFF " %d %d %d %" PRIu32
+        " %" PRIu32 " %" PRIu32 " %" PRIu32 "\n", fs_meta->addr,
+        fs_meta->type, fs_meta->flags, fs_meta->mode, fs_meta->size,
+        fs_meta->nlink, (int) fs_meta->uid, (int) fs_meta->gid,
+        (uint32_t) fs_meta->mtime, (uint32_t) fs_meta->atime,
+        (uint32_t) fs_meta->ctime, (uint32_t) fs_meta->crtime);
+    a_list += buf;
+
+    cnt = tsk_fs_file_attr_getsize(a_fs_file);
+    for (i = 0; i < cnt; i++) {
+        const TSK_FS_ATTR *fs_attr = tsk_fs_file_attr_get_idx(a_fs_file, i);
+        if (fs_attr == NULL) {
+            a_list += " attr: error\n";
+            tsk_error_reset();
+            continue;
+        }
+        snprintf(buf, 512, " attr: %d %d %d %" PRIuOFF " %s",
+            fs_attr->type, fs_attr->id, fs_attr->flags, fs_attr->size,
+            fs_attr->name ? fs_attr->name : "");
+        a_list += buf;
+
+        /* the data units of non-resident attributes (for small files) */
+        if ((fs_attr->flags & TSK_FS_ATTR_NONRES)
+            && (fs_attr->size < 1024 * 1024)) {
+            if (tsk_fs_attr_walk(fs_attr,
+                    (TSK_FS_FILE_WALK_FLAG_ENUM)
+                    (TSK_FS_FILE_WALK_FLAG_AONLY |
+                        TSK_FS_FILE_WALK_FLAG_SLACK), list_attr_act,
+                    &a_list)) {
+                a_list += " walk error";
+                tsk_error_reset();
+            }
+        }
+        a_list += "\n";
+    }
+
+    /* a checksum of the start of the content */
+    if (fs_meta->type == TSK_FS_META_TYPE_REG) {
+        char data[8192];
+        ssize_t len;
+        uint32_t sum = 0;
+
+        len = tsk_fs_file_read(a_fs_file, 0, data, sizeof(data),
+            TSK_FS_FILE_READ_FLAG_NONE);
+        if (len == -1) {
+            a_list += " content: error\n";
+            tsk_error_reset();
+        }
+        else {
+            for (ssize_t j = 0; j < len; j++)
+                sum = sum * 31 + (uint8_t) data[j];
+            snprintf(buf, 512, " content: %zd %" PRIu32 "\n", len, sum);
+            a_list += buf;
+        }
+    }
+}
+
+static TSK_WALK_RET_ENUM
+list_act(TSK_FS_FILE * a_fs_file, const char *a_path, void *a_ptr)
+{
+    LIST_DATA *data = (LIST_DATA *) a_ptr;
+    char buf[128];
+
+    *data->list += a_path;
+    *data->list += a_fs_file->name->name;
+    *data->list += " ";
+    if (a_fs_file->name->shrt_name)
+        *data->list += a_fs_file->name->shrt_name;
+    snprintf(buf, 128, " %" PRIuINUM " %d %d %d\n",
+        a_fs_file->name->meta_addr, a_fs_file->name->meta_seq,
+        a_fs_file->name->type, a_fs_file->name->flags);
+    *data->list += buf;
+
+    if (a_fs_file->meta) {
+        list_meta(a_fs_file, *data->list);
+
+        if ((data->dirs) && (a_fs_file->meta->type == TSK_FS_META_TYPE_DIR)
+            && (a_fs_file->name->flags & TSK_FS_NAME_FLAG_ALLOC)
+            && (TSK_FS_ISDOT(a_fs_file->name->name) == 0)
+            && (a_fs_file->meta->addr !=
+                TSK_FS_ORPHANDIR_INUM(a_fs_file->fs_info)))
+            data->dirs->push_back(a_fs_file->meta->addr);
+    }
+    return TSK_WALK_CONT;
+}
+
+/* Make a listing of all of the files in the file system
+ * @param a_dirs If not NULL, the addresses of the allocated directories
+ * (other than the orphan files directory, which is not cached) are added
+ * to it.
+ * @returns 1 on error */
+static int
+list_fs(TSK_FS_INFO * a_fs, std::string & a_list,
+    std::vector < TSK_INUM_T > *a_dirs)
+{
+    LIST_DATA data;
+
+    a_list.clear();
+    data.list = &a_list;
+    data.dirs = a_dirs;
+    if (tsk_fs_dir_walk(a_fs, a_fs->root_inum,
+            (TSK_FS_DIR_WALK_FLAG_ENUM) (TSK_FS_DIR_WALK_FLAG_ALLOC |
+                TSK_FS_DIR_WALK_FLAG_UNALLOC |
+                TSK_FS_DIR_WALK_FLAG_RECURSE), list_act, &data)) {
+        tsk_error_print(stderr);
+        return 1;
+    }
+    return 0;
+}
+
+/* List the names in each of the directories with tsk_fs_dir_open_meta().
+ * @param a_keep_open If 1, all of the directories are kept open until
+ * the end, so the blocks that their names are in are not reused.
+ * @returns 1 on error */
+static int
+list_dirs(TSK_FS_INFO * a_fs, const std::vector < TSK_INUM_T > &a_dirs,
+    int a_keep_open, std::string & a_list)
+{
+    std::vector < TSK_FS_DIR * >open_dirs;
+    int retval = 0;
+
+    a_list.clear();
+    for (size_t i = 0; i < a_dirs.size(); i++) {
+        TSK_FS_DIR *fs_dir;
+        char buf[128];
+
+        if ((fs_dir = tsk_fs_dir_open_meta(a_fs, a_dirs[i])) == NULL) {
+            fprintf(stderr, "Error opening directory %" PRIuINUM "\n",
+                a_dirs[i]);
+            tsk_error_print(stderr);
+            retval = 1;
+            break;
+        }
+        snprintf(buf, 128, "dir %" PRIuINUM "\n", a_dirs[i]);
+        a_list += buf;
+        for (size_t j = 0; j < tsk_fs_dir_getsize(fs_dir); j++) {
+            const TSK_FS_NAME *fs_name = &fs_dir->names[j];
+            a_list += fs_name->name;
+            a_list += " ";
+            if (fs_name->shrt_name)
+                a_list += fs_name->shrt_name;
+            snprintf(buf, 128, " %" PRIuINUM "\n", fs_name->meta_addr);
+            a_list += buf;
+        }
+        if (a_keep_open)
+            open_dirs.push_back(fs_dir);
+        else
+            tsk_fs_dir_close(fs_dir);
+    }
+
+    // check that the names of the open directories were not changed
+    // by opening the later ones
+    if ((retval == 0) && (a_keep_open)) {
+        std::string list2;
+        for (size_t i = 0; i < open_dirs.size(); i++) {
+            char buf[128];
+            snprintf(buf, 128, "dir %" PRIuINUM "\n", a_dirs[i]);
+            list2 += buf;
+            for (size_t j = 0; j < tsk_fs_dir_getsize(open_dirs[i]); j++) {
+                const TSK_FS_NAME *fs_name = &open_dirs[i]->names[j];
+                list2 += fs_name->name;
+                list2 += " ";
+                if (fs_name->shrt_name)
+                    list2 += fs_name->shrt_name;
+                snprintf(buf, 128, " %" PRIuINUM "\n", fs_name->meta_addr);
+                list2 += buf;
+            }
+        }
+        if (list2 != a_list) {
+            fprintf(stderr, "Names changed in open directories\n");
+            retval = 1;
+        }
+    }
+
+    for (size_t i = 0; i < open_dirs.size(); i++)
+        tsk_fs_dir_close(open_dirs[i]);
+    return retval;
+}
+
+/* Compare the listings of a file system with the given cache sizes to
+ * the listings without caches.  Each listing is made twice so that the
+ * second one can be served from the caches.
+ * @returns 1 on error */
+static int
+test_cache_size(const char *a_name, TSK_OFF_T a_offset, size_t a_size,
+    const std::string & a_list, const std::vector < TSK_INUM_T > &a_dirs,
+    const std::string & a_dir_list)
+{
+    TSK_FS_INFO *fs;
+    TSK_IMG_INFO *img;
+    TSK_FS_CACHE_STATS meta_stats, dir_stats;
+    std::string list;
+    int retval = 0;
+
+    if ((fs = tsk_test_open_fs(a_name, a_offset, &img)) == NULL)
+        return 1;
+
+    if (tsk_fs_meta_cache_set_size(fs, a_size)
+        || tsk_fs_dir_cache_set_size(fs, a_size)) {
+        fprintf(stderr, "Error setting cache sizes (%s)\n", a_name);
+        tsk_error_print(stderr);
+        retval = 1;
+        goto cleanup;
+    }
+
+    for (int pass = 0; pass < 2; pass++) {
+        if (list_fs(fs, list, NULL)) {
+            retval = 1;
+            goto cleanup;
+        }
+        if (list != a_list) {
+            fprintf(stderr,
+                "Listing with %" PRIuSIZE
+                " byte caches is different (%s pass %d)\n", a_size,
+                a_name, pass);
+            retval = 1;
+            goto cleanup;
+        }
+
+        if (list_dirs(fs, a_dirs, pass, list)) {
+            retval = 1;
+            goto cleanup;
+        }
+        if (list != a_dir_list) {
+            fprintf(stderr,
+                "Directories with %" PRIuSIZE
+                " byte caches are different (%s pass %d)\n", a_size,
+                a_name, pass);
+            retval = 1;
+            goto cleanup;
+        }
+    }
+
+    tsk_fs_meta_cache_get_stats(fs, &meta_stats);
+    tsk_fs_dir_cache_get_stats(fs, &dir_stats);
+    if ((meta_stats.max_bytes != a_size) || (dir_stats.max_bytes != a_size)) {
+        fprintf(stderr, "Cache sizes were not set (%s)\n", a_name);
+        retval = 1;
+        goto cleanup;
+    }
+    if ((meta_stats.bytes > a_size) || (dir_stats.bytes > a_size)) {
+        fprintf(stderr, "Caches are larger than their limit (%s)\n",
+            a_name);
+        retval = 1;
+        goto cleanup;
+    }
+    // the second passes should find entries in the large caches
+    if ((a_size >= 1024 * 1024)
+        && ((meta_stats.hits == 0) || (dir_stats.hits == 0))) {
+        fprintf(stderr, "Caches were not used (%s)\n", a_name);
+        retval = 1;
+        goto cleanup;
+    }
+
+  cleanup:
+    tsk_test_close_fs(fs, img);
+    return retval;
+}
+
+static int
+test_image(const char *a_name, TSK_OFF_T a_offset)
+{
+    TSK_FS_INFO *fs;
+    TSK_IMG_INFO *img;
+    std::string list, dir_list, dir_list2;
+    std::vector < TSK_INUM_T > dirs;
+
+    // listings without the caches
+    if ((fs = tsk_test_open_fs(a_name, a_offset, &img)) == NULL)
+        return 1;
+    dirs.push_back(fs->root_inum);
+    if (list_fs(fs, list, &dirs) || list_dirs(fs, dirs, 0, dir_list)
+        || list_dirs(fs, dirs, 1, dir_list2)) {
+        fprintf(stderr, "%s failure\n", a_name);
+        tsk_test_close_fs(fs, img);
+        return 1;
+    }
+    tsk_test_close_fs(fs, img);
+    if (dir_list != dir_list2) {
+        fprintf(stderr,
+            "Directories opened one at a time are different (%s)\n",
+            a_name);
+        return 1;
+    }
+
+    if (test_cache_size(a_name, a_offset, 64 * 1024 * 1024, list, dirs,
+            dir_list)
+        || test_cache_size(a_name, a_offset, 8 * 1024, list, dirs,
+            dir_list)) {
+        fprintf(stderr, "%s failure\n", a_name);
+        return 1;
+    }
+    return 0;
+}
+
+
+int
+main(int argc, char **argv)
+{
+    if (argc != 2) {
+        fprintf(stderr, "missing image root directory\n");
+        return 1;
+    }
+    tsk_test_img_dir = argv[1];
+
+    if (test_image("fat12.dd", 0)
+        || test_image("fat32.dd", 0)
+        || test_image("ext2fs.dd", 0)
+        || test_image("misc-ufs1.dd", 0)
+        || test_image("ntfs-img-kw-1.dd", 0)
+        || test_image("fe_test_1.img", 32256)
+        || test_image("test_hfs.dmg", 64 * 512))
+        return 1;
+
+    printf("Tests Passed\n");
+    return 0;
+}
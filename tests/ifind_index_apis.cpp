@@ -0,0 +1,344 @@
+/*
+* The Sleuth Kit
+*
+* Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2013 Brian Carrier.  All Rights reserved
+*
+*
+* This software is distributed under the Common Public License 1.0
+*
+*/
+
+/* Test that the ifind data unit index gives the same owners as walking
+ * every file and that index files are saved, loaded, and verified. */
+
+#include "tsk_test_util.h"
+#include <vector>
+#include <map>
+#include <set>
+
+static const char *s_idx1 = "ifind_index_1.tmp";
+static const char *s_idx2 = "ifind_index_2.tmp";
+
+
+/* Owners of each data unit, in the order that the inode walk finds them */
+typedef std::map < TSK_DADDR_T, std::vector < std::string > >OWNER_MAP;
+
+typedef struct {
+    OWNER_MAP *owners;
+    std::set < TSK_DADDR_T > *seen;     // data units seen in this attribute
+    TSK_INUM_T inum;
+    uint32_t type;
+    uint16_t id;
+} WALK_DATA;
+
+
+static std::string
+owner_str(TSK_INUM_T a_inum, uint32_t a_type, uint16_t a_id,
+    TSK_OFF_T a_off)
+{
+    char buf[128];
+    snprintf(buf, 128, "%" PRIuINUM "-%" PRIu32 "-%" PRIu16 " %" PRIuOFF,
+        a_inum, a_type, a_id, a_off);
+    return buf;
+}
+
+static TSK_WALK_RET_ENUM
+walk_file_act(TSK_FS_FILE * a_fs_file, TSK_OFF_T a_off,
+    TSK_DADDR_T a_addr, char *a_buf, size_t a_size,
+    TSK_FS_BLOCK_FLAG_ENUM a_flags, void *a_ptr)
+{
+    WALK_DATA *data = (WALK_DATA *) a_ptr;
+
+    if (a_flags & TSK_FS_BLOCK_FLAG_SPARSE)
+        return TSK_WALK_CONT;
+
+    // only the first offset of a data unit in an attribute is reported
+    if (data->seen->insert(a_addr).second)
+        (*data->owners)[a_addr].push_back(owner_str(data->inum,
+                data->type, data->id, a_off));
+    return TSK_WALK_CONT;
+}
+
+/* Same attributes and data units that ifind -d looks at */
+static TSK_WALK_RET_ENUM
+walk_meta_act(TSK_FS_FILE * a_fs_file, void *a_ptr)
+{
+    WALK_DATA *data = (WALK_DATA *) a_ptr;
+    int i, cnt;
+
+    data->inum = a_fs_file->meta->addr;
+    cnt = tsk_fs_file_attr_getsize(a_fs_file);
+    for (i = 0; i < cnt; i++) {
+        const TSK_FS_ATTR *fs_attr =
+            tsk_fs_file_attr_get_idx(a_fs_file, i);
+        if ((fs_attr == NULL) || ((fs_attr->flags & TSK_FS_ATTR_NONRES) == 0))
+            continue;
+
+        std::set < TSK_DADDR_T > seen;
+        data->seen = &seen;
+        data->type = fs_attr->type;
+        data->id = fs_attr->id;
+        if (tsk_fs_attr_walk(fs_attr,
+                (TSK_FS_FILE_WALK_FLAG_ENUM) (TSK_FS_FILE_WALK_FLAG_AONLY |
+                    TSK_FS_FILE_WALK_FLAG_SLACK), walk_file_act, data))
+            tsk_error_reset();
+    }
+    return TSK_WALK_CONT;
+}
+
+/* List the owners of every data unit by walking all of the files.
+ * @returns 1 on error */
+static int
+list_walk(TSK_FS_INFO * a_fs, std::string & a_all, std::string & a_first)
+{
+    OWNER_MAP owners;
+    WALK_DATA data;
+    char buf[64];
+
+    memset(&data, 0, sizeof(data));
+    data.owners = &owners;
+    if (tsk_fs_meta_walk(a_fs, a_fs->first_inum, a_fs->last_inum,
+            (TSK_FS_META_FLAG_ENUM) (TSK_FS_META_FLAG_ALLOC |
+                TSK_FS_META_FLAG_UNALLOC), walk_meta_act, &data)) {
+        tsk_error_print(stderr);
+        return 1;
+    }
+
+    a_all.clear();
+    a_first.clear();
+    for (OWNER_MAP::iterator it = owners.begin(); it != owners.end(); ++it) {
+        snprintf(buf, 64, "%" PRIuDADDR " ", it->first);
+        for (size_t i = 0; i < it->second.size(); i++) {
+            a_all += buf + it->second[i] + "\n";
+            if (i == 0)
+                a_first += buf + it->second[i] + "\n";
+        }
+    }
+    return 0;
+}
+
+
+static TSK_WALK_RET_ENUM
+batch_act(TSK_FS_INFO * a_fs, const TSK_FS_IFIND_DATA_HIT * a_hit,
+    void *a_ptr)
+{
+    std::string * list = (std::string *) a_ptr;
+    char buf[64];
+
+    snprintf(buf, 64, "%" PRIuDADDR " ", a_hit->addr);
+    *list += buf + owner_str(a_hit->inum, (uint32_t) a_hit->type,
+        a_hit->id, a_hit->offset) + "\n";
+    return TSK_WALK_CONT;
+}
+
+/* List the owners of every data unit with the index.
+ * @returns 1 on error */
+static int
+list_batch(TSK_FS_INFO * a_fs, TSK_FS_IFIND_FLAG_ENUM a_flags,
+    std::string & a_list)
+{
+    std::vector < TSK_DADDR_T > addrs;
+
+    for (TSK_DADDR_T addr = 0; addr <= a_fs->last_block; addr++)
+        addrs.push_back(addr);
+
+    a_list.clear();
+    if (tsk_fs_ifind_data_batch(a_fs, a_flags, &addrs[0], addrs.size(),
+            batch_act, &a_list)) {
+        tsk_error_print(stderr);
+        return 1;
+    }
+    return 0;
+}
+
+
+/* Compare the batch results with a walk of all files, then save the
+ * index, load it in a new TSK_FS_INFO and compare again. */
+static int
+test_image(const char *a_name, TSK_OFF_T a_offset)
+{
+    TSK_FS_INFO *fs;
+    TSK_IMG_INFO *img;
+    std::string walk_all, walk_first, list, data1, data2;
+    int retval = 1;
+
+    if ((fs = tsk_test_open_fs(a_name, a_offset, &img)) == NULL)
+        return 1;
+    if (list_walk(fs, walk_all, walk_first))
+        goto done;
+    if (walk_all.empty()) {
+        fprintf(stderr, "No data units found by walk (%s)\n", a_name);
+        goto done;
+    }
+
+    if (list_batch(fs, TSK_FS_IFIND_ALL, list))
+        goto done;
+    if (list != walk_all) {
+        fprintf(stderr, "Index and walk give different owners (%s)\n",
+            a_name);
+        goto done;
+    }
+    if (list_batch(fs, TSK_FS_IFIND_NONE, list))
+        goto done;
+    if (list != walk_first) {
+        fprintf(stderr,
+            "Index and walk give different first owners (%s)\n", a_name);
+        goto done;
+    }
+
+    if (tsk_fs_ifind_index_save(fs, (const TSK_TCHAR *) s_idx1)) {
+        fprintf(stderr, "Error saving index (%s)\n", a_name);
+        tsk_error_print(stderr);
+        goto done;
+    }
+    tsk_test_close_fs(fs, img);
+
+    if ((fs = tsk_test_open_fs(a_name, a_offset, &img)) == NULL)
+        return 1;
+    if (tsk_fs_ifind_index_load(fs, (const TSK_TCHAR *) s_idx1)) {
+        fprintf(stderr, "Error loading index (%s)\n", a_name);
+        tsk_error_print(stderr);
+        goto done;
+    }
+    if (list_batch(fs, TSK_FS_IFIND_ALL, list))
+        goto done;
+    if (list != walk_all) {
+        fprintf(stderr, "Loaded index gives different owners (%s)\n",
+            a_name);
+        goto done;
+    }
+
+    // saving the loaded index should give the same file
+    if (tsk_fs_ifind_index_save(fs, (const TSK_TCHAR *) s_idx2)) {
+        fprintf(stderr, "Error saving loaded index (%s)\n", a_name);
+        tsk_error_print(stderr);
+        goto done;
+    }
+
+    if (tsk_test_read_file(s_idx1, data1)
+        || tsk_test_read_file(s_idx2, data2))
+        goto done;
+    if (data1 != data2) {
+        fprintf(stderr, "Saved indexes are different (%s)\n", a_name);
+        goto done;
+    }
+    retval = 0;
+
+  done:
+    tsk_test_close_fs(fs, img);
+    return retval;
+}
+
+
+/* Verify that truncated, damaged, and stale index files are not loaded
+ * and that the index is then built from the file system */
+static int
+test_bad_files(const char *a_name, TSK_OFF_T a_offset,
+    const char *a_other, TSK_OFF_T a_other_offset)
+{
+    TSK_FS_INFO *fs;
+    TSK_IMG_INFO *img;
+    std::string data, corrupt, walk_all, walk_first, list;
+    uint32_t entry_size;
+    int retval = 1;
+
+    if ((fs = tsk_test_open_fs(a_name, a_offset, &img)) == NULL)
+        return 1;
+    if (tsk_fs_ifind_index_save(fs, (const TSK_TCHAR *) s_idx1)) {
+        fprintf(stderr, "Error saving index (%s)\n", a_name);
+        tsk_error_print(stderr);
+        tsk_test_close_fs(fs, img);
+        return 1;
+    }
+    tsk_test_close_fs(fs, img);
+    if (tsk_test_read_file(s_idx1, data))
+        return 1;
+
+    // last run starts past the end of the file system (the header gives
+    // the size of each run and the run starts with its first data unit)
+    if (data.size() < 12) {
+        fprintf(stderr, "Index file has no header (%s)\n", a_name);
+        return 1;
+    }
+    memcpy(&entry_size, &data[8], sizeof(entry_size));
+    if ((entry_size == 0) || (data.size() < entry_size + 8)) {
+        fprintf(stderr, "Index file has no runs (%s)\n", a_name);
+        return 1;
+    }
+    corrupt = data;
+    memset(&corrupt[corrupt.size() - entry_size], 0xff, 8);
+
+    if ((fs = tsk_test_open_fs(a_name, a_offset, &img)) == NULL)
+        return 1;
+    if (tsk_test_bad_files(fs, tsk_fs_ifind_index_load, data, corrupt,
+            s_idx2, a_name))
+        goto done;
+
+    // the index should still be built from the file system
+    if (list_walk(fs, walk_all, walk_first))
+        goto done;
+    if (list_batch(fs, TSK_FS_IFIND_ALL, list))
+        goto done;
+    if (list != walk_all) {
+        fprintf(stderr,
+            "Index after bad files gives different owners (%s)\n", a_name);
+        goto done;
+    }
+    retval = 0;
+
+  done:
+    tsk_test_close_fs(fs, img);
+    if (retval)
+        return 1;
+
+    return tsk_test_other_fs(a_other, a_other_offset,
+        tsk_fs_ifind_index_load, s_idx1, a_name);
+}
+
+
+int
+main(int argc, char **argv)
+{
+    int retval = 0;
+
+    if (argc != 2) {
+        fprintf(stderr, "missing image root directory\n");
+        return 1;
+    }
+    tsk_test_img_dir = argv[1];
+
+    if (test_image("fat12.dd", 0)) {
+        fprintf(stderr, "fat12.dd failure\n");
+        retval = 1;
+    }
+    else if (test_image("ext2fs.dd", 0)) {
+        fprintf(stderr, "ext2fs.dd failure\n");
+        retval = 1;
+    }
+    else if (test_image("misc-ufs1.dd", 0)) {
+        fprintf(stderr, "misc-ufs1.dd failure\n");
+        retval = 1;
+    }
+    else if (test_image("ntfs-img-kw-1.dd", 0)) {
+        fprintf(stderr, "ntfs-img-kw-1.dd failure\n");
+        retval = 1;
+    }
+    else if (test_bad_files("ntfs-img-kw-1.dd", 0, "fe_test_1.img",
+            32256)) {
+        fprintf(stderr, "ntfs-img-kw-1.dd bad file failure\n");
+        retval = 1;
+    }
+    else if (test_bad_files("fat12.dd", 0, "ext2fs.dd", 0)) {
+        fprintf(stderr, "fat12.dd bad file failure\n");
+        retval = 1;
+    }
+
+    remove(s_idx1);
+    remove(s_idx2);
+    if (retval)
+        return 1;
+
+    printf("Tests Passed\n");
+    return 0;
+}
@@ -0,0 +1,264 @@
+/*
+* The Sleuth Kit
+*
+* Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2013 Brian Carrier.  All Rights reserved
+*
+*
+* This software is distributed under the Common Public License 1.0
+*
+*/
+
+/* Test that the ".." entry of an ISO9660 directory is found when its
+ * parent directory is more than 4GB into the file system.  The image is
+ * made by the test as a sparse file. */
+
+#include "tsk/tsk_tools_i.h"
+#include "tsk/fs/tsk_iso9660.h"
+
+static const char *s_iso = "iso9660_apis.tmp";
+
+#define ISO_BSIZE   2048
+#define ISO_PT_BLK  18          // M path table
+#define ISO_ROOT_BLK 20
+#define ISO_B_BLK   21
+#define ISO_A_BLK   2100000     // past 4GB
+
+
+static void
+put_be32(unsigned char *a_buf, uint32_t a_val)
+{
+    a_buf[0] = (a_val >> 24) & 0xff;
+    a_buf[1] = (a_val >> 16) & 0xff;
+    a_buf[2] = (a_val >> 8) & 0xff;
+    a_buf[3] = a_val & 0xff;
+}
+
+/* little endian followed by big endian */
+static void
+put_both32(unsigned char *a_buf, uint32_t a_val)
+{
+    a_buf[0] = a_val & 0xff;
+    a_buf[1] = (a_val >> 8) & 0xff;
+    a_buf[2] = (a_val >> 16) & 0xff;
+    a_buf[3] = (a_val >> 24) & 0xff;
+    put_be32(&a_buf[4], a_val);
+}
+
+static void
+put_both16(unsigned char *a_buf, uint16_t a_val)
+{
+    a_buf[0] = a_val & 0xff;
+    a_buf[1] = (a_val >> 8) & 0xff;
+    a_buf[2] = (a_val >> 8) & 0xff;
+    a_buf[3] = a_val & 0xff;
+}
+
+/* Add a directory record for a one block directory to a buffer.
+ * @returns length of the record */
+static int
+put_dentry(unsigned char *a_buf, uint32_t a_blk, const char *a_name,
+    int a_name_len)
+{
+    int len = 33 + a_name_len + ((a_name_len % 2) ? 0 : 1);
+
+    memset(a_buf, 0, len);
+    a_buf[0] = len;
+    put_both32(&a_buf[2], a_blk);
+    put_both32(&a_buf[10], ISO_BSIZE);
+    a_buf[18] = 113;            // 2013
+    a_buf[19] = 1;
+    a_buf[20] = 1;
+    a_buf[25] = ISO9660_FLAG_DIR;
+    put_both16(&a_buf[28], 1);
+    a_buf[32] = a_name_len;
+    memcpy(&a_buf[33], a_name, a_name_len);
+    return len;
+}
+
+/* Make a directory block with ".", "..", and an optional sub-directory */
+static void
+make_dir(unsigned char *a_buf, uint32_t a_blk, uint32_t a_par_blk,
+    const char *a_sub, uint32_t a_sub_blk)
+{
+    int off = 0;
+
+    memset(a_buf, 0, ISO_BSIZE);
+    off += put_dentry(&a_buf[off], a_blk, "\0", 1);
+    off += put_dentry(&a_buf[off], a_par_blk, "\1", 1);
+    if (a_sub)
+        put_dentry(&a_buf[off], a_sub_blk, a_sub, strlen(a_sub));
+}
+
+static int
+write_blk(FILE * a_hFile, uint32_t a_blk, const unsigned char *a_buf)
+{
+    if (fseeko(a_hFile, (off_t) a_blk * ISO_BSIZE, SEEK_SET)
+        || (fwrite(a_buf, ISO_BSIZE, 1, a_hFile) != 1)) {
+        fprintf(stderr, "Error writing %s\n", s_iso);
+        return 1;
+    }
+    return 0;
+}
+
+/* Make an image with /A at ISO_A_BLK and /A/B at ISO_B_BLK.
+ * @returns 1 on error */
+static int
+make_iso()
+{
+    unsigned char buf[ISO_BSIZE];
+    FILE *hFile;
+    int off;
+
+    if ((hFile = fopen(s_iso, "wb")) == NULL) {
+        fprintf(stderr, "Error creating %s\n", s_iso);
+        return 1;
+    }
+
+    // primary volume descriptor
+    memset(buf, 0, sizeof(buf));
+    buf[0] = ISO9660_PRIM_VOL_DESC;
+    memcpy(&buf[1], ISO9660_MAGIC, 5);
+    buf[6] = 1;
+    memset(&buf[8], ' ', 64);
+    put_both32(&buf[80], ISO_A_BLK + 1);
+    put_both16(&buf[120], 1);
+    put_both16(&buf[124], 1);
+    put_both16(&buf[128], ISO_BSIZE);
+    put_both32(&buf[132], 30);
+    put_be32(&buf[148], ISO_PT_BLK);
+    put_dentry(&buf[156], ISO_ROOT_BLK, "\0", 1);
+    buf[881] = 1;
+    if (write_blk(hFile, 16, buf)) {
+        fclose(hFile);
+        return 1;
+    }
+
+    // volume descriptor set terminator
+    memset(buf, 0, sizeof(buf));
+    buf[0] = ISO9660_VOL_DESC_SET_TERM;
+    memcpy(&buf[1], ISO9660_MAGIC, 5);
+    buf[6] = 1;
+    if (write_blk(hFile, 17, buf)) {
+        fclose(hFile);
+        return 1;
+    }
+
+    // M path table with the root, A, and B
+    memset(buf, 0, sizeof(buf));
+    off = 0;
+    buf[off] = 1;
+    put_be32(&buf[off + 2], ISO_ROOT_BLK);
+    buf[off + 7] = 1;
+    off += 10;
+    buf[off] = 1;
+    put_be32(&buf[off + 2], ISO_A_BLK);
+    buf[off + 7] = 1;
+    buf[off + 8] = 'A';
+    off += 10;
+    buf[off] = 1;
+    put_be32(&buf[off + 2], ISO_B_BLK);
+    buf[off + 7] = 2;
+    buf[off + 8] = 'B';
+    if (write_blk(hFile, ISO_PT_BLK, buf)) {
+        fclose(hFile);
+        return 1;
+    }
+
+    make_dir(buf, ISO_ROOT_BLK, ISO_ROOT_BLK, "A", ISO_A_BLK);
+    if (write_blk(hFile, ISO_ROOT_BLK, buf)) {
+        fclose(hFile);
+        return 1;
+    }
+    make_dir(buf, ISO_B_BLK, ISO_A_BLK, NULL, 0);
+    if (write_blk(hFile, ISO_B_BLK, buf)) {
+        fclose(hFile);
+        return 1;
+    }
+    make_dir(buf, ISO_A_BLK, ISO_ROOT_BLK, "B", ISO_B_BLK);
+    if (write_blk(hFile, ISO_A_BLK, buf)) {
+        fclose(hFile);
+        return 1;
+    }
+
+    fclose(hFile);
+    return 0;
+}
+
+
+static int
+test_parent()
+{
+    TSK_IMG_INFO *img;
+    TSK_FS_INFO *fs;
+    TSK_FS_DIR *fs_dir;
+    TSK_INUM_T a_inum;
+    int retval = 1;
+
+    if ((img = tsk_img_open_sing((const TSK_TCHAR *) s_iso,
+                TSK_IMG_TYPE_RAW, 0)) == NULL) {
+        fprintf(stderr, "Error opening %s\n", s_iso);
+        tsk_error_print(stderr);
+        return 1;
+    }
+    if ((fs = tsk_fs_open_img(img, 0, TSK_FS_TYPE_ISO9660)) == NULL) {
+        fprintf(stderr, "Error opening file system in %s\n", s_iso);
+        tsk_error_print(stderr);
+        tsk_img_close(img);
+        return 1;
+    }
+
+    if ((fs_dir = tsk_fs_dir_open(fs, "/A")) == NULL) {
+        fprintf(stderr, "Error opening /A\n");
+        tsk_error_print(stderr);
+        goto done;
+    }
+    a_inum = fs_dir->addr;
+    tsk_fs_dir_close(fs_dir);
+
+    if ((fs_dir = tsk_fs_dir_open(fs, "/A/B")) == NULL) {
+        fprintf(stderr, "Error opening /A/B\n");
+        tsk_error_print(stderr);
+        goto done;
+    }
+    for (size_t i = 0; i < tsk_fs_dir_getsize(fs_dir); i++) {
+        const TSK_FS_NAME *fs_name = &fs_dir->names[i];
+        if (strcmp(fs_name->name, "..") == 0) {
+            if (fs_name->meta_addr != a_inum) {
+                fprintf(stderr,
+                    ".. of /A/B is %" PRIuINUM " instead of %" PRIuINUM
+                    "\n", fs_name->meta_addr, a_inum);
+                tsk_fs_dir_close(fs_dir);
+                goto done;
+            }
+            retval = 0;
+        }
+    }
+    tsk_fs_dir_close(fs_dir);
+    if (retval)
+        fprintf(stderr, "/A/B has no .. entry\n");
+
+  done:
+    tsk_fs_close(fs);
+    tsk_img_close(img);
+    return retval;
+}
+
+
+int
+main(int argc, char **argv)
+{
+    int retval = 0;
+
+    if (make_iso())
+        retval = 1;
+    else if (test_parent())
+        retval = 1;
+
+    remove(s_iso);
+    if (retval)
+        return 1;
+
+    printf("Tests Passed\n");
+    return 0;
+}
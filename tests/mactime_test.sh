@@ -0,0 +1,128 @@
+#!/bin/sh
+#
+# Compare the output of tsk_mactime with the output of the mactime
+# script for the same body files and options.
+#
+# usage: mactime_test.sh srcdir image_dir
+#
+# The body files are the test body file in srcdir, one made with fls
+# for each image, and a large copy of one that makes tsk_mactime sort
+# with temporary files.  tsk_mactime -I is compared with mactime on
+# the body file from tsk_gettimes.  The body files of all of the images
+# are also combined, which gives the same names for different files.
+
+if [ $# -ne 2 ]; then
+    echo "usage: $0 srcdir image_dir" >&2
+    exit 1
+fi
+SRCDIR=$1
+IMAGE_DIR=$2
+
+MACTIME=../tools/timeline/mactime
+TSK_MACTIME=../tools/timeline/tsk_mactime
+FLS=../tools/fstools/fls
+GETTIMES=../tools/autotools/tsk_gettimes
+TMP=mactime_test.tmp
+
+IMAGES="fat12.dd fat32.dd ext2fs.dd misc-ufs1.dd ntfs-img-kw-1.dd"
+
+rm -rf $TMP
+mkdir $TMP || exit 1
+
+# compare body_file [options]
+compare() {
+    body=$1
+    shift
+    $MACTIME -z UTC -b $body "$@" > $TMP/perl.out 2>&1
+    $TSK_MACTIME -z UTC -b $body "$@" > $TMP/tsk.out 2>&1
+    if ! cmp -s $TMP/perl.out $TMP/tsk.out; then
+        echo "Output is different: $body $*"
+        diff $TMP/perl.out $TMP/tsk.out | head -20
+        exit 1
+    fi
+}
+
+# compare_idx body_file day|hour
+compare_idx() {
+    $MACTIME -z UTC -b $1 -d -i $2 $TMP/perl.idx > $TMP/perl.out 2>&1
+    $TSK_MACTIME -z UTC -b $1 -d -i $2 $TMP/tsk.idx > $TMP/tsk.out 2>&1
+    if ! cmp -s $TMP/perl.out $TMP/tsk.out \
+        || ! cmp -s $TMP/perl.idx $TMP/tsk.idx; then
+        echo "Output or index is different: $1 -i $2"
+        diff $TMP/perl.idx $TMP/tsk.idx | head -20
+        exit 1
+    fi
+}
+
+# compare_all body_file
+compare_all() {
+    compare $1
+    compare $1 -d
+    compare $1 -y
+    compare $1 -m
+    compare $1 -d -y
+    compare $1 -p $SRCDIR/mactime.passwd -g $SRCDIR/mactime.group
+    compare_idx $1 day
+    compare_idx $1 hour
+}
+
+echo "mactime.body"
+compare_all $SRCDIR/mactime.body
+compare $SRCDIR/mactime.body 2011-03-13
+compare $SRCDIR/mactime.body 2011-03-13..2011-03-14
+compare $SRCDIR/mactime.body 1970-01-01..2011-03-13
+
+for i in $IMAGES; do
+    echo $i
+    if ! $FLS -r -m / $IMAGE_DIR/$i > $TMP/$i.body; then
+        echo "Error running fls on $i"
+        exit 1
+    fi
+    compare_all $TMP/$i.body
+
+    # timeline straight from the image
+    $GETTIMES $IMAGE_DIR/$i > $TMP/gettimes.body 2> /dev/null
+    $MACTIME -z UTC -d -b $TMP/gettimes.body > $TMP/perl.out 2>&1
+    $TSK_MACTIME -z UTC -d -I $IMAGE_DIR/$i > $TMP/tsk.out 2>&1
+    if ! cmp -s $TMP/perl.out $TMP/tsk.out; then
+        echo "Output of -I is different: $i"
+        diff $TMP/perl.out $TMP/tsk.out | head -20
+        exit 1
+    fi
+done
+
+# all of the images, once in memory and then twice with temporary files
+echo "all images"
+for i in $IMAGES; do
+    cat $TMP/$i.body
+done > $TMP/all.body
+compare_all $TMP/all.body
+cat $TMP/all.body $TMP/all.body > $TMP/all2.body
+$MACTIME -z UTC -d -b $TMP/all2.body > $TMP/perl.out 2>&1
+$TSK_MACTIME -z UTC -d -M 1 -T $TMP -b $TMP/all2.body > $TMP/tsk.out 2>&1
+if ! cmp -s $TMP/perl.out $TMP/tsk.out; then
+    echo "Output of all images with temporary files is different"
+    diff $TMP/perl.out $TMP/tsk.out | head -20
+    exit 1
+fi
+
+# copies of a body file (with unique names) that have enough lines for
+# a 1MB limit to give more than the 64 runs that are merged in one pass
+echo "large body file"
+awk -F'|' 'BEGIN { OFS = "|" }
+    { l[NR] = $0 }
+    END {
+        for (i = 0; i * NR < 530000; i++)
+            for (j = 1; j <= NR; j++) { $0 = l[j]; $2 = "/c" i $2; print }
+    }' $TMP/fat12.dd.body > $TMP/large.body
+$MACTIME -z UTC -d -b $TMP/large.body > $TMP/perl.out 2>&1
+$TSK_MACTIME -z UTC -d -M 1 -T $TMP -b $TMP/large.body > $TMP/tsk.out 2>&1
+if ! cmp -s $TMP/perl.out $TMP/tsk.out; then
+    echo "Output with temporary files is different"
+    diff $TMP/perl.out $TMP/tsk.out | head -20
+    exit 1
+fi
+
+rm -rf $TMP
+echo "Tests Passed"
+exit 0
@@ -0,0 +1,362 @@
+/*
+* The Sleuth Kit
+*
+* Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2013 Brian Carrier.  All Rights reserved
+*
+*
+* This software is distributed under the Common Public License 1.0
+*
+*/
+
+/* Test that the blocks of an NTFS compressed (LZNT1) file are decompressed
+ * based on the flag in their headers.  A 4096 byte block without the flag
+ * is copied as is and a 4096 byte block with the flag is decompressed.
+ * The image is made by the test. */
+
+#include "tsk/tsk_tools_i.h"
+#include "tsk/fs/tsk_ntfs.h"
+
+static const char *s_ntfs = "ntfs_comp_apis.tmp";
+
+#define NTFS_SSIZE  512
+#define NTFS_CSIZE  512         // one sector per cluster
+#define NTFS_RSIZE  1024        // MFT entry size
+#define NTFS_NCLUST 128
+#define NTFS_MFT_CL 16
+#define NTFS_MFT_CNT 17         // $MFT to the test file
+#define NTFS_BMAP_CL 50
+#define NTFS_FILE   16          // MFT entry of the compressed file
+#define NTFS_UNIT0_CL 60
+#define NTFS_UNIT1_CL 80
+#define NTFS_UNIT_B (16 * NTFS_CSIZE)   // compression unit of 16 clusters
+#define NTFS_CHUNK  4096        // uncompressed size of an LZNT1 block
+#define NTFS_FILE_B (NTFS_UNIT_B + NTFS_CHUNK)  // the second unit has one block
+
+static unsigned char s_img[NTFS_NCLUST * NTFS_CSIZE];
+
+
+static void
+put_le(unsigned char *a_buf, uint64_t a_val, int a_len)
+{
+    for (int i = 0; i < a_len; i++)
+        a_buf[i] = (a_val >> (8 * i)) & 0xff;
+}
+
+/* Add a resident attribute to an MFT entry.
+ * @returns offset after the attribute */
+static int
+put_res(unsigned char *a_rec, int a_off, uint32_t a_type,
+    const unsigned char *a_content, int a_len, int a_id)
+{
+    int len = (24 + a_len + 7) & ~7;
+
+    memset(&a_rec[a_off], 0, len);
+    put_le(&a_rec[a_off], a_type, 4);
+    put_le(&a_rec[a_off + 4], len, 4);
+    a_rec[a_off + 8] = 0;
+    put_le(&a_rec[a_off + 10], 24, 2);
+    put_le(&a_rec[a_off + 14], a_id, 2);
+    put_le(&a_rec[a_off + 16], a_len, 4);
+    put_le(&a_rec[a_off + 20], 24, 2);
+    if (a_len)
+        memcpy(&a_rec[a_off + 24], a_content, a_len);
+    return a_off + len;
+}
+
+/* Add a non-resident $DATA attribute to an MFT entry.
+ * @param a_comp Set to 1 for a compressed attribute
+ * @returns offset after the attribute */
+static int
+put_nonres(unsigned char *a_rec, int a_off, const unsigned char *a_runs,
+    int a_runs_len, uint64_t a_clusters, uint64_t a_size, int a_comp,
+    int a_id)
+{
+    int hdr = a_comp ? 72 : 64;
+    int len = (hdr + a_runs_len + 7) & ~7;
+
+    memset(&a_rec[a_off], 0, len);
+    put_le(&a_rec[a_off], NTFS_ATYPE_DATA, 4);
+    put_le(&a_rec[a_off + 4], len, 4);
+    a_rec[a_off + 8] = 1;
+    put_le(&a_rec[a_off + 10], hdr, 2);
+    put_le(&a_rec[a_off + 12], a_comp ? NTFS_ATTR_FLAG_COMP : 0, 2);
+    put_le(&a_rec[a_off + 14], a_id, 2);
+    put_le(&a_rec[a_off + 24], a_clusters - 1, 8);
+    put_le(&a_rec[a_off + 32], hdr, 2);
+    put_le(&a_rec[a_off + 34], a_comp ? 4 : 0, 2);      // 2^4 clusters
+    put_le(&a_rec[a_off + 40], a_clusters * NTFS_CSIZE, 8);
+    put_le(&a_rec[a_off + 48], a_size, 8);
+    put_le(&a_rec[a_off + 56], a_size, 8);
+    memcpy(&a_rec[a_off + hdr], a_runs, a_runs_len);
+    return a_off + len;
+}
+
+/* Write an MFT entry with $STANDARD_INFORMATION and an optional
+ * $DATA or $VOLUME_INFORMATION attribute (already in a_attrs) to the
+ * image, with the update sequence fixups. */
+static void
+put_mft(int a_num, const unsigned char *a_attrs, int a_attrs_len)
+{
+    unsigned char rec[NTFS_RSIZE];
+    unsigned char si[72];
+    int off;
+
+    memset(rec, 0, sizeof(rec));
+    put_le(rec, NTFS_MFT_MAGIC, 4);
+    put_le(&rec[4], 48, 2);
+    put_le(&rec[6], NTFS_RSIZE / NTFS_SSIZE + 1, 2);
+    put_le(&rec[16], 1, 2);
+    put_le(&rec[18], 1, 2);
+    put_le(&rec[20], 56, 2);
+    put_le(&rec[22], NTFS_MFT_INUSE, 2);
+    put_le(&rec[44], a_num, 4);
+
+    memset(si, 0, sizeof(si));
+    off = put_res(rec, 56, NTFS_ATYPE_SI, si, sizeof(si), 0);
+    memcpy(&rec[off], a_attrs, a_attrs_len);
+    off += a_attrs_len;
+    put_le(&rec[off], 0xffffffff, 4);
+    off += 8;
+    put_le(&rec[24], off, 4);
+    put_le(&rec[28], NTFS_RSIZE, 4);
+    put_le(&rec[40], 2, 2);
+
+    // update sequence
+    put_le(&rec[48], 1, 2);
+    for (int i = 0; i < NTFS_RSIZE / NTFS_SSIZE; i++) {
+        int end = (i + 1) * NTFS_SSIZE - 2;
+        memcpy(&rec[50 + 2 * i], &rec[end], 2);
+        put_le(&rec[end], 1, 2);
+    }
+    memcpy(&s_img[NTFS_MFT_CL * NTFS_CSIZE + a_num * NTFS_RSIZE], rec,
+        NTFS_RSIZE);
+}
+
+/* Make the data of the compressed file and the content that it must
+ * decompress to.
+ * @param a_expect Buffer of NTFS_FILE_B bytes for the content */
+static void
+make_comp(unsigned char *a_expect)
+{
+    unsigned char *unit0 = &s_img[NTFS_UNIT0_CL * NTFS_CSIZE];
+    unsigned char *unit1 = &s_img[NTFS_UNIT1_CL * NTFS_CSIZE];
+    int off;
+
+
+    /* Unit 0, block 1: 4096 bytes that are not compressed (the header
+     * has a size of 4096 and not the compressed flag). */
+    put_le(unit0, 0x3000 | (NTFS_CHUNK - 1), 2);
+    for (int i = 0; i < NTFS_CHUNK; i++) {
+        unit0[2 + i] = (i * 7 + 3) & 0xff;
+        a_expect[i] = unit0[2 + i];
+    }
+    off = 2 + NTFS_CHUNK;
+
+    /* Unit 0, block 2: one symbol and a phrase that repeats it for the
+     * rest of the 4096 bytes. */
+    put_le(&unit0[off], 0xb000 | (6 - 3), 2);
+    unit0[off + 2] = 0x02;
+    unit0[off + 3] = 'x';
+    put_le(&unit0[off + 4], (0 << 12) | (NTFS_CHUNK - 1 - 3), 2);
+    memset(&a_expect[NTFS_CHUNK], 'x', NTFS_CHUNK);
+    off += 6;
+    put_le(&unit0[off], 0, 2);
+
+    /* Unit 1: a compressed block whose compressed size is 4096 bytes.
+     * The first group has a symbol, a phrase that repeats it 457 times,
+     * and 6 symbols.  The other 454 groups have 8 symbols. */
+    put_le(unit1, 0xb000 | (NTFS_CHUNK - 1), 2);
+    unit1[2] = 0x02;
+    unit1[3] = 'y';
+    put_le(&unit1[4], (0 << 12) | (457 - 3), 2);
+    memset(&a_expect[NTFS_UNIT_B], 'y', 458);
+    off = 6;
+    int exp_off = NTFS_UNIT_B + 458;
+    for (int i = 0; off < 2 + NTFS_CHUNK; i++) {
+        if ((i >= 6) && ((i - 6) % 8 == 0))
+            unit1[off++] = 0;
+        unit1[off] = (off * 13 + 1) & 0xff;
+        a_expect[exp_off++] = unit1[off++];
+    }
+    put_le(&unit1[off], 0, 2);
+}
+
+/* Make the image with the compressed file in NTFS_FILE.
+ * @returns 1 on error */
+static int
+make_ntfs(unsigned char *a_expect)
+{
+    unsigned char attrs[256];
+    unsigned char runs[32];
+    unsigned char vinfo[16];
+    FILE *hFile;
+    int len;
+
+    memset(s_img, 0, sizeof(s_img));
+
+    // boot sector
+    memcpy(&s_img[3], "NTFS    ", 8);
+    put_le(&s_img[11], NTFS_SSIZE, 2);
+    s_img[13] = NTFS_CSIZE / NTFS_SSIZE;
+    put_le(&s_img[40], NTFS_NCLUST * (NTFS_CSIZE / NTFS_SSIZE) - 1, 8);
+    put_le(&s_img[48], NTFS_MFT_CL, 8);
+    put_le(&s_img[56], NTFS_MFT_CL, 8);
+    s_img[64] = 256 - 10;       // 1024 byte entries
+    s_img[68] = 256 - 12;       // 4096 byte index records
+    put_le(&s_img[72], 0x0123456789abcdefULL, 8);
+    s_img[510] = 0x55;
+    s_img[511] = 0xaa;
+
+    // $MFT
+    runs[0] = 0x11;
+    runs[1] = NTFS_MFT_CNT * NTFS_RSIZE / NTFS_CSIZE;
+    runs[2] = NTFS_MFT_CL;
+    runs[3] = 0;
+    len = put_nonres(attrs, 0, runs, 4,
+        NTFS_MFT_CNT * NTFS_RSIZE / NTFS_CSIZE, NTFS_MFT_CNT * NTFS_RSIZE,
+        0, 1);
+    put_mft(NTFS_MFT_MFT, attrs, len);
+
+    // $Volume with version 3.1
+    memset(vinfo, 0, sizeof(vinfo));
+    vinfo[8] = 3;
+    vinfo[9] = 1;
+    len = put_res(attrs, 0, NTFS_ATYPE_VINFO, vinfo, sizeof(vinfo), 1);
+    put_mft(NTFS_MFT_VOL, attrs, len);
+
+    // $Bitmap with the clusters that are used
+    runs[0] = 0x11;
+    runs[1] = 1;
+    runs[2] = NTFS_BMAP_CL;
+    runs[3] = 0;
+    len = put_nonres(attrs, 0, runs, 4, 1, NTFS_NCLUST / 8, 0, 1);
+    put_mft(NTFS_MFT_BMAP, attrs, len);
+    for (int i = 0; i < NTFS_BMAP_CL + 1; i++)
+        s_img[NTFS_BMAP_CL * NTFS_CSIZE + i / 8] |= 1 << (i % 8);
+
+    /* The compressed file has two units with 9 clusters of data and
+     * 7 sparse clusters each. */
+    make_comp(a_expect);
+    len = 0;
+    runs[len++] = 0x11;
+    runs[len++] = 9;
+    runs[len++] = NTFS_UNIT0_CL;
+    runs[len++] = 0x01;
+    runs[len++] = 7;
+    runs[len++] = 0x11;
+    runs[len++] = 9;
+    runs[len++] = NTFS_UNIT1_CL - NTFS_UNIT0_CL;
+    runs[len++] = 0x01;
+    runs[len++] = 7;
+    runs[len++] = 0;
+    len = put_nonres(attrs, 0, runs, len, 2 * NTFS_UNIT_B / NTFS_CSIZE,
+        NTFS_FILE_B, 1, 1);
+    put_mft(NTFS_FILE, attrs, len);
+
+    if ((hFile = fopen(s_ntfs, "wb")) == NULL) {
+        fprintf(stderr, "Error creating %s\n", s_ntfs);
+        return 1;
+    }
+    if (fwrite(s_img, sizeof(s_img), 1, hFile) != 1) {
+        fprintf(stderr, "Error writing %s\n", s_ntfs);
+        fclose(hFile);
+        return 1;
+    }
+    fclose(hFile);
+    return 0;
+}
+
+
+/* Read the file at once and in small pieces and compare it with
+ * a_expect. */
+static int
+test_read(const unsigned char *a_expect)
+{
+    TSK_IMG_INFO *img;
+    TSK_FS_INFO *fs;
+    TSK_FS_FILE *fs_file;
+    unsigned char buf[NTFS_FILE_B];
+    int retval = 1;
+    ssize_t cnt;
+
+    if ((img = tsk_img_open_sing((const TSK_TCHAR *) s_ntfs,
+                TSK_IMG_TYPE_RAW, 0)) == NULL) {
+        fprintf(stderr, "Error opening %s\n", s_ntfs);
+        tsk_error_print(stderr);
+        return 1;
+    }
+    if ((fs = tsk_fs_open_img(img, 0, TSK_FS_TYPE_NTFS)) == NULL) {
+        fprintf(stderr, "Error opening file system in %s\n", s_ntfs);
+        tsk_error_print(stderr);
+        tsk_img_close(img);
+        return 1;
+    }
+    if ((fs_file = tsk_fs_file_open_meta(fs, NULL, NTFS_FILE)) == NULL) {
+        fprintf(stderr, "Error opening compressed file\n");
+        tsk_error_print(stderr);
+        goto done;
+    }
+
+    cnt = tsk_fs_file_read(fs_file, 0, (char *) buf, sizeof(buf),
+        TSK_FS_FILE_READ_FLAG_NONE);
+    if (cnt != (ssize_t) sizeof(buf)) {
+        fprintf(stderr, "Error reading compressed file (%d)\n", (int) cnt);
+        tsk_error_print(stderr);
+        goto done_file;
+    }
+    for (size_t i = 0; i < sizeof(buf); i++) {
+        if (buf[i] != a_expect[i]) {
+            fprintf(stderr,
+                "Byte %d of compressed file is %d instead of %d\n",
+                (int) i, buf[i], a_expect[i]);
+            goto done_file;
+        }
+    }
+
+    // small reads, which can use the cache of decompressed units
+    memset(buf, 0, sizeof(buf));
+    for (size_t off = 0; off < sizeof(buf); off += 1000) {
+        size_t len = sizeof(buf) - off < 1000 ? sizeof(buf) - off : 1000;
+        cnt = tsk_fs_file_read(fs_file, off, (char *) &buf[off], len,
+            TSK_FS_FILE_READ_FLAG_NONE);
+        if (cnt != (ssize_t) len) {
+            fprintf(stderr, "Error reading compressed file at %d\n",
+                (int) off);
+            tsk_error_print(stderr);
+            goto done_file;
+        }
+    }
+    if (memcmp(buf, a_expect, sizeof(buf))) {
+        fprintf(stderr, "Small reads of compressed file are different\n");
+        goto done_file;
+    }
+    retval = 0;
+
+  done_file:
+    tsk_fs_file_close(fs_file);
+  done:
+    tsk_fs_close(fs);
+    tsk_img_close(img);
+    return retval;
+}
+
+
+int
+main(int argc, char **argv)
+{
+    static unsigned char expect[NTFS_FILE_B];
+    int retval = 0;
+
+    if (make_ntfs(expect))
+        retval = 1;
+    else if (test_read(expect))
+        retval = 1;
+
+    remove(s_ntfs);
+    if (retval)
+        return 1;
+
+    printf("Tests Passed\n");
+    return 0;
+}
@@ -0,0 +1,190 @@
+/*
+* The Sleuth Kit
+*
+* Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2013 Brian Carrier.  All Rights reserved
+*
+*
+* This software is distributed under the Common Public License 1.0
+*
+*/
+
+/* Test that the NTFS parent map cache file can be saved and loaded again
+ * and that the file system gives the same directory contents with it. */
+
+#include "tsk_test_util.h"
+#include "tsk/fs/tsk_ntfs.h"
+
+static const char *s_map1 = "ntfs_parmap_1.tmp";
+static const char *s_map2 = "ntfs_parmap_2.tmp";
+
+
+static TSK_WALK_RET_ENUM
+list_act(TSK_FS_FILE * a_fs_file, const char *a_path, void *a_ptr)
+{
+    std::string * list = (std::string *) a_ptr;
+    char buf[64];
+
+    *list += a_path;
+    *list += a_fs_file->name->name;
+    snprintf(buf, 64, " %" PRIuINUM " %d\n", a_fs_file->name->meta_addr,
+        a_fs_file->name->flags);
+    *list += buf;
+    return TSK_WALK_CONT;
+}
+
+/* Make a listing of all of the files in the file system (including the
+ * orphan files, which come from the parent map).
+ * @returns 1 on error */
+static int
+list_fs(TSK_FS_INFO * a_fs, std::string & a_list)
+{
+    a_list.clear();
+    if (tsk_fs_dir_walk(a_fs, a_fs->root_inum,
+            (TSK_FS_DIR_WALK_FLAG_ENUM) (TSK_FS_DIR_WALK_FLAG_ALLOC |
+                TSK_FS_DIR_WALK_FLAG_UNALLOC |
+                TSK_FS_DIR_WALK_FLAG_RECURSE), list_act, &a_list)) {
+        tsk_error_print(stderr);
+        return 1;
+    }
+    return 0;
+}
+
+/* Save the map, load it in a new TSK_FS_INFO and compare the listings
+ * and a second save of the map */
+static int
+test_round_trip(const char *a_name, TSK_OFF_T a_offset)
+{
+    TSK_FS_INFO *fs;
+    TSK_IMG_INFO *img;
+    std::string list1, list2, data1, data2;
+
+    if ((fs = tsk_test_open_fs(a_name, a_offset, &img)) == NULL)
+        return 1;
+    if (ntfs_parent_map_save(fs, (const TSK_TCHAR *) s_map1)) {
+        fprintf(stderr, "Error saving map (%s)\n", a_name);
+        tsk_error_print(stderr);
+        tsk_test_close_fs(fs, img);
+        return 1;
+    }
+    if (list_fs(fs, list1)) {
+        tsk_test_close_fs(fs, img);
+        return 1;
+    }
+    tsk_test_close_fs(fs, img);
+
+    if ((fs = tsk_test_open_fs(a_name, a_offset, &img)) == NULL)
+        return 1;
+    if (ntfs_parent_map_load(fs, (const TSK_TCHAR *) s_map1)) {
+        fprintf(stderr, "Error loading map (%s)\n", a_name);
+        tsk_error_print(stderr);
+        tsk_test_close_fs(fs, img);
+        return 1;
+    }
+    if (list_fs(fs, list2)) {
+        tsk_test_close_fs(fs, img);
+        return 1;
+    }
+    if (list1 != list2) {
+        fprintf(stderr,
+            "Listing with loaded map is different (%s)\n", a_name);
+        tsk_test_close_fs(fs, img);
+        return 1;
+    }
+
+    // saving the loaded map should give the same file
+    if (ntfs_parent_map_save(fs, (const TSK_TCHAR *) s_map2)) {
+        fprintf(stderr, "Error saving loaded map (%s)\n", a_name);
+        tsk_error_print(stderr);
+        tsk_test_close_fs(fs, img);
+        return 1;
+    }
+    tsk_test_close_fs(fs, img);
+
+    if (tsk_test_read_file(s_map1, data1)
+        || tsk_test_read_file(s_map2, data2))
+        return 1;
+    if (data1 != data2) {
+        fprintf(stderr, "Saved maps are different (%s)\n", a_name);
+        return 1;
+    }
+
+    // the header is little endian with magic "TKPM" and version 2
+    if ((data1.size() < 88)
+        || (memcmp(data1.data(), "MPKT\x02\x00\x00\x00", 8) != 0)) {
+        fprintf(stderr, "Unexpected map file header (%s)\n", a_name);
+        return 1;
+    }
+    return 0;
+}
+
+
+/* Verify that truncated, damaged, and foreign map files are not loaded */
+static int
+test_bad_files(const char *a_name, TSK_OFF_T a_offset,
+    const char *a_other, TSK_OFF_T a_other_offset)
+{
+    TSK_FS_INFO *fs;
+    TSK_IMG_INFO *img;
+    std::string data, corrupt, list;
+    int retval = 0;
+
+    if (tsk_test_read_file(s_map1, data))
+        return 1;
+
+    if ((fs = tsk_test_open_fs(a_name, a_offset, &img)) == NULL)
+        return 1;
+
+    // name offset past the end of the names (first entry after 88 bytes
+    // of header and 3 bytes per MFT entry)
+    size_t ent = 88 + 3 * (size_t) fs->last_inum;
+    if (data.size() < ent + 22) {
+        fprintf(stderr, "Map file has no entries (%s)\n", a_name);
+        tsk_test_close_fs(fs, img);
+        return 1;
+    }
+    corrupt = data;
+    memset(&corrupt[ent + 16], 0xff, 4);
+
+    if (tsk_test_bad_files(fs, ntfs_parent_map_load, data, corrupt,
+            s_map2, a_name))
+        retval = 1;
+    // the file system should still work
+    else if (list_fs(fs, list))
+        retval = 1;
+    tsk_test_close_fs(fs, img);
+    if (retval)
+        return 1;
+
+    return tsk_test_other_fs(a_other, a_other_offset,
+        ntfs_parent_map_load, s_map1, a_name);
+}
+
+
+int
+main(int argc, char **argv)
+{
+    int retval = 0;
+
+    if (argc != 2) {
+        fprintf(stderr, "missing image root directory\n");
+        return 1;
+    }
+    tsk_test_img_dir = argv[1];
+
+    if (test_round_trip("ntfs-img-kw-1.dd", 0))
+        retval = 1;
+    else if (test_bad_files("ntfs-img-kw-1.dd", 0, "fe_test_1.img",
+            32256))
+        retval = 1;
+    else if (test_round_trip("fe_test_1.img", 32256))
+        retval = 1;
+
+    remove(s_map1);
+    remove(s_map2);
+    if (retval)
+        return 1;
+
+    printf("Tests Passed\n");
+    return 0;
+}
@@ -0,0 +1,169 @@
+/*
+* The Sleuth Kit
+*
+* Brian Carrier [carrier <at> sleuthkit [dot] org]
+* Copyright (c) 2013 Brian Carrier.  All Rights reserved
+*
+*
+* This software is distributed under the Common Public License 1.0
+*
+*/
+
+#include "tsk_test_util.h"
+
+const char *tsk_test_img_dir = NULL;
+
+
+/* Read a file into a string.
+ * @returns 1 on error */
+int
+tsk_test_read_file(const char *a_path, std::string & a_data)
+{
+    FILE *hFile;
+    char buf[4096];
+    size_t len;
+
+    a_data.clear();
+    if ((hFile = fopen(a_path, "rb")) == NULL) {
+        fprintf(stderr, "Error opening %s\n", a_path);
+        return 1;
+    }
+    while ((len = fread(buf, 1, sizeof(buf), hFile)) > 0)
+        a_data.append(buf, len);
+    fclose(hFile);
+    return 0;
+}
+
+/* Write a string to a file.
+ * @returns 1 on error */
+int
+tsk_test_write_file(const char *a_path, const std::string & a_data)
+{
+    FILE *hFile;
+
+    if ((hFile = fopen(a_path, "wb")) == NULL) {
+        fprintf(stderr, "Error creating %s\n", a_path);
+        return 1;
+    }
+    if ((a_data.size())
+        && (fwrite(a_data.data(), a_data.size(), 1, hFile) != 1)) {
+        fprintf(stderr, "Error writing %s\n", a_path);
+        fclose(hFile);
+        return 1;
+    }
+    fclose(hFile);
+    return 0;
+}
+
+
+/* Open the file system at an offset of an image in tsk_test_img_dir.
+ * Close it with tsk_test_close_fs().
+ * @param a_img Set to the image that the file system is in
+ * @returns NULL on error */
+TSK_FS_INFO *
+tsk_test_open_fs(const char *a_name, TSK_OFF_T a_offset,
+    TSK_IMG_INFO ** a_img)
+{
+    char fname[512];
+    TSK_FS_INFO *fs;
+
+    snprintf(fname, 512, "%s/%s", tsk_test_img_dir, a_name);
+    if ((*a_img =
+            tsk_img_open_sing((const TSK_TCHAR *) fname,
+                (TSK_IMG_TYPE_ENUM) 0, 0)) == NULL) {
+        fprintf(stderr, "Error opening %s image\n", a_name);
+        tsk_error_print(stderr);
+        return NULL;
+    }
+
+    if ((fs = tsk_fs_open_img(*a_img, a_offset, (TSK_FS_TYPE_ENUM) 0)) == NULL) {
+        fprintf(stderr, "Error opening %s image\n", a_name);
+        tsk_error_print(stderr);
+        tsk_img_close(*a_img);
+        *a_img = NULL;
+        return NULL;
+    }
+    return fs;
+}
+
+void
+tsk_test_close_fs(TSK_FS_INFO * a_fs, TSK_IMG_INFO * a_img)
+{
+    if (a_fs)
+        tsk_fs_close(a_fs);
+    if (a_img)
+        tsk_img_close(a_img);
+}
+
+
+/* Try to load a saved file with one byte missing, with another version
+ * (a 32-bit version after the 4 byte magic), and with corrupt contents.
+ * None of them should be loaded.
+ * @param a_data Contents of a good file for a_fs
+ * @param a_corrupt a_data with contents that do not fit a_fs
+ * @param a_tmp Path to write the bad files to
+ * @param a_desc Description of the file system for messages
+ * @returns 1 if a file was loaded or on error */
+int
+tsk_test_bad_files(TSK_FS_INFO * a_fs, TSK_TEST_LOAD_FUNC a_load,
+    const std::string & a_data, const std::string & a_corrupt,
+    const char *a_tmp, const char *a_desc)
+{
+    std::string bad;
+
+    if (a_data.size() < 8) {
+        fprintf(stderr, "Saved file is too small (%s)\n", a_desc);
+        return 1;
+    }
+
+    // truncated
+    bad = a_data.substr(0, a_data.size() - 1);
+    if (tsk_test_write_file(a_tmp, bad))
+        return 1;
+    if (a_load(a_fs, (const TSK_TCHAR *) a_tmp) == 0) {
+        fprintf(stderr, "Truncated file was loaded (%s)\n", a_desc);
+        return 1;
+    }
+
+    // different version
+    bad = a_data;
+    bad[4] ^= 0x7f;
+    if (tsk_test_write_file(a_tmp, bad))
+        return 1;
+    if (a_load(a_fs, (const TSK_TCHAR *) a_tmp) == 0) {
+        fprintf(stderr, "File with other version was loaded (%s)\n",
+            a_desc);
+        return 1;
+    }
+
+    if (tsk_test_write_file(a_tmp, a_corrupt))
+        return 1;
+    if (a_load(a_fs, (const TSK_TCHAR *) a_tmp) == 0) {
+        fprintf(stderr, "Corrupt file was loaded (%s)\n", a_desc);
+        return 1;
+    }
+    tsk_error_reset();
+    return 0;
+}
+
+/* Try to load a file that was saved for another file system.
+ * @returns 1 if it was loaded or on error */
+int
+tsk_test_other_fs(const char *a_name, TSK_OFF_T a_offset,
+    TSK_TEST_LOAD_FUNC a_load, const char *a_path, const char *a_desc)
+{
+    TSK_FS_INFO *fs;
+    TSK_IMG_INFO *img;
+    int retval = 0;
+
+    if ((fs = tsk_test_open_fs(a_name, a_offset, &img)) == NULL)
+        return 1;
+    if (a_load(fs, (const TSK_TCHAR *) a_path) == 0) {
+        fprintf(stderr, "File of %s was loaded for %s\n", a_desc,
+            a_name);
+        retval = 1;
+    }
+    tsk_error_reset();
+    tsk_test_close_fs(fs, img);
+    return retval;
+}
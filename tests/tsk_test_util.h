@@ -0,0 +1,30 @@
+#ifndef _TSK_TEST_UTIL_H
+#define _TSK_TEST_UTIL_H
+
+/* Functions that are shared by the API tests */
+
+#include "tsk/tsk_tools_i.h"
+#include <string>
+
+// directory of the test images (set from the command line)
+extern const char *tsk_test_img_dir;
+
+extern int tsk_test_read_file(const char *a_path, std::string & a_data);
+extern int tsk_test_write_file(const char *a_path,
+    const std::string & a_data);
+
+extern TSK_FS_INFO *tsk_test_open_fs(const char *a_name,
+    TSK_OFF_T a_offset, TSK_IMG_INFO ** a_img);
+extern void tsk_test_close_fs(TSK_FS_INFO * a_fs, TSK_IMG_INFO * a_img);
+
+/* Function that loads a saved file (such as an index) for a file system */
+typedef uint8_t(*TSK_TEST_LOAD_FUNC) (TSK_FS_INFO *, const TSK_TCHAR *);
+
+extern int tsk_test_bad_files(TSK_FS_INFO * a_fs,
+    TSK_TEST_LOAD_FUNC a_load, const std::string & a_data,
+    const std::string & a_corrupt, const char *a_tmp,
+    const char *a_desc);
+extern int tsk_test_other_fs(const char *a_name, TSK_OFF_T a_offset,
+    TSK_TEST_LOAD_FUNC a_load, const char *a_path, const char *a_desc);
+
+#endif
@@ -35,7 +35,7 @@ usage()
 {
     TFPRINTF(stderr,
         _TSK_T
-        ("usage: %s [-aAelvV] [-f fstype] [-i imgtype] [-b dev_sector_size] [-o imgoffset] image [images] [start-stop]\n"),
+        ("usage: %s [-aAelvV] [-f fstype] [-i imgtype] [-b dev_sector_size] [-o imgoffset] [-t threads] image [images] [start-stop]\n"),
         progname);
     tsk_fprintf(stderr, "\t-e: every block (including file system metadata blocks)\n");
     tsk_fprintf(stderr,
@@ -52,6 +52,8 @@ usage()
         "\t-o imgoffset: The offset of the file system in the image (in sectors)\n");
     tsk_fprintf(stderr,
         "\t-s: print slack space only (other flags are ignored\n");
+    tsk_fprintf(stderr,
+        "\t-t threads: Number of threads to find slack space with (default is 1)\n");
     tsk_fprintf(stderr, "\t-v: verbose to stderr\n");
     tsk_fprintf(stderr, "\t-V: print version\n");
 
@@ -85,6 +87,7 @@ main(int argc, char **argv1)
     char lclflags = TSK_FS_BLKLS_CAT, set_bounds = 1;
     TSK_TCHAR **argv;
     unsigned int ssize = 0;
+    unsigned int threads = 1;
 
 #ifdef TSK_WIN32
     // On Windows, get the wide arguments (mingw doesn't support wmain)
@@ -100,7 +103,7 @@ main(int argc, char **argv1)
     progname = argv[0];
     setlocale(LC_ALL, "");
 
-    while ((ch = GETOPT(argc, argv, _TSK_T("aAb:ef:i:lo:svV"))) > 0) {
+    while ((ch = GETOPT(argc, argv, _TSK_T("aAb:ef:i:lo:st:vV"))) > 0) {
         switch (ch) {
         case _TSK_T('?'):
         default:
@@ -164,6 +167,16 @@ main(int argc, char **argv1)
         case _TSK_T('s'):
             lclflags |= TSK_FS_BLKLS_SLACK;
             break;
+        case _TSK_T('t'):
+            threads = (unsigned int) TSTRTOUL(OPTARG, &cp, 0);
+            if (*cp || *cp == *OPTARG || threads < 1) {
+                TFPRINTF(stderr,
+                    _TSK_T
+                    ("invalid argument: threads must be positive: %s\n"),
+                    OPTARG);
+                usage();
+            }
+            break;
         case _TSK_T('v'):
             tsk_verbose++;
             break;
@@ -319,8 +332,8 @@ main(int argc, char **argv1)
         }
     }
 
-    if (tsk_fs_blkls(fs, (TSK_FS_BLKLS_FLAG_ENUM) lclflags, bstart, blast,
-            (TSK_FS_BLOCK_WALK_FLAG_ENUM)flags)) {
+    if (tsk_fs_blkls_threads(fs, (TSK_FS_BLKLS_FLAG_ENUM) lclflags, bstart,
+            blast, (TSK_FS_BLOCK_WALK_FLAG_ENUM) flags, threads)) {
         tsk_error_print(stderr);
         fs->close(fs);
         img->close(img);
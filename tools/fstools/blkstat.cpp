@@ -16,6 +16,7 @@
 */
 #include "tsk/tsk_tools_i.h"
 #include <locale.h>
+#include <sys/stat.h>
 
 static TSK_TCHAR *progname;
 
@@ -24,7 +25,7 @@ usage()
 {
     TFPRINTF(stderr,
         _TSK_T
-        ("usage: %s [-vV] [-f fstype] [-i imgtype] [-b dev_sector_size] [-o imgoffset] image [images] addr\n"),
+        ("usage: %s [-vV] [-f fstype] [-i imgtype] [-b dev_sector_size] [-o imgoffset] [-x index_file] image [images] addr\n"),
         progname);
     tsk_fprintf(stderr,
         "\t-f fstype: File system type (use '-f list' for supported types)\n");
@@ -36,6 +37,8 @@ usage()
         "\t-o imgoffset: The offset of the file system in the image (in sectors)\n");
     tsk_fprintf(stderr, "\t-v: Verbose output to stderr\n");
     tsk_fprintf(stderr, "\t-V: Print version\n");
+    tsk_fprintf(stderr,
+        "\t-x index_file: List the files that use the data unit from a data unit index file (it is created if it does not exist)\n");
 
     exit(1);
 }
@@ -58,6 +61,7 @@ main(int argc, char **argv1)
     TSK_DADDR_T addr;
     TSK_TCHAR **argv;
     unsigned int ssize = 0;
+    TSK_TCHAR *index_path = NULL;
 
 #ifdef TSK_WIN32
     // On Windows, get the wide arguments (mingw doesn't support wmain)
@@ -73,7 +77,7 @@ main(int argc, char **argv1)
     progname = argv[0];
     setlocale(LC_ALL, "");
 
-    while ((ch = GETOPT(argc, argv, _TSK_T("b:f:i:o:uvV"))) > 0) {
+    while ((ch = GETOPT(argc, argv, _TSK_T("b:f:i:o:uvVx:"))) > 0) {
         switch (ch) {
         case _TSK_T('b'):
             ssize = (unsigned int) TSTRTOUL(OPTARG, &cp, 0);
@@ -121,6 +125,9 @@ main(int argc, char **argv1)
         case _TSK_T('V'):
             tsk_version_print(stdout);
             exit(0);
+        case _TSK_T('x'):
+            index_path = OPTARG;
+            break;
         case _TSK_T('?'):
         default:
             TFPRINTF(stderr, _TSK_T("Invalid argument: %s\n"),
@@ -180,6 +187,22 @@ main(int argc, char **argv1)
         exit(1);
     }
 
+    if (index_path) {
+        struct STAT_STR stat_buf;
+        uint8_t retval;
+
+        /* load the index if it exists and make it otherwise */
+        if (TSTAT(index_path, &stat_buf) == 0)
+            retval = tsk_fs_ifind_index_load(fs, index_path);
+        else
+            retval = tsk_fs_ifind_index_save(fs, index_path);
+        if (retval) {
+            tsk_error_print(stderr);
+            fs->close(fs);
+            img->close(img);
+            exit(1);
+        }
+    }
 
     if (tsk_fs_blkstat(fs, addr)) {
         tsk_error_print(stderr);
@@ -20,8 +20,10 @@
 **
 */
 #include "tsk/tsk_tools_i.h"
+#include "tsk/fs/tsk_ntfs.h"
 #include <locale.h>
 #include <time.h>
+#include <sys/stat.h>
 
 static TSK_TCHAR *progname;
 
@@ -30,7 +32,7 @@ usage()
 {
     TFPRINTF(stderr,
         _TSK_T
-        ("usage: %s [-adDFlpruvV] [-f fstype] [-i imgtype] [-b dev_sector_size] [-m dir/] [-o imgoffset] [-z ZONE] [-s seconds] image [images] [inode]\n"),
+        ("usage: %s [-adDFlpruvV] [-f fstype] [-i imgtype] [-b dev_sector_size] [-m dir/] [-o imgoffset] [-x map_file] [-z ZONE] [-s seconds] image [images] [inode]\n"),
         progname);
     tsk_fprintf(stderr,
         "\tIf [inode] is not given, the root directory is used\n");
@@ -56,6 +58,8 @@ usage()
     tsk_fprintf(stderr, "\t-u: Display undeleted entries only\n");
     tsk_fprintf(stderr, "\t-v: verbose output to stderr\n");
     tsk_fprintf(stderr, "\t-V: Print version\n");
+    tsk_fprintf(stderr,
+        "\t-x map_file: NTFS parent directory map file (it is created if it does not exist)\n");
     tsk_fprintf(stderr,
         "\t-z: Time zone of original machine (i.e. EST5EDT or GMT) (only useful with -l)\n");
     tsk_fprintf(stderr,
@@ -84,6 +88,7 @@ main(int argc, char **argv1)
     TSK_TCHAR **argv;
     unsigned int ssize = 0;
     TSK_TCHAR *cp;
+    TSK_TCHAR *map_path = NULL;
 
 #ifdef TSK_WIN32
     // On Windows, get the wide arguments (mingw doesn't support wmain)
@@ -102,7 +107,7 @@ main(int argc, char **argv1)
     fls_flags = TSK_FS_FLS_DIR | TSK_FS_FLS_FILE;
 
     while ((ch =
-            GETOPT(argc, argv, _TSK_T("ab:dDf:Fi:m:lo:prs:uvVz:"))) > 0) {
+            GETOPT(argc, argv, _TSK_T("ab:dDf:Fi:m:lo:prs:uvVx:z:"))) > 0) {
         switch (ch) {
         case _TSK_T('?'):
         default:
@@ -188,6 +193,9 @@ main(int argc, char **argv1)
         case _TSK_T('V'):
             tsk_version_print(stdout);
             exit(0);
+        case _TSK_T('x'):
+            map_path = OPTARG;
+            break;
         case 'z':
             {
                 TSK_TCHAR envstr[32];
@@ -300,6 +308,30 @@ main(int argc, char **argv1)
         }
     }
 
+    if (map_path) {
+        struct STAT_STR stat_buf;
+        uint8_t retval;
+
+        if (TSK_FS_TYPE_ISNTFS(fs->ftype) == 0) {
+            tsk_fprintf(stderr, "-x works only with NTFS file systems\n");
+            fs->close(fs);
+            img->close(img);
+            exit(1);
+        }
+
+        /* load the map if it exists and make it otherwise */
+        if (TSTAT(map_path, &stat_buf) == 0)
+            retval = ntfs_parent_map_load(fs, map_path);
+        else
+            retval = ntfs_parent_map_save(fs, map_path);
+        if (retval) {
+            tsk_error_print(stderr);
+            fs->close(fs);
+            img->close(img);
+            exit(1);
+        }
+    }
+
     if (tsk_fs_fls(fs, (TSK_FS_FLS_FLAG_ENUM) fls_flags, inode,
             (TSK_FS_DIR_WALK_FLAG_ENUM) name_flags, macpre, sec_skew)) {
         tsk_error_print(stderr);
@@ -22,6 +22,7 @@
 #include "tsk/tsk_tools_i.h"
 #include <locale.h>
 #include <time.h>
+#include <sys/stat.h>
 
 static TSK_TCHAR *progname;
 static uint8_t localflags;
@@ -31,7 +32,7 @@ usage()
 {
     TFPRINTF(stderr,
         _TSK_T
-        ("usage: %s [-alvV] [-f fstype] [-i imgtype] [-b dev_sector_size] [-o imgoffset] [-d unit_addr] [-n file] [-p par_addr] [-z ZONE] image [images]\n"),
+        ("usage: %s [-alvV] [-f fstype] [-i imgtype] [-b dev_sector_size] [-o imgoffset] [-d unit_addr] [-n file] [-p par_addr] [-x index_file] [-z ZONE] image [images]\n"),
         progname);
     tsk_fprintf(stderr, "\t-a: find all inodes\n");
     tsk_fprintf(stderr,
@@ -51,6 +52,8 @@ usage()
         "\t-o imgoffset: The offset of the file system in the image (in sectors)\n");
     tsk_fprintf(stderr, "\t-v: Verbose output to stderr\n");
     tsk_fprintf(stderr, "\t-V: Print version\n");
+    tsk_fprintf(stderr,
+        "\t-x index_file: Use a data unit index file with -d (it is created if it does not exist)\n");
     tsk_fprintf(stderr,
         "\t-z ZONE: Time zone setting when -l -p is given\n");
 
@@ -78,6 +81,7 @@ main(int argc, char **argv1)
     TSK_DADDR_T block = 0;      /* the block to find */
     TSK_INUM_T parinode = 0;
     TSK_TCHAR *path = NULL;
+    TSK_TCHAR *index_path = NULL;
     TSK_TCHAR **argv;
     unsigned int ssize = 0;
 
@@ -97,7 +101,7 @@ main(int argc, char **argv1)
 
     localflags = 0;
 
-    while ((ch = GETOPT(argc, argv, _TSK_T("ab:d:f:i:ln:o:p:vVz:"))) > 0) {
+    while ((ch = GETOPT(argc, argv, _TSK_T("ab:d:f:i:ln:o:p:vVx:z:"))) > 0) {
         switch (ch) {
         case _TSK_T('a'):
             localflags |= TSK_FS_IFIND_ALL;
@@ -196,6 +200,9 @@ main(int argc, char **argv1)
         case 'V':
             tsk_version_print(stdout);
             exit(0);
+        case 'x':
+            index_path = OPTARG;
+            break;
         case 'z':
             {
                 TSK_TCHAR envstr[32];
@@ -265,6 +272,22 @@ main(int argc, char **argv1)
             img->close(img);
             exit(1);
         }
+        if (index_path) {
+            struct STAT_STR stat_buf;
+            uint8_t retval;
+
+            /* load the index if it exists and make it otherwise */
+            if (TSTAT(index_path, &stat_buf) == 0)
+                retval = tsk_fs_ifind_index_load(fs, index_path);
+            else
+                retval = tsk_fs_ifind_index_save(fs, index_path);
+            if (retval) {
+                tsk_error_print(stderr);
+                fs->close(fs);
+                img->close(img);
+                exit(1);
+            }
+        }
         if (tsk_fs_ifind_data(fs, (TSK_FS_IFIND_FLAG_ENUM) localflags,
                 block)) {
             tsk_error_print(stderr);
@@ -0,0 +1,392 @@
+/*
+ ** tsk_mactime
+ ** The Sleuth Kit
+ **
+ ** Makes a timeline from a body file (or an image) in the same format as
+ ** the mactime script, but sorts it with bounded memory.
+ **
+ ** Brian Carrier [carrier <at> sleuthkit [dot] org]
+ ** Copyright (c) 2013 Brian Carrier.  All Rights reserved
+ **
+ ** This software is distributed under the Common Public License 1.0
+ **
+ */
+
+#include "tsk/tsk_tools_i.h"
+#include "tsk/auto/tsk_timeline.h"
+#include <locale.h>
+#include <time.h>
+
+
+static TSK_TCHAR *progname;
+
+static void
+usage()
+{
+    TFPRINTF(stderr,
+        _TSK_T
+        ("usage: %s [-b body_file] [-p password_file] [-g group_file] [-i day|hour idx_file] [-dhmvVy] [-z TIME_ZONE] [-I image] [-M mem_mb] [-T temp_dir] [DATE]\n"),
+        progname);
+    tsk_fprintf(stderr,
+        "\t-b: Specifies the body file location, else STDIN is used\n");
+    tsk_fprintf(stderr, "\t-d: Output in comma delimited format\n");
+    tsk_fprintf(stderr,
+        "\t-h: Display a header with session information\n");
+    tsk_fprintf(stderr,
+        "\t-i [day | hour] file: Specifies the index file with a summary of results\n");
+    tsk_fprintf(stderr, "\t-y: Dates are displayed in ISO 8601 format\n");
+    tsk_fprintf(stderr,
+        "\t-m: Dates have month as number instead of word (does not work with -y)\n");
+    tsk_fprintf(stderr,
+        "\t-z: Specify the timezone the data came from (in the local system format) (does not work with -y)\n");
+    tsk_fprintf(stderr,
+        "\t-g: Specifies the group file location, else GIDs are used\n");
+    tsk_fprintf(stderr,
+        "\t-p: Specifies the password file location, else UIDs are used\n");
+    tsk_fprintf(stderr,
+        "\t-I image: Make the timeline from the file systems in an image instead of a body file\n");
+    tsk_fprintf(stderr,
+        "\t-M mem_mb: Memory (in MB) to sort with before temporary files are used\n");
+    tsk_fprintf(stderr,
+        "\t-T temp_dir: Directory for temporary files\n");
+    tsk_fprintf(stderr, "\t-v: verbose output to stderr\n");
+    tsk_fprintf(stderr, "\t-V: Prints the version to STDOUT\n");
+    tsk_fprintf(stderr,
+        "\t[DATE]: starting date (yyyy-mm-dd) or range (yyyy-mm-dd..yyyy-mm-dd)\n");
+
+    exit(1);
+}
+
+/* Adds the times in an image to the timeline */
+class TskMactimeAuto:public TskAutoTimeline {
+  public:
+    TskMactimeAuto(TskTimeline * a_timeline):TskAutoTimeline(a_timeline) {
+    }
+    virtual uint8_t handleError();
+};
+
+// Print errors as they are encountered
+uint8_t TskMactimeAuto::handleError()
+{
+    fprintf(stderr, "%s", tsk_error_get());
+    return 0;
+}
+
+/* Convert a TSK_TCHAR string to UTF-8 (paths are opened with the
+ * narrow functions). */
+static std::string
+toUtf8(const TSK_TCHAR * a_str)
+{
+#ifdef TSK_WIN32
+    std::string out;
+    size_t len = wcslen(a_str);
+    std::vector<char> buf(len * 4 + 1);
+    UTF16 *ptr16 = (UTF16 *) a_str;
+    UTF8 *ptr8 = (UTF8 *) & buf[0];
+
+    if (tsk_UTF16toUTF8_lclorder((const UTF16 **) &ptr16,
+            (UTF16 *) & a_str[len], &ptr8, (UTF8 *) & buf[buf.size() - 1],
+            TSKlenientConversion) == TSKconversionOK) {
+        *ptr8 = '\0';
+        out = &buf[0];
+    }
+    return out;
+#else
+    return std::string(a_str);
+#endif
+}
+
+/* Convert yyyy-mm-dd to the time of its midnight.
+ * Returns -1 if it is not in that format. */
+static time_t
+parseIsoDate(const TSK_TCHAR * a_str, size_t a_len)
+{
+    static const char fmt[] = "dddd-dd-dd";
+    int vals[3] = { 0, 0, 0 };
+    int field = 0;
+    struct tm tmTime;
+
+    if (a_len != 10)
+        return -1;
+    for (size_t i = 0; i < a_len; i++) {
+        if (fmt[i] == '-') {
+            if (a_str[i] != _TSK_T('-'))
+                return -1;
+            field++;
+        }
+        else if ((a_str[i] >= _TSK_T('0')) && (a_str[i] <= _TSK_T('9'))) {
+            vals[field] = vals[field] * 10 + (a_str[i] - _TSK_T('0'));
+        }
+        else {
+            return -1;
+        }
+    }
+
+    memset(&tmTime, 0, sizeof(tmTime));
+    tmTime.tm_year = vals[0] - 1900;
+    tmTime.tm_mon = vals[1] - 1;
+    tmTime.tm_mday = vals[2];
+    tmTime.tm_isdst = -1;
+    return mktime(&tmTime);
+}
+
+int
+main(int argc, char **argv1)
+{
+    TSK_TCHAR **argv;
+    int ch;
+    TSK_TCHAR *cp;
+    TSK_TCHAR *body = NULL;
+    TSK_TCHAR *image = NULL;
+    TSK_TCHAR *index = NULL;
+    TSK_TCHAR *passwd = NULL;
+    TSK_TCHAR *group = NULL;
+    TSK_TCHAR *tempDir = NULL;
+    TSK_TCHAR *dateArg = NULL;
+    bool hourly = false;
+    bool delim = false;
+    bool header = false;
+    bool iso = false;
+    bool monthNum = false;
+    size_t memLimit = TSK_TIMELINE_MEM_DEFAULT;
+    time_t start = 0;
+    time_t end = 0;
+    FILE *hIndex = NULL;
+
+#ifdef TSK_WIN32
+    // On Windows, get the wide arguments (mingw doesn't support wmain)
+    argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+    if (argv == NULL) {
+        fprintf(stderr, "Error getting wide arguments\n");
+        exit(1);
+    }
+#else
+    argv = (TSK_TCHAR **) argv1;
+#endif
+
+    progname = argv[0];
+    setlocale(LC_ALL, "");
+
+    if (argc == 1)
+        usage();
+
+    while ((ch = GETOPT(argc, argv, _TSK_T("b:dg:hi:I:mM:p:T:vVyz:"))) > 0) {
+        switch (ch) {
+        case _TSK_T('?'):
+        default:
+            TFPRINTF(stderr, _TSK_T("Invalid argument: %s\n"),
+                argv[OPTIND]);
+            usage();
+
+        case _TSK_T('b'):
+            body = OPTARG;
+            break;
+
+        case _TSK_T('d'):
+            delim = true;
+            break;
+
+        case _TSK_T('g'):
+            group = OPTARG;
+            break;
+
+        case _TSK_T('h'):
+            header = true;
+            break;
+
+        case _TSK_T('i'):
+            // the type is optional and the file name is the next argument
+            if (TSTRCMP(OPTARG, _TSK_T("hour")) == 0)
+                hourly = true;
+            if (OPTIND >= argc) {
+                tsk_fprintf(stderr, "-i requires index file argument\n");
+                usage();
+            }
+            index = argv[OPTIND++];
+            break;
+
+        case _TSK_T('I'):
+            image = OPTARG;
+            break;
+
+        case _TSK_T('m'):
+            monthNum = true;
+            break;
+
+        case _TSK_T('M'):
+            memLimit = (size_t) TSTRTOUL(OPTARG, &cp, 0);
+            if (*cp || *cp == *OPTARG || memLimit < 1) {
+                TFPRINTF(stderr,
+                    _TSK_T
+                    ("invalid argument: memory size must be positive: %s\n"),
+                    OPTARG);
+                usage();
+            }
+            memLimit *= 1024 * 1024;
+            break;
+
+        case _TSK_T('p'):
+            passwd = OPTARG;
+            break;
+
+        case _TSK_T('T'):
+            tempDir = OPTARG;
+            break;
+
+        case _TSK_T('v'):
+            tsk_verbose++;
+            break;
+
+        case _TSK_T('V'):
+            tsk_version_print(stdout);
+            exit(0);
+
+        case _TSK_T('y'):
+            iso = true;
+            break;
+
+        case _TSK_T('z'):
+            {
+                // putenv() keeps a pointer to the string
+                static TSK_TCHAR envstr[32];
+                TSNPRINTF(envstr, 32, _TSK_T("TZ=%s"), OPTARG);
+                if (0 != TPUTENV(envstr)) {
+                    tsk_fprintf(stderr, "error setting environment");
+                    exit(1);
+                }
+                TZSET();
+            }
+            break;
+        }
+    }
+
+    if ((body) && (image)) {
+        tsk_fprintf(stderr, "-b and -I cannot be used together\n");
+        usage();
+    }
+
+    // Was the time given
+    if (OPTIND < argc) {
+        const TSK_TCHAR *sep;
+
+        dateArg = argv[OPTIND];
+        sep = TSTRCHR(dateArg, _TSK_T('.'));
+        if ((sep) && (sep[1] == _TSK_T('.'))) {
+            start = parseIsoDate(dateArg, sep - dateArg);
+            if (start < 0) {
+                TFPRINTF(stderr, _TSK_T("Invalid Date: %s\n"), dateArg);
+                exit(1);
+            }
+            if (sep[2] != _TSK_T('\0')) {
+                end = parseIsoDate(&sep[2], TSTRLEN(&sep[2]));
+                if (end < 0) {
+                    TFPRINTF(stderr, _TSK_T("Invalid Date: %s\n"),
+                        &sep[2]);
+                    exit(1);
+                }
+            }
+        }
+        else {
+            start = parseIsoDate(dateArg, TSTRLEN(dateArg));
+            if (start < 0) {
+                TFPRINTF(stderr, _TSK_T("Invalid Date: %s\n"), dateArg);
+                exit(1);
+            }
+        }
+    }
+
+    TskMactime mactime(stdout);
+    mactime.setDelimited(delim);
+    mactime.setIso8601(iso);
+    mactime.setMonthNum(monthNum);
+    mactime.setTimeRange(start, end);
+    mactime.setMemoryLimit(memLimit);
+    if (tempDir)
+        mactime.setTempDir(toUtf8(tempDir).c_str());
+
+    if ((passwd) && (mactime.loadPasswd(toUtf8(passwd).c_str()))) {
+        tsk_error_print(stderr);
+        exit(1);
+    }
+    if ((group) && (mactime.loadGroup(toUtf8(group).c_str()))) {
+        tsk_error_print(stderr);
+        exit(1);
+    }
+
+    if (index) {
+        if ((hIndex = fopen(toUtf8(index).c_str(), "w")) == NULL) {
+            TFPRINTF(stderr, _TSK_T("Can not open %s\n"), index);
+            exit(1);
+        }
+        mactime.setIndex(hIndex, hourly);
+    }
+
+    // Print header info
+    if (header) {
+        tsk_fprintf(stdout, "The Sleuth Kit mactime Timeline\n");
+        tsk_fprintf(stdout, "Input Source: %s\n",
+            body ? toUtf8(body).c_str() : (image ? toUtf8(image).
+                c_str() : "STDIN"));
+        if (dateArg)
+            tsk_fprintf(stdout, "Time: %s\t\t", toUtf8(dateArg).c_str());
+        const char *tz = getenv("TZ");
+        if ((tz == NULL) || (tz[0] == '\0'))
+            tsk_fprintf(stdout, "\n");
+        else
+            tsk_fprintf(stdout, "Timezone: %s\n", tz);
+        if (passwd)
+            tsk_fprintf(stdout, "passwd File: %s",
+                toUtf8(passwd).c_str());
+        if (group)
+            tsk_fprintf(stdout, "%sgroup File: %s", passwd ? "\t" : "",
+                toUtf8(group).c_str());
+        if ((passwd) || (group))
+            tsk_fprintf(stdout, "\n");
+        tsk_fprintf(stdout, "\n");
+    }
+
+    // Print the index header
+    if (hIndex) {
+        fprintf(hIndex, "%s Summary for Timeline of %s\n\n",
+            hourly ? "Hourly" : "Daily",
+            body ? toUtf8(body).c_str() : (image ? toUtf8(image).
+                c_str() : "STDIN"));
+    }
+
+    if (image) {
+        TskMactimeAuto autoTimeline(&mactime);
+
+        if (autoTimeline.openImage(1, &image, TSK_IMG_TYPE_DETECT, 0)) {
+            tsk_error_print(stderr);
+            exit(1);
+        }
+        if (autoTimeline.findFilesInImg()) {
+            // we already logged the errors
+            exit(1);
+        }
+    }
+    else {
+        FILE *hBody = stdin;
+
+        if ((body)
+            && ((hBody = fopen(toUtf8(body).c_str(), "r")) == NULL)) {
+            TFPRINTF(stderr, _TSK_T("Can't open %s\n"), body);
+            exit(1);
+        }
+        if (mactime.addBodyFile(hBody)) {
+            tsk_error_print(stderr);
+            exit(1);
+        }
+        if (body)
+            fclose(hBody);
+    }
+
+    if (mactime.print()) {
+        tsk_error_print(stderr);
+        exit(1);
+    }
+
+    if (hIndex)
+        fclose(hIndex);
+    exit(0);
+}
@@ -27,12 +27,16 @@ TskAuto::TskAuto()
     m_fileFilterFlags = TSK_FS_DIR_WALK_FLAG_RECURSE;
     m_stopAllProcessing = false;
     m_internalOpen = false;
+    m_threadCount = 1;
+    m_volNext = 0;
+    tsk_init_lock(&m_lock);
 }
 
 
 TskAuto::~TskAuto()
 {
     closeImage();
+    tsk_deinit_lock(&m_lock);
     m_tag = 0;
 }
 
@@ -167,6 +171,44 @@ void
     m_fileFilterFlags = file_flags;
 }
 
+/**
+ * Set the maximum number of threads that are used to process the file
+ * systems in a volume system.  The default is 1, which processes
+ * everything in the calling thread.  See the class description for
+ * which methods can then be called concurrently.  This has no effect
+ * if the library was built without thread support.
+ * This must be called before the findFilesInXX() method.
+ * @param a_count Number of threads (including the calling thread)
+ */
+void
+ TskAuto::setThreadCount(unsigned int a_count)
+{
+    m_threadCount = (a_count > 0) ? a_count : 1;
+}
+
+/**
+ * Returns the details of the volume that a file system is in.  This can
+ * be called from filterFs(), processFile(), and processAttribute().
+ * @param a_fs_info File system that is being processed
+ * @returns NULL if the file system is not in a volume of a volume system
+ * (or is not being processed)
+ */
+const TskAuto::vol_context *
+TskAuto::getVolContext(const TSK_FS_INFO * a_fs_info)
+{
+    vol_context *vol = NULL;
+
+    tsk_take_lock(&m_lock);
+    for (size_t i = 0; i < m_vols.size(); i++) {
+        if (m_vols[i]->fs_info == a_fs_info) {
+            vol = m_vols[i];
+            break;
+        }
+    }
+    tsk_release_lock(&m_lock);
+    return vol;
+}
+
 /**
  * @return The size of the image in bytes or -1 if the 
  * image is not open.
@@ -245,10 +287,29 @@ TSK_WALK_RET_ENUM
     else if ((retval1 == TSK_FILTER_STOP) || (tsk->getStopProcessing()))
         return TSK_WALK_STOP;    
 
+    vol_context *vol = new vol_context;
+    vol->addr = a_vs_part->addr;
+    vol->start = a_vs_part->start * a_vs_part->vs->block_size;
+    vol->descr = tsk->getCurVsPartDescr();
+    vol->flags = a_vs_part->flags;
+    vol->fs_info = NULL;
+
+    tsk_take_lock(&tsk->m_lock);
+    tsk->m_vols.push_back(vol);
+    tsk_release_lock(&tsk->m_lock);
+
+    // findFilesInVs() will process the queue after the walk
+    if (tsk->m_threadCount > 1)
+        return TSK_WALK_CONT;
+
     // process it
-    TSK_RETVAL_ENUM retval2 =
-        tsk->findFilesInFsRet(a_vs_part->start *
-        a_vs_part->vs->block_size, TSK_FS_TYPE_DETECT);
+    TSK_RETVAL_ENUM retval2 = tsk->findFilesInVol(vol);
+
+    tsk_take_lock(&tsk->m_lock);
+    tsk->m_vols.pop_back();
+    tsk_release_lock(&tsk->m_lock);
+    delete vol;
+
     if ((retval2 == TSK_STOP) || (tsk->getStopProcessing())) {
         return TSK_WALK_STOP;
     }
@@ -259,6 +320,170 @@ TSK_WALK_RET_ENUM
 }
 
 
+/** \internal
+ * Opens the file system in a volume and processes it.
+ * @param a_vol Volume to process
+ * @returns OK, STOP, or ERR (error message will already have been registered)
+ */
+TSK_RETVAL_ENUM
+TskAuto::findFilesInVol(vol_context * a_vol)
+{
+    TSK_FS_INFO *fs_info;
+    if ((fs_info =
+            tsk_fs_open_img(m_img_info, a_vol->start,
+                TSK_FS_TYPE_DETECT)) == NULL) {
+        if (a_vol->flags & TSK_VS_PART_FLAG_ALLOC) {
+            tsk_error_set_errstr2 ("Sector offset: %" PRIuOFF ", Partition Type: %s",
+                a_vol->start/512, a_vol->descr.c_str() );
+            registerError();
+            return TSK_ERR;
+        }
+        else {
+            tsk_error_reset();
+            return TSK_OK;
+        }
+    }
+
+    tsk_take_lock(&m_lock);
+    a_vol->fs_info = fs_info;
+    tsk_release_lock(&m_lock);
+
+    TSK_RETVAL_ENUM retval = findFilesInFsInt(fs_info, fs_info->root_inum);
+
+    tsk_take_lock(&m_lock);
+    a_vol->fs_info = NULL;
+    tsk_release_lock(&m_lock);
+
+    tsk_fs_close(fs_info);
+    return retval;
+}
+
+/** \internal
+ * Processes queued volumes until there are none left or processing
+ * should stop.  Called from each thread.
+ */
+void
+TskAuto::processVolQueue()
+{
+    while (true) {
+        vol_context *vol = NULL;
+
+        tsk_take_lock(&m_lock);
+        if ((m_volNext < m_vols.size()) && (m_stopAllProcessing == false))
+            vol = m_vols[m_volNext++];
+        tsk_release_lock(&m_lock);
+
+        if (vol == NULL)
+            break;
+
+        // all errors will have been registered.  STOP ends the volume
+        // walk, so do not give out the remaining volumes.
+        if (findFilesInVol(vol) == TSK_STOP) {
+            tsk_take_lock(&m_lock);
+            m_volNext = m_vols.size();
+            tsk_release_lock(&m_lock);
+        }
+    }
+}
+
+/** \internal
+ * Argument for the thread start routine, which cannot call the private
+ * TskAuto::processVolQueue() directly.
+ */
+typedef struct {
+    TskAuto *tsk;
+    void (TskAuto::*process) ();
+} TSK_AUTO_VOL_THREAD;
+
+/** \internal
+ * Thread start routine for processing queued volumes.
+ */
+static void *
+tsk_auto_vol_thread(void *a_ptr)
+{
+    TSK_AUTO_VOL_THREAD *arg = (TSK_AUTO_VOL_THREAD *) a_ptr;
+    (arg->tsk->*arg->process) ();
+    return NULL;
+}
+
+#if defined(TSK_MULTITHREAD_LIB) && defined(TSK_WIN32)
+static DWORD WINAPI
+tsk_auto_vol_thread_win32(LPVOID a_ptr)
+{
+    tsk_auto_vol_thread(a_ptr);
+    return 0;
+}
+#endif
+
+/** \internal
+ * Processes the volumes that vsWalkCb() queued because more than one
+ * thread is allowed.  The calling thread processes volumes too, so
+ * everything still gets processed if threads cannot be started.
+ */
+void
+TskAuto::findFilesInVols()
+{
+    size_t nthreads = 0;
+
+    if (m_vols.empty())
+        return;
+
+    m_volNext = 0;
+
+#ifdef TSK_MULTITHREAD_LIB
+    TSK_AUTO_VOL_THREAD arg;
+    arg.tsk = this;
+    arg.process = &TskAuto::processVolQueue;
+
+    nthreads = m_threadCount - 1;
+    if (nthreads > m_vols.size() - 1)
+        nthreads = m_vols.size() - 1;
+
+#ifdef TSK_WIN32
+    std::vector<HANDLE> threads;
+    for (size_t i = 0; i < nthreads; i++) {
+        HANDLE thread = CreateThread(NULL, 0, tsk_auto_vol_thread_win32,
+            &arg, 0, NULL);
+        if (thread == NULL)
+            break;
+        threads.push_back(thread);
+    }
+#else
+    std::vector<pthread_t> threads;
+    for (size_t i = 0; i < nthreads; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, tsk_auto_vol_thread, &arg))
+            break;
+        threads.push_back(thread);
+    }
+#endif
+    if (tsk_verbose)
+        tsk_fprintf(stderr,
+            "findFilesInVols: Processing %" PRIu64
+            " volumes with %" PRIu64 " extra threads\n",
+            (uint64_t) m_vols.size(), (uint64_t) threads.size());
+#endif
+
+    processVolQueue();
+
+#ifdef TSK_MULTITHREAD_LIB
+    for (size_t i = 0; i < threads.size(); i++) {
+#ifdef TSK_WIN32
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+#else
+        pthread_join(threads[i], NULL);
+#endif
+    }
+#endif
+
+    for (size_t i = 0; i < m_vols.size(); i++)
+        delete m_vols[i];
+    m_vols.clear();
+    m_volNext = 0;
+}
+
+
 /**
  * Starts in a specified byte offset of the opened disk images and looks for a
  * volume system or file system. Will call processFile() on each file
@@ -302,9 +527,12 @@ TskAuto::findFilesInVs(TSK_OFF_T a_start, TSK_VS_TYPE_ENUM a_vtype)
         if (tsk_vs_part_walk(vs_info, 0, vs_info->part_count - 1,
                 m_volFilterFlags, vsWalkCb, this)) {
             registerError();
+            findFilesInVols();
             tsk_vs_close(vs_info);
             return 1;
         }
+        // process the volumes that were queued in threads
+        findFilesInVols();
         tsk_vs_close(vs_info);
     }
     return m_errors.empty() ? 0 : 1;
@@ -576,6 +804,16 @@ TskAuto::processAttribute(TSK_FS_FILE * fs_file,
 };
 
 
+TskAutoFlag & TskAutoFlag::operator=(bool a_val) {
+    tsk_atomic_store_long(&m_val, a_val ? 1 : 0);
+    return *this;
+}
+
+TskAutoFlag::operator bool() const {
+    return tsk_atomic_load_long(&m_val) != 0;
+}
+
+
 void TskAuto::setStopProcessing() {
     m_stopAllProcessing = true;
 }
@@ -590,7 +828,9 @@ uint8_t TskAuto::registerError() {
     er.code = tsk_error_get_errno();
     er.msg1 = tsk_error_get_errstr();
     er.msg2 = tsk_error_get_errstr2();
+    tsk_take_lock(&m_lock);
     m_errors.push_back(er);
+    tsk_release_lock(&m_lock);
     
     // call super class implementation
     uint8_t retval = handleError();
@@ -601,11 +841,16 @@ uint8_t TskAuto::registerError() {
 
  
 const std::vector<TskAuto::error_record> TskAuto::getErrorList() {
-    return m_errors;
+    tsk_take_lock(&m_lock);
+    std::vector<error_record> errors = m_errors;
+    tsk_release_lock(&m_lock);
+    return errors;
 }
 
 void TskAuto::resetErrorList() {
+    tsk_take_lock(&m_lock);
     m_errors.clear();
+    tsk_release_lock(&m_lock);
 }
 
 std::string TskAuto::errorRecordToString(error_record &rec) {
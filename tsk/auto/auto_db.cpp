@@ -694,35 +694,41 @@ TskAutoDb::md5HashAttr(unsigned char md5Hash[16], const TSK_FS_ATTR * fs_attr)
 }
 
 /**
-* Callback invoked per every unallocated block in the filesystem
+* Callback invoked per every range of unallocated blocks in the filesystem
 * Creates file ranges and file entries 
 * A single file entry per consecutive range of blocks
-* @param a_block block being walked
+* @param a_fs file system being walked
+* @param a_addr first block in the range
+* @param a_len number of blocks in the range
+* @param a_flags flags of the blocks
+* @param a_buf unused (the walk is address only)
 * @param a_ptr point to TskAutoDb class
 * @returns TSK_WALK_CONT if continue, otherwise TSK_WALK_STOP if stop processing requested
 */
-TSK_WALK_RET_ENUM TskAutoDb::fsWalkUnallocBlocksCb(const TSK_FS_BLOCK *a_block, void *a_ptr) {
+TSK_WALK_RET_ENUM TskAutoDb::fsWalkUnallocBlocksCb(TSK_FS_INFO *a_fs, TSK_DADDR_T a_addr, TSK_DADDR_T a_len,
+    TSK_FS_BLOCK_FLAG_ENUM a_flags, const char *a_buf, void *a_ptr) {
     UNALLOC_BLOCK_WLK_TRACK * unallocBlockWlkTrack = (UNALLOC_BLOCK_WLK_TRACK *) a_ptr;
 
     if (unallocBlockWlkTrack->tskAutoDb.m_stopAllProcessing)
         return TSK_WALK_STOP;
 
-	// initialize if this is the first block
+	// initialize if this is the first range
     if (unallocBlockWlkTrack->isStart) {
         unallocBlockWlkTrack->isStart = false;
-        unallocBlockWlkTrack->curRangeStart = a_block->addr;
-        unallocBlockWlkTrack->prevBlock = a_block->addr;
+        unallocBlockWlkTrack->curRangeStart = a_addr;
+        unallocBlockWlkTrack->prevBlock = a_addr + a_len - 1;
 		unallocBlockWlkTrack->size = 0;
 		return TSK_WALK_CONT;
     }
 
-	// if this block is consecutive with the previous one, update prevBlock and return
-	if (a_block->addr == unallocBlockWlkTrack->prevBlock + 1) {
-		unallocBlockWlkTrack->prevBlock = a_block->addr;
+	// if this range is consecutive with the previous one (the walk gives
+	// separate ranges for meta and content blocks), update prevBlock and return
+	if (a_addr == unallocBlockWlkTrack->prevBlock + 1) {
+		unallocBlockWlkTrack->prevBlock = a_addr + a_len - 1;
 		return TSK_WALK_CONT;
 	}
 
-	// this block is not contiguous with the previous one; create and add a range object
+	// this range is not contiguous with the previous one; create and add a range object
 	const uint64_t rangeStartOffset = unallocBlockWlkTrack->curRangeStart * unallocBlockWlkTrack->fsInfo.block_size 
 		+ unallocBlockWlkTrack->fsInfo.offset;
 	const uint64_t rangeSizeBytes = (1 + unallocBlockWlkTrack->prevBlock - unallocBlockWlkTrack->curRangeStart) 
@@ -731,8 +737,8 @@ TSK_WALK_RET_ENUM TskAutoDb::fsWalkUnallocBlocksCb(const TSK_FS_BLOCK *a_block,
 	
 	// bookkeeping for the next range object
 	unallocBlockWlkTrack->size += rangeSizeBytes;
-	unallocBlockWlkTrack->curRangeStart = a_block->addr;
-	unallocBlockWlkTrack->prevBlock = a_block->addr;
+	unallocBlockWlkTrack->curRangeStart = a_addr;
+	unallocBlockWlkTrack->prevBlock = a_addr + a_len - 1;
 
 	// Here we just return if we are a) collecting all unallocated data
 	// for the given volumen (chunkSize == 0) or b) collecting all unallocated
@@ -750,7 +756,7 @@ TSK_WALK_RET_ENUM TskAutoDb::fsWalkUnallocBlocksCb(const TSK_FS_BLOCK *a_block,
 		unallocBlockWlkTrack->fsObjId, unallocBlockWlkTrack->size, unallocBlockWlkTrack->ranges, fileObjId);
 
 	// reset
-	unallocBlockWlkTrack->curRangeStart = a_block->addr;
+	unallocBlockWlkTrack->curRangeStart = a_addr;
 	unallocBlockWlkTrack->size = 0;
 	unallocBlockWlkTrack->ranges.clear();
 
@@ -786,7 +792,7 @@ int8_t TskAutoDb::addFsInfoUnalloc(const TSK_DB_FS_INFO & dbFsInfo) {
     //walk unalloc blocks on the fs and process them
     //initialize the unalloc block walk tracking 
 	UNALLOC_BLOCK_WLK_TRACK unallocBlockWlkTrack(*this, *fsInfo, dbFsInfo.objId, m_chunkSize);
-    uint8_t block_walk_ret = tsk_fs_block_walk(fsInfo, fsInfo->first_block, fsInfo->last_block, (TSK_FS_BLOCK_WALK_FLAG_ENUM)(TSK_FS_BLOCK_WALK_FLAG_UNALLOC | TSK_FS_BLOCK_WALK_FLAG_AONLY), 
+    uint8_t block_walk_ret = tsk_fs_block_range_walk(fsInfo, fsInfo->first_block, fsInfo->last_block, (TSK_FS_BLOCK_WALK_FLAG_ENUM)(TSK_FS_BLOCK_WALK_FLAG_UNALLOC | TSK_FS_BLOCK_WALK_FLAG_AONLY), 
         fsWalkUnallocBlocksCb, &unallocBlockWlkTrack);
 
     if (block_walk_ret == 1) {
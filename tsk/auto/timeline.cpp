@@ -0,0 +1,1173 @@
+/*
+ ** The Sleuth Kit
+ **
+ ** Brian Carrier [carrier <at> sleuthkit [dot] org]
+ ** Copyright (c) 2013 Brian Carrier.  All Rights reserved
+ **
+ ** This software is distributed under the Common Public License 1.0
+ **
+ */
+
+/**
+ * \file timeline.cpp
+ * Contains the classes that sort body file data into a timeline and print
+ * it in the mactime format.
+ */
+
+#include "tsk_auto_i.h"
+#include "tsk_timeline.h"
+
+#include <algorithm>
+#include <queue>
+
+#ifndef TSK_WIN32
+#include <unistd.h>
+#endif
+
+/* Maximum number of runs that are merged at once.  More runs are merged
+ * in passes so that we do not run out of file handles. */
+#define TSK_TIMELINE_MERGE_WAYS 64
+
+/* Bytes that the heap uses to keep track of each allocation (a guess) */
+#define TSK_TIMELINE_ALLOC_OVERHEAD (2 * sizeof(void *))
+
+/* Compare two times the way mactime does, which is as strings of at
+ * least 10 digits. */
+static int
+timeCompare(int64_t a_time1, int64_t a_time2)
+{
+    if (a_time1 == a_time2)
+        return 0;
+    if ((a_time1 >= 0) && (a_time2 >= 0) && (a_time1 < 10000000000LL)
+        && (a_time2 < 10000000000LL))
+        return (a_time1 < a_time2) ? -1 : 1;
+
+    char buf1[32], buf2[32];
+    snprintf(buf1, sizeof(buf1), "%.10" PRId64, a_time1);
+    snprintf(buf2, sizeof(buf2), "%.10" PRId64, a_time2);
+    return strcmp(buf1, buf2);
+}
+
+/* Number of bytes that a string has allocated from the heap */
+static size_t
+heapSize(const std::string & a_str)
+{
+    const char *data = a_str.data();
+
+    // short strings can be stored in the string object itself
+    if ((data >= (const char *) &a_str)
+        && (data < (const char *) (&a_str + 1)))
+        return 0;
+    return a_str.capacity() + 1 + TSK_TIMELINE_ALLOC_OVERHEAD;
+}
+
+/* Comparison for sorting the body file lines by name, with the last line
+ * with a name first. */
+struct TskTimeline::line_cmp {
+    bool operator() (const line & a, const line & b) const {
+        int c = a.key.compare(a.name, std::string::npos, b.key, b.name,
+            std::string::npos);
+        if (c != 0)
+            return c < 0;
+        return a.seq > b.seq;
+    }
+};
+
+/* Comparison for sorting the records into the timeline.  Sorting by the
+ * time and then the meta address and name (as a string) gives the same
+ * order that mactime does. */
+struct TskTimeline::record_cmp {
+    bool operator() (const record & a, const record & b) const {
+        int c = timeCompare(a.time, b.time);
+        if (c != 0)
+            return c < 0;
+        c = a.key.compare(b.key);
+        if (c != 0)
+            return c < 0;
+        return a.seq < b.seq;
+    }
+};
+
+/* Comparison for the queue of runs in mergeRuns().  priority_queue returns
+ * the largest, so this compares in reverse. */
+template < class T, class Cmp > struct TskTimelineHeadCmp {
+    const std::vector<T> *heads;
+    bool operator() (size_t a, size_t b) const {
+        return Cmp()((*heads)[b], (*heads)[a]);
+    }
+};
+
+
+TskTimeline::TskTimeline()
+{
+    m_start = 0;
+    m_end = 0;
+    m_memLimit = TSK_TIMELINE_MEM_DEFAULT;
+    m_linesMem = 0;
+    m_recsMem = 0;
+    m_baseMem = 0;
+    m_seq = 0;
+    m_failed = false;
+    m_havePend = false;
+    m_haveName = false;
+    tsk_init_lock(&m_lock);
+}
+
+TskTimeline::~TskTimeline()
+{
+    clear();
+    tsk_deinit_lock(&m_lock);
+}
+
+/**
+ * Set the range of times to include in the timeline.  Times before a_start
+ * and times at or after a_end are dropped when lines are added.
+ * @param a_start First time to include
+ * @param a_end Time to stop at (or 0 for no end)
+ */
+void
+ TskTimeline::setTimeRange(time_t a_start, time_t a_end)
+{
+    m_start = a_start;
+    m_end = a_end;
+}
+
+/**
+ * Set the amount of memory that the entries can use before they are
+ * written to temporary files.  The default is TSK_TIMELINE_MEM_DEFAULT.
+ * @param a_bytes Number of bytes
+ */
+void
+ TskTimeline::setMemoryLimit(size_t a_bytes)
+{
+    m_memLimit = a_bytes;
+}
+
+/**
+ * Set the directory to make temporary files in.  By default, the system
+ * temporary directory is used.
+ * @param a_dir Directory to use (or NULL for the default)
+ */
+void
+ TskTimeline::setTempDir(const char *a_dir)
+{
+    m_tempDir = a_dir ? a_dir : "";
+}
+
+/* Free the lines and records and close the runs */
+void
+ TskTimeline::clear()
+{
+    std::vector<line>().swap(m_lines);
+    m_linesMem = 0;
+    closeRuns(m_lineRuns);
+    std::vector<record>().swap(m_recs);
+    m_recsMem = 0;
+    closeRuns(m_runs);
+    m_baseMem = 0;
+    m_seq = 0;
+    m_failed = false;
+    m_havePend = false;
+    m_haveName = false;
+}
+
+void
+ TskTimeline::closeRuns(std::vector<FILE *> &a_runs)
+{
+    for (size_t i = 0; i < a_runs.size(); i++)
+        fclose(a_runs[i]);
+    a_runs.clear();
+}
+
+/* Open a temporary file that is deleted when it is closed.
+ * Returns NULL on error. */
+FILE *
+TskTimeline::openTemp()
+{
+    FILE *hFile = NULL;
+
+    if (m_tempDir.empty()) {
+        hFile = tmpfile();
+    }
+    else {
+#ifdef TSK_WIN32
+        char *name = _tempnam(m_tempDir.c_str(), "tsk");
+        if (name) {
+            hFile = fopen(name, "w+bD");
+            free(name);
+        }
+#else
+        std::string name = m_tempDir + "/tsk_timelineXXXXXX";
+        std::vector<char> buf(name.begin(), name.end());
+        buf.push_back('\0');
+        int fd = mkstemp(&buf[0]);
+        if (fd != -1) {
+            unlink(&buf[0]);
+            if ((hFile = fdopen(fd, "w+b")) == NULL)
+                close(fd);
+        }
+#endif
+    }
+
+    if (hFile == NULL) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_AUTO_TEMP);
+        tsk_error_set_errstr("TskTimeline: Error creating temporary file in %s",
+            m_tempDir.empty() ? "default directory" : m_tempDir.c_str());
+    }
+    return hFile;
+}
+
+static void
+tempError(const char *a_what)
+{
+    tsk_error_reset();
+    tsk_error_set_errno(TSK_ERR_AUTO_TEMP);
+    tsk_error_set_errstr("TskTimeline: Error %s temporary file", a_what);
+}
+
+static bool
+writeStr(FILE * a_hFile, const std::string & a_str)
+{
+    uint32_t len = (uint32_t) a_str.size();
+    return (fwrite(&len, sizeof(len), 1, a_hFile) == 1)
+        && (fwrite(a_str.data(), 1, len, a_hFile) == len);
+}
+
+static bool
+readStr(FILE * a_hFile, std::string & a_str)
+{
+    uint32_t len;
+    if (fread(&len, sizeof(len), 1, a_hFile) != 1)
+        return false;
+    a_str.resize(len);
+    return (len == 0) || (fread(&a_str[0], 1, len, a_hFile) == len);
+}
+
+/* Write a line to a temporary file.  Returns 1 on error. */
+uint8_t
+TskTimeline::line::write(FILE * a_hFile) const
+{
+    if ((fwrite(times, sizeof(times), 1, a_hFile) != 1)
+        || (fwrite(&seq, sizeof(seq), 1, a_hFile) != 1)
+        || (fwrite(flags, sizeof(flags), 1, a_hFile) != 1)
+        || (writeStr(a_hFile, key) == false)
+        || (writeStr(a_hFile, attrs) == false)) {
+        tempError("writing");
+        return 1;
+    }
+    return 0;
+}
+
+/* Read a line that write() wrote.
+ * Returns 1 if a line was read, 0 at the end of the file, and -1 on error. */
+int
+TskTimeline::line::read(FILE * a_hFile)
+{
+    if (fread(times, sizeof(times), 1, a_hFile) != 1) {
+        if (feof(a_hFile))
+            return 0;
+    }
+    else if ((fread(&seq, sizeof(seq), 1, a_hFile) == 1)
+        && (fread(flags, sizeof(flags), 1, a_hFile) == 1)
+        && (readStr(a_hFile, key)) && (readStr(a_hFile, attrs))) {
+        name = (uint32_t) key.find(',') + 1;
+        return 1;
+    }
+    tempError("reading");
+    return -1;
+}
+
+/* Write a record to a temporary file.  Returns 1 on error. */
+uint8_t
+TskTimeline::record::write(FILE * a_hFile) const
+{
+    if ((fwrite(&time, sizeof(time), 1, a_hFile) != 1)
+        || (fwrite(&seq, sizeof(seq), 1, a_hFile) != 1)
+        || (fwrite(&flags, sizeof(flags), 1, a_hFile) != 1)
+        || (writeStr(a_hFile, key) == false)
+        || (writeStr(a_hFile, attrs) == false)) {
+        tempError("writing");
+        return 1;
+    }
+    return 0;
+}
+
+/* Read a record that write() wrote.
+ * Returns 1 if a record was read, 0 at the end of the file, and -1 on error. */
+int
+TskTimeline::record::read(FILE * a_hFile)
+{
+    if (fread(&time, sizeof(time), 1, a_hFile) != 1) {
+        if (feof(a_hFile))
+            return 0;
+    }
+    else if ((fread(&seq, sizeof(seq), 1, a_hFile) == 1)
+        && (fread(&flags, sizeof(flags), 1, a_hFile) == 1)
+        && (readStr(a_hFile, key)) && (readStr(a_hFile, attrs)))
+        return 1;
+    tempError("reading");
+    return -1;
+}
+
+/* Sort the lines or records in memory and write them to a new run.  Their
+ * memory is freed.  Must be called with m_lock held (or from walkEvents()).
+ * Returns 1 on error. */
+template < class T, class Cmp > uint8_t
+TskTimeline::spillRun(std::vector<T> &a_recs, size_t & a_mem,
+    std::vector<FILE *> &a_runs)
+{
+    FILE *hFile;
+
+    if ((hFile = openTemp()) == NULL)
+        return 1;
+    a_runs.push_back(hFile);
+
+    std::sort(a_recs.begin(), a_recs.end(), Cmp());
+    for (size_t i = 0; i < a_recs.size(); i++) {
+        if (a_recs[i].write(hFile))
+            return 1;
+    }
+    std::vector<T>().swap(a_recs);
+    a_mem = 0;
+
+    if (tsk_verbose)
+        tsk_fprintf(stderr,
+            "TskTimeline::spillRun: Wrote run %" PRIu64 "\n",
+            (uint64_t) a_runs.size());
+    return 0;
+}
+
+/* Add a line or record to a_recs and write them to a run if they use
+ * more memory than the limit.  a_mem has the memory used by the strings
+ * in a_recs.  Must be called with m_lock held (or from walkEvents()).
+ * Returns 1 on error. */
+template < class T, class Cmp > uint8_t
+TskTimeline::addRec(std::vector<T> &a_recs, size_t & a_mem,
+    std::vector<FILE *> &a_runs, const T & a_rec)
+{
+    /* the vector is counted by its capacity, which is what it allocated.
+     * Spill before it grows past the limit, because the old and new
+     * arrays are both allocated while it grows. */
+    if ((a_recs.size() == a_recs.capacity()) && (a_recs.empty() == false)
+        && (3 * a_recs.capacity() * sizeof(T) + a_mem + m_baseMem >
+            m_memLimit) && (spillRun<T, Cmp>(a_recs, a_mem, a_runs)))
+        return 1;
+
+    a_recs.push_back(a_rec);
+    a_mem += heapSize(a_recs.back().key) + heapSize(a_recs.back().attrs);
+    if (a_recs.capacity() * sizeof(T) + a_mem + m_baseMem > m_memLimit)
+        return spillRun<T, Cmp>(a_recs, a_mem, a_runs);
+    return 0;
+}
+
+/* decode the %XX escapes that mactime allows in body file fields */
+static void
+decodeField(std::string & a_field)
+{
+    size_t out = 0;
+
+    if (a_field.find('%') == std::string::npos)
+        return;
+
+    for (size_t i = 0; i < a_field.size(); i++) {
+        if ((a_field[i] == '%') && (i + 2 < a_field.size())
+            && (isxdigit((unsigned char) a_field[i + 1]))
+            && (isxdigit((unsigned char) a_field[i + 2]))) {
+            char hex[3] = { a_field[i + 1], a_field[i + 2], '\0' };
+            a_field[out++] = (char) strtoul(hex, NULL, 16);
+            i += 2;
+        }
+        else {
+            a_field[out++] = a_field[i];
+        }
+    }
+    a_field.resize(out);
+}
+
+static bool
+hasDigit(const std::string & a_str)
+{
+    for (size_t i = 0; i < a_str.size(); i++) {
+        if (isdigit((unsigned char) a_str[i]))
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Add a line from a body file to the timeline.  Comment lines and lines
+ * that are not in the body file format are ignored, like mactime does.
+ * @param a_line Line to add (the trailing newline is optional)
+ * @returns 1 on error (writing a temporary file) and 0 on success
+ */
+uint8_t
+TskTimeline::addBodyLine(const char *a_line)
+{
+    std::vector<std::string> fields;
+    size_t len = strlen(a_line);
+    size_t i;
+
+    // skip comments and blank lines
+    if (a_line[0] == '#')
+        return 0;
+    for (i = 0; i < len; i++) {
+        if (!isspace((unsigned char) a_line[i]))
+            break;
+    }
+    if (i == len)
+        return 0;
+
+    if (a_line[len - 1] == '\n')
+        len--;
+
+    // MD5|name|inode|mode_as_string|UID|GID|size|atime|mtime|ctime|crtime
+    const char *cur = a_line;
+    const char *end = a_line + len;
+    while (1) {
+        const char *sep = (const char *) memchr(cur, '|', end - cur);
+        fields.push_back(std::string(cur, sep ? sep : end));
+        if (sep == NULL)
+            break;
+        cur = sep + 1;
+    }
+    if (fields.size() < 11)
+        return 0;
+    for (i = 0; i < fields.size(); i++)
+        decodeField(fields[i]);
+
+    // sanity checks so that we ignore headers and other bad data
+    const std::string & meta = fields[2];
+    if (meta.find_first_of("0123456789-") == std::string::npos)
+        return 0;
+    for (i = 4; i < 11; i++) {
+        if (hasDigit(fields[i]) == false)
+            return 0;
+    }
+
+    // we need *some* value in the times
+    if ((fields[7] == "0") && (fields[8] == "0") && (fields[9] == "0")
+        && (fields[10] == "0"))
+        return 0;
+
+    /* mactime does not print the entries of a line whose meta address is
+     * not just digits and dashes or whose name has a newline, but its
+     * attributes are still used for the other lines with the name. */
+    bool printable = (meta.find_first_not_of("0123456789-") ==
+        std::string::npos) && (fields[1].find('\n') == std::string::npos);
+
+    int64_t times[4];
+    static const uint8_t tflags[4] = { TSK_TIMELINE_FLAG_ATIME,
+        TSK_TIMELINE_FLAG_MTIME, TSK_TIMELINE_FLAG_CTIME,
+        TSK_TIMELINE_FLAG_CRTIME
+    };
+    uint8_t flags[4] = { 0, 0, 0, 0 };
+    bool tooEarly = true;
+    for (i = 0; i < 4; i++) {
+        times[i] = strtoll(fields[7 + i].c_str(), NULL, 10);
+        if (times[i] >= (int64_t) m_start)
+            tooEarly = false;
+        if ((printable) && (times[i] >= 0)
+            && (times[i] >= (int64_t) m_start)
+            && ((m_end == 0) || (times[i] < (int64_t) m_end)))
+            flags[i] = tflags[i];
+    }
+    // like mactime, lines with only times before the range are ignored
+    if (tooEarly)
+        return 0;
+    // merge the flags of times that are the same
+    for (i = 0; i < 4; i++) {
+        if (flags[i] == 0)
+            continue;
+        for (size_t j = i + 1; j < 4; j++) {
+            if ((flags[j]) && (times[j] == times[i])) {
+                flags[i] |= flags[j];
+                flags[j] = 0;
+            }
+        }
+    }
+
+    line ln;
+    for (i = 0; i < 4; i++) {
+        ln.times[i] = times[i];
+        ln.flags[i] = flags[i];
+    }
+    // a line without entries still gives the attributes for its name
+    ln.key = (printable ? meta : std::string()) + "," + fields[1];
+    ln.name = (uint32_t) (ln.key.size() - fields[1].size());
+    ln.attrs = fields[3] + ":" + fields[4] + ":" + fields[5] + ":"
+        + fields[6];
+
+    uint8_t retval = 0;
+    tsk_take_lock(&m_lock);
+    if (m_failed) {
+        tsk_release_lock(&m_lock);
+        return 1;
+    }
+    ln.seq = m_seq++;
+    if (addRec<line, line_cmp>(m_lines, m_linesMem, m_lineRuns, ln)) {
+        m_failed = true;
+        retval = 1;
+    }
+    tsk_release_lock(&m_lock);
+    return retval;
+}
+
+/**
+ * Add the lines in a body file to the timeline.
+ * @param a_hFile File to read from
+ * @returns 1 on error and 0 on success
+ */
+uint8_t
+TskTimeline::addBodyFile(FILE * a_hFile)
+{
+    char buf[4096];
+    std::string line;
+
+    while (fgets(buf, sizeof(buf), a_hFile) != NULL) {
+        size_t len = strlen(buf);
+        line.append(buf, len);
+        if ((len == 0) || (buf[len - 1] != '\n'))
+            continue;
+        if (addBodyLine(line.c_str()))
+            return 1;
+        line.clear();
+    }
+    if (ferror(a_hFile)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_AUTO_CORRUPT);
+        tsk_error_set_errstr("TskTimeline::addBodyFile: Error reading file");
+        return 1;
+    }
+    if ((line.empty() == false) && (addBodyLine(line.c_str())))
+        return 1;
+    return 0;
+}
+
+/* Pass the merged record to processEvent() */
+TSK_RETVAL_ENUM
+TskTimeline::flushPend()
+{
+    if (m_havePend == false)
+        return TSK_OK;
+    m_havePend = false;
+
+    size_t comma = m_pend.key.find(',');
+    m_event.time = (time_t) m_pend.time;
+    m_event.flags = m_pend.flags;
+    m_event.meta.assign(m_pend.key, 0, comma);
+    m_event.name.assign(m_pend.key, comma + 1, std::string::npos);
+
+    // the attributes are split like mactime does
+    std::string *attrs[4] =
+        { &m_event.mode, &m_event.uid, &m_event.gid, &m_event.size };
+    size_t start = 0;
+    for (int i = 0; i < 4; i++) {
+        size_t sep = (i < 3) ? m_pend.attrs.find(':', start) : std::string::npos;
+        if (start > m_pend.attrs.size())
+            attrs[i]->clear();
+        else
+            attrs[i]->assign(m_pend.attrs, start,
+                (sep == std::string::npos) ? std::string::npos : sep - start);
+        start = (sep == std::string::npos) ? m_pend.attrs.size() + 1 : sep + 1;
+    }
+
+    return processEvent(m_event);
+}
+
+/* Records arrive here in sorted order.  Records with the same time and key
+ * are merged before they are passed on. */
+TSK_RETVAL_ENUM
+TskTimeline::deliver(const record & a_rec)
+{
+    if (m_havePend && (m_pend.time == a_rec.time)
+        && (m_pend.key == a_rec.key)) {
+        m_pend.flags |= a_rec.flags;
+        m_pend.attrs = a_rec.attrs;
+        return TSK_OK;
+    }
+
+    TSK_RETVAL_ENUM retval = flushPend();
+    m_pend = a_rec;
+    m_havePend = true;
+    return retval;
+}
+
+/* Lines arrive here sorted by name, with the last line with a name first.
+ * Their entries are given the attributes of that line and are added to
+ * m_recs to be sorted by time. */
+TSK_RETVAL_ENUM
+TskTimeline::addNamed(line & a_line)
+{
+    if ((m_haveName == false)
+        || (a_line.key.compare(a_line.name, std::string::npos,
+                m_name) != 0)) {
+        m_name.assign(a_line.key, a_line.name, std::string::npos);
+        m_nameAttrs = a_line.attrs;
+        m_haveName = true;
+    }
+
+    record rec;
+    rec.seq = a_line.seq;
+    for (int i = 0; i < 4; i++) {
+        if (a_line.flags[i] == 0)
+            continue;
+        rec.time = a_line.times[i];
+        rec.flags = a_line.flags[i];
+        if (rec.key.empty()) {
+            rec.key = a_line.key;
+            rec.attrs = m_nameAttrs;
+        }
+        if (addRec<record, record_cmp>(m_recs, m_recsMem, m_runs, rec))
+            return TSK_ERR;
+    }
+    return TSK_OK;
+}
+
+TSK_RETVAL_ENUM
+TskTimeline::consume(line & a_line)
+{
+    return addNamed(a_line);
+}
+
+TSK_RETVAL_ENUM
+TskTimeline::consume(record & a_rec)
+{
+    return deliver(a_rec);
+}
+
+/* Merge sorted runs of lines or records.  If a_out is not NULL, they are
+ * written to it, else they are passed to consume().
+ * Returns 1 on error and 0 on success (or if processing was stopped). */
+template < class T, class Cmp > uint8_t
+TskTimeline::mergeRuns(std::vector<FILE *> &a_runs, FILE * a_out)
+{
+    std::vector<T> heads(a_runs.size());
+
+    TskTimelineHeadCmp<T, Cmp> cmp;
+    cmp.heads = &heads;
+    std::priority_queue<size_t, std::vector<size_t>,
+        TskTimelineHeadCmp<T, Cmp> > queue(cmp);
+
+    for (size_t i = 0; i < a_runs.size(); i++) {
+        if (fflush(a_runs[i]) || fseek(a_runs[i], 0, SEEK_SET)) {
+            tempError("rewinding");
+            return 1;
+        }
+        int ret = heads[i].read(a_runs[i]);
+        if (ret == -1)
+            return 1;
+        else if (ret == 1)
+            queue.push(i);
+    }
+
+    while (queue.empty() == false) {
+        size_t idx = queue.top();
+        queue.pop();
+
+        if (a_out) {
+            if (heads[idx].write(a_out))
+                return 1;
+        }
+        else {
+            TSK_RETVAL_ENUM retval = consume(heads[idx]);
+            if (retval != TSK_OK) {
+                m_havePend = false;
+                return (retval == TSK_ERR) ? 1 : 0;
+            }
+        }
+
+        int ret = heads[idx].read(a_runs[idx]);
+        if (ret == -1)
+            return 1;
+        else if (ret == 1)
+            queue.push(idx);
+    }
+    return 0;
+}
+
+/* Merge groups of runs until they can all be merged at once.
+ * Returns 1 on error. */
+template < class T, class Cmp > uint8_t
+TskTimeline::reduceRuns(std::vector<FILE *> &a_runs)
+{
+    while (a_runs.size() > TSK_TIMELINE_MERGE_WAYS) {
+        std::vector<FILE *> group(a_runs.begin(),
+            a_runs.begin() + TSK_TIMELINE_MERGE_WAYS);
+        FILE *hFile = openTemp();
+        if ((hFile == NULL) || (mergeRuns<T, Cmp>(group, hFile))) {
+            if (hFile)
+                fclose(hFile);
+            return 1;
+        }
+        closeRuns(group);
+        a_runs.erase(a_runs.begin(),
+            a_runs.begin() + TSK_TIMELINE_MERGE_WAYS);
+        a_runs.push_back(hFile);
+    }
+    return 0;
+}
+
+/* Sort the lines by name and pass them to addNamed().
+ * Returns 1 on error. */
+uint8_t
+TskTimeline::nameLines()
+{
+    /* If the lines use more than half of the memory, they are written to
+     * a run so that the records have room. */
+    if ((m_lineRuns.empty())
+        && (m_lines.capacity() * sizeof(line) + m_linesMem <=
+            m_memLimit / 2)) {
+        std::sort(m_lines.begin(), m_lines.end(), line_cmp());
+
+        // the lines are counted until their strings are freed
+        m_baseMem = m_lines.capacity() * sizeof(line) + m_linesMem;
+        for (size_t i = 0; i < m_lines.size(); i++) {
+            line & ln = m_lines[i];
+            size_t mem = heapSize(ln.key) + heapSize(ln.attrs);
+            if (addNamed(ln) != TSK_OK)
+                return 1;
+            std::string().swap(ln.key);
+            std::string().swap(ln.attrs);
+            m_baseMem -= mem;
+        }
+        std::vector<line>().swap(m_lines);
+        m_linesMem = 0;
+        m_baseMem = 0;
+        return 0;
+    }
+
+    if ((m_lines.empty() == false)
+        && (spillRun<line, line_cmp>(m_lines, m_linesMem, m_lineRuns)))
+        return 1;
+    if (reduceRuns<line, line_cmp>(m_lineRuns)
+        || mergeRuns<line, line_cmp>(m_lineRuns, NULL))
+        return 1;
+    closeRuns(m_lineRuns);
+    return 0;
+}
+
+/**
+ * Sort the entries that were added and pass them to processEvent().
+ * The timeline is empty after this returns, so it can be reused.
+ * @returns 1 on error and 0 on success
+ */
+uint8_t
+TskTimeline::walkEvents()
+{
+    uint8_t retval = 0;
+
+    /* The lines are first sorted by name so that each entry can be given
+     * the attributes of the last line with its name (like mactime does).
+     * The entries are then sorted by time. */
+    if ((m_failed) || (nameLines())) {
+        clear();
+        return 1;
+    }
+
+    if (m_runs.empty()) {
+        // everything fit in memory
+        std::sort(m_recs.begin(), m_recs.end(), record_cmp());
+        for (size_t i = 0; i < m_recs.size(); i++) {
+            TSK_RETVAL_ENUM ret = deliver(m_recs[i]);
+            if (ret != TSK_OK) {
+                m_havePend = false;
+                if (ret == TSK_ERR)
+                    retval = 1;
+                break;
+            }
+        }
+    }
+    else {
+        if (((m_recs.empty() == false)
+                && (spillRun<record, record_cmp>(m_recs, m_recsMem,
+                        m_runs)))
+            || (reduceRuns<record, record_cmp>(m_runs))) {
+            clear();
+            return 1;
+        }
+        retval = mergeRuns<record, record_cmp>(m_runs, NULL);
+    }
+
+    if ((retval == 0) && (flushPend() == TSK_ERR))
+        retval = 1;
+    clear();
+    return retval;
+}
+
+
+
+static const char *tsk_mactime_days[] =
+    { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+static const char *tsk_mactime_months[] =
+    { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct",
+    "Nov", "Dec"
+};
+
+/**
+ * Create an object that prints the timeline.
+ * @param a_hFile File to print the timeline to
+ */
+TskMactime::TskMactime(FILE * a_hFile)
+{
+    m_hFile = a_hFile;
+    m_delim = false;
+    m_iso = false;
+    m_monthNum = false;
+    m_hIndex = NULL;
+    m_hourly = false;
+    m_prevHour = 0;
+    m_prevCnt = 0;
+}
+
+/**
+ * Print the timeline in comma delimited format (the -d option of mactime).
+ */
+void
+ TskMactime::setDelimited(bool a_delim)
+{
+    m_delim = a_delim;
+}
+
+/**
+ * Print dates in ISO 8601 format and in UTC (the -y option of mactime).
+ */
+void
+ TskMactime::setIso8601(bool a_iso)
+{
+    m_iso = a_iso;
+}
+
+/**
+ * Print the month as a number instead of a word (the -m option of mactime).
+ */
+void
+ TskMactime::setMonthNum(bool a_monthNum)
+{
+    m_monthNum = a_monthNum;
+}
+
+/**
+ * Print a summary of the number of entries per day or hour (the -i option
+ * of mactime).  The caller prints the title of the index.
+ * @param a_hFile File to print the summary to
+ * @param a_hourly true for an hourly summary and false for a daily summary
+ */
+void
+ TskMactime::setIndex(FILE * a_hFile, bool a_hourly)
+{
+    m_hIndex = a_hFile;
+    m_hourly = a_hourly;
+}
+
+/* Read a passwd or group file and map the IDs to the names */
+uint8_t
+TskMactime::loadIds(const char *a_path,
+    std::map<std::string, std::string> &a_map)
+{
+    FILE *hFile;
+    char buf[1024];
+
+    if ((hFile = fopen(a_path, "r")) == NULL) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_AUTO_CORRUPT);
+        tsk_error_set_errstr("TskMactime: Error opening %s", a_path);
+        return 1;
+    }
+
+    while (fgets(buf, sizeof(buf), hFile) != NULL) {
+        std::string line(buf);
+        if (line.empty() == false)
+            line.erase(line.size() - 1);
+        if ((line.empty()) || (line[0] == '+'))
+            continue;
+
+        // name:password:id
+        size_t sep1 = line.find(':');
+        if ((sep1 == std::string::npos) || (sep1 == 0))
+            continue;
+        size_t sep2 = line.find(':', sep1 + 1);
+        if (sep2 == std::string::npos)
+            continue;
+        size_t sep3 = line.find(':', sep2 + 1);
+        std::string name = line.substr(0, sep1);
+        std::string id = line.substr(sep2 + 1,
+            (sep3 == std::string::npos) ? std::string::npos : sep3 - sep2 - 1);
+        if (id.empty())
+            continue;
+
+        std::map<std::string, std::string>::iterator it = a_map.find(id);
+        if (it == a_map.end())
+            a_map[id] = name;
+        else
+            it->second += " " + name;
+    }
+    fclose(hFile);
+    return 0;
+}
+
+/**
+ * Load a passwd file to print user names instead of UIDs (the -p option of mactime).
+ * @param a_path Path of the passwd file
+ * @returns 1 on error and 0 on success
+ */
+uint8_t
+TskMactime::loadPasswd(const char *a_path)
+{
+    return loadIds(a_path, m_uidNames);
+}
+
+/**
+ * Load a group file to print group names instead of GIDs (the -g option of mactime).
+ * @param a_path Path of the group file
+ * @returns 1 on error and 0 on success
+ */
+uint8_t
+TskMactime::loadGroup(const char *a_path)
+{
+    return loadIds(a_path, m_gidNames);
+}
+
+std::string TskMactime::mapId(const std::map<std::string,
+    std::string> &a_map, const std::string & a_id) const
+{
+    std::map<std::string, std::string>::const_iterator it =
+        a_map.find(a_id);
+    std::string name = (it == a_map.end())? a_id : it->second;
+
+    // put /'s between multiple names
+    for (size_t i = 0; i < name.size(); i++) {
+        if (isspace((unsigned char) name[i]))
+            name[i] = '/';
+    }
+    return name;
+}
+
+/* Print the index entry for m_prevDay and m_prevHour */
+void
+ TskMactime::printIndex()
+{
+    int mday, wday, mon, year;
+
+    if (sscanf(m_prevDay.c_str(), "%d %d %d %d", &mday, &wday, &mon,
+            &year) != 4)
+        return;
+
+    if (m_monthNum)
+        fprintf(m_hIndex, "%s %02d %02d %d", tsk_mactime_days[wday], mon,
+            mday, year);
+    else
+        fprintf(m_hIndex, "%s %s %02d %d", tsk_mactime_days[wday],
+            tsk_mactime_months[mon - 1], mday, year);
+    if (m_hourly)
+        fprintf(m_hIndex, " %02d:00:00", m_prevHour);
+    fprintf(m_hIndex, "%s %" PRIu64 "\n", m_delim ? "," : ":", m_prevCnt);
+}
+
+TSK_RETVAL_ENUM TskMactime::processEvent(const event & a_event)
+{
+    struct tm *tmTime;
+    char date[64];
+    char day[64];
+    char macb[5];
+
+    if (m_iso)
+        tmTime = gmtime(&a_event.time);
+    else
+        tmTime = localtime(&a_event.time);
+    if (tmTime == NULL) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_AUTO_CORRUPT);
+        tsk_error_set_errstr("TskMactime: Error converting time %" PRIu64,
+            (uint64_t) a_event.time);
+        return TSK_ERR;
+    }
+
+    if (m_iso) {
+        if (a_event.time == 0)
+            snprintf(date, sizeof(date), "0000-00-00T00:00:00Z");
+        else
+            snprintf(date, sizeof(date), "%d-%02d-%02dT%02d:%02d:%02dZ",
+                tmTime->tm_year + 1900, tmTime->tm_mon + 1,
+                tmTime->tm_mday, tmTime->tm_hour, tmTime->tm_min,
+                tmTime->tm_sec);
+    }
+    else if (a_event.time == 0) {
+        snprintf(date, sizeof(date), "Xxx Xxx 00 0000 00:00:00");
+    }
+    else if (m_monthNum) {
+        snprintf(date, sizeof(date), "%s %02d %02d %d %02d:%02d:%02d",
+            tsk_mactime_days[tmTime->tm_wday], tmTime->tm_mon + 1,
+            tmTime->tm_mday, tmTime->tm_year + 1900, tmTime->tm_hour,
+            tmTime->tm_min, tmTime->tm_sec);
+    }
+    else {
+        snprintf(date, sizeof(date), "%s %s %02d %d %02d:%02d:%02d",
+            tsk_mactime_days[tmTime->tm_wday],
+            tsk_mactime_months[tmTime->tm_mon], tmTime->tm_mday,
+            tmTime->tm_year + 1900, tmTime->tm_hour, tmTime->tm_min,
+            tmTime->tm_sec);
+    }
+
+    // only print the date if it is different from the one above
+    const char *dateStr = date;
+    if (m_oldDate == date) {
+        dateStr = m_iso ? "                    " : "                        ";
+        if (m_hIndex)
+            m_prevCnt++;
+    }
+    else {
+        m_oldDate = date;
+
+        if (m_hIndex) {
+            snprintf(day, sizeof(day), "%d %d %d %d", tmTime->tm_mday,
+                tmTime->tm_wday, tmTime->tm_mon + 1,
+                tmTime->tm_year + 1900);
+
+            if (m_prevDay.empty()) {
+                m_prevDay = day;
+                m_prevHour = tmTime->tm_hour;
+                m_prevCnt = 0;
+            }
+            else if (m_prevDay != day) {
+                printIndex();
+                m_prevCnt = 0;
+                m_prevDay = day;
+                m_prevHour = tmTime->tm_hour;
+            }
+            else if ((m_hourly) && (m_prevHour != tmTime->tm_hour)) {
+                printIndex();
+                m_prevCnt = 0;
+                m_prevHour = tmTime->tm_hour;
+            }
+            m_prevCnt++;
+        }
+    }
+
+    macb[0] = (a_event.flags & TSK_TIMELINE_FLAG_MTIME) ? 'm' : '.';
+    macb[1] = (a_event.flags & TSK_TIMELINE_FLAG_ATIME) ? 'a' : '.';
+    macb[2] = (a_event.flags & TSK_TIMELINE_FLAG_CTIME) ? 'c' : '.';
+    macb[3] = (a_event.flags & TSK_TIMELINE_FLAG_CRTIME) ? 'b' : '.';
+    macb[4] = '\0';
+
+    std::string uid = mapId(m_uidNames, a_event.uid);
+    std::string gid = mapId(m_gidNames, a_event.gid);
+
+    if (m_delim) {
+        // escape any quotes in the name
+        std::string name;
+        for (size_t i = 0; i < a_event.name.size(); i++) {
+            if (a_event.name[i] == '"')
+                name += '"';
+            name += a_event.name[i];
+        }
+        fprintf(m_hFile, "%s,%s,%s,%s,%s,%s,%s,\"%s\"\n",
+            m_oldDate.c_str(), a_event.size.c_str(), macb,
+            a_event.mode.c_str(), uid.c_str(), gid.c_str(),
+            a_event.meta.c_str(), name.c_str());
+    }
+    else {
+        fprintf(m_hFile, "%s %8s %3s %s %-8s %-8s %-8s %s\n", dateStr,
+            a_event.size.c_str(), macb, a_event.mode.c_str(), uid.c_str(),
+            gid.c_str(), a_event.meta.c_str(), a_event.name.c_str());
+    }
+    return TSK_OK;
+}
+
+/**
+ * Sort the entries that were added and print the timeline.
+ * @returns 1 on error and 0 on success
+ */
+uint8_t
+TskMactime::print()
+{
+    m_oldDate.clear();
+    m_prevDay.clear();
+    m_prevHour = 0;
+    m_prevCnt = 0;
+
+    if (m_delim)
+        fprintf(m_hFile, "Date,Size,Type,Mode,UID,GID,Meta,File Name\n");
+
+    uint8_t retval = walkEvents();
+
+    // finish the index for the last entry
+    if ((m_hIndex) && (m_prevCnt > 0))
+        printIndex();
+    return retval;
+}
+
+
+
+/**
+ * Create an object that adds the times in an image to a timeline.
+ * @param a_timeline Timeline to add the times to
+ */
+TskAutoTimeline::TskAutoTimeline(TskTimeline * a_timeline)
+{
+    m_timeline = a_timeline;
+    m_secSkew = 0;
+    m_hash = false;
+}
+
+/**
+ * Set the number of seconds to subtract from each time.
+ */
+void
+ TskAutoTimeline::setSecSkew(int32_t a_skew)
+{
+    m_secSkew = a_skew;
+}
+
+/**
+ * Calculate the MD5 hash of each file (slow).
+ */
+void
+ TskAutoTimeline::hashFiles(bool a_hash)
+{
+    m_hash = a_hash;
+}
+
+TSK_WALK_RET_ENUM
+TskAutoTimeline::lineCb(const char *a_line, void *a_ptr)
+{
+    TskTimeline *timeline = (TskTimeline *) a_ptr;
+    if (timeline->addBodyLine(a_line))
+        return TSK_WALK_ERROR;
+    return TSK_WALK_CONT;
+}
+
+TSK_FILTER_ENUM TskAutoTimeline::filterFs(TSK_FS_INFO * fs_info)
+{
+    char volName[32];
+    const vol_context *vol = getVolContext(fs_info);
+
+    if (vol)
+        snprintf(volName, sizeof(volName), "vol%" PRIuPNUM "/", vol->addr);
+    else
+        volName[0] = '\0';
+
+    TSK_FS_FLS_FLAG_ENUM fls_flags =
+        (TSK_FS_FLS_FLAG_ENUM) (TSK_FS_FLS_MAC | TSK_FS_FLS_DIR |
+        TSK_FS_FLS_FILE | TSK_FS_FLS_FULL);
+    if (m_hash)
+        fls_flags = (TSK_FS_FLS_FLAG_ENUM) (fls_flags | TSK_FS_FLS_HASH);
+
+    if (tsk_fs_fls_mac(fs_info, fls_flags, fs_info->root_inum,
+            (TSK_FS_DIR_WALK_FLAG_ENUM) (TSK_FS_DIR_WALK_FLAG_ALLOC |
+                TSK_FS_DIR_WALK_FLAG_UNALLOC |
+                TSK_FS_DIR_WALK_FLAG_RECURSE), volName, m_secSkew,
+            lineCb, m_timeline)) {
+        if (registerError())
+            return TSK_FILTER_STOP;
+    }
+
+    // the files were already processed
+    return TSK_FILTER_SKIP;
+}
+
+TSK_RETVAL_ENUM TskAutoTimeline::processFile(TSK_FS_FILE * fs_file,
+    const char *path)
+{
+    return TSK_OK;
+}
@@ -44,6 +44,25 @@ typedef enum {
 } TSK_FILTER_ENUM;
 
 
+/** \ingroup autolib
+ * A bool that can be read and set by several threads without a lock.
+ * It is used for flags that volume threads check often.
+ */
+class TskAutoFlag {
+  public:
+    TskAutoFlag() {
+        m_val = 0;
+    }
+    TskAutoFlag & operator=(bool a_val);
+    operator  bool() const;
+
+  private:
+    volatile long m_val;
+
+    TskAutoFlag(const TskAutoFlag &);
+};
+
+
 /** \ingroup autolib
  * C++ class that automatically analyzes a disk image to extract files from it.  This class
  * hides many of the details that are required to use lower-level TSK APIs to analyze volume 
@@ -59,6 +78,17 @@ typedef enum {
  * This class, by default, will not stop if an error occurs.  It registers the error into an 
  * internal list. Those can be retrieved with getErrorList().  If you want to deal with errors
  * differently, you must implement handleError(). 
+ *
+ * By default, everything is processed in the calling thread.  If setThreadCount() is used 
+ * to allow more than one thread, the file systems in the volumes of a volume system are 
+ * processed at the same time by a pool of threads.  In that case:
+ * - filterVs() and filterVol() are still called from the calling thread in volume order.
+ * - filterFs(), processFile(), processAttribute() and handleError() can be called from several
+ * threads at once.  All calls for a given file system come from the same thread and in the
+ * same order as they would without threads.  Implementations must protect any state that they
+ * share between file systems.
+ * - getCurVsPartDescr() and getCurVsPartFlag() refer to the last volume passed to filterVol().
+ * Use getVolContext() to find the volume that a file system is in.
  */
 class TskAuto {
   public:
@@ -95,6 +125,20 @@ class TskAuto {
 
     void setFileFilterFlags(TSK_FS_DIR_WALK_FLAG_ENUM);
     void setVolFilterFlags(TSK_VS_PART_FLAG_ENUM);
+    void setThreadCount(unsigned int);
+
+    /**
+     * Details about a volume whose file system is being processed.
+     */
+    struct vol_context {
+        TSK_PNUM_T addr;        ///< Address of the volume in the volume system
+        TSK_OFF_T start;        ///< Byte offset of the volume in the image
+        std::string descr;      ///< Description of the volume
+        TSK_VS_PART_FLAG_ENUM flags;    ///< Flags of the volume
+        TSK_FS_INFO *fs_info;   ///< File system in the volume (NULL until it is opened)
+    };
+
+    const vol_context *getVolContext(const TSK_FS_INFO * a_fs_info);
 
     /**
      * TskAuto calls this method before it processes the volume system that is found in an 
@@ -200,6 +244,10 @@ class TskAuto {
     TSK_VS_PART_FLAG_ENUM m_volFilterFlags;
     TSK_FS_DIR_WALK_FLAG_ENUM m_fileFilterFlags;
     std::vector<error_record> m_errors;
+    unsigned int m_threadCount; ///< Maximum number of threads to process volumes with
+    std::vector<vol_context *> m_vols;  ///< Volumes that are being (or will be) processed
+    size_t m_volNext;           ///< Index in m_vols of the next volume for a thread to process
+    tsk_lock_t m_lock;          ///< Protects m_vols, m_volNext, and m_errors
 
     // prevent copying until we add proper logic to handle it
     TskAuto(const TskAuto&);
@@ -211,6 +259,9 @@ class TskAuto {
         const TSK_VS_PART_INFO * vs_part, void *ptr);
 
     TSK_RETVAL_ENUM findFilesInFsInt(TSK_FS_INFO *, TSK_INUM_T inum);
+    TSK_RETVAL_ENUM findFilesInVol(vol_context *);
+    void findFilesInVols();
+    void processVolQueue();
 
     std::string m_curVsPartDescr; ///< description string of the current volume being processed
     TSK_VS_PART_FLAG_ENUM m_curVsPartFlag; ///< Flag of the current volume being processed
@@ -221,7 +272,7 @@ class TskAuto {
   protected:
     TSK_IMG_INFO * m_img_info;
     bool m_internalOpen;        ///< True if m_img_info was opened in TskAuto and false if passed in
-    bool m_stopAllProcessing;   ///< True if no further processing should occur
+    TskAutoFlag m_stopAllProcessing;    ///< True if no further processing should occur
     
     uint8_t isNtfsSystemFiles(TSK_FS_FILE * fs_file, const char *path);
     uint8_t isFATSystemFiles(TSK_FS_FILE * fs_file);
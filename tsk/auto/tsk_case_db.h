@@ -148,7 +148,8 @@ class TskAutoDb:public TskAuto {
         TSK_FS_BLOCK_FLAG_ENUM a_flags, void *ptr);
     int md5HashAttr(unsigned char md5Hash[16], const TSK_FS_ATTR * fs_attr);
 
-    static TSK_WALK_RET_ENUM fsWalkUnallocBlocksCb(const TSK_FS_BLOCK *a_block, void *a_ptr);
+    static TSK_WALK_RET_ENUM fsWalkUnallocBlocksCb(TSK_FS_INFO *a_fs, TSK_DADDR_T a_addr,
+        TSK_DADDR_T a_len, TSK_FS_BLOCK_FLAG_ENUM a_flags, const char *a_buf, void *a_ptr);
     int8_t addFsInfoUnalloc(const TSK_DB_FS_INFO & dbFsInfo);
     uint8_t addUnallocFsSpaceToDb(size_t & numFs);
     uint8_t addUnallocVsSpaceToDb(size_t & numVsP);
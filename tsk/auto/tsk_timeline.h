@@ -0,0 +1,241 @@
+/*
+ ** The Sleuth Kit
+ **
+ ** Brian Carrier [carrier <at> sleuthkit [dot] org]
+ ** Copyright (c) 2013 Brian Carrier.  All Rights reserved
+ **
+ ** This software is distributed under the Common Public License 1.0
+ **
+ */
+
+/**
+ * \file tsk_timeline.h
+ * Contains the class definitions for making timelines from body file data.
+ * Note that this file is not meant to be directly included.
+ * It is included by libtsk.h.
+ */
+
+#ifndef _TSK_TIMELINE_H
+#define _TSK_TIMELINE_H
+
+#ifdef __cplusplus
+
+#include "tsk_auto.h"
+
+#include <stdio.h>
+#include <time.h>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * Flags for the times that an entry in a timeline is for.
+ */
+typedef enum {
+    TSK_TIMELINE_FLAG_MTIME = 0x01,     ///< Content modification time
+    TSK_TIMELINE_FLAG_ATIME = 0x02,     ///< Content access time
+    TSK_TIMELINE_FLAG_CTIME = 0x04,     ///< Metadata change time
+    TSK_TIMELINE_FLAG_CRTIME = 0x08,    ///< Creation time
+} TSK_TIMELINE_FLAG_ENUM;
+
+#define TSK_TIMELINE_MEM_DEFAULT (128 * 1024 * 1024)    ///< Default memory limit (in bytes) for sorting
+
+/** \ingroup autolib
+ * C++ class that sorts the times in body file data (the format that 'fls -m'
+ * makes) into a timeline.  This does the work that the 'mactime' script does.
+ *
+ * Lines are added with addBodyLine() or addBodyFile() and the sorted entries
+ * are then passed to processEvent() by walkEvents().  Each entry is for one
+ * time of one file name and its flags show which of the file's times have
+ * that value.  Entries are sorted by time and then by the meta address and name
+ * (as a string).  If more than one line has the same time, meta address,
+ * and name, the entries are merged.  Like mactime, the mode, UID, GID, and
+ * size of every entry are those of the last line with the same name (even if
+ * it is for a different meta address, such as in another file system).
+ *
+ * Times outside of the range given to setTimeRange() are dropped when the lines are
+ * added.  When the entries use more memory than setMemoryLimit() allows,
+ * they are sorted and written to a temporary file.  walkEvents() merges those files
+ * (the lines by name to find the attributes and then the entries by time),
+ * so the memory that is used does not grow with the number of lines.
+ *
+ * addBodyLine() can be called from more than one thread at a time.
+ */
+class TskTimeline {
+  public:
+    TskTimeline();
+    virtual ~ TskTimeline();
+
+    /**
+     * An entry in the timeline.
+     */
+    struct event {
+        time_t time;            ///< Time of the entry
+        uint8_t flags;          ///< Times that have this value (TSK_TIMELINE_FLAG_ENUM)
+        std::string meta;       ///< Meta data address (as it is in the body file)
+        std::string name;       ///< File name
+        std::string mode;       ///< Mode string
+        std::string uid;        ///< User ID
+        std::string gid;        ///< Group ID
+        std::string size;       ///< Size
+    };
+
+    void setTimeRange(time_t a_start, time_t a_end);
+    void setMemoryLimit(size_t a_bytes);
+    void setTempDir(const char *a_dir);
+
+    uint8_t addBodyLine(const char *a_line);
+    uint8_t addBodyFile(FILE * a_hFile);
+    uint8_t walkEvents();
+
+    /**
+     * Method that is called by walkEvents() for each entry in the timeline, in
+     * sorted order.
+     * @param a_event Entry in the timeline
+     * @returns TSK_OK to continue, TSK_STOP to stop, and TSK_ERR on error (which
+     * must be registered with tsk_error_set_errno()).
+     */
+    virtual TSK_RETVAL_ENUM processEvent(const event & a_event) = 0;
+
+  private:
+    struct line {
+        int64_t times[4];       ///< mtime, atime, ctime, and crtime
+        uint64_t seq;           ///< Order that the line was added in
+        uint8_t flags[4];       ///< Flags of the entry for each time (0 if there is none)
+        uint32_t name;          ///< Offset of the name in key
+        std::string key;        ///< "meta,name"
+        std::string attrs;      ///< "mode:uid:gid:size"
+
+        uint8_t write(FILE * a_hFile) const;
+        int read(FILE * a_hFile);
+    };
+    struct record {
+        int64_t time;
+        uint64_t seq;           ///< Order that the line was added in
+        uint8_t flags;
+        std::string key;        ///< "meta,name"
+        std::string attrs;      ///< "mode:uid:gid:size"
+
+        uint8_t write(FILE * a_hFile) const;
+        int read(FILE * a_hFile);
+    };
+    struct line_cmp;
+    struct record_cmp;
+
+    time_t m_start;
+    time_t m_end;
+    size_t m_memLimit;
+    std::string m_tempDir;
+
+    std::vector<line> m_lines;  ///< Lines that have not been written to a run yet
+    size_t m_linesMem;          ///< Approximate heap memory used by the strings in m_lines
+    std::vector<FILE *> m_lineRuns;     ///< Temporary files with runs of lines sorted by name
+    std::vector<record> m_recs; ///< Entries that have not been written to a run yet
+    size_t m_recsMem;           ///< Approximate heap memory used by the strings in m_recs
+    std::vector<FILE *> m_runs; ///< Temporary files with runs of entries sorted by time
+    size_t m_baseMem;           ///< Memory used by the lines while the entries are made
+    uint64_t m_seq;
+    bool m_failed;              ///< True if an error occurred while adding lines
+    tsk_lock_t m_lock;          ///< Protects the members that addBodyLine() uses
+
+    record m_pend;              ///< Entry that walkEvents() is merging equal entries into
+    bool m_havePend;
+    event m_event;
+    std::string m_name;         ///< Name that walkEvents() is giving attributes to
+    std::string m_nameAttrs;    ///< Attributes of the last line with that name
+    bool m_haveName;
+
+    // prevent copying
+    TskTimeline(const TskTimeline &);
+    TskTimeline & operator=(const TskTimeline &);
+
+    FILE *openTemp();
+    void closeRuns(std::vector<FILE *> &a_runs);
+    template < class T, class Cmp > uint8_t spillRun(std::vector<T> &a_recs,
+        size_t & a_mem, std::vector<FILE *> &a_runs);
+    template < class T, class Cmp > uint8_t addRec(std::vector<T> &a_recs,
+        size_t & a_mem, std::vector<FILE *> &a_runs, const T & a_rec);
+    template < class T, class Cmp > uint8_t mergeRuns(std::vector<FILE *>
+        &a_runs, FILE * a_out);
+    template < class T, class Cmp > uint8_t reduceRuns(std::vector<FILE *>
+        &a_runs);
+    uint8_t nameLines();
+    TSK_RETVAL_ENUM addNamed(line & a_line);
+    TSK_RETVAL_ENUM consume(line & a_line);
+    TSK_RETVAL_ENUM consume(record & a_rec);
+    TSK_RETVAL_ENUM deliver(const record & a_rec);
+    TSK_RETVAL_ENUM flushPend();
+    void clear();
+};
+
+
+/** \ingroup autolib
+ * C++ class that prints a timeline in the same format as the 'mactime' script.
+ * The options match those of mactime.  The index (-i) and header (-h) text
+ * that mactime prints before the timeline must be printed by the caller.
+ */
+class TskMactime:public TskTimeline {
+  public:
+    TskMactime(FILE * a_hFile);
+
+    void setDelimited(bool a_delim);
+    void setIso8601(bool a_iso);
+    void setMonthNum(bool a_monthNum);
+    void setIndex(FILE * a_hFile, bool a_hourly);
+    uint8_t loadPasswd(const char *a_path);
+    uint8_t loadGroup(const char *a_path);
+
+    uint8_t print();
+    virtual TSK_RETVAL_ENUM processEvent(const event & a_event);
+
+  private:
+    FILE *m_hFile;
+    bool m_delim;
+    bool m_iso;
+    bool m_monthNum;
+    FILE *m_hIndex;
+    bool m_hourly;
+    std::map<std::string, std::string> m_uidNames;
+    std::map<std::string, std::string> m_gidNames;
+
+    std::string m_oldDate;      ///< Last date that was printed
+    std::string m_prevDay;      ///< "mday wday mon year" of the current index entry
+    int m_prevHour;
+    uint64_t m_prevCnt;
+
+    uint8_t loadIds(const char *a_path,
+        std::map<std::string, std::string> &a_map);
+    std::string mapId(const std::map<std::string, std::string> &a_map,
+        const std::string & a_id) const;
+    void printIndex();
+};
+
+
+/** \ingroup autolib
+ * C++ class that adds the times of the files in an image to a TskTimeline.
+ * This makes the same lines that tsk_gettimes does, but they are passed directly
+ * to the timeline instead of to a body file.  File systems in a volume system
+ * are given a "volX/" prefix.
+ */
+class TskAutoTimeline:public TskAuto {
+  public:
+    TskAutoTimeline(TskTimeline * a_timeline);
+
+    void setSecSkew(int32_t a_skew);
+    void hashFiles(bool a_hash);
+
+    virtual TSK_FILTER_ENUM filterFs(TSK_FS_INFO * fs_info);
+    virtual TSK_RETVAL_ENUM processFile(TSK_FS_FILE * fs_file,
+        const char *path);
+
+  private:
+    TskTimeline * m_timeline;
+    int32_t m_secSkew;
+    bool m_hash;
+
+    static TSK_WALK_RET_ENUM lineCb(const char *a_line, void *a_ptr);
+};
+
+#endif
+
+#endif
@@ -156,6 +156,18 @@ extern "C" {
     extern void tsk_list_free(TSK_LIST * list);
 
 
+    typedef struct TSK_BITMAP TSK_BITMAP;
+    /**
+    * Sparse set of 64-bit keys.  Keys are grouped into chunks that are stored
+    * either as a sorted array or as a bitmap, whichever is smaller.  Use this
+    * instead of TSK_LIST when the set can get large or is searched often.
+    */
+    extern uint8_t tsk_bitmap_find(const TSK_BITMAP * map, uint64_t key);
+    extern uint8_t tsk_bitmap_add(TSK_BITMAP ** map, uint64_t key);
+    extern uint64_t tsk_bitmap_count(const TSK_BITMAP * map);
+    extern void tsk_bitmap_free(TSK_BITMAP * map);
+
+
     // note that the stack code is in this file and not internal for convenience to users
     /**
      * Basic stack structure to push and pop (used for finding loops in recursion).
@@ -372,7 +384,8 @@ extern "C" {
 #define TSK_ERR_AUTO_CORRUPT (TSK_ERR_AUTO | 1)
 #define TSK_ERR_AUTO_UNICODE (TSK_ERR_AUTO | 2)
 #define TSK_ERR_AUTO_NOTOPEN (TSK_ERR_AUTO | 3)
-#define TSK_ERR_AUTO_MAX 4
+#define TSK_ERR_AUTO_TEMP (TSK_ERR_AUTO | 4)
+#define TSK_ERR_AUTO_MAX 5
 //@}
 
 
@@ -39,6 +39,36 @@ extern "C" {
     extern void tsk_take_lock(tsk_lock_t *);
     extern void tsk_release_lock(tsk_lock_t *);
 
+/* Loads and stores of values that are read without taking a lock, such
+ * as a pointer that is set once while a lock is held.  The loads have
+ * acquire and the stores have release ordering. */
+#ifdef TSK_MULTITHREAD_LIB
+#ifdef TSK_WIN32
+#define tsk_atomic_load_ptr(a_ptr) \
+    InterlockedCompareExchangePointer((PVOID volatile *) (a_ptr), NULL, NULL)
+#define tsk_atomic_store_ptr(a_ptr, a_val) \
+    InterlockedExchangePointer((PVOID volatile *) (a_ptr), (PVOID) (a_val))
+#define tsk_atomic_load_long(a_ptr) \
+    InterlockedCompareExchange((LONG volatile *) (a_ptr), 0, 0)
+#define tsk_atomic_store_long(a_ptr, a_val) \
+    InterlockedExchange((LONG volatile *) (a_ptr), (LONG) (a_val))
+#else
+#define tsk_atomic_load_ptr(a_ptr) \
+    __atomic_load_n((a_ptr), __ATOMIC_ACQUIRE)
+#define tsk_atomic_store_ptr(a_ptr, a_val) \
+    __atomic_store_n((a_ptr), (a_val), __ATOMIC_RELEASE)
+#define tsk_atomic_load_long(a_ptr) \
+    __atomic_load_n((a_ptr), __ATOMIC_ACQUIRE)
+#define tsk_atomic_store_long(a_ptr, a_val) \
+    __atomic_store_n((a_ptr), (a_val), __ATOMIC_RELEASE)
+#endif
+#else
+#define tsk_atomic_load_ptr(a_ptr) (*(a_ptr))
+#define tsk_atomic_store_ptr(a_ptr, a_val) (*(a_ptr) = (a_val))
+#define tsk_atomic_load_long(a_ptr) (*(a_ptr))
+#define tsk_atomic_store_long(a_ptr, a_val) (*(a_ptr) = (a_val))
+#endif
+
 #ifndef rounddown
 #define rounddown(x, y)	\
     ((((x) % (y)) == 0) ? (x) : \
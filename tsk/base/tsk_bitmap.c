@@ -0,0 +1,277 @@
+/*
+ * The Sleuth Kit
+ *
+ * Brian Carrier [carrier <at> sleuthkit [dot] org]
+ * Copyright (c) 2007-2011 Brian Carrier.  All Rights reserved
+ *
+ * This software is distributed under the Common Public License 1.0
+ */
+#include "tsk_base_i.h"
+
+/** \file tsk_bitmap.c
+ * tsk_bitmaps are sparse sets of 64-bit keys.  The key space is split into
+ * chunks of 2^16 keys.  A chunk starts out as a sorted array of the low 16
+ * bits of its keys and is converted to a plain bitmap once it holds enough
+ * keys that the bitmap is smaller.  Lookups are a binary search on the chunk
+ * list followed by either a bit test or a binary search in the chunk. This
+ * keeps sparse sets small and dense sets (such as large runs of inode
+ * addresses) at one bit per key.
+ */
+
+#define TSK_BITMAP_CHUNK_BITS   16
+#define TSK_BITMAP_CHUNK_KEYS   ((uint32_t) 1 << TSK_BITMAP_CHUNK_BITS)
+#define TSK_BITMAP_CHUNK_WORDS  (TSK_BITMAP_CHUNK_KEYS / 64)
+/* Number of array entries that take up the same space as the bitmap */
+#define TSK_BITMAP_ARRAY_MAX    (TSK_BITMAP_CHUNK_KEYS / 16)
+
+typedef struct {
+    uint64_t high;              // key >> TSK_BITMAP_CHUNK_BITS for all keys in the chunk
+    uint32_t cnt;               // number of keys set in the chunk
+    uint32_t alloc;             // number of entries allocated in vals (0 if bitmap)
+    uint16_t *vals;             // sorted low bits of the keys (if array)
+    uint64_t *bits;             // bitmap of the low bits of the keys (if bitmap)
+} TSK_BITMAP_CHUNK;
+
+struct TSK_BITMAP {
+    TSK_BITMAP_CHUNK *chunks;   // chunks sorted by high
+    size_t chunks_used;
+    size_t chunks_alloc;
+    uint64_t cnt;               // number of keys in the set
+};
+
+
+/*
+ * Find the chunk that covers a given key
+ * @param a_map Map to search
+ * @param a_high High bits of key to search for
+ * @param a_idx Set to the index of the chunk or, if not found, to the index that it should be inserted at
+ * @returns 1 if found and 0 if not
+ */
+static uint8_t
+tsk_bitmap_chunk_find(const TSK_BITMAP * a_map, uint64_t a_high,
+    size_t * a_idx)
+{
+    size_t lo = 0;
+    size_t hi = a_map->chunks_used;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (a_map->chunks[mid].high < a_high)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    *a_idx = lo;
+    return ((lo < a_map->chunks_used) && (a_map->chunks[lo].high == a_high));
+}
+
+/*
+ * Search the sorted array of a chunk
+ * @param a_chunk Chunk to search
+ * @param a_low Low bits of the key
+ * @param a_idx Set to the index of the value or to where it should be inserted
+ * @returns 1 if found and 0 if not
+ */
+static uint8_t
+tsk_bitmap_array_find(const TSK_BITMAP_CHUNK * a_chunk, uint16_t a_low,
+    uint32_t * a_idx)
+{
+    uint32_t lo = 0;
+    uint32_t hi = a_chunk->cnt;
+
+    /* keys are typically added in increasing order, so check the end first */
+    if ((hi > 0) && (a_chunk->vals[hi - 1] < a_low)) {
+        *a_idx = hi;
+        return 0;
+    }
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (a_chunk->vals[mid] < a_low)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    *a_idx = lo;
+    return ((lo < a_chunk->cnt) && (a_chunk->vals[lo] == a_low));
+}
+
+/*
+ * Convert a chunk from a sorted array to a bitmap.
+ * @returns 1 on error
+ */
+static uint8_t
+tsk_bitmap_chunk_tobits(TSK_BITMAP_CHUNK * a_chunk)
+{
+    uint32_t i;
+
+    if ((a_chunk->bits =
+            (uint64_t *) tsk_malloc(TSK_BITMAP_CHUNK_WORDS *
+                sizeof(uint64_t))) == NULL)
+        return 1;
+
+    for (i = 0; i < a_chunk->cnt; i++) {
+        uint16_t v = a_chunk->vals[i];
+        a_chunk->bits[v / 64] |= ((uint64_t) 1 << (v % 64));
+    }
+    free(a_chunk->vals);
+    a_chunk->vals = NULL;
+    a_chunk->alloc = 0;
+    return 0;
+}
+
+/**
+ * \ingroup baselib
+ * Add a key to a TSK_BITMAP (and create one if one does not exist)
+ * @param a_map Pointer to pointer for the map (can point to NULL if no map exists).
+ * @param a_key Value to add to map
+ * @returns 1 on error
+ */
+uint8_t
+tsk_bitmap_add(TSK_BITMAP ** a_map, uint64_t a_key)
+{
+    TSK_BITMAP *map;
+    TSK_BITMAP_CHUNK *chunk;
+    uint64_t high = a_key >> TSK_BITMAP_CHUNK_BITS;
+    uint16_t low = (uint16_t) (a_key & (TSK_BITMAP_CHUNK_KEYS - 1));
+    size_t cidx;
+    uint32_t vidx;
+
+    if (*a_map == NULL) {
+        if ((*a_map =
+                (TSK_BITMAP *) tsk_malloc(sizeof(TSK_BITMAP))) == NULL)
+            return 1;
+    }
+    map = *a_map;
+
+    /* find the chunk, or make a new one */
+    if (tsk_bitmap_chunk_find(map, high, &cidx) == 0) {
+        if (map->chunks_used == map->chunks_alloc) {
+            size_t new_alloc =
+                map->chunks_alloc ? map->chunks_alloc * 2 : 16;
+            TSK_BITMAP_CHUNK *tmp;
+            if ((tmp = (TSK_BITMAP_CHUNK *) tsk_realloc(map->chunks,
+                        new_alloc * sizeof(TSK_BITMAP_CHUNK))) == NULL)
+                return 1;
+            map->chunks = tmp;
+            map->chunks_alloc = new_alloc;
+        }
+        if (cidx < map->chunks_used) {
+            memmove(&map->chunks[cidx + 1], &map->chunks[cidx],
+                (map->chunks_used - cidx) * sizeof(TSK_BITMAP_CHUNK));
+        }
+        memset(&map->chunks[cidx], 0, sizeof(TSK_BITMAP_CHUNK));
+        map->chunks[cidx].high = high;
+        map->chunks_used++;
+    }
+    chunk = &map->chunks[cidx];
+
+    if (chunk->bits) {
+        uint64_t mask = (uint64_t) 1 << (low % 64);
+        if ((chunk->bits[low / 64] & mask) == 0) {
+            chunk->bits[low / 64] |= mask;
+            chunk->cnt++;
+            map->cnt++;
+        }
+        return 0;
+    }
+
+    if (tsk_bitmap_array_find(chunk, low, &vidx))
+        return 0;
+
+    /* switch to a bitmap once the array would be larger */
+    if (chunk->cnt == TSK_BITMAP_ARRAY_MAX) {
+        if (tsk_bitmap_chunk_tobits(chunk))
+            return 1;
+        chunk->bits[low / 64] |= ((uint64_t) 1 << (low % 64));
+        chunk->cnt++;
+        map->cnt++;
+        return 0;
+    }
+
+    if (chunk->cnt == chunk->alloc) {
+        uint32_t new_alloc = chunk->alloc ? chunk->alloc * 2 : 16;
+        uint16_t *tmp;
+        if (new_alloc > TSK_BITMAP_ARRAY_MAX)
+            new_alloc = TSK_BITMAP_ARRAY_MAX;
+        if ((tmp = (uint16_t *) tsk_realloc(chunk->vals,
+                    new_alloc * sizeof(uint16_t))) == NULL)
+            return 1;
+        chunk->vals = tmp;
+        chunk->alloc = new_alloc;
+    }
+    if (vidx < chunk->cnt) {
+        memmove(&chunk->vals[vidx + 1], &chunk->vals[vidx],
+            (chunk->cnt - vidx) * sizeof(uint16_t));
+    }
+    chunk->vals[vidx] = low;
+    chunk->cnt++;
+    map->cnt++;
+    return 0;
+}
+
+/**
+ * \ingroup baselib
+ * Search a TSK_BITMAP for a given key.  A map is not modified by
+ * searching, so several threads can search the same map at once as
+ * long as no thread is adding to it.
+ * @param a_map Map to search (can be NULL)
+ * @param a_key Value to search for
+ * @returns 1 if found and 0 if not
+ */
+uint8_t
+tsk_bitmap_find(const TSK_BITMAP * a_map, uint64_t a_key)
+{
+    const TSK_BITMAP_CHUNK *chunk;
+    uint16_t low = (uint16_t) (a_key & (TSK_BITMAP_CHUNK_KEYS - 1));
+    size_t cidx;
+    uint32_t vidx;
+
+    if (a_map == NULL)
+        return 0;
+
+    if (tsk_bitmap_chunk_find(a_map, a_key >> TSK_BITMAP_CHUNK_BITS,
+            &cidx) == 0)
+        return 0;
+    chunk = &a_map->chunks[cidx];
+
+    if (chunk->bits)
+        return (chunk->bits[low / 64] >> (low % 64)) & 1;
+
+    return tsk_bitmap_array_find(chunk, low, &vidx);
+}
+
+/**
+ * \ingroup baselib
+ * Return the number of keys in a TSK_BITMAP
+ * @param a_map Map to count (can be NULL)
+ * @returns number of keys that have been added
+ */
+uint64_t
+tsk_bitmap_count(const TSK_BITMAP * a_map)
+{
+    if (a_map == NULL)
+        return 0;
+    return a_map->cnt;
+}
+
+/**
+ * \ingroup baselib
+ * Free an allocated TSK_BITMAP structure
+ * @param a_map Map to free (can be NULL)
+ */
+void
+tsk_bitmap_free(TSK_BITMAP * a_map)
+{
+    size_t i;
+
+    if (a_map == NULL)
+        return;
+
+    for (i = 0; i < a_map->chunks_used; i++) {
+        free(a_map->chunks[i].vals);
+        free(a_map->chunks[i].bits);
+    }
+    free(a_map->chunks);
+    free(a_map);
+}
@@ -97,7 +97,8 @@ static const char *tsk_err_auto_str[TSK_ERR_AUTO_MAX] = {
     "Database Error",
     "Corrupt file data",
     "Error converting Unicode",
-    "Image not opened yet"
+    "Image not opened yet",
+    "Error using temporary file"
 };
 
 
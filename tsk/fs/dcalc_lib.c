@@ -48,47 +48,56 @@ typedef struct {
 ** keeps a count of unallocated blocks seen thus far
 **
 ** If the specified block is allocated, an error is given, else the
-** count of unalloc blocks is given 
+** number of unalloc blocks before it is given, which is its 0-based
+** address in the blkls image (the same numbering as -u).  Versions
+** before 4.1.1 gave the 1-based count.
 **
-** This is called for all blocks (alloc and unalloc)
+** This is called for all ranges of blocks (alloc and unalloc)
 */
 static TSK_WALK_RET_ENUM
-count_dd_act(const TSK_FS_BLOCK * fs_block, void *ptr)
+count_dd_act(TSK_FS_INFO * fs, TSK_DADDR_T addr, TSK_DADDR_T len,
+    TSK_FS_BLOCK_FLAG_ENUM flags, const char *buf, void *ptr)
 {
     BLKCALC_DATA *data = (BLKCALC_DATA *) ptr;
 
-    if (fs_block->flags & TSK_FS_BLOCK_FLAG_UNALLOC)
-        data->uncnt++;
+    /* the block is not in this range */
+    if (data->count >= len) {
+        data->count -= len;
+        if (flags & TSK_FS_BLOCK_FLAG_UNALLOC)
+            data->uncnt += len;
+        return TSK_WALK_CONT;
+    }
 
-    if (data->count-- == 0) {
-        if (fs_block->flags & TSK_FS_BLOCK_FLAG_UNALLOC)
-            tsk_printf("%" PRIuDADDR "\n", data->uncnt);
-        else
-            printf
-                ("ERROR: unit is allocated, it will not be in an blkls image\n");
+    if (flags & TSK_FS_BLOCK_FLAG_UNALLOC)
+        tsk_printf("%" PRIuDADDR "\n", data->uncnt + data->count);
+    else
+        printf
+            ("ERROR: unit is allocated, it will not be in an blkls image\n");
 
-        data->found = 1;
-        return TSK_WALK_STOP;
-    }
-    return TSK_WALK_CONT;
+    data->found = 1;
+    return TSK_WALK_STOP;
 }
 
 /*
 ** count how many unalloc blocks there are.
 **
-** This is called for unalloc blocks only
+** This is called for ranges of unalloc blocks only
 */
 static TSK_WALK_RET_ENUM
-count_blkls_act(const TSK_FS_BLOCK * fs_block, void *ptr)
+count_blkls_act(TSK_FS_INFO * fs, TSK_DADDR_T addr, TSK_DADDR_T len,
+    TSK_FS_BLOCK_FLAG_ENUM flags, const char *buf, void *ptr)
 {
     BLKCALC_DATA *data = (BLKCALC_DATA *) ptr;
 
-    if (data->count-- == 0) {
-        tsk_printf("%" PRIuDADDR "\n", fs_block->addr);
-        data->found = 1;
-        return TSK_WALK_STOP;
+    /* the block is not in this range */
+    if (data->count >= len) {
+        data->count -= len;
+        return TSK_WALK_CONT;
     }
-    return TSK_WALK_CONT;
+
+    tsk_printf("%" PRIuDADDR "\n", addr + data->count);
+    data->found = 1;
+    return TSK_WALK_STOP;
 }
 
 
@@ -196,10 +205,11 @@ tsk_fs_blkcalc(TSK_FS_INFO * fs, TSK_FS_BLKCALC_FLAG_ENUM a_lclflags,
     BLKCALC_DATA data;
 
     data.count = a_cnt;
+    data.uncnt = 0;
     data.found = 0;
 
     if (a_lclflags == TSK_FS_BLKCALC_BLKLS) {
-        if (tsk_fs_block_walk(fs, fs->first_block, fs->last_block,
+        if (tsk_fs_block_range_walk(fs, fs->first_block, fs->last_block,
                 (TSK_FS_BLOCK_WALK_FLAG_UNALLOC |
                     TSK_FS_BLOCK_WALK_FLAG_META |
                     TSK_FS_BLOCK_WALK_FLAG_CONT |
@@ -207,7 +217,7 @@ tsk_fs_blkcalc(TSK_FS_INFO * fs, TSK_FS_BLKCALC_FLAG_ENUM a_lclflags,
             return -1;
     }
     else if (a_lclflags == TSK_FS_BLKCALC_DD) {
-        if (tsk_fs_block_walk(fs, fs->first_block, fs->last_block,
+        if (tsk_fs_block_range_walk(fs, fs->first_block, fs->last_block,
                 (TSK_FS_BLOCK_WALK_FLAG_ALLOC |
                     TSK_FS_BLOCK_WALK_FLAG_UNALLOC |
                     TSK_FS_BLOCK_WALK_FLAG_META |
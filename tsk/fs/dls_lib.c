@@ -78,6 +78,43 @@ print_list(const TSK_FS_BLOCK * fs_block, void *ptr)
 
 
 
+/** \internal
+ * Largest number of bytes that are read and written at a time when runs of
+ * blocks are copied.
+ */
+#define BLKLS_READ_SIZE (1024 * 1024)
+
+/** \internal
+ * Number of meta data addresses that each slack thread processes at a time.
+ */
+#define BLKLS_SLACK_INUMS 4096
+
+/** \internal
+ * Number of bytes of slack output that a slack thread saves in memory
+ * before it stops.  The rest of its addresses are done when its output
+ * is written.
+ */
+#define BLKLS_SLACK_BUF_MAX (16 * 1024 * 1024)
+
+
+/** \internal 
+* Structure to store data for callbacks.
+*/
+typedef struct {
+    TSK_OFF_T flen;
+
+    TSK_DADDR_T run_start;      ///< First block of the run that has not been copied yet
+    TSK_DADDR_T run_len;        ///< Number of blocks in the run
+
+    FILE *hFile;                ///< Where slack is written, or NULL to add it to buf
+    char *buf;                  ///< Copy buffer for runs or slack output for one chunk
+    size_t buf_len;             ///< Number of bytes of slack output in buf
+    size_t buf_size;            ///< Allocated size of buf
+    uint8_t failed;             ///< Set if slack output could not be saved in buf
+    TSK_INUM_T next_inum;       ///< Address to continue at if the walk stopped because buf was full (0 if it did not)
+} BLKLS_DATA;
+
+
 /* print_block - write data block to stdout */
 static TSK_WALK_RET_ENUM
 print_block(const TSK_FS_BLOCK * fs_block, void *ptr)
@@ -99,16 +136,135 @@ print_block(const TSK_FS_BLOCK * fs_block, void *ptr)
 }
 
 
-/** \internal 
-* Structure to store data for callbacks.
-*/
-typedef struct {
-    TSK_OFF_T flen;
-} BLKLS_DATA;
+/* copy_run - copy the saved run of blocks to stdout with large reads.
+ *
+ * return 1 on error
+ */
+static uint8_t
+copy_run(TSK_FS_INFO * fs, BLKLS_DATA * data)
+{
+    size_t max_blks = data->buf_size / fs->block_size;
+
+    if (tsk_verbose && data->run_len)
+        tsk_fprintf(stderr, "write blocks %" PRIuDADDR " to %" PRIuDADDR
+            "\n", data->run_start, data->run_start + data->run_len - 1);
+
+    while (data->run_len) {
+        size_t blks = max_blks;
+        size_t len;
+        ssize_t cnt;
+
+        if (blks > data->run_len)
+            blks = (size_t) data->run_len;
+        len = blks * fs->block_size;
+
+        cnt = tsk_fs_read_block(fs, data->run_start, data->buf, len);
+        if (cnt != (ssize_t) len) {
+            /* Read one block at a time so that the blocks before the
+             * one that cannot be read are still copied */
+            for (len = 0; len < blks * fs->block_size;
+                len += fs->block_size) {
+                cnt = tsk_fs_read_block(fs, data->run_start,
+                    &data->buf[len], fs->block_size);
+                if (cnt != (ssize_t) fs->block_size)
+                    break;
+                data->run_start++;
+                data->run_len--;
+            }
+            if ((len) && (fwrite(data->buf, len, 1, stdout) != 1)) {
+                tsk_error_reset();
+                tsk_error_set_errno(TSK_ERR_FS_WRITE);
+                tsk_error_set_errstr
+                    ("blkls_lib: error writing to stdout: %s",
+                    strerror(errno));
+                return 1;
+            }
+            if (len == blks * fs->block_size)
+                continue;
+            if (cnt >= 0) {
+                tsk_error_reset();
+                tsk_error_set_errno(TSK_ERR_FS_READ);
+            }
+            tsk_error_set_errstr2("blkls_lib: block %" PRIuDADDR,
+                data->run_start);
+            return 1;
+        }
+
+        if (fwrite(data->buf, len, 1, stdout) != 1) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_FS_WRITE);
+            tsk_error_set_errstr("blkls_lib: error writing to stdout: %s",
+                strerror(errno));
+            return 1;
+        }
+        data->run_start += blks;
+        data->run_len -= blks;
+    }
+    return 0;
+}
+
+/* print_range - add the range of blocks to the current run and copy the
+ * run when the range does not extend it.  The walk is done without reading
+ * the blocks (AONLY), so the data is read with large reads by copy_run(). */
+static TSK_WALK_RET_ENUM
+print_range(TSK_FS_INFO * fs, TSK_DADDR_T addr, TSK_DADDR_T len,
+    TSK_FS_BLOCK_FLAG_ENUM flags, const char *buf, void *ptr)
+{
+    BLKLS_DATA *data = (BLKLS_DATA *) ptr;
+
+    if ((data->run_len) && (addr == data->run_start + data->run_len)) {
+        data->run_len += len;
+        return TSK_WALK_CONT;
+    }
+
+    if (copy_run(fs, data))
+        return TSK_WALK_ERROR;
+
+    data->run_start = addr;
+    data->run_len = len;
+    return TSK_WALK_CONT;
+}
 
 
 /* SLACK SPACE  call backs */
 
+/* slack_write - write slack data to the output file or save it
+ * in the buffer for the chunk.
+ *
+ * return 1 on error
+ */
+static uint8_t
+slack_write(BLKLS_DATA * data, const char *buf, size_t size)
+{
+    if (data->hFile) {
+        if (fwrite(buf, size, 1, data->hFile) != 1) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_FS_WRITE);
+            tsk_error_set_errstr("blkls_lib: error writing to stdout: %s",
+                strerror(errno));
+            return 1;
+        }
+        return 0;
+    }
+
+    if (data->buf_len + size > data->buf_size) {
+        size_t new_size = data->buf_size ? data->buf_size : 64 * 1024;
+        char *new_buf;
+
+        while (new_size < data->buf_len + size)
+            new_size *= 2;
+        if ((new_buf = (char *) tsk_realloc(data->buf, new_size)) == NULL) {
+            data->failed = 1;
+            return 1;
+        }
+        data->buf = new_buf;
+        data->buf_size = new_size;
+    }
+    memcpy(&data->buf[data->buf_len], buf, size);
+    data->buf_len += size;
+    return 0;
+}
+
 static TSK_WALK_RET_ENUM
 slack_file_act(TSK_FS_FILE * fs_file, TSK_OFF_T a_off, TSK_DADDR_T addr,
     char *buf, size_t size, TSK_FS_BLOCK_FLAG_ENUM flags, void *ptr)
@@ -127,25 +283,15 @@ slack_file_act(TSK_FS_FILE * fs_file, TSK_OFF_T a_off, TSK_DADDR_T addr,
     }
     /* We have passed the end of the allocated space */
     else if (data->flen == 0) {
-        if (fwrite(buf, size, 1, stdout) != 1) {
-            tsk_error_reset();
-            tsk_error_set_errno(TSK_ERR_FS_WRITE);
-            tsk_error_set_errstr("blkls_lib: error writing to stdout: %s",
-                strerror(errno));
+        if (slack_write(data, buf, size))
             return TSK_WALK_ERROR;
-        }
     }
     /* This is the last data unit and there is unused space */
     else if (data->flen < size) {
         /* Clear the used space and print it */
         memset(buf, 0, (size_t) data->flen);
-        if (fwrite(buf, size, 1, stdout) != 1) {
-            tsk_error_reset();
-            tsk_error_set_errno(TSK_ERR_FS_WRITE);
-            tsk_error_set_errstr("blkls_lib: error writing to stdout: %s",
-                strerror(errno));
+        if (slack_write(data, buf, size))
             return TSK_WALK_ERROR;
-        }
         data->flen = 0;
     }
 
@@ -203,23 +349,282 @@ slack_inode_act(TSK_FS_FILE * fs_file, void *ptr)
         }
     }
 
+    /* Stop if the saved output is too big.  The rest is done after
+     * it is written. */
+    if ((data->hFile == NULL) && (data->buf_len >= BLKLS_SLACK_BUF_MAX)) {
+        data->next_inum = fs_file->meta->addr + 1;
+        return TSK_WALK_STOP;
+    }
+
     return TSK_WALK_CONT;
 }
 
 
 
+/** \internal
+ * Range of meta data addresses that one thread gets the slack space of.
+ */
+typedef struct {
+    TSK_FS_INFO *fs;
+    TSK_INUM_T start;
+    TSK_INUM_T end;
+    BLKLS_DATA data;            ///< Slack output is saved in data.buf
+    uint8_t retval;             ///< Return value of the inode walk
+    uint32_t errnum;            ///< Error from the walk (errors are per-thread)
+    char errstr[TSK_ERROR_STRING_MAX_LENGTH + 1];
+    char errstr2[TSK_ERROR_STRING_MAX_LENGTH + 1];
+} BLKLS_SLACK_CHUNK;
+
+static void *
+slack_chunk_thread(void *a_ptr)
+{
+    BLKLS_SLACK_CHUNK *chunk = (BLKLS_SLACK_CHUNK *) a_ptr;
+
+    chunk->retval = chunk->fs->inode_walk(chunk->fs, chunk->start,
+        chunk->end, TSK_FS_META_FLAG_ALLOC, slack_inode_act, &chunk->data);
+    if (chunk->retval) {
+        chunk->errnum = tsk_error_get_errno();
+        strncpy(chunk->errstr, tsk_error_get_errstr(),
+            TSK_ERROR_STRING_MAX_LENGTH);
+        strncpy(chunk->errstr2, tsk_error_get_errstr2(),
+            TSK_ERROR_STRING_MAX_LENGTH);
+    }
+    else if (chunk->data.failed) {
+        chunk->retval = 1;
+        chunk->errnum = TSK_ERR_AUX_MALLOC;
+        snprintf(chunk->errstr, TSK_ERROR_STRING_MAX_LENGTH,
+            "blkls_lib: error saving slack of %" PRIuINUM " to %"
+            PRIuINUM, chunk->start, chunk->end);
+    }
+    return NULL;
+}
+
+#if defined(TSK_MULTITHREAD_LIB) && defined(TSK_WIN32)
+static DWORD WINAPI
+slack_chunk_thread_win32(LPVOID a_ptr)
+{
+    slack_chunk_thread(a_ptr);
+    return 0;
+}
+#endif
+
+/* blkls_slack - copy the slack space of the allocated files to stdout.
+ * The meta data addresses are divided into chunks and up to a_threads
+ * chunks are processed at a time.  Each thread saves its output in
+ * memory and the output is written in address order after the threads
+ * are done, so it is the same as with one thread.  A thread stops when
+ * it has saved BLKLS_SLACK_BUF_MAX bytes and the rest of its chunk is
+ * written directly when its output is written.
+ *
+ * return 1 on error
+ */
+static uint8_t
+blkls_slack(TSK_FS_INFO * fs, unsigned int a_threads)
+{
+    BLKLS_SLACK_CHUNK *chunks;
+    TSK_INUM_T inum;
+    unsigned int i;
+    uint8_t retval = 0;
+    uint8_t done = 0;
+
+#ifdef TSK_MULTITHREAD_LIB
+#ifdef TSK_WIN32
+    HANDLE *threads;
+#else
+    pthread_t *threads;
+#endif
+    uint8_t *started;
+#endif
+
+    if ((a_threads <= 1)
+        || (fs->last_inum - fs->first_inum < BLKLS_SLACK_INUMS)) {
+        BLKLS_DATA data;
+
+        memset(&data, 0, sizeof(data));
+        data.hFile = stdout;
+        return fs->inode_walk(fs, fs->first_inum, fs->last_inum,
+            TSK_FS_META_FLAG_ALLOC, slack_inode_act, &data);
+    }
+
+    if ((chunks = (BLKLS_SLACK_CHUNK *)
+            tsk_malloc(a_threads * sizeof(BLKLS_SLACK_CHUNK))) == NULL)
+        return 1;
+#ifdef TSK_MULTITHREAD_LIB
+#ifdef TSK_WIN32
+    threads = (HANDLE *) tsk_malloc(a_threads * sizeof(HANDLE));
+#else
+    threads = (pthread_t *) tsk_malloc(a_threads * sizeof(pthread_t));
+#endif
+    if (threads == NULL) {
+        free(chunks);
+        return 1;
+    }
+    if ((started = (uint8_t *) tsk_malloc(a_threads)) == NULL) {
+        free(threads);
+        free(chunks);
+        return 1;
+    }
+#endif
+
+    inum = fs->first_inum;
+    while ((done == 0) && (retval == 0)) {
+        unsigned int nchunks = 0;
+
+        /* set up the chunks for this round.  The buffers are kept
+         * from the last round. */
+        while ((nchunks < a_threads) && (done == 0)) {
+            BLKLS_SLACK_CHUNK *chunk = &chunks[nchunks++];
+
+            chunk->fs = fs;
+            chunk->start = inum;
+            chunk->retval = 0;
+            chunk->data.buf_len = 0;
+            chunk->data.failed = 0;
+            chunk->data.next_inum = 0;
+            if (fs->last_inum - inum < BLKLS_SLACK_INUMS) {
+                chunk->end = fs->last_inum;
+                done = 1;
+            }
+            else {
+                chunk->end = inum + BLKLS_SLACK_INUMS - 1;
+                inum = chunk->end + 1;
+            }
+        }
+
+        if (tsk_verbose)
+            tsk_fprintf(stderr,
+                "blkls_slack: Processing %" PRIuINUM " to %" PRIuINUM
+                " with %u threads\n", chunks[0].start,
+                chunks[nchunks - 1].end, nchunks);
+
+        /* The calling thread does the first chunk.  A chunk is done
+         * here too if its thread could not be started. */
+#ifdef TSK_MULTITHREAD_LIB
+        for (i = 1; i < nchunks; i++) {
+#ifdef TSK_WIN32
+            threads[i] = CreateThread(NULL, 0, slack_chunk_thread_win32,
+                &chunks[i], 0, NULL);
+            started[i] = (threads[i] != NULL);
+#else
+            started[i] = (pthread_create(&threads[i], NULL,
+                    slack_chunk_thread, &chunks[i]) == 0);
+#endif
+        }
+        slack_chunk_thread(&chunks[0]);
+        for (i = 1; i < nchunks; i++) {
+            if (started[i] == 0) {
+                slack_chunk_thread(&chunks[i]);
+                continue;
+            }
+#ifdef TSK_WIN32
+            WaitForSingleObject(threads[i], INFINITE);
+            CloseHandle(threads[i]);
+#else
+            pthread_join(threads[i], NULL);
+#endif
+        }
+#else
+        for (i = 0; i < nchunks; i++)
+            slack_chunk_thread(&chunks[i]);
+#endif
+
+        /* write the output in order */
+        for (i = 0; i < nchunks; i++) {
+            BLKLS_SLACK_CHUNK *chunk = &chunks[i];
+
+            if (chunk->retval) {
+                tsk_error_reset();
+                tsk_error_set_errno(chunk->errnum);
+                tsk_error_set_errstr("%s", chunk->errstr);
+                if (chunk->errstr2[0])
+                    tsk_error_set_errstr2("%s", chunk->errstr2);
+                retval = 1;
+                break;
+            }
+            if ((chunk->data.buf_len)
+                && (fwrite(chunk->data.buf, chunk->data.buf_len, 1,
+                        stdout) != 1)) {
+                tsk_error_reset();
+                tsk_error_set_errno(TSK_ERR_FS_WRITE);
+                tsk_error_set_errstr
+                    ("blkls_lib: error writing to stdout: %s",
+                    strerror(errno));
+                retval = 1;
+                break;
+            }
+
+            /* finish the chunk if it stopped because its buffer was full */
+            if ((chunk->data.next_inum)
+                && (chunk->data.next_inum <= chunk->end)) {
+                BLKLS_DATA data;
+
+                if (tsk_verbose)
+                    tsk_fprintf(stderr,
+                        "blkls_slack: Finishing %" PRIuINUM " to %"
+                        PRIuINUM "\n", chunk->data.next_inum, chunk->end);
+
+                memset(&data, 0, sizeof(data));
+                data.hFile = stdout;
+                if (fs->inode_walk(fs, chunk->data.next_inum, chunk->end,
+                        TSK_FS_META_FLAG_ALLOC, slack_inode_act, &data)) {
+                    retval = 1;
+                    break;
+                }
+            }
+        }
+    }
+
+    for (i = 0; i < a_threads; i++)
+        free(chunks[i].data.buf);
+    free(chunks);
+#ifdef TSK_MULTITHREAD_LIB
+    free(threads);
+    free(started);
+#endif
+    return retval;
+}
+
 /* Return 1 on error and 0 on success */
 uint8_t
 tsk_fs_blkls(TSK_FS_INFO * fs, TSK_FS_BLKLS_FLAG_ENUM a_blklsflags,
     TSK_DADDR_T bstart, TSK_DADDR_T blast,
     TSK_FS_BLOCK_WALK_FLAG_ENUM a_block_flags)
+{
+    return tsk_fs_blkls_threads(fs, a_blklsflags, bstart, blast,
+        a_block_flags, 1);
+}
+
+/**
+ * \ingroup fslib
+ * Copy or list the data units of a file system, like tsk_fs_blkls(), and
+ * use several threads to find the slack space.
+ *
+ * Blocks are copied to stdout in runs of consecutive blocks with large reads.
+ * With TSK_FS_BLKLS_SLACK, the meta data addresses are divided into ranges
+ * that are walked on up to a_threads threads at a time.  The output is
+ * the same as with one thread.
+ *
+ * @param fs File system to analyze
+ * @param a_blklsflags Flags for what to do
+ * @param bstart Block address to start at
+ * @param blast Block address to end at
+ * @param a_block_flags Flags for the blocks to copy or list
+ * @param a_threads Maximum number of threads to use for slack space (including
+ * the calling thread)
+ * @returns 1 on error and 0 on success
+ */
+uint8_t
+tsk_fs_blkls_threads(TSK_FS_INFO * fs, TSK_FS_BLKLS_FLAG_ENUM a_blklsflags,
+    TSK_DADDR_T bstart, TSK_DADDR_T blast,
+    TSK_FS_BLOCK_WALK_FLAG_ENUM a_block_flags, unsigned int a_threads)
 {
     BLKLS_DATA data;
 
+    memset(&data, 0, sizeof(data));
+
     if (a_blklsflags & TSK_FS_BLKLS_SLACK) {
         /* get the info on each allocated inode */
-        if (fs->inode_walk(fs, fs->first_inum, fs->last_inum,
-                TSK_FS_META_FLAG_ALLOC, slack_inode_act, &data))
+        if (blkls_slack(fs, a_threads))
             return 1;
     }
     else if (a_blklsflags & TSK_FS_BLKLS_LIST) {
@@ -232,6 +637,8 @@ tsk_fs_blkls(TSK_FS_INFO * fs, TSK_FS_BLKLS_FLAG_ENUM a_blklsflags,
             return 1;
     }
     else {
+        uint8_t retval;
+
 #ifdef TSK_WIN32
         if (-1 == _setmode(_fileno(stdout), _O_BINARY)) {
             tsk_error_reset();
@@ -242,8 +649,30 @@ tsk_fs_blkls(TSK_FS_INFO * fs, TSK_FS_BLKLS_FLAG_ENUM a_blklsflags,
             return 1;
         }
 #endif
-        if (tsk_fs_block_walk(fs, bstart, blast, a_block_flags,
-                print_block, &data))
+        /* The block walks read the raw blocks, so blocks in file systems
+         * with data around each block are still copied one at a time */
+        if ((fs->block_pre_size) || (fs->block_post_size)) {
+            if (tsk_fs_block_walk(fs, bstart, blast, a_block_flags,
+                    print_block, &data))
+                return 1;
+            return 0;
+        }
+
+        data.buf_size =
+            (BLKLS_READ_SIZE / fs->block_size) * fs->block_size;
+        if (data.buf_size == 0)
+            data.buf_size = fs->block_size;
+        if ((data.buf = (char *) tsk_malloc(data.buf_size)) == NULL)
+            return 1;
+
+        /* Copy the blocks that were found before an error too */
+        retval = tsk_fs_block_range_walk(fs, bstart, blast,
+            a_block_flags | TSK_FS_BLOCK_WALK_FLAG_AONLY, print_range,
+            &data);
+        if (copy_run(fs, &data))
+            retval = 1;
+        free(data.buf);
+        if (retval)
             return 1;
     }
 
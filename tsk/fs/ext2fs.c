@@ -97,34 +97,189 @@ ext2fs_bg_has_super(uint32_t feature_ro_compat, uint32_t group_block)
 
 
 
-/* ext2fs_group_load - load block group descriptor into cache
+/* ext2fs_gd_get - return a group descriptor from the table that was loaded
+ * at open.  The table is not modified after open, so no lock is needed.
  *
- * Note: This routine assumes &ext2fs->lock is locked by the caller.
+ * return NULL on error
+ * */
+static const uint8_t *
+ext2fs_gd_get(EXT2FS_INFO * ext2fs, EXT2_GRPNUM_T grp_num)
+{
+    if (grp_num >= ext2fs->groups_count) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr
+            ("ext2fs_gd_get: invalid cylinder group number: %"
+            PRI_EXT2GRP "", grp_num);
+        return NULL;
+    }
+    else if (grp_num >= ext2fs->gd_count) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_READ);
+        tsk_error_set_errstr("ext2fs_gd_get: Group descriptor %"
+            PRI_EXT2GRP " at %" PRIuOFF, grp_num,
+            ext2fs->groups_offset + (TSK_OFF_T) grp_num * ext2fs->gd_size);
+        return NULL;
+    }
+    return &ext2fs->gd_buf[(size_t) grp_num * ext2fs->gd_size];
+}
+
+/* The high 32 bits of the locations are only used if the descriptors
+ * are large enough to hold them */
+#define EXT2FS_GD_IS64(ext2fs) \
+    (EXT2FS_HAS_INCOMPAT_FEATURE(((TSK_FS_INFO *) (ext2fs)), (ext2fs)->fs, \
+        EXT2FS_FEATURE_INCOMPAT_64BIT) && ((ext2fs)->gd_size >= 64))
+
+/* ext2fs_gd_block_bitmap - block address of a group's block bitmap */
+static TSK_DADDR_T
+ext2fs_gd_block_bitmap(EXT2FS_INFO * ext2fs, const uint8_t * gd)
+{
+    TSK_FS_INFO *fs = &ext2fs->fs_info;
+    if (EXT2FS_GD_IS64(ext2fs))
+        return ext4_getu64(fs->endian,
+            ((ext4fs_gd *) gd)->bg_block_bitmap_hi,
+            ((ext4fs_gd *) gd)->bg_block_bitmap_lo);
+    return tsk_getu32(fs->endian, ((ext2fs_gd *) gd)->bg_block_bitmap);
+}
+
+/* ext2fs_gd_inode_bitmap - block address of a group's inode bitmap */
+static TSK_DADDR_T
+ext2fs_gd_inode_bitmap(EXT2FS_INFO * ext2fs, const uint8_t * gd)
+{
+    TSK_FS_INFO *fs = &ext2fs->fs_info;
+    if (EXT2FS_GD_IS64(ext2fs))
+        return ext4_getu64(fs->endian,
+            ((ext4fs_gd *) gd)->bg_inode_bitmap_hi,
+            ((ext4fs_gd *) gd)->bg_inode_bitmap_lo);
+    return tsk_getu32(fs->endian, ((ext2fs_gd *) gd)->bg_inode_bitmap);
+}
+
+/* ext2fs_gd_inode_table - block address of a group's inode table */
+static TSK_DADDR_T
+ext2fs_gd_inode_table(EXT2FS_INFO * ext2fs, const uint8_t * gd)
+{
+    TSK_FS_INFO *fs = &ext2fs->fs_info;
+    if (EXT2FS_GD_IS64(ext2fs))
+        return ext4_getu64(fs->endian,
+            ((ext4fs_gd *) gd)->bg_inode_table_hi,
+            ((ext4fs_gd *) gd)->bg_inode_table_lo);
+    return tsk_getu32(fs->endian, ((ext2fs_gd *) gd)->bg_inode_table);
+}
+
+/* ext2fs_gd_inodes_used - number of inodes at the start of a group's
+ * inode table that may have been used.  The rest of the table has never
+ * been initialized.  The descriptor fields that say this are only trusted
+ * if the descriptors have checksums.
+ * */
+static TSK_INUM_T
+ext2fs_gd_inodes_used(EXT2FS_INFO * ext2fs, const uint8_t * gd)
+{
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) ext2fs;
+    ext4fs_gd *ext4_gd = (ext4fs_gd *) gd;
+    TSK_INUM_T ipg =
+        tsk_getu32(fs->endian, ext2fs->fs->s_inodes_per_group);
+    TSK_INUM_T unused;
+
+    if (!EXT2FS_HAS_RO_COMPAT_FEATURE(fs, ext2fs->fs,
+            (EXT2FS_FEATURE_RO_COMPAT_GDT_CSUM |
+                EXT4FS_FEATURE_RO_COMPAT_METADATA_CSUM)))
+        return ipg;
+
+    if (EXT4BG_HAS_FLAG(fs, ext4_gd, EXT4_BG_INODE_UNINIT))
+        return 0;
+
+    unused = tsk_getu16(fs->endian, ext4_gd->bg_itable_unused_lo);
+    if (ext2fs->gd_size >= 64)
+        unused |= (TSK_INUM_T) tsk_getu16(fs->endian,
+            ext4_gd->bg_itable_unused_hi) << 16;
+    if (unused > ipg)
+        return ipg;
+    return ipg - unused;
+}
+
+/* ext2fs_gd_table_load - read all of the group descriptors into gd_buf
+ * with one read.  If the image is truncated, only the descriptors that
+ * could be read are available and ext2fs_gd_get() returns an error for
+ * the rest.
  *
  * return 1 on error and 0 on success
- *
  * */
 static uint8_t
-ext2fs_group_load(EXT2FS_INFO * ext2fs, EXT2_GRPNUM_T grp_num)
+ext2fs_gd_table_load(EXT2FS_INFO * ext2fs)
 {
-    void *gd;
-    TSK_OFF_T offs;
-    ssize_t cnt;
     TSK_FS_INFO *fs = (TSK_FS_INFO *) ext2fs;
-    int gd_size = tsk_getu16(fs->endian, ext2fs->fs->s_desc_size);
-    ext4fs_gd *ext4_gd = NULL;
+    TSK_OFF_T img_len;
+    size_t len, off;
+    ssize_t cnt;
 
-    if (!gd_size) {
+    ext2fs->gd_size = tsk_getu16(fs->endian, ext2fs->fs->s_desc_size);
+    if (!ext2fs->gd_size) {
         if (fs->ftype == TSK_FS_TYPE_EXT4 &&
             EXT2FS_HAS_INCOMPAT_FEATURE(fs, ext2fs->fs,
                 EXT2FS_FEATURE_INCOMPAT_64BIT)) {
-            gd_size = sizeof(ext4fs_gd);
+            ext2fs->gd_size = sizeof(ext4fs_gd);
         }
         else {
-            gd_size = sizeof(ext2fs_gd);
+            ext2fs->gd_size = sizeof(ext2fs_gd);
+        }
+    }
+    ext2fs->gd_count = 0;
+
+    /* do not allocate more than can be in the image if the group count
+     * is corrupt */
+    img_len = fs->img_info->size - fs->offset - ext2fs->groups_offset;
+    if (img_len <= 0)
+        return 0;
+    len = (size_t) ext2fs->groups_count * ext2fs->gd_size;
+    if ((TSK_OFF_T) len > img_len)
+        len = (size_t) img_len - (size_t) img_len % ext2fs->gd_size;
+    if (len == 0)
+        return 0;
+
+    if ((ext2fs->gd_buf = (uint8_t *) tsk_malloc(len)) == NULL)
+        return 1;
+
+    cnt = tsk_fs_read(fs, ext2fs->groups_offset, (char *) ext2fs->gd_buf,
+        len);
+    if (cnt < 0) {
+        /* fall back to reading a block at a time to get what we can */
+        for (off = 0; off < len; off += cnt) {
+            size_t rlen = len - off;
+            if (rlen > fs->block_size)
+                rlen = fs->block_size;
+            cnt = tsk_fs_read(fs, ext2fs->groups_offset + off,
+                (char *) &ext2fs->gd_buf[off], rlen);
+            if (cnt <= 0)
+                break;
         }
+        cnt = off;
+        tsk_error_reset();
     }
 
+    ext2fs->gd_count = (EXT2_GRPNUM_T) (cnt / ext2fs->gd_size);
+    if ((tsk_verbose) && (ext2fs->gd_count < ext2fs->groups_count))
+        tsk_fprintf(stderr,
+            "ext2fs_gd_table_load: only %" PRI_EXT2GRP " of %" PRI_EXT2GRP
+            " group descriptors could be read\n", ext2fs->gd_count,
+            ext2fs->groups_count);
+    return 0;
+}
+
+/* ext2fs_group_load - load block group descriptor into cache
+ *
+ * Note: This routine assumes &ext2fs->lock is locked by the caller.
+ *
+ * return 1 on error and 0 on success
+ *
+ * */
+static uint8_t
+ext2fs_group_load(EXT2FS_INFO * ext2fs, EXT2_GRPNUM_T grp_num)
+{
+    void *gd;
+    const uint8_t *gd_src;
+    TSK_OFF_T offs;
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) ext2fs;
+    ext4fs_gd *ext4_gd = NULL;
 
     /*
      * Sanity check
@@ -138,12 +293,16 @@ ext2fs_group_load(EXT2FS_INFO * ext2fs, EXT2_GRPNUM_T grp_num)
         return 1;
     }
 
+    /* the buffer is at least as big as the ext4 structure so that its
+     * fields can be used even if the descriptors on disk are smaller */
     if (ext2fs->grp_buf == NULL) {
+        size_t len = ext2fs->gd_size > sizeof(ext4fs_gd) ?
+            ext2fs->gd_size : sizeof(ext4fs_gd);
         if (fs->ftype == TSK_FS_TYPE_EXT4) {
-            ext2fs->ext4_grp_buf = (ext4fs_gd *) tsk_malloc(gd_size);
+            ext2fs->ext4_grp_buf = (ext4fs_gd *) tsk_malloc(len);
         }
         else {
-            ext2fs->grp_buf = (ext2fs_gd *) tsk_malloc(gd_size);
+            ext2fs->grp_buf = (ext2fs_gd *) tsk_malloc(len);
         }
         if (ext2fs->grp_buf == NULL && ext2fs->ext4_grp_buf == NULL) {
             return 1;
@@ -156,26 +315,21 @@ ext2fs_group_load(EXT2FS_INFO * ext2fs, EXT2_GRPNUM_T grp_num)
     gd = ext2fs->grp_buf;
 
     /*
-     * We're not reading group descriptors often, so it is OK to do small
-     * reads instead of cacheing group descriptors in a large buffer.
+     * The descriptors were all read at open, so copy this one out of
+     * the table.
      */
-    offs = ext2fs->groups_offset + grp_num * gd_size;
+    offs = ext2fs->groups_offset + (TSK_OFF_T) grp_num * ext2fs->gd_size;
     if (fs->ftype == TSK_FS_TYPE_EXT4)
         gd = ext2fs->ext4_grp_buf;
-    cnt = tsk_fs_read(&ext2fs->fs_info, offs, (char *) gd, gd_size);
+    if ((gd_src = ext2fs_gd_get(ext2fs, grp_num)) == NULL) {
+        tsk_error_set_errstr2("ext2fs_group_load");
+        return 1;
+    }
+    memcpy(gd, gd_src, ext2fs->gd_size);
      /*DEBUG*/
 #ifdef Ext4_DBG
-        debug_print_buf((char *) ext2fs->ext4_grp_buf, gd_size);
+        debug_print_buf((char *) ext2fs->ext4_grp_buf, ext2fs->gd_size);
 #endif
-    if (cnt != gd_size) {
-        if (cnt >= 0) {
-            tsk_error_reset();
-            tsk_error_set_errno(TSK_ERR_FS_READ);
-        }
-        tsk_error_set_errstr2("ext2fs_group_load: Group descriptor %"
-            PRI_EXT2GRP " at %" PRIuOFF, grp_num, offs);
-        return 1;
-    }
     /* Perform a sanity check on the data to make sure offsets are in range */
     if (fs->ftype == TSK_FS_TYPE_EXT4) {
         ext2fs->grp_buf = (ext2fs_gd *) ext2fs->ext4_grp_buf;
@@ -327,93 +481,224 @@ ext2fs_print_map(uint8_t * map, int len)
     ((tsk_getu32(ext2fs->fs_info.endian, ext2fs->fs->s_inodes_per_group) * ext2fs->inode_size - 1) \
            / ext2fs->fs_info.block_size + 1)
 
-/* ext2fs_bmap_load - look up block bitmap & load into cache
+/* ext2fs_cache_find - find an entry in a bitmap or inode table cache
  *
  * Note: This routine assumes &ext2fs->lock is locked by the caller.
  *
+ * return the entry or NULL if the key is not cached
+ * */
+static EXT2FS_CACHE_ENT *
+ext2fs_cache_find(EXT2FS_INFO * ext2fs, EXT2FS_CACHE_ENT * a_cache,
+    int a_cnt, TSK_DADDR_T a_key)
+{
+    int i;
+
+    for (i = 0; i < a_cnt; i++) {
+        if ((a_cache[i].len > 0) && (a_cache[i].key == a_key)) {
+            a_cache[i].age = ++ext2fs->cache_age;
+            return &a_cache[i];
+        }
+    }
+    return NULL;
+}
+
+/* ext2fs_cache_slot - get a cache entry to load new data into.  An unused
+ * entry is returned if there is one, otherwise the least recently used one.
+ * The entry is not used for lookups until its len is set.
+ *
+ * Note: This routine assumes &ext2fs->lock is locked by the caller.
+ *
+ * return NULL on error
+ * */
+static EXT2FS_CACHE_ENT *
+ext2fs_cache_slot(EXT2FS_INFO * ext2fs, EXT2FS_CACHE_ENT * a_cache,
+    int a_cnt, size_t a_len)
+{
+    EXT2FS_CACHE_ENT *ent = &a_cache[0];
+    int i;
+
+    for (i = 0; i < a_cnt; i++) {
+        if (a_cache[i].len == 0) {
+            ent = &a_cache[i];
+            break;
+        }
+        if (a_cache[i].age < ent->age)
+            ent = &a_cache[i];
+    }
+
+    /* all entries in a cache hold the same amount of data, so the
+     * buffer of an old entry can be reused */
+    if (ent->buf == NULL) {
+        if ((ent->buf = (uint8_t *) tsk_malloc(a_len)) == NULL)
+            return NULL;
+    }
+    ent->len = 0;
+    ent->age = ++ext2fs->cache_age;
+    return ent;
+}
+
+/* ext2fs_cache_free - free the buffers of a bitmap or inode table cache */
+static void
+ext2fs_cache_free(EXT2FS_CACHE_ENT * a_cache, int a_cnt)
+{
+    int i;
+
+    for (i = 0; i < a_cnt; i++) {
+        free(a_cache[i].buf);
+        a_cache[i].buf = NULL;
+    }
+}
+
+/* ext2fs_map_load - look up a block or inode bitmap & load into cache
+ *
+ * With flex_bg, the bitmaps of several groups are next to each other on
+ * disk.  When a bitmap is not cached, the bitmaps of the following groups
+ * that are adjacent to it are read at the same time.
+ *
+ * Note: This routine assumes &ext2fs->lock is locked by the caller.  The
+ * returned buffer is valid until the lock is released.
+ *
+ * @param ext2fs File system to load from
+ * @param grp_num Group to load the bitmap of
+ * @param a_inode 1 to load the inode bitmap and 0 for the block bitmap
+ * @param a_map Set to the bitmap
+ *
  * return 1 on error and 0 on success
  * */
 static uint8_t
-ext2fs_bmap_load(EXT2FS_INFO * ext2fs, EXT2_GRPNUM_T grp_num)
+ext2fs_map_load(EXT2FS_INFO * ext2fs, EXT2_GRPNUM_T grp_num,
+    uint8_t a_inode, uint8_t ** a_map)
 {
     TSK_FS_INFO *fs = (TSK_FS_INFO *) & ext2fs->fs_info;
+    EXT2FS_CACHE_ENT *cache =
+        a_inode ? ext2fs->imap_cache : ext2fs->bmap_cache;
+    EXT2FS_CACHE_ENT *ent;
+    const uint8_t *gd;
+    TSK_DADDR_T addr;
+    EXT2_GRPNUM_T n, i;
+    uint8_t *buf;
     ssize_t cnt;
 
+    if ((ent = ext2fs_cache_find(ext2fs, cache, EXT2FS_BMAP_CACHE_CNT,
+                grp_num)) != NULL) {
+        *a_map = ent->buf;
+        return 0;
+    }
+
     /*
-     * Look up the group descriptor info.  The load will do the sanity check.
+     * Look up the group descriptor info.
      */
-    if (ext2fs_group_load(ext2fs, grp_num)) {
+    if ((gd = ext2fs_gd_get(ext2fs, grp_num)) == NULL)
         return 1;
-    }
 
-    if (ext2fs->bmap_buf == NULL) {
-        if ((ext2fs->bmap_buf =
-                (uint8_t *) tsk_malloc(fs->block_size)) == NULL) {
-            return 1;
-        }
-    }
-    else if (ext2fs->bmap_grp_num == grp_num) {
-        return 0;
-    }
-
-    if (tsk_verbose) {
+    if ((tsk_verbose) && (a_inode == 0)) {
         TSK_DADDR_T dbase = 0;  /* first block number in group */
         TSK_DADDR_T dmin = 0;   /* first block after inodes */
 
         dbase = ext2_cgbase_lcl(fs, ext2fs->fs, grp_num);
-        dmin = tsk_getu32(fs->endian,
-            ext2fs->grp_buf->bg_inode_table) + INODE_TABLE_SIZE(ext2fs);
+        dmin = ext2fs_gd_inode_table(ext2fs, gd) + INODE_TABLE_SIZE(ext2fs);
 
         tsk_fprintf(stderr,
             "ext2_bmap_load: loading group %" PRI_EXT2GRP
             " dbase %" PRIuDADDR " bmap +%" PRIuDADDR
             " imap +%" PRIuDADDR " inos +%" PRIuDADDR "..%"
             PRIuDADDR "\n", grp_num, dbase,
-            (TSK_DADDR_T) tsk_getu32(fs->endian,
-                ext2fs->grp_buf->bg_block_bitmap)
-            - dbase, (TSK_DADDR_T) tsk_getu32(fs->endian,
-                ext2fs->grp_buf->bg_inode_bitmap) - dbase,
-            (TSK_DADDR_T) tsk_getu32(fs->endian,
-                ext2fs->grp_buf->bg_inode_table) - dbase,
-            dmin - 1 - dbase);
+            ext2fs_gd_block_bitmap(ext2fs, gd) - dbase,
+            ext2fs_gd_inode_bitmap(ext2fs, gd) - dbase,
+            ext2fs_gd_inode_table(ext2fs, gd) - dbase, dmin - 1 - dbase);
     }
 
-    /*
-     * Look up the block allocation bitmap.
-     */
-    if (tsk_getu32(fs->endian,
-            ext2fs->grp_buf->bg_block_bitmap) > fs->last_block) {
+    addr = a_inode ? ext2fs_gd_inode_bitmap(ext2fs, gd) :
+        ext2fs_gd_block_bitmap(ext2fs, gd);
+    if (addr > fs->last_block) {
         tsk_error_reset();
         tsk_error_set_errno(TSK_ERR_FS_BLK_NUM);
         tsk_error_set_errstr
-            ("ext2fs_bmap_load: Block too large for image: %" PRIu32 "",
-            tsk_getu32(fs->endian, ext2fs->grp_buf->bg_block_bitmap));
+            ("ext2fs_%s_load: Block too large for image: %" PRIuDADDR "",
+            a_inode ? "imap" : "bmap", addr);
         return 1;
     }
 
-    cnt = tsk_fs_read(fs, (TSK_DADDR_T) tsk_getu32(fs->endian,
-            ext2fs->grp_buf->bg_block_bitmap) * fs->block_size,
-        (char *) ext2fs->bmap_buf, ext2fs->fs_info.block_size);
+    /* Find how many of the following groups have their bitmap right
+     * after this one and are not already cached */
+    for (n = 1; n < EXT2FS_BMAP_READ_MAX; n++) {
+        const uint8_t *gd2;
+        TSK_DADDR_T addr2;
 
-    if (cnt != ext2fs->fs_info.block_size) {
+        if ((grp_num + n >= ext2fs->gd_count) ||
+            (addr + n > fs->last_block_act))
+            break;
+        gd2 = &ext2fs->gd_buf[(size_t) (grp_num + n) * ext2fs->gd_size];
+        addr2 = a_inode ? ext2fs_gd_inode_bitmap(ext2fs, gd2) :
+            ext2fs_gd_block_bitmap(ext2fs, gd2);
+        if ((addr2 != addr + n) ||
+            (ext2fs_cache_find(ext2fs, cache, EXT2FS_BMAP_CACHE_CNT,
+                    grp_num + n) != NULL))
+            break;
+    }
+
+    if ((buf = (uint8_t *) tsk_malloc(n * fs->block_size)) == NULL)
+        return 1;
+
+    cnt = tsk_fs_read(fs, addr * fs->block_size, (char *) buf,
+        n * fs->block_size);
+    if ((cnt != (ssize_t) (n * fs->block_size)) && (n > 1)) {
+        n = 1;
+        cnt = tsk_fs_read(fs, addr * fs->block_size, (char *) buf,
+            fs->block_size);
+    }
+    if (cnt != (ssize_t) (n * fs->block_size)) {
+        /* As before, a bitmap that cannot be read is recorded as an
+         * error, but is used as though it were all zeros */
         if (cnt >= 0) {
             tsk_error_reset();
             tsk_error_set_errno(TSK_ERR_FS_READ);
         }
-        tsk_error_set_errstr2("ext2fs_bmap_load: Bitmap group %"
-            PRI_EXT2GRP " at %" PRIu32, grp_num, tsk_getu32(fs->endian,
-                ext2fs->grp_buf->bg_block_bitmap));
+        tsk_error_set_errstr2("ext2fs_%s_load: %s bitmap %" PRI_EXT2GRP
+            " at %" PRIuDADDR, a_inode ? "imap" : "bmap",
+            a_inode ? "Inode" : "Block", grp_num, addr);
+        if (cnt < 0)
+            cnt = 0;
+        memset(&buf[cnt], 0, fs->block_size - cnt);
     }
 
-    ext2fs->bmap_grp_num = grp_num;
+    /* Add the following groups first so that the requested one is the
+     * most recently used */
+    for (i = n; i > 0; i--) {
+        if ((ent = ext2fs_cache_slot(ext2fs, cache, EXT2FS_BMAP_CACHE_CNT,
+                    fs->block_size)) == NULL) {
+            free(buf);
+            return 1;
+        }
+        memcpy(ent->buf, &buf[(i - 1) * fs->block_size], fs->block_size);
+        ent->key = grp_num + i - 1;
+        ent->len = fs->block_size;
+    }
+    free(buf);
 
     if (tsk_verbose > 1)
-        ext2fs_print_map(ext2fs->bmap_buf,
-            tsk_getu32(fs->endian, ext2fs->fs->s_blocks_per_group));
+        ext2fs_print_map(ent->buf,
+            tsk_getu32(fs->endian, a_inode ?
+                ext2fs->fs->s_inodes_per_group :
+                ext2fs->fs->s_blocks_per_group));
 
+    *a_map = ent->buf;
     return 0;
 }
 
+/* ext2fs_bmap_load - look up block bitmap & load into cache
+ *
+ * Note: This routine assumes &ext2fs->lock is locked by the caller.
+ *
+ * return 1 on error and 0 on success
+ * */
+static uint8_t
+ext2fs_bmap_load(EXT2FS_INFO * ext2fs, EXT2_GRPNUM_T grp_num,
+    uint8_t ** a_map)
+{
+    return ext2fs_map_load(ext2fs, grp_num, 0, a_map);
+}
+
 
 /* ext2fs_imap_load - look up inode bitmap & load into cache
  *
@@ -422,97 +707,10 @@ ext2fs_bmap_load(EXT2FS_INFO * ext2fs, EXT2_GRPNUM_T grp_num)
  * return 0 on success and 1 on error
  * */
 static uint8_t
-ext2fs_imap_load(EXT2FS_INFO * ext2fs, EXT2_GRPNUM_T grp_num)
+ext2fs_imap_load(EXT2FS_INFO * ext2fs, EXT2_GRPNUM_T grp_num,
+    uint8_t ** a_map)
 {
-    TSK_FS_INFO *fs = (TSK_FS_INFO *) & ext2fs->fs_info;
-    ssize_t cnt;
-
-    /*
-     * Look up the group descriptor info.
-     */
-    if (ext2fs_group_load(ext2fs, grp_num)) {
-        return 1;
-    }
-
-    /* Allocate the cache buffer and exit if map is already loaded */
-    if (ext2fs->imap_buf == NULL) {
-        if ((ext2fs->imap_buf =
-                (uint8_t *) tsk_malloc(fs->block_size)) == NULL) {
-            return 1;
-        }
-    }
-    else if (ext2fs->imap_grp_num == grp_num) {
-        return 0;
-    }
-
-    /*
-     * Look up the inode allocation bitmap.
-     */
-    if (EXT2FS_HAS_INCOMPAT_FEATURE(fs, ext2fs->fs,
-            EXT2FS_FEATURE_INCOMPAT_64BIT)) {
-        if (ext4_getu64(fs->endian,
-                ext2fs->ext4_grp_buf->bg_block_bitmap_hi,
-                ext2fs->ext4_grp_buf->bg_block_bitmap_lo)
-            > fs->last_block) {
-            tsk_error_reset();
-            tsk_error_set_errno(TSK_ERR_FS_BLK_NUM);
-            tsk_error_set_errstr
-                ("ext2fs_imap_load: Block too large for image: %" PRIu64
-                "", ext4_getu64(fs->endian,
-                    ext2fs->ext4_grp_buf->bg_block_bitmap_hi,
-                    ext2fs->ext4_grp_buf->bg_block_bitmap_lo));
-        }
-
-        cnt = tsk_fs_read(fs,
-            (TSK_DADDR_T) ext4_getu64(fs->endian,
-                ext2fs->ext4_grp_buf->bg_inode_bitmap_hi,
-                ext2fs->ext4_grp_buf->bg_block_bitmap_lo) * fs->block_size,
-            (char *) ext2fs->imap_buf, ext2fs->fs_info.block_size);
-
-        if (cnt != ext2fs->fs_info.block_size) {
-            if (cnt >= 0) {
-                tsk_error_reset();
-                tsk_error_set_errno(TSK_ERR_FS_READ);
-            }
-            tsk_error_set_errstr2("ext2fs_imap_load: Inode bitmap %"
-                PRI_EXT2GRP " at %" PRIu32, grp_num, tsk_getu32(fs->endian,
-                    ext2fs->grp_buf->bg_inode_bitmap));
-        }
-    }
-    else {
-        if (tsk_getu32(fs->endian,
-                ext2fs->grp_buf->bg_inode_bitmap) > fs->last_block) {
-            tsk_error_reset();
-            tsk_error_set_errno(TSK_ERR_FS_BLK_NUM);
-            tsk_error_set_errstr
-                ("ext2fs_imap_load: Block too large for image: %" PRIu32
-                "", tsk_getu32(fs->endian,
-                    ext2fs->grp_buf->bg_inode_bitmap));
-        }
-
-        cnt = tsk_fs_read(fs,
-            (TSK_DADDR_T) tsk_getu32(fs->endian,
-                ext2fs->grp_buf->bg_inode_bitmap) * fs->block_size,
-            (char *) ext2fs->imap_buf, ext2fs->fs_info.block_size);
-
-        if (cnt != ext2fs->fs_info.block_size) {
-            if (cnt >= 0) {
-                tsk_error_reset();
-                tsk_error_set_errno(TSK_ERR_FS_READ);
-            }
-            tsk_error_set_errstr2("ext2fs_imap_load: Inode bitmap %"
-                PRI_EXT2GRP " at %" PRIu32, grp_num, tsk_getu32(fs->endian,
-                    ext2fs->grp_buf->bg_inode_bitmap));
-        }
-    }
-
-
-    ext2fs->imap_grp_num = grp_num;
-    if (tsk_verbose > 1)
-        ext2fs_print_map(ext2fs->imap_buf,
-            tsk_getu32(fs->endian, ext2fs->fs->s_inodes_per_group));
-
-    return 0;
+    return ext2fs_map_load(ext2fs, grp_num, 1, a_map);
 }
 
 /* ext2fs_dinode_load - look up disk inode & load into ext2fs_inode structure
@@ -532,6 +730,12 @@ ext2fs_dinode_load(EXT2FS_INFO * ext2fs, TSK_INUM_T dino_inum,
     ssize_t cnt;
     TSK_INUM_T rel_inum;
     TSK_FS_INFO *fs = (TSK_FS_INFO *) & ext2fs->fs_info;
+    const uint8_t *gd;
+    TSK_DADDR_T tbl_addr;
+    TSK_OFF_T tbl_off;
+    TSK_DADDR_T chunk_blk;
+    size_t chunk_off;
+    EXT2FS_CACHE_ENT *ent;
 
     /*
      * Sanity check.
@@ -558,11 +762,7 @@ ext2fs_dinode_load(EXT2FS_INFO * ext2fs, TSK_INUM_T dino_inum,
     grp_num = (EXT2_GRPNUM_T) ((dino_inum - fs->first_inum) /
         tsk_getu32(fs->endian, ext2fs->fs->s_inodes_per_group));
 
-    /* lock access to grp_buf */
-    tsk_take_lock(&ext2fs->lock);
-
-    if (ext2fs_group_load(ext2fs, grp_num)) {
-        tsk_release_lock(&ext2fs->lock);
+    if ((gd = ext2fs_gd_get(ext2fs, grp_num)) == NULL) {
         return 1;
     }
 
@@ -572,38 +772,66 @@ ext2fs_dinode_load(EXT2FS_INFO * ext2fs, TSK_INUM_T dino_inum,
     rel_inum =
         (dino_inum - 1) - tsk_getu32(fs->endian,
         ext2fs->fs->s_inodes_per_group) * grp_num;
-    if (EXT2FS_HAS_INCOMPAT_FEATURE(fs, ext2fs->fs,
-            EXT2FS_FEATURE_INCOMPAT_64BIT)
-        && (tsk_getu16(fs->endian, ext2fs->fs->s_desc_size) >= 64)) {
-#ifdef Ext4_DBG
-        printf("DEBUG: d_inode_load 64bit gd_size=%d\n",
-            tsk_getu16(fs->endian, ext2fs->fs->s_desc_size));
-#endif
-        addr =
-            (TSK_OFF_T) ext4_getu64(fs->endian,
-            ext2fs->ext4_grp_buf->bg_inode_table_hi,
-            ext2fs->ext4_grp_buf->bg_inode_table_lo)
-            * (TSK_OFF_T) fs->block_size +
-            rel_inum * (TSK_OFF_T) ext2fs->inode_size;
+    tbl_addr = ext2fs_gd_inode_table(ext2fs, gd);
+    tbl_off = rel_inum * (TSK_OFF_T) ext2fs->inode_size;
+    addr = (TSK_OFF_T) tbl_addr *(TSK_OFF_T) fs->block_size + tbl_off;
+
+    /*
+     * The inode table is read and cached in chunks of
+     * EXT2FS_ITBL_CACHE_BLKS blocks (aligned to the start of the table)
+     * so that neighboring inodes do not each need their own read.
+     */
+    chunk_blk = (TSK_DADDR_T) (tbl_off / fs->block_size);
+    chunk_blk -= chunk_blk % EXT2FS_ITBL_CACHE_BLKS;
+    chunk_off = (size_t) (tbl_off - (TSK_OFF_T) chunk_blk * fs->block_size);
+
+    /* lock access to itbl_cache */
+    tsk_take_lock(&ext2fs->lock);
+
+    if ((ent = ext2fs_cache_find(ext2fs, ext2fs->itbl_cache,
+                EXT2FS_ITBL_CACHE_CNT, tbl_addr + chunk_blk)) == NULL) {
+        TSK_DADDR_T chunk_cnt = INODE_TABLE_SIZE(ext2fs) - chunk_blk;
+        if (chunk_cnt > EXT2FS_ITBL_CACHE_BLKS)
+            chunk_cnt = EXT2FS_ITBL_CACHE_BLKS;
+
+        if ((tbl_addr + chunk_blk + chunk_cnt - 1 <= fs->last_block_act)
+            && ((ent = ext2fs_cache_slot(ext2fs, ext2fs->itbl_cache,
+                        EXT2FS_ITBL_CACHE_CNT,
+                        EXT2FS_ITBL_CACHE_BLKS * fs->block_size)) !=
+                NULL)) {
+            cnt = tsk_fs_read(fs,
+                (TSK_OFF_T) (tbl_addr + chunk_blk) * fs->block_size,
+                (char *) ent->buf, (size_t) chunk_cnt * fs->block_size);
+            if (cnt == (ssize_t) (chunk_cnt * fs->block_size)) {
+                ent->key = tbl_addr + chunk_blk;
+                ent->len = (size_t) cnt;
+            }
+            else {
+                /* leave it unused and read the inode on its own below */
+                ent = NULL;
+                tsk_error_reset();
+            }
+        }
     }
-    else {
-        addr =
-            (TSK_OFF_T) tsk_getu32(fs->endian,
-            ext2fs->grp_buf->bg_inode_table) * (TSK_OFF_T) fs->block_size +
-            rel_inum * (TSK_OFF_T) ext2fs->inode_size;
+
+    if ((ent != NULL) && (chunk_off + ext2fs->inode_size <= ent->len)) {
+        memcpy(dino_buf, &ent->buf[chunk_off], ext2fs->inode_size);
+        tsk_release_lock(&ext2fs->lock);
     }
-    tsk_release_lock(&ext2fs->lock);
+    else {
+        tsk_release_lock(&ext2fs->lock);
 
-    cnt = tsk_fs_read(fs, addr, (char *) dino_buf, ext2fs->inode_size);
+        cnt = tsk_fs_read(fs, addr, (char *) dino_buf, ext2fs->inode_size);
 
-    if (cnt != ext2fs->inode_size) {
-        if (cnt >= 0) {
-            tsk_error_reset();
-            tsk_error_set_errno(TSK_ERR_FS_READ);
+        if (cnt != ext2fs->inode_size) {
+            if (cnt >= 0) {
+                tsk_error_reset();
+                tsk_error_set_errno(TSK_ERR_FS_READ);
+            }
+            tsk_error_set_errstr2("ext2fs_dinode_load: Inode %" PRIuINUM
+                " from %" PRIuOFF, dino_inum, addr);
+            return 1;
         }
-        tsk_error_set_errstr2("ext2fs_dinode_load: Inode %" PRIuINUM
-            " from %" PRIuOFF, dino_inum, addr);
-        return 1;
     }
 //DEBUG    printf("Inode Size: %d, %d, %d, %d\n", sizeof(ext2fs_inode), *ext2fs->fs->s_inode_size, ext2fs->inode_size, *ext2fs->fs->s_want_extra_isize);
 //DEBUG    debug_print_buf((char *)dino_buf, ext2fs->inode_size);
@@ -645,6 +873,7 @@ ext2fs_dinode_copy(EXT2FS_INFO * ext2fs, TSK_FS_META * fs_meta,
     ext2fs_sb *sb = ext2fs->fs;
     EXT2_GRPNUM_T grp_num;
     TSK_INUM_T ibase = 0;
+    uint8_t *imap;
 
 
     if (dino_buf == NULL) {
@@ -888,7 +1117,7 @@ ext2fs_dinode_copy(EXT2FS_INFO * ext2fs, TSK_FS_META * fs_meta,
 
     tsk_take_lock(&ext2fs->lock);
 
-    if (ext2fs_imap_load(ext2fs, grp_num)) {
+    if (ext2fs_imap_load(ext2fs, grp_num, &imap)) {
         tsk_release_lock(&ext2fs->lock);
         return 1;
     }
@@ -900,7 +1129,7 @@ ext2fs_dinode_copy(EXT2FS_INFO * ext2fs, TSK_FS_META * fs_meta,
     /*
      * Apply the allocated/unallocated restriction.
      */
-    fs_meta->flags = (isset(ext2fs->imap_buf, inum - ibase) ?
+    fs_meta->flags = (isset(imap, inum - ibase) ?
         TSK_FS_META_FLAG_ALLOC : TSK_FS_META_FLAG_UNALLOC);
 
     tsk_release_lock(&ext2fs->lock);
@@ -999,10 +1228,19 @@ ext2fs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
     TSK_INUM_T inum;
     TSK_INUM_T end_inum_tmp;
     TSK_INUM_T ibase = 0;
+    uint8_t *imap;
     TSK_FS_FILE *fs_file;
     int myflags;
     ext2fs_inode *dino_buf = NULL;
     unsigned int size = 0;
+    TSK_INUM_T ipg;
+    EXT2_GRPNUM_T scan_grp = 0xffffffff;
+    uint8_t *grp_imap = NULL;   /* copy of the inode bitmap of scan_grp */
+    TSK_INUM_T grp_used = 0;
+    TSK_DADDR_T tbl_addr = 0;
+    uint8_t *itbl_buf = NULL;   /* chunk of the inode table of scan_grp */
+    TSK_INUM_T itbl_max, itbl_first = 0, itbl_cnt = 0;
+    uint8_t itbl_ok = 0;
 
     // clean up any error messages that are lying around
     tsk_error_reset();
@@ -1087,43 +1325,122 @@ ext2fs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
         return 1;
     }
 
+    /*
+     * The inode bitmap of each group is copied once and the inode table
+     * is read in chunks of up to EXT2FS_ISCAN_BLKS blocks instead of one
+     * inode at a time.
+     */
+    ipg = tsk_getu32(fs->endian, ext2fs->fs->s_inodes_per_group);
+    itbl_max = ipg;
+    if (ext2fs->inode_size > 0 && itbl_max >
+        (TSK_INUM_T) EXT2FS_ISCAN_BLKS * fs->block_size / ext2fs->inode_size)
+        itbl_max =
+            (TSK_INUM_T) EXT2FS_ISCAN_BLKS * fs->block_size /
+            ext2fs->inode_size;
+    if (((grp_imap = (uint8_t *) tsk_malloc(fs->block_size)) == NULL) ||
+        ((itbl_buf =
+                (uint8_t *) tsk_malloc((size_t) itbl_max *
+                    ext2fs->inode_size)) == NULL)) {
+        tsk_fs_file_close(fs_file);
+        free(dino_buf);
+        free(grp_imap);
+        return 1;
+    }
+
     for (inum = start_inum; inum <= end_inum_tmp; inum++) {
         int retval;
+        TSK_INUM_T rel_inum;
 
         /*
          * Be sure to use the proper group descriptor data. XXX Linux inodes
          * start at 1, as in Fortran.
          */
-        grp_num =
-            (EXT2_GRPNUM_T) ((inum - 1) / tsk_getu32(fs->endian,
-                ext2fs->fs->s_inodes_per_group));
-
-        /* lock access to imap_buf */
-        tsk_take_lock(&ext2fs->lock);
+        grp_num = (EXT2_GRPNUM_T) ((inum - 1) / ipg);
+        ibase = grp_num * ipg + 1;
+        rel_inum = inum - ibase;
+
+        if (grp_num != scan_grp) {
+            const uint8_t *gd;
+
+            /* lock access to imap_cache */
+            tsk_take_lock(&ext2fs->lock);
+
+            if (ext2fs_imap_load(ext2fs, grp_num, &imap)) {
+                tsk_release_lock(&ext2fs->lock);
+                tsk_fs_file_close(fs_file);
+                free(dino_buf);
+                free(grp_imap);
+                free(itbl_buf);
+                return 1;
+            }
+            memcpy(grp_imap, imap, fs->block_size);
 
-        if (ext2fs_imap_load(ext2fs, grp_num)) {
             tsk_release_lock(&ext2fs->lock);
-            free(dino_buf);
-            return 1;
+
+            gd = ext2fs_gd_get(ext2fs, grp_num);
+            grp_used = ext2fs_gd_inodes_used(ext2fs, gd);
+            tbl_addr = ext2fs_gd_inode_table(ext2fs, gd);
+            scan_grp = grp_num;
+            itbl_first = 0;
+            itbl_cnt = 0;
+            itbl_ok = 0;
+        }
+
+        /* The rest of the group has never been used, so skip to the
+         * next group unless unallocated inodes were asked for */
+        if ((rel_inum >= grp_used)
+            && ((flags & TSK_FS_META_FLAG_UNALLOC) == 0)) {
+            inum = ibase + ipg - 1;
+            continue;
         }
-        ibase =
-            grp_num * tsk_getu32(fs->endian,
-            ext2fs->fs->s_inodes_per_group) + 1;
 
         /*
          * Apply the allocated/unallocated restriction.
          */
-        myflags = (isset(ext2fs->imap_buf, inum - ibase) ?
+        myflags = (isset(grp_imap, rel_inum) ?
             TSK_FS_META_FLAG_ALLOC : TSK_FS_META_FLAG_UNALLOC);
 
-        tsk_release_lock(&ext2fs->lock);
-
         if ((flags & myflags) != myflags)
             continue;
 
-        if (ext2fs_dinode_load(ext2fs, inum, dino_buf)) {
+        /* Read the next chunk of the inode table if this inode is not in
+         * the current one */
+        if ((rel_inum < itbl_first) || (rel_inum >= itbl_first + itbl_cnt)) {
+            TSK_INUM_T last = ipg;
+            ssize_t cnt;
+
+            if ((flags & TSK_FS_META_FLAG_UNALLOC) == 0)
+                last = grp_used;
+            itbl_first = rel_inum;
+            itbl_cnt = last - rel_inum;
+            if (itbl_cnt > itbl_max)
+                itbl_cnt = itbl_max;
+
+            cnt = tsk_fs_read(fs,
+                (TSK_OFF_T) tbl_addr * fs->block_size +
+                (TSK_OFF_T) rel_inum * ext2fs->inode_size,
+                (char *) itbl_buf, (size_t) itbl_cnt * ext2fs->inode_size);
+            if (cnt == (ssize_t) (itbl_cnt * ext2fs->inode_size)) {
+                itbl_ok = 1;
+            }
+            else {
+                /* load the inodes in this range one at a time so that
+                 * the ones that can be read are still returned */
+                itbl_ok = 0;
+                tsk_error_reset();
+            }
+        }
+
+        if (itbl_ok) {
+            memcpy(dino_buf,
+                &itbl_buf[(rel_inum - itbl_first) * ext2fs->inode_size],
+                ext2fs->inode_size);
+        }
+        else if (ext2fs_dinode_load(ext2fs, inum, dino_buf)) {
             tsk_fs_file_close(fs_file);
             free(dino_buf);
+            free(grp_imap);
+            free(itbl_buf);
             return 1;
         }
 
@@ -1154,6 +1471,8 @@ ext2fs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
         if (ext2fs_dinode_copy(ext2fs, fs_file->meta, inum, dino_buf)) {
             tsk_fs_meta_close(fs_file->meta);
             free(dino_buf);
+            free(grp_imap);
+            free(itbl_buf);
             return 1;
         }
 
@@ -1161,11 +1480,15 @@ ext2fs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
         if (retval == TSK_WALK_STOP) {
             tsk_fs_file_close(fs_file);
             free(dino_buf);
+            free(grp_imap);
+            free(itbl_buf);
             return 0;
         }
         else if (retval == TSK_WALK_ERROR) {
             tsk_fs_file_close(fs_file);
             free(dino_buf);
+            free(grp_imap);
+            free(itbl_buf);
             return 1;
         }
     }
@@ -1179,6 +1502,8 @@ ext2fs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
         if (tsk_fs_dir_make_orphan_dir_meta(fs, fs_file->meta)) {
             tsk_fs_file_close(fs_file);
             free(dino_buf);
+            free(grp_imap);
+            free(itbl_buf);
             return 1;
         }
         /* call action */
@@ -1186,11 +1511,15 @@ ext2fs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
         if (retval == TSK_WALK_STOP) {
             tsk_fs_file_close(fs_file);
             free(dino_buf);
+            free(grp_imap);
+            free(itbl_buf);
             return 0;
         }
         else if (retval == TSK_WALK_ERROR) {
             tsk_fs_file_close(fs_file);
             free(dino_buf);
+            free(grp_imap);
+            free(itbl_buf);
             return 1;
         }
     }
@@ -1201,6 +1530,8 @@ ext2fs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
     tsk_fs_file_close(fs_file);
     if (dino_buf != NULL)
         free((char *) dino_buf);
+    free(grp_imap);
+    free(itbl_buf);
 
     return 0;
 }
@@ -1215,6 +1546,9 @@ ext2fs_block_getflags(TSK_FS_INFO * a_fs, TSK_DADDR_T a_addr)
     EXT2_GRPNUM_T grp_num;
     TSK_DADDR_T dbase = 0;      /* first block number in group */
     TSK_DADDR_T dmin = 0;       /* first block after inodes */
+    TSK_DADDR_T block_bitmap, inode_bitmap, inode_table;
+    const uint8_t *gd;
+    uint8_t *bmap;
 
     // these blocks are not described in the group descriptors
     // sparse
@@ -1225,11 +1559,15 @@ ext2fs_block_getflags(TSK_FS_INFO * a_fs, TSK_DADDR_T a_addr)
 
     grp_num = ext2_dtog_lcl(a_fs, ext2fs->fs, a_addr);
 
-    /* lock access to bmap_buf */
+    if ((gd = ext2fs_gd_get(ext2fs, grp_num)) == NULL) {
+        return 0;
+    }
+
+    /* lock access to bmap_cache */
     tsk_take_lock(&ext2fs->lock);
 
     /* Lookup bitmap if not loaded */
-    if (ext2fs_bmap_load(ext2fs, grp_num)) {
+    if (ext2fs_bmap_load(ext2fs, grp_num, &bmap)) {
         tsk_release_lock(&ext2fs->lock);
         return 0;
     }
@@ -1243,9 +1581,10 @@ ext2fs_block_getflags(TSK_FS_INFO * a_fs, TSK_DADDR_T a_addr)
      * s_first_data_block field.
      */
     dbase = ext2_cgbase_lcl(a_fs, ext2fs->fs, grp_num);
-    dmin =
-        tsk_getu32(a_fs->endian,
-        ext2fs->grp_buf->bg_inode_table) + INODE_TABLE_SIZE(ext2fs);
+    block_bitmap = ext2fs_gd_block_bitmap(ext2fs, gd);
+    inode_bitmap = ext2fs_gd_inode_bitmap(ext2fs, gd);
+    inode_table = ext2fs_gd_inode_table(ext2fs, gd);
+    dmin = inode_table + INODE_TABLE_SIZE(ext2fs);
 
     /*
      *  Identify meta blocks
@@ -1264,28 +1603,121 @@ ext2fs_block_getflags(TSK_FS_INFO * a_fs, TSK_DADDR_T a_addr)
      * locations of superblocks and group descriptor blocks are reserved.
      * They just happen to be reserved for something else :-)
      */
-    flags = (isset(ext2fs->bmap_buf, a_addr - dbase) ?
+    flags = (isset(bmap, a_addr - dbase) ?
         TSK_FS_BLOCK_FLAG_ALLOC : TSK_FS_BLOCK_FLAG_UNALLOC);
 
-    if ((a_addr >= dbase
-            && a_addr < tsk_getu32(a_fs->endian,
-                ext2fs->grp_buf->bg_block_bitmap))
-        || (a_addr == tsk_getu32(a_fs->endian,
-                ext2fs->grp_buf->bg_block_bitmap))
-        || (a_addr == tsk_getu32(a_fs->endian,
-                ext2fs->grp_buf->bg_inode_bitmap))
-        || (a_addr >= tsk_getu32(a_fs->endian,
-                ext2fs->grp_buf->bg_inode_table)
-            && a_addr < dmin))
+    tsk_release_lock(&ext2fs->lock);
+
+    if ((a_addr >= dbase && a_addr < block_bitmap)
+        || (a_addr == block_bitmap)
+        || (a_addr == inode_bitmap)
+        || (a_addr >= inode_table && a_addr < dmin))
         flags |= TSK_FS_BLOCK_FLAG_META;
     else
         flags |= TSK_FS_BLOCK_FLAG_CONT;
 
-    tsk_release_lock(&ext2fs->lock);
     return flags;
 }
 
 
+/* ext2fs_block_getflags_range - get the flags of a_addr and the number of
+ * blocks after it (up to a_end) that have the same flags.  This uses the
+ * block bitmap of the group directly instead of calling
+ * ext2fs_block_getflags() for each block.
+ *
+ * return the number of blocks or 0 on error
+ */
+static TSK_DADDR_T
+ext2fs_block_getflags_range(TSK_FS_INFO * a_fs, TSK_DADDR_T a_addr,
+    TSK_DADDR_T a_end, TSK_FS_BLOCK_FLAG_ENUM * a_flags)
+{
+    EXT2FS_INFO *ext2fs = (EXT2FS_INFO *) a_fs;
+    EXT2_GRPNUM_T grp_num;
+    TSK_DADDR_T dbase, dmin, last, addr;
+    TSK_DADDR_T block_bitmap, inode_bitmap, inode_table;
+    TSK_DADDR_T bounds[7];
+    const uint8_t *gd;
+    uint8_t *bmap;
+    int meta, alloc, i;
+
+    // these blocks are not described in the group descriptors
+    if (a_addr == 0) {
+        *a_flags = TSK_FS_BLOCK_FLAG_CONT | TSK_FS_BLOCK_FLAG_ALLOC;
+        return 1;
+    }
+    if (a_addr < ext2fs->first_data_block) {
+        *a_flags = TSK_FS_BLOCK_FLAG_META | TSK_FS_BLOCK_FLAG_ALLOC;
+        if (a_end >= ext2fs->first_data_block)
+            return ext2fs->first_data_block - a_addr;
+        return a_end - a_addr + 1;
+    }
+
+    grp_num = ext2_dtog_lcl(a_fs, ext2fs->fs, a_addr);
+    if ((gd = ext2fs_gd_get(ext2fs, grp_num)) == NULL)
+        return 0;
+
+    dbase = ext2_cgbase_lcl(a_fs, ext2fs->fs, grp_num);
+    block_bitmap = ext2fs_gd_block_bitmap(ext2fs, gd);
+    inode_bitmap = ext2fs_gd_inode_bitmap(ext2fs, gd);
+    inode_table = ext2fs_gd_inode_table(ext2fs, gd);
+    dmin = inode_table + INODE_TABLE_SIZE(ext2fs);
+
+    /* the range stops at the end of the group */
+    last = dbase + tsk_getu32(a_fs->endian,
+        ext2fs->fs->s_blocks_per_group) - 1;
+    if (last > a_end)
+        last = a_end;
+
+    /* The meta blocks are the same as in ext2fs_block_getflags().  Whether
+     * a block is meta can only change at one of these addresses. */
+    meta = ((a_addr >= dbase && a_addr < block_bitmap)
+        || (a_addr == block_bitmap)
+        || (a_addr == inode_bitmap)
+        || (a_addr >= inode_table && a_addr < dmin));
+    bounds[0] = dbase;
+    bounds[1] = block_bitmap;
+    bounds[2] = block_bitmap + 1;
+    bounds[3] = inode_bitmap;
+    bounds[4] = inode_bitmap + 1;
+    bounds[5] = inode_table;
+    bounds[6] = dmin;
+    for (i = 0; i < 7; i++) {
+        if ((bounds[i] > a_addr) && (bounds[i] - 1 < last))
+            last = bounds[i] - 1;
+    }
+
+    /* lock access to bmap_cache */
+    tsk_take_lock(&ext2fs->lock);
+
+    if (ext2fs_bmap_load(ext2fs, grp_num, &bmap)) {
+        tsk_release_lock(&ext2fs->lock);
+        return 0;
+    }
+
+    alloc = isset(bmap, a_addr - dbase) ? 1 : 0;
+    for (addr = a_addr + 1; addr <= last;) {
+        TSK_DADDR_T bit = addr - dbase;
+
+        /* skip whole bytes that match */
+        if ((bit % 8 == 0) && (addr + 7 <= last)
+            && (bmap[bit / 8] == (alloc ? 0xff : 0x00))) {
+            addr += 8;
+            continue;
+        }
+        if ((isset(bmap, bit) ? 1 : 0) != alloc)
+            break;
+        addr++;
+    }
+
+    tsk_release_lock(&ext2fs->lock);
+
+    *a_flags = (alloc ? TSK_FS_BLOCK_FLAG_ALLOC :
+        TSK_FS_BLOCK_FLAG_UNALLOC) | (meta ? TSK_FS_BLOCK_FLAG_META :
+        TSK_FS_BLOCK_FLAG_CONT);
+    return addr - a_addr;
+}
+
+
 /* ext2fs_block_walk - block iterator
  *
  * flags: TSK_FS_BLOCK_FLAG_ALLOC, TSK_FS_BLOCK_FLAG_UNALLOC, TSK_FS_BLOCK_FLAG_CONT,
@@ -1435,154 +1867,138 @@ ext2fs_make_data_run_extent(TSK_FS_INFO * fs_info, TSK_FS_ATTR * fs_attr,
 
 
 /** \internal
- * Given a block that contains an extent node (which starts with extent_header),
- * walk it, and add everything encountered to the appropriate attributes.
+ * Walk the children of an interior extent node and add everything
+ * encountered to the appropriate attributes.  Children that are stored
+ * in consecutive blocks are read with a single read.
+ *
+ * @param fs_info File system to analyze
+ * @param fs_attr Attribute to add the data runs to
+ * @param fs_attr_extent Attribute to add the extent index blocks to
+ * @param header Interior node whose children should be walked (already in memory)
+ * @param a_count Incremented for each extent index block that is added
  * @return 0 on success, 1 on error.
  */
-static TSK_OFF_T
+static uint8_t
 ext2fs_make_data_run_extent_index(TSK_FS_INFO * fs_info,
     TSK_FS_ATTR * fs_attr, TSK_FS_ATTR * fs_attr_extent,
-    TSK_DADDR_T idx_block)
+    ext2fs_extent_header * header, int32_t * a_count)
 {
-    ext2fs_extent_header *header;
-    TSK_FS_ATTR_RUN *data_run;
+    unsigned int fs_blocksize = fs_info->block_size;
+    uint16_t depth = tsk_getu16(fs_info->endian, header->eh_depth);
+    uint16_t num_entries = tsk_getu16(fs_info->endian, header->eh_entries);
+    ext2fs_extent_idx *indices = (ext2fs_extent_idx *) (header + 1);
+    unsigned int max_entries = (fs_blocksize -
+        sizeof(ext2fs_extent_header)) / sizeof(ext2fs_extent_idx);
     uint8_t *buf;
-    ssize_t cnt;
-    unsigned int i;
+    unsigned int i, j, n;
 
-    /* first, read the block specified by the parameter */
-    int fs_blocksize = fs_info->block_size;
-    if ((buf = (uint8_t *) tsk_malloc(fs_blocksize)) == NULL) {
+    if ((buf = (uint8_t *) tsk_malloc(EXT2FS_EXTENT_READ_MAX *
+                fs_blocksize)) == NULL) {
         return 1;
     }
 
-    cnt =
-        tsk_fs_read_block(fs_info, idx_block, (char *) buf, fs_blocksize);
-    if (cnt != fs_blocksize) {
-        if (cnt >= 0) {
-            tsk_error_reset();
-            tsk_error_set_errno(TSK_ERR_FS_READ);
-        }
-        tsk_error_set_errstr("ext2fs_make_data_run_extent_index: Block %"
-            PRIuDADDR, idx_block);
-        return 1;
-    }
-    header = (ext2fs_extent_header *) buf;
+    for (i = 0; i < num_entries; i += n) {
+        TSK_DADDR_T block =
+            (((uint32_t) tsk_getu16(fs_info->endian,
+                    indices[i].ei_leaf_hi)) << 16) |
+            tsk_getu32(fs_info->endian, indices[i].ei_leaf_lo);
+        ssize_t cnt;
 
-    /* add it to the extent attribute */
-    if (tsk_getu16(fs_info->endian, header->eh_magic) != 0xF30A) {
-        tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
-        tsk_error_set_errstr
-            ("ext2fs_make_data_run_extent_index: extent header magic valid incorrect!");
-        return 1;
-    }
+        /* see how many of the following children are in the next blocks */
+        for (n = 1; (n < EXT2FS_EXTENT_READ_MAX) && (i + n < num_entries);
+            n++) {
+            TSK_DADDR_T next =
+                (((uint32_t) tsk_getu16(fs_info->endian,
+                        indices[i + n].ei_leaf_hi)) << 16) |
+                tsk_getu32(fs_info->endian, indices[i + n].ei_leaf_lo);
+            if (next != block + n)
+                break;
+        }
 
-    data_run = tsk_fs_attr_run_alloc();
-    if (data_run == NULL) {
-        return 1;
-    }
-    data_run->addr = idx_block;
-    data_run->len = fs_blocksize;
+        cnt = tsk_fs_read_block(fs_info, block, (char *) buf,
+            n * fs_blocksize);
+        if (cnt != (ssize_t) (n * fs_blocksize)) {
+            if (cnt >= 0) {
+                tsk_error_reset();
+                tsk_error_set_errno(TSK_ERR_FS_READ);
+            }
+            tsk_error_set_errstr2
+                ("ext2fs_make_data_run_extent_index: Block %" PRIuDADDR,
+                block);
+            free(buf);
+            return 1;
+        }
 
-    if (tsk_fs_attr_add_run(fs_info, fs_attr_extent, data_run)) {
-        return 1;
-    }
+        for (j = 0; j < n; j++) {
+            ext2fs_extent_header *child =
+                (ext2fs_extent_header *) & buf[j * fs_blocksize];
+            TSK_FS_ATTR_RUN *data_run;
 
-    /* process leaf nodes */
-    if (tsk_getu16(fs_info->endian, header->eh_depth) == 0) {
-        ext2fs_extent *extents = (ext2fs_extent *) (header + 1);
-        for (i = 0; i < tsk_getu16(fs_info->endian, header->eh_entries);
-            i++) {
-            ext2fs_extent extent = extents[i];
-            if (ext2fs_make_data_run_extent(fs_info, fs_attr, &extent)) {
+            if (tsk_getu16(fs_info->endian, child->eh_magic) != 0xF30A) {
+                tsk_error_reset();
+                tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
+                tsk_error_set_errstr
+                    ("ext2fs_make_data_run_extent_index: extent header magic valid incorrect!");
+                free(buf);
                 return 1;
             }
-        }
-    }
-    /* recurse on interior nodes */
-    else {
-        ext2fs_extent_idx *indices = (ext2fs_extent_idx *) (header + 1);
-        for (i = 0; i < tsk_getu16(fs_info->endian, header->eh_entries);
-            i++) {
-            ext2fs_extent_idx *index = &indices[i];
-            TSK_DADDR_T child_block =
-                (((uint32_t) tsk_getu16(fs_info->endian,
-                        index->ei_leaf_hi)) << 16) | tsk_getu32(fs_info->
-                endian, index->ei_leaf_lo);
-            if (ext2fs_make_data_run_extent_index(fs_info, fs_attr,
-                    fs_attr_extent, child_block)) {
+
+            /* the depth must go down by one at each level (which also
+             * keeps a corrupt tree from looping) */
+            if ((tsk_getu16(fs_info->endian, child->eh_depth) + 1 != depth)
+                || (tsk_getu16(fs_info->endian,
+                        child->eh_entries) > max_entries)) {
+                tsk_error_reset();
+                tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
+                tsk_error_set_errstr
+                    ("ext2fs_make_data_run_extent_index: invalid extent node in block %"
+                    PRIuDADDR, block + j);
+                free(buf);
                 return 1;
             }
-        }
-    }
-
-    free(buf);
-    return 0;
-}
 
-/** \internal
- * Get the number of extent blocks rooted at the given extent_header.
- * The count does not include the extent header passed as a parameter.
- *
- * @return the number of extent blocks, or -1 on error.
- */
-static int32_t
-ext2fs_extent_tree_index_count(TSK_FS_INFO * fs_info,
-    TSK_FS_META * fs_meta, ext2fs_extent_header * header)
-{
-    int fs_blocksize = fs_info->block_size;
-    ext2fs_extent_idx *indices;
-    int count = 0;
-    uint8_t *buf;
-    int i;
-
-    if (tsk_getu16(fs_info->endian, header->eh_magic) != 0xF30A) {
-        tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
-        tsk_error_set_errstr
-            ("ext2fs_load_attrs: extent header magic valid incorrect!");
-        return -1;
-    }
-
-    if (tsk_getu16(fs_info->endian, header->eh_depth) == 0) {
-        return 0;
-    }
-
-    if ((buf = (uint8_t *) tsk_malloc(fs_blocksize)) == NULL) {
-        return -1;
-    }
-
-    indices = (ext2fs_extent_idx *) (header + 1);
-    for (i = 0; i < tsk_getu16(fs_info->endian, header->eh_entries); i++) {
-        ext2fs_extent_idx *index = &indices[i];
-        TSK_DADDR_T block =
-            (((uint32_t) tsk_getu16(fs_info->endian,
-                    index->ei_leaf_hi)) << 16) | tsk_getu32(fs_info->
-            endian, index->ei_leaf_lo);
-        ssize_t cnt =
-            tsk_fs_read_block(fs_info, block, (char *) buf, fs_blocksize);
-        int ret;
-
-        if (cnt != fs_blocksize) {
-            if (cnt >= 0) {
-                tsk_error_reset();
-                tsk_error_set_errno(TSK_ERR_FS_READ);
+            /* add it to the extent attribute */
+            data_run = tsk_fs_attr_run_alloc();
+            if (data_run == NULL) {
+                free(buf);
+                return 1;
             }
-            tsk_error_set_errstr2("ext2fs_extent_tree_index_count: Block %"
-                PRIuDADDR, block);
-            return -1;
-        }
+            data_run->offset = *a_count;
+            data_run->addr = block + j;
+            data_run->len = 1;
 
-        if ((ret =
-                ext2fs_extent_tree_index_count(fs_info, fs_meta,
-                    (ext2fs_extent_header *) buf)) < 0) {
-            return -1;
+            if (tsk_fs_attr_add_run(fs_info, fs_attr_extent, data_run)) {
+                free(buf);
+                return 1;
+            }
+            (*a_count)++;
+
+            /* process leaf nodes */
+            if (depth == 1) {
+                ext2fs_extent *extents = (ext2fs_extent *) (child + 1);
+                unsigned int k;
+                for (k = 0;
+                    k < tsk_getu16(fs_info->endian, child->eh_entries);
+                    k++) {
+                    ext2fs_extent extent = extents[k];
+                    if (ext2fs_make_data_run_extent(fs_info, fs_attr,
+                            &extent)) {
+                        free(buf);
+                        return 1;
+                    }
+                }
+            }
+            /* recurse on interior nodes */
+            else if (ext2fs_make_data_run_extent_index(fs_info, fs_attr,
+                    fs_attr_extent, child, a_count)) {
+                free(buf);
+                return 1;
+            }
         }
-        count += ret;
-        count++;
     }
 
     free(buf);
-    return count;
+    return 0;
 }
 
 
@@ -1601,7 +2017,6 @@ ext2fs_load_attrs(TSK_FS_FILE * fs_file)
     TSK_FS_ATTR *fs_attr;
     int i;
     ext2fs_extent *extents = NULL;
-    ext2fs_extent_idx *indices = NULL;
 
     if (fs_meta->content_type == TSK_FS_META_CONTENT_TYPE_EXT4_EXTENTS) {
         ext2fs_extent_header *header =
@@ -1690,39 +2105,36 @@ ext2fs_load_attrs(TSK_FS_FILE * fs_file)
                 return 1;
             }
 
-            if ((fs_attr_extent =
-                    tsk_fs_attrlist_getnew(fs_meta->attr,
-                        TSK_FS_ATTR_NONRES)) == NULL) {
+            if (depth > EXT2FS_EXTENT_MAX_DEPTH) {
+                tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
+                tsk_error_set_errstr
+                    ("ext2fs_load_attr: Inode reports too deep an extent tree");
                 return 1;
             }
 
-            extent_index_size =
-                ext2fs_extent_tree_index_count(fs_info, fs_meta, header);
-            if (extent_index_size < 0) {
+            if ((fs_attr_extent =
+                    tsk_fs_attrlist_getnew(fs_meta->attr,
+                        TSK_FS_ATTR_NONRES)) == NULL) {
                 return 1;
             }
 
+            /* The tree is only walked once, so the size of the extent
+             * attribute is set after the index blocks have been counted */
             if (tsk_fs_attr_set_run(fs_file, fs_attr_extent, NULL, NULL,
                     TSK_FS_ATTR_TYPE_UNIX_EXTENT, TSK_FS_ATTR_ID_DEFAULT,
-                    fs_info->block_size * extent_index_size,
-                    fs_info->block_size * extent_index_size,
-                    fs_info->block_size * extent_index_size, 0, 0)) {
+                    0, 0, 0, 0, 0)) {
                 return 1;
             }
 
-            indices = (ext2fs_extent_idx *) (header + 1);
-            for (i = 0; i < num_entries; i++) {
-                ext2fs_extent_idx *index = &indices[i];
-                TSK_DADDR_T child_block =
-                    (((uint32_t) tsk_getu16(fs_info->endian,
-                            index->
-                            ei_leaf_hi)) << 16) | tsk_getu32(fs_info->
-                    endian, index->ei_leaf_lo);
-                if (ext2fs_make_data_run_extent_index(fs_info, fs_attr,
-                        fs_attr_extent, child_block)) {
-                    return 1;
-                }
+            extent_index_size = 0;
+            if (ext2fs_make_data_run_extent_index(fs_info, fs_attr,
+                    fs_attr_extent, header, &extent_index_size)) {
+                return 1;
             }
+
+            fs_attr_extent->size = fs_attr_extent->nrd.allocsize =
+                fs_attr_extent->nrd.initsize =
+                (TSK_OFF_T) fs_info->block_size * extent_index_size;
         }
         fs_meta->attr_state = TSK_FS_META_ATTR_STUDIED;
 
@@ -2626,7 +3038,9 @@ ext2fs_istat(TSK_FS_INFO * fs, FILE * hFile, TSK_INUM_T inum,
     tsk_fprintf(hFile, "%sAllocated\n",
         (fs_meta->flags & TSK_FS_META_FLAG_ALLOC) ? "" : "Not ");
 
-    tsk_fprintf(hFile, "Group: %" PRIuGID "\n", ext2fs->grp_num);
+    tsk_fprintf(hFile, "Group: %" PRI_EXT2GRP "\n",
+        (EXT2_GRPNUM_T) ((inum - fs->first_inum) /
+            tsk_getu32(fs->endian, ext2fs->fs->s_inodes_per_group)));
 
     // Note that if this is a "virtual file", then ext2fs->dino_buf may not be set.
     tsk_fprintf(hFile, "Generation Id: %" PRIu32 "\n",
@@ -3122,11 +3536,10 @@ ext2fs_close(TSK_FS_INFO * fs)
     if (ext2fs->grp_buf != NULL)
         free((char *) ext2fs->grp_buf);
 
-    if (ext2fs->bmap_buf != NULL)
-        free((char *) ext2fs->bmap_buf);
-
-    if (ext2fs->imap_buf != NULL)
-        free((char *) ext2fs->imap_buf);
+    free(ext2fs->gd_buf);
+    ext2fs_cache_free(ext2fs->bmap_cache, EXT2FS_BMAP_CACHE_CNT);
+    ext2fs_cache_free(ext2fs->imap_cache, EXT2FS_BMAP_CACHE_CNT);
+    ext2fs_cache_free(ext2fs->itbl_cache, EXT2FS_ITBL_CACHE_CNT);
 
     tsk_deinit_lock(&ext2fs->lock);
 
@@ -3356,6 +3769,7 @@ ext2fs_open(TSK_IMG_INFO * img_info, TSK_OFF_T offset,
     fs->inode_walk = ext2fs_inode_walk;
     fs->block_walk = ext2fs_block_walk;
     fs->block_getflags = ext2fs_block_getflags;
+    fs->block_getflags_range = ext2fs_block_getflags_range;
 
     fs->get_default_attr_type = tsk_fs_unix_get_default_attr_type;
     //fs->load_attrs = tsk_fs_unix_make_data_run;
@@ -3376,19 +3790,20 @@ ext2fs_open(TSK_IMG_INFO * img_info, TSK_OFF_T offset,
     fs->jentry_walk = ext2fs_jentry_walk;
     fs->jopen = ext2fs_jopen;
 
-    /* initialize the caches */
-    /* inode map */
-    ext2fs->imap_buf = NULL;
-    ext2fs->imap_grp_num = 0xffffffff;
-
-    /* block map */
-    ext2fs->bmap_buf = NULL;
-    ext2fs->bmap_grp_num = 0xffffffff;
-
+    /* initialize the caches.  The bitmap and inode table caches are
+     * zeroed by tsk_fs_malloc(). */
     /* group descriptor */
     ext2fs->grp_buf = NULL;
     ext2fs->grp_num = 0xffffffff;
 
+    /* Read all of the group descriptors */
+    if (ext2fs_gd_table_load(ext2fs)) {
+        fs->tag = 0;
+        free(ext2fs->fs);
+        tsk_fs_free(fs);
+        return NULL;
+    }
+
 
     /*
      * Print some stats.
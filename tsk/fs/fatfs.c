@@ -133,19 +133,108 @@ getFATCacheIdx(FATFS_INFO * fatfs, TSK_DADDR_T sect)
 
 
 /*
- * Set *value to the entry in the File Allocation Table (FAT) 
- * for the given cluster
+ * Set *value to the raw entry in the decoded FAT table for the given
+ * cluster, filling in the chunk of the table that holds it first if
+ * needed.
  *
- * *value is in clusters and may need to be coverted to
- * sectors by the calling function
+ * Note: This routine assumes &fatfs->cache_lock is locked by the caller.
  *
- * Invalid values in the FAT (i.e. greater than the largest
- * cluster have a value of 0 returned and a 0 return value.
+ * Return 0 if *value was set and 1 if the table cannot be used for this
+ * cluster (in which case the FAT cache is used instead)
+ */
+static uint8_t
+getFATTable(FATFS_INFO * fatfs, TSK_DADDR_T clust, TSK_DADDR_T * value)
+{
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) & fatfs->fs_info;
+    TSK_DADDR_T chunk = clust / FATFS_TABLE_CHUNK;
+
+    if (fatfs->fat_table == NULL)
+        return 1;
+
+    if (fatfs->fat_table_loaded[chunk] == 0) {
+        TSK_DADDR_T first = chunk * FATFS_TABLE_CHUNK;
+        TSK_DADDR_T last = first + FATFS_TABLE_CHUNK - 1;
+        TSK_DADDR_T i;
+        TSK_OFF_T byte_first, byte_last;
+        uint8_t *buf;
+        ssize_t cnt;
+
+        if (last > fatfs->lastclust)
+            last = fatfs->lastclust;
+
+        /* byte range of the entries in the FAT */
+        if (fs->ftype == TSK_FS_TYPE_FAT12) {
+            byte_first = first + (first >> 1);
+            byte_last = last + (last >> 1) + 1;
+        }
+        else if (fs->ftype == TSK_FS_TYPE_FAT16) {
+            byte_first = first << 1;
+            byte_last = (last << 1) + 1;
+        }
+        else {
+            byte_first = first << 2;
+            byte_last = (last << 2) + 3;
+        }
+
+        if ((buf = (uint8_t *) malloc((size_t) (byte_last - byte_first +
+                        1))) == NULL) {
+            fatfs->fat_table_loaded[chunk] = 2;
+            return 1;
+        }
+
+        cnt = tsk_fs_read(fs,
+            fatfs->firstfatsect * fs->block_size + byte_first,
+            (char *) buf, (size_t) (byte_last - byte_first + 1));
+        if (cnt != byte_last - byte_first + 1) {
+            // let the FAT cache read (and report errors for) this part
+            tsk_error_reset();
+            free(buf);
+            fatfs->fat_table_loaded[chunk] = 2;
+            return 1;
+        }
+
+        for (i = first; i <= last; i++) {
+            if (fs->ftype == TSK_FS_TYPE_FAT12) {
+                uint16_t tmp16 = tsk_getu16(fs->endian,
+                    &buf[i + (i >> 1) - byte_first]);
+                /* slide it over if it is one of the odd clusters */
+                if (i & 1)
+                    tmp16 >>= 4;
+                fatfs->fat_table[i] = tmp16 & FATFS_12_MASK;
+            }
+            else if (fs->ftype == TSK_FS_TYPE_FAT16) {
+                fatfs->fat_table[i] =
+                    tsk_getu16(fs->endian,
+                    &buf[(i << 1) - byte_first]) & FATFS_16_MASK;
+            }
+            else {
+                fatfs->fat_table[i] =
+                    tsk_getu32(fs->endian,
+                    &buf[(i << 2) - byte_first]) & FATFS_32_MASK;
+            }
+        }
+        free(buf);
+        fatfs->fat_table_loaded[chunk] = 1;
+    }
+    else if (fatfs->fat_table_loaded[chunk] == 2) {
+        return 1;
+    }
+
+    *value = fatfs->fat_table[clust];
+    return 0;
+}
+
+
+/*
+ * Set *value to the raw entry in the FAT for the given cluster using
+ * the FAT cache.
+ *
+ * Note: This routine assumes &fatfs->cache_lock is locked by the caller.
  *
  * Return 1 on error and 0 on success
  */
-uint8_t
-fatfs_getFAT(FATFS_INFO * fatfs, TSK_DADDR_T clust, TSK_DADDR_T * value)
+static uint8_t
+getFATCache(FATFS_INFO * fatfs, TSK_DADDR_T clust, TSK_DADDR_T * value)
 {
     uint8_t *a_ptr;
     uint16_t tmp16;
@@ -154,48 +243,16 @@ fatfs_getFAT(FATFS_INFO * fatfs, TSK_DADDR_T clust, TSK_DADDR_T * value)
     ssize_t cnt;
     int cidx;
 
-    /* Sanity Check */
-    if (clust > fatfs->lastclust) {
-        /* silently ignore requests for the unclustered sectors... */
-        if ((clust == fatfs->lastclust + 1) &&
-            ((fatfs->firstclustsect + fatfs->csize * fatfs->clustcnt -
-                    1) != fs->last_block)) {
-            if (tsk_verbose)
-                tsk_fprintf(stderr,
-                    "fatfs_getFAT: Ignoring request for non-clustered sector\n");
-            return 0;
-        }
-
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_FS_ARG);
-        tsk_error_set_errstr("fatfs_getFAT: invalid cluster address: %"
-            PRIuDADDR, clust);
-        return 1;
-    }
-
     switch (fatfs->fs_info.ftype) {
     case TSK_FS_TYPE_FAT12:
-        if (clust & 0xf000) {
-            tsk_error_reset();
-            tsk_error_set_errno(TSK_ERR_FS_ARG);
-            tsk_error_set_errstr
-                ("fatfs_getFAT: TSK_FS_TYPE_FAT12 Cluster %" PRIuDADDR
-                " too large", clust);
-            return 1;
-        }
-
         /* id the sector in the FAT */
         sect = fatfs->firstfatsect +
             ((clust + (clust >> 1)) >> fatfs->ssize_sh);
 
-        tsk_take_lock(&fatfs->cache_lock);
-
         /* Load the FAT if we don't have it */
         // see if it is in the cache
-        if (-1 == (cidx = getFATCacheIdx(fatfs, sect))) {
-            tsk_release_lock(&fatfs->cache_lock);
+        if (-1 == (cidx = getFATCacheIdx(fatfs, sect)))
             return 1;
-        }
 
         /* get the offset into the cache */
         offs = ((sect - fatfs->fatc_addr[cidx]) << fatfs->ssize_sh) +
@@ -212,7 +269,6 @@ fatfs_getFAT(FATFS_INFO * fatfs, TSK_DADDR_T clust, TSK_DADDR_T * value)
                 tsk_fs_read(fs, sect * fs->block_size,
                 fatfs->fatc_buf[cidx], FAT_CACHE_B);
             if (cnt != FAT_CACHE_B) {
-                tsk_release_lock(&fatfs->cache_lock);
                 if (cnt >= 0) {
                     tsk_error_reset();
                     tsk_error_set_errno(TSK_ERR_FS_READ);
@@ -232,37 +288,19 @@ fatfs_getFAT(FATFS_INFO * fatfs, TSK_DADDR_T clust, TSK_DADDR_T * value)
 
         tmp16 = tsk_getu16(fs->endian, a_ptr);
 
-        tsk_release_lock(&fatfs->cache_lock);
-
         /* slide it over if it is one of the odd clusters */
         if (clust & 1)
             tmp16 >>= 4;
 
         *value = tmp16 & FATFS_12_MASK;
-
-        /* sanity check */
-        if ((*value > (fatfs->lastclust)) &&
-            (*value < (0x0ffffff7 & FATFS_12_MASK))) {
-            if (tsk_verbose)
-                tsk_fprintf(stderr,
-                    "fatfs_getFAT: TSK_FS_TYPE_FAT12 cluster (%" PRIuDADDR
-                    ") too large (%" PRIuDADDR ") - resetting\n", clust,
-                    *value);
-            *value = 0;
-        }
         return 0;
 
     case TSK_FS_TYPE_FAT16:
         /* Get sector in FAT for cluster and load it if needed */
         sect = fatfs->firstfatsect + ((clust << 1) >> fatfs->ssize_sh);
 
-        tsk_take_lock(&fatfs->cache_lock);
-
-        if (-1 == (cidx = getFATCacheIdx(fatfs, sect))) {
-            tsk_release_lock(&fatfs->cache_lock);
+        if (-1 == (cidx = getFATCacheIdx(fatfs, sect)))
             return 1;
-        }
-
 
         /* get pointer to entry in the cache buffer */
         a_ptr = (uint8_t *) fatfs->fatc_buf[cidx] +
@@ -270,31 +308,14 @@ fatfs_getFAT(FATFS_INFO * fatfs, TSK_DADDR_T clust, TSK_DADDR_T * value)
             ((clust << 1) % fatfs->ssize);
 
         *value = tsk_getu16(fs->endian, a_ptr) & FATFS_16_MASK;
-
-        tsk_release_lock(&fatfs->cache_lock);
-
-        /* sanity check */
-        if ((*value > (fatfs->lastclust)) &&
-            (*value < (0x0ffffff7 & FATFS_16_MASK))) {
-            if (tsk_verbose)
-                tsk_fprintf(stderr,
-                    "fatfs_getFAT: contents of TSK_FS_TYPE_FAT16 entry %"
-                    PRIuDADDR " too large - resetting\n", clust);
-            *value = 0;
-        }
         return 0;
 
-    case TSK_FS_TYPE_FAT32:
+    default:
         /* Get sector in FAT for cluster and load if needed */
         sect = fatfs->firstfatsect + ((clust << 2) >> fatfs->ssize_sh);
 
-        tsk_take_lock(&fatfs->cache_lock);
-
-        if (-1 == (cidx = getFATCacheIdx(fatfs, sect))) {
-            tsk_release_lock(&fatfs->cache_lock);
+        if (-1 == (cidx = getFATCacheIdx(fatfs, sect)))
             return 1;
-        }
-
 
         /* get pointer to entry in current buffer */
         a_ptr = (uint8_t *) fatfs->fatc_buf[cidx] +
@@ -302,20 +323,68 @@ fatfs_getFAT(FATFS_INFO * fatfs, TSK_DADDR_T clust, TSK_DADDR_T * value)
             (clust << 2) % fatfs->ssize;
 
         *value = tsk_getu32(fs->endian, a_ptr) & FATFS_32_MASK;
+        return 0;
+    }
+}
 
-        tsk_release_lock(&fatfs->cache_lock);
 
-        /* sanity check */
-        if ((*value > fatfs->lastclust) &&
-            (*value < (0x0ffffff7 & FATFS_32_MASK))) {
+/*
+ * Set *value to the entry in the File Allocation Table (FAT) 
+ * for the given cluster
+ *
+ * *value is in clusters and may need to be coverted to
+ * sectors by the calling function
+ *
+ * Invalid values in the FAT (i.e. greater than the largest
+ * cluster have a value of 0 returned and a 0 return value.
+ *
+ * Return 1 on error and 0 on success
+ */
+uint8_t
+fatfs_getFAT(FATFS_INFO * fatfs, TSK_DADDR_T clust, TSK_DADDR_T * value)
+{
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) & fatfs->fs_info;
+    uint32_t mask;
+
+    /* Sanity Check */
+    if (clust > fatfs->lastclust) {
+        /* silently ignore requests for the unclustered sectors... */
+        if ((clust == fatfs->lastclust + 1) &&
+            ((fatfs->firstclustsect + fatfs->csize * fatfs->clustcnt -
+                    1) != fs->last_block)) {
             if (tsk_verbose)
                 tsk_fprintf(stderr,
-                    "fatfs_getFAT: contents of entry %" PRIuDADDR
-                    " too large - resetting\n", clust);
+                    "fatfs_getFAT: Ignoring request for non-clustered sector\n");
+            return 0;
+        }
+
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr("fatfs_getFAT: invalid cluster address: %"
+            PRIuDADDR, clust);
+        return 1;
+    }
 
-            *value = 0;
+    switch (fatfs->fs_info.ftype) {
+    case TSK_FS_TYPE_FAT12:
+        if (clust & 0xf000) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_FS_ARG);
+            tsk_error_set_errstr
+                ("fatfs_getFAT: TSK_FS_TYPE_FAT12 Cluster %" PRIuDADDR
+                " too large", clust);
+            return 1;
         }
-        return 0;
+        mask = FATFS_12_MASK;
+        break;
+
+    case TSK_FS_TYPE_FAT16:
+        mask = FATFS_16_MASK;
+        break;
+
+    case TSK_FS_TYPE_FAT32:
+        mask = FATFS_32_MASK;
+        break;
 
     default:
         tsk_error_reset();
@@ -324,6 +393,35 @@ fatfs_getFAT(FATFS_INFO * fatfs, TSK_DADDR_T clust, TSK_DADDR_T * value)
             fatfs->fs_info.ftype);
         return 1;
     }
+
+    tsk_take_lock(&fatfs->cache_lock);
+    if (getFATTable(fatfs, clust, value)
+        && getFATCache(fatfs, clust, value)) {
+        tsk_release_lock(&fatfs->cache_lock);
+        return 1;
+    }
+    tsk_release_lock(&fatfs->cache_lock);
+
+    /* sanity check */
+    if ((*value > (fatfs->lastclust)) && (*value < (0x0ffffff7 & mask))) {
+        if (tsk_verbose) {
+            if (fatfs->fs_info.ftype == TSK_FS_TYPE_FAT12)
+                tsk_fprintf(stderr,
+                    "fatfs_getFAT: TSK_FS_TYPE_FAT12 cluster (%" PRIuDADDR
+                    ") too large (%" PRIuDADDR ") - resetting\n", clust,
+                    *value);
+            else if (fatfs->fs_info.ftype == TSK_FS_TYPE_FAT16)
+                tsk_fprintf(stderr,
+                    "fatfs_getFAT: contents of TSK_FS_TYPE_FAT16 entry %"
+                    PRIuDADDR " too large - resetting\n", clust);
+            else
+                tsk_fprintf(stderr,
+                    "fatfs_getFAT: contents of entry %" PRIuDADDR
+                    " too large - resetting\n", clust);
+        }
+        *value = 0;
+    }
+    return 0;
 }
 
 
@@ -402,6 +500,145 @@ fatfs_block_getflags(TSK_FS_INFO * a_fs, TSK_DADDR_T a_addr)
 
 
 
+/* fatfs_clust_run - count the clusters from a_clust to a_last that have
+ * the allocation status a_alloc (as fatfs_is_clustalloc() gives it) using
+ * the decoded FAT table.  Runs of unallocated clusters are skipped two
+ * zero entries at a time.
+ *
+ * return the number of clusters, which is less than the full run if the
+ * table cannot be used for a cluster
+ */
+static TSK_DADDR_T
+fatfs_clust_run(FATFS_INFO * fatfs, TSK_DADDR_T a_clust, TSK_DADDR_T a_last,
+    int8_t a_alloc)
+{
+    TSK_DADDR_T clust = a_clust;
+    uint32_t bad;
+
+    if (fatfs->fat_table == NULL)
+        return 0;
+    if (a_last > fatfs->lastclust)
+        a_last = fatfs->lastclust;
+
+    /* entries from here up to the reserved values are reset to 0 by
+     * fatfs_getFAT() */
+    if (fatfs->fs_info.ftype == TSK_FS_TYPE_FAT12)
+        bad = 0x0ffffff7 & FATFS_12_MASK;
+    else if (fatfs->fs_info.ftype == TSK_FS_TYPE_FAT16)
+        bad = 0x0ffffff7 & FATFS_16_MASK;
+    else
+        bad = 0x0ffffff7 & FATFS_32_MASK;
+
+    tsk_take_lock(&fatfs->cache_lock);
+    while (clust <= a_last) {
+        TSK_DADDR_T end = (clust / FATFS_TABLE_CHUNK + 1) *
+            FATFS_TABLE_CHUNK - 1;
+        TSK_DADDR_T value;
+        const uint32_t *tbl = fatfs->fat_table;
+
+        /* make sure that the chunk is filled in */
+        if (getFATTable(fatfs, clust, &value))
+            break;
+        if (end > a_last)
+            end = a_last;
+
+        if (a_alloc == 0) {
+            while (clust + 1 <= end) {
+                uint64_t pair;
+
+                memcpy(&pair, &tbl[clust], sizeof(pair));
+                if (pair)
+                    break;
+                clust += 2;
+            }
+        }
+        for (; clust <= end; clust++) {
+            uint32_t v = tbl[clust];
+            int8_t alloc = ((v != FATFS_UNALLOC) && ((v <= fatfs->lastclust)
+                    || (v >= bad)));
+
+            if (alloc != a_alloc)
+                break;
+        }
+        if (clust <= end)
+            break;
+    }
+    tsk_release_lock(&fatfs->cache_lock);
+
+    return clust - a_clust;
+}
+
+/* fatfs_block_getflags_range - get the flags of a_addr and the number of
+ * sectors after it (up to a_end) that have the same flags.  The allocation
+ * status is looked up once per cluster in the FAT instead of once per sector,
+ * and runs are found in the decoded FAT table when it is used.
+ *
+ * return the number of sectors or 0 on error
+ */
+static TSK_DADDR_T
+fatfs_block_getflags_range(TSK_FS_INFO * a_fs, TSK_DADDR_T a_addr,
+    TSK_DADDR_T a_end, TSK_FS_BLOCK_FLAG_ENUM * a_flags)
+{
+    FATFS_INFO *fatfs = (FATFS_INFO *) a_fs;
+    TSK_DADDR_T clustend, addr;
+    int8_t alloc;
+
+    // FATs and boot sector
+    if (a_addr < fatfs->firstdatasect) {
+        *a_flags = TSK_FS_BLOCK_FLAG_META | TSK_FS_BLOCK_FLAG_ALLOC;
+        if (a_end >= fatfs->firstdatasect)
+            return fatfs->firstdatasect - a_addr;
+        return a_end - a_addr + 1;
+    }
+    // root directory for FAT12/16
+    if (a_addr < fatfs->firstclustsect) {
+        *a_flags = TSK_FS_BLOCK_FLAG_CONT | TSK_FS_BLOCK_FLAG_ALLOC;
+        if (a_end >= fatfs->firstclustsect)
+            return fatfs->firstclustsect - a_addr;
+        return a_end - a_addr + 1;
+    }
+
+    // sectors after the last cluster are unallocated
+    clustend = fatfs->firstclustsect + fatfs->csize * fatfs->clustcnt;
+    if (a_addr >= clustend) {
+        *a_flags = TSK_FS_BLOCK_FLAG_CONT | TSK_FS_BLOCK_FLAG_UNALLOC;
+        return a_end - a_addr + 1;
+    }
+
+    if ((alloc = fatfs_is_clustalloc(fatfs,
+                FATFS_SECT_2_CLUST(fatfs, a_addr))) == -1)
+        return 0;
+
+    /* go to the start of the next cluster and then a cluster at a time */
+    addr = FATFS_CLUST_2_SECT(fatfs, FATFS_SECT_2_CLUST(fatfs,
+            a_addr)) + fatfs->csize;
+    if ((addr <= a_end) && (addr < clustend)) {
+        TSK_DADDR_T last = (a_end < clustend) ? a_end : clustend - 1;
+
+        addr += fatfs->csize * fatfs_clust_run(fatfs,
+            FATFS_SECT_2_CLUST(fatfs, addr), FATFS_SECT_2_CLUST(fatfs,
+                last), alloc);
+    }
+    while ((addr <= a_end) && (addr < clustend)) {
+        int8_t retval;
+
+        if ((retval = fatfs_is_clustalloc(fatfs,
+                    FATFS_SECT_2_CLUST(fatfs, addr))) == -1)
+            return 0;
+        if (retval != alloc)
+            break;
+        addr += fatfs->csize;
+    }
+    if (addr > a_end + 1)
+        addr = a_end + 1;
+
+    *a_flags = TSK_FS_BLOCK_FLAG_CONT | (alloc ? TSK_FS_BLOCK_FLAG_ALLOC :
+        TSK_FS_BLOCK_FLAG_UNALLOC);
+    return addr - a_addr;
+}
+
+
+
 /**************************************************************************
  *
  * BLOCK WALKING
@@ -1325,6 +1562,9 @@ fatfs_close(TSK_FS_INFO * fs)
 
     fs->tag = 0;
     free(fatfs->sb);
+    free(fatfs->fat_table);
+    free(fatfs->fat_table_loaded);
+    free(fatfs->dir_sect_map);
     tsk_deinit_lock(&fatfs->cache_lock);
     tsk_deinit_lock(&fatfs->dir_lock);
 
@@ -1770,6 +2010,24 @@ fatfs_open(TSK_IMG_INFO * img_info, TSK_OFF_T offset,
         fatfs->fatc_ttl[i] = 0;
     }
 
+    /* Use a decoded copy of the FAT if it is not too big.  If the memory
+     * is not available, the FAT cache is used instead. */
+    if (fatfs->lastclust < FATFS_TABLE_MAX) {
+        fatfs->fat_table =
+            (uint32_t *) malloc((size_t) (fatfs->lastclust +
+                1) * sizeof(uint32_t));
+        fatfs->fat_table_loaded =
+            (uint8_t *) calloc((size_t) (fatfs->lastclust /
+                FATFS_TABLE_CHUNK + 1), 1);
+        if ((fatfs->fat_table == NULL)
+            || (fatfs->fat_table_loaded == NULL)) {
+            free(fatfs->fat_table);
+            free(fatfs->fat_table_loaded);
+            fatfs->fat_table = NULL;
+            fatfs->fat_table_loaded = NULL;
+        }
+    }
+
     /*
      * block calculations : although there are no blocks in fat, we will
      * use these fields for sector calculations
@@ -1818,6 +2076,7 @@ fatfs_open(TSK_IMG_INFO * img_info, TSK_OFF_T offset,
 
     fs->block_walk = fatfs_block_walk;
     fs->block_getflags = fatfs_block_getflags;
+    fs->block_getflags_range = fatfs_block_getflags_range;
 
     fs->inode_walk = fatfs_inode_walk;
     fs->istat = fatfs_istat;
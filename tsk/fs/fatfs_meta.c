@@ -1016,6 +1016,74 @@ inode_walk_dent_act(TSK_FS_FILE * fs_file, const char *a_path, void *a_ptr)
     return TSK_WALK_CONT;
 }
 
+/*
+ * Return the bitmap of sectors that are used by the allocated directories
+ * in the directory tree, building it with a name_walk and file_walks the
+ * first time it is needed.  The bitmap is kept until the file system is
+ * closed.
+ *
+ * @param fatfs File system to analyze
+ * @param fs_file File structure (with meta) that can be used while walking
+ * @returns Bitmap (owned by fatfs) or NULL on error
+ */
+static uint8_t *
+fatfs_dir_sect_map(FATFS_INFO * fatfs, TSK_FS_FILE * fs_file)
+{
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) & fatfs->fs_info;
+    uint8_t *map;
+
+    tsk_take_lock(&fatfs->dir_lock);
+    map = fatfs->dir_sect_map;
+    tsk_release_lock(&fatfs->dir_lock);
+    if (map)
+        return map;
+
+    if ((map =
+            (uint8_t *) tsk_malloc((size_t) ((fs->block_count +
+                        7) / 8))) == NULL)
+        return NULL;
+
+    if (tsk_verbose)
+        tsk_fprintf(stderr,
+            "fatfs_inode_walk: Walking directories to collect sector info\n");
+
+    // Do a file_walk on the root directory to get its layout
+    if (fatfs_make_root(fatfs, fs_file->meta)) {
+        free(map);
+        return NULL;
+    }
+
+    if (tsk_fs_file_walk(fs_file,
+            TSK_FS_FILE_WALK_FLAG_SLACK | TSK_FS_FILE_WALK_FLAG_AONLY,
+            inode_walk_file_act, (void *) map)) {
+        free(map);
+        return NULL;
+    }
+
+    // now get the rest of the directories.
+    if (tsk_fs_dir_walk(fs, fs->root_inum,
+            TSK_FS_DIR_WALK_FLAG_ALLOC | TSK_FS_DIR_WALK_FLAG_RECURSE |
+            TSK_FS_DIR_WALK_FLAG_NOORPHAN, inode_walk_dent_act,
+            (void *) map)) {
+        tsk_error_errstr2_concat("- fatfs_inode_walk: mapping directories");
+        free(map);
+        return NULL;
+    }
+
+    /* another thread may have built it in the meantime */
+    tsk_take_lock(&fatfs->dir_lock);
+    if (fatfs->dir_sect_map == NULL) {
+        fatfs->dir_sect_map = map;
+    }
+    else {
+        free(map);
+        map = fatfs->dir_sect_map;
+    }
+    tsk_release_lock(&fatfs->dir_lock);
+
+    return map;
+}
+
 /* fatfs_dinode_load - look up disk inode & load into fatfs_dentry structure
  *
  * return 1 on error and 0 on success
@@ -1089,6 +1157,11 @@ fatfs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
     fatfs_dentry *dep;
     unsigned int myflags, didx;
     uint8_t *sect_alloc;
+    uint8_t *sect_alloc_free = NULL;    // sect_alloc if it needs to be freed
+    int8_t *batch_alloc;        // allocation status of each cluster in a batch
+    size_t batch_max;
+    uint8_t one_at_a_time = 0;  // 1 if clusters are read one at a time up to one_last
+    TSK_DADDR_T one_last = 0;
     ssize_t cnt;
     uint8_t done = 0;
 
@@ -1205,44 +1278,20 @@ fatfs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
      * because it doesn't help and can introduce infinite loop situations
      * inode_walk was called by the function that determines which inodes
      * are orphans. */
-    if ((sect_alloc =
-            (uint8_t *) tsk_malloc((size_t) ((fs->block_count +
-                        7) / 8))) == NULL) {
-        tsk_fs_file_close(fs_file);
-        return 1;
-    }
     if ((a_flags & TSK_FS_META_FLAG_ORPHAN) == 0) {
-
-        if (tsk_verbose)
-            tsk_fprintf(stderr,
-                "fatfs_inode_walk: Walking directories to collect sector info\n");
-
-        // Do a file_walk on the root directory to get its layout
-        if (fatfs_make_root(fatfs, fs_file->meta)) {
-            tsk_fs_file_close(fs_file);
-            free(sect_alloc);
-            return 1;
-        }
-
-        if (tsk_fs_file_walk(fs_file,
-                TSK_FS_FILE_WALK_FLAG_SLACK | TSK_FS_FILE_WALK_FLAG_AONLY,
-                inode_walk_file_act, (void *) sect_alloc)) {
+        if ((sect_alloc = fatfs_dir_sect_map(fatfs, fs_file)) == NULL) {
             tsk_fs_file_close(fs_file);
-            free(sect_alloc);
             return 1;
         }
-
-        // now get the rest of the directories.
-        if (tsk_fs_dir_walk(fs, fs->root_inum,
-                TSK_FS_DIR_WALK_FLAG_ALLOC | TSK_FS_DIR_WALK_FLAG_RECURSE |
-                TSK_FS_DIR_WALK_FLAG_NOORPHAN, inode_walk_dent_act,
-                (void *) sect_alloc)) {
-            tsk_error_errstr2_concat
-                ("- fatfs_inode_walk: mapping directories");
+    }
+    else {
+        if ((sect_alloc_free =
+                (uint8_t *) tsk_malloc((size_t) ((fs->block_count +
+                            7) / 8))) == NULL) {
             tsk_fs_file_close(fs_file);
-            free(sect_alloc);
             return 1;
         }
+        sect_alloc = sect_alloc_free;
     }
 
     /* start analyzing each sector
@@ -1272,7 +1321,7 @@ fatfs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
             ("fatfs_inode_walk: Starting inode in sector too big for image: %"
             PRIuDADDR, ssect);
         tsk_fs_file_close(fs_file);
-        free(sect_alloc);
+        free(sect_alloc_free);
         return 1;
     }
     else if (lsect > fs->last_block) {
@@ -1282,23 +1331,46 @@ fatfs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
             ("fatfs_inode_walk: Ending inode in sector too big for image: %"
             PRIuDADDR, lsect);
         tsk_fs_file_close(fs_file);
-        free(sect_alloc);
+        free(sect_alloc_free);
         return 1;
     }
 
-    sect = ssect;
+    /* Clusters that need to be looked at are read in batches of up to
+     * FATFS_WALK_READ_SIZE bytes so that large scans are done with large
+     * sequential reads.  If a batch cannot be read, the clusters in it
+     * are re-read one at a time so that we get as far as we can. */
+    batch_max = FATFS_WALK_READ_SIZE / (fatfs->csize << fatfs->ssize_sh);
+    if (batch_max == 0)
+        batch_max = 1;
+
     if ((dino_buf =
-            (char *) tsk_malloc(fatfs->csize << fatfs->ssize_sh)) ==
-        NULL) {
+            (char *) tsk_malloc((batch_max *
+                    fatfs->csize) << fatfs->ssize_sh)) == NULL) {
+        tsk_fs_file_close(fs_file);
+        free(sect_alloc_free);
+        return 1;
+    }
+    if ((batch_alloc = (int8_t *) tsk_malloc(batch_max)) == NULL) {
         tsk_fs_file_close(fs_file);
-        free(sect_alloc);
+        free(sect_alloc_free);
+        free(dino_buf);
         return 1;
     }
+
+    sect = ssect;
     while (sect <= lsect) {
         int clustalloc;         // 1 if current sector / cluster is allocated
-        size_t sect_proc;       // number of sectors read for this loop
+        size_t sect_proc;       // number of sectors to process for a unit
         size_t sidx;            // sector index for loop
         uint8_t basicTest;      // 1 if only a basic dentry test is needed
+        TSK_DADDR_T bsect;      // first sector in the batch
+        size_t unit_sects;      // number of sectors per unit in the batch
+        size_t unit_cnt;        // number of units (sectors or clusters) in the batch
+        size_t bsects;          // number of sectors in the batch
+        size_t cur_max;         // maximum number of clusters in this batch
+        size_t uidx;
+
+        cur_max = ((one_at_a_time) && (sect <= one_last)) ? 1 : batch_max;
 
         /* This occurs for the root directory of TSK_FS_TYPE_FAT12/16
          *
@@ -1313,238 +1385,275 @@ fatfs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
                 continue;
             }
 
-            clustalloc = 1;
-
-            /* read the sector */
-            cnt = tsk_fs_read_block(fs, sect, dino_buf, fatfs->ssize);
-            if (cnt != fatfs->ssize) {
-                if (cnt >= 0) {
-                    tsk_error_reset();
-                    tsk_error_set_errno(TSK_ERR_FS_READ);
-                }
-                tsk_error_set_errstr2
-                    ("fatfs_inode_walk (root dir): sector: %" PRIuDADDR,
-                    sect);
-                tsk_fs_file_close(fs_file);
-                free(sect_alloc);
-                free(dino_buf);
-                return 1;
-            }
-            sect_proc = 1;
+            /* the root directory is processed a sector at a time */
+            bsect = sect;
+            unit_sects = 1;
+            unit_cnt = (size_t) (fatfs->firstclustsect - sect);
+            if (lsect - sect + 1 < unit_cnt)
+                unit_cnt = (size_t) (lsect - sect + 1);
+            if (cur_max == 1)
+                unit_cnt = 1;
+            else if (unit_cnt > batch_max * fatfs->csize)
+                unit_cnt = batch_max * fatfs->csize;
+            bsects = unit_cnt;
         }
 
         /* For the data area, we will read in cluster-sized chunks */
         else {
 
             /* get the base sector for the cluster in which the first inode exists */
-            sect =
+            bsect =
                 FATFS_CLUST_2_SECT(fatfs, (FATFS_SECT_2_CLUST(fatfs,
                         sect)));
+            unit_sects = fatfs->csize;
+            unit_cnt = 0;
 
-            /* if the cluster is not allocated, then do not go into it if we
-             * only want allocated/link entries
-             * If it is allocated, then go into it no matter what
-             */
-            clustalloc = fatfs_is_sectalloc(fatfs, sect);
-            if (clustalloc == -1) {
-                tsk_fs_file_close(fs_file);
-                free(sect_alloc);
-                free(dino_buf);
-                return 1;
+            /* collect the run of clusters that we need to look at */
+            while ((unit_cnt < cur_max)
+                && (bsect + unit_cnt * fatfs->csize <= lsect)) {
+                TSK_DADDR_T csect = bsect + unit_cnt * fatfs->csize;
+
+                /* if the cluster is not allocated, then do not go into it if we
+                 * only want allocated/link entries
+                 * If it is allocated, then go into it no matter what
+                 */
+                clustalloc = fatfs_is_sectalloc(fatfs, csect);
+                if (clustalloc == -1) {
+                    tsk_fs_file_close(fs_file);
+                    free(sect_alloc_free);
+                    free(dino_buf);
+                    free(batch_alloc);
+                    return 1;
+                }
+
+                /* If it is allocated, but we know it is not allocated to a
+                 * directory then skip it.  NOTE: This will miss unallocated
+                 * entries in slack space of the file...
+                 */
+                if (((clustalloc == 0)
+                        && ((a_flags & TSK_FS_META_FLAG_UNALLOC) == 0))
+                    || ((clustalloc == 1)
+                        && (isset(sect_alloc, csect) == 0))) {
+                    if (unit_cnt > 0)
+                        break;
+                    bsect += fatfs->csize;
+                    continue;
+                }
+                batch_alloc[unit_cnt++] = (int8_t) clustalloc;
             }
-            else if ((clustalloc == 0)
-                && ((a_flags & TSK_FS_META_FLAG_UNALLOC) == 0)) {
-                sect += fatfs->csize;
+            if (unit_cnt == 0) {
+                sect = bsect;
                 continue;
             }
 
+            /* The final cluster may not be full */
+            bsects = unit_cnt * fatfs->csize;
+            if (lsect - bsect + 1 < bsects)
+                bsects = (size_t) (lsect - bsect + 1);
+        }
 
-            /* If it is allocated, but we know it is not allocated to a
-             * directory then skip it.  NOTE: This will miss unallocated
-             * entries in slack space of the file...
-             */
-            if ((clustalloc == 1) && (isset(sect_alloc, sect) == 0)) {
-                sect += fatfs->csize;
+        /* read the batch */
+        cnt = tsk_fs_read_block
+            (fs, bsect, dino_buf, bsects << fatfs->ssize_sh);
+        if (cnt != (bsects << fatfs->ssize_sh)) {
+            if (cur_max > 1) {
+                tsk_error_reset();
+                one_at_a_time = 1;
+                one_last = bsect + bsects - 1;
+                sect = bsect;
                 continue;
             }
-
-            /* The final cluster may not be full */
-            if (lsect - sect + 1 < fatfs->csize)
-                sect_proc = (size_t) (lsect - sect + 1);
+            if (cnt >= 0) {
+                tsk_error_reset();
+                tsk_error_set_errno(TSK_ERR_FS_READ);
+            }
+            if (bsect < fatfs->firstclustsect)
+                tsk_error_set_errstr2
+                    ("fatfs_inode_walk (root dir): sector: %" PRIuDADDR,
+                    bsect);
             else
-                sect_proc = fatfs->csize;
-
-            /* read the full cluster */
-            cnt = tsk_fs_read_block
-                (fs, sect, dino_buf, sect_proc << fatfs->ssize_sh);
-            if (cnt != (sect_proc << fatfs->ssize_sh)) {
-                if (cnt >= 0) {
-                    tsk_error_reset();
-                    tsk_error_set_errno(TSK_ERR_FS_READ);
-                }
                 tsk_error_set_errstr2("fatfs_inode_walk: sector: %"
-                    PRIuDADDR, sect);
-                tsk_fs_file_close(fs_file);
-                free(sect_alloc);
-                free(dino_buf);
-                return 1;
-            }
+                    PRIuDADDR, bsect);
+            tsk_fs_file_close(fs_file);
+            free(sect_alloc_free);
+            free(dino_buf);
+            free(batch_alloc);
+            return 1;
         }
 
-        /* do an in-depth test if we are in an unallocted cluster
-         * or if we are not in a known directory. */
-        basicTest = 1;
-        if ((isset(sect_alloc, sect) == 0) || (clustalloc == 0))
-            basicTest = 0;
+        // cycle through the units read
+        for (uidx = 0; uidx < unit_cnt; uidx++) {
+            sect = bsect + uidx * unit_sects;
+            clustalloc =
+                (bsect < fatfs->firstclustsect) ? 1 : batch_alloc[uidx];
 
-        // cycle through the sectors read
-        for (sidx = 0; sidx < sect_proc; sidx++) {
-            TSK_INUM_T inum;
-            uint8_t isInDir;
+            sect_proc = unit_sects;
+            if (lsect - sect + 1 < sect_proc)
+                sect_proc = (size_t) (lsect - sect + 1);
 
-            dep = (fatfs_dentry *) & dino_buf[sidx << fatfs->ssize_sh];
+            /* do an in-depth test if we are in an unallocted cluster
+             * or if we are not in a known directory. */
+            basicTest = 1;
+            if ((isset(sect_alloc, sect) == 0) || (clustalloc == 0))
+                basicTest = 0;
+
+            // cycle through the sectors read
+            for (sidx = 0; sidx < sect_proc; sidx++) {
+                TSK_INUM_T inum;
+                uint8_t isInDir;
+
+                dep = (fatfs_dentry *) & dino_buf[(uidx * unit_sects +
+                        sidx) << fatfs->ssize_sh];
+
+                /* if we know it is not part of a directory and it is not valid dentires,
+                 * then skip it */
+                isInDir = isset(sect_alloc, sect);
+                if ((isInDir == 0) && (fatfs_isdentry(fatfs, dep, 0) == 0)) {
+                    sect++;
+                    continue;
+                }
 
-            /* if we know it is not part of a directory and it is not valid dentires,
-             * then skip it */
-            isInDir = isset(sect_alloc, sect);
-            if ((isInDir == 0) && (fatfs_isdentry(fatfs, dep, 0) == 0)) {
-                sect++;
-                continue;
-            }
+                /* See if the last inode in this sector is smaller than the starting one */
+                if (FATFS_SECT_2_INODE(fatfs, sect + 1) < start_inum) {
+                    sect++;
+                    continue;
+                }
 
-            /* See if the last inode in this sector is smaller than the starting one */
-            if (FATFS_SECT_2_INODE(fatfs, sect + 1) < start_inum) {
-                sect++;
-                continue;
-            }
+                /* get the base inode address of this sector */
+                inum = FATFS_SECT_2_INODE(fatfs, sect);
 
-            /* get the base inode address of this sector */
-            inum = FATFS_SECT_2_INODE(fatfs, sect);
+                if (tsk_verbose)
+                    tsk_fprintf(stderr,
+                        "fatfs_inode_walk: Processing sector %" PRIuDADDR
+                        " starting at inode %" PRIuINUM "\n", sect, inum);
 
-            if (tsk_verbose)
-                tsk_fprintf(stderr,
-                    "fatfs_inode_walk: Processing sector %" PRIuDADDR
-                    " starting at inode %" PRIuINUM "\n", sect, inum);
+                /* cycle through the directory entries */
 
-            /* cycle through the directory entries */
+                for (didx = 0; didx < fatfs->dentry_cnt_se;
+                    didx++, inum++, dep++) {
+                    int retval;
+                    TSK_RETVAL_ENUM retval2;
 
-            for (didx = 0; didx < fatfs->dentry_cnt_se;
-                didx++, inum++, dep++) {
-                int retval;
-                TSK_RETVAL_ENUM retval2;
+                    /* If less, then move on */
+                    if (inum < start_inum)
+                        continue;
 
-                /* If less, then move on */
-                if (inum < start_inum)
-                    continue;
+                    /* If we are done, then exit from the loops  */
+                    if (inum > end_inum_tmp) {
+                        done = 1;
+                        break;
+                    }
 
-                /* If we are done, then exit from the loops  */
-                if (inum > end_inum_tmp) {
-                    done = 1;
-                    break;
-                }
 
+                    /* if this is a long file name entry, then skip it and
+                     * wait for the short name */
+                    if ((dep->attrib & FATFS_ATTR_LFN) == FATFS_ATTR_LFN)
+                        continue;
 
-                /* if this is a long file name entry, then skip it and
-                 * wait for the short name */
-                if ((dep->attrib & FATFS_ATTR_LFN) == FATFS_ATTR_LFN)
-                    continue;
 
+                    /* we don't care about . and .. entries because they
+                     * are redundant of other 'inode' entries */
+                    if (((dep->attrib & FATFS_ATTR_DIRECTORY)
+                            == FATFS_ATTR_DIRECTORY)
+                        && (dep->name[0] == '.'))
+                        continue;
 
-                /* we don't care about . and .. entries because they
-                 * are redundant of other 'inode' entries */
-                if (((dep->attrib & FATFS_ATTR_DIRECTORY)
-                        == FATFS_ATTR_DIRECTORY)
-                    && (dep->name[0] == '.'))
-                    continue;
 
+                    /* Allocation status
+                     * This is determined first by the sector allocation status
+                     * an then the dentry flag.  When a directory is deleted, the
+                     * contents are not always set to unallocated
+                     */
+                    if (clustalloc == 1) {
+                        myflags =
+                            ((dep->name[0] ==
+                                FATFS_SLOT_DELETED) ? TSK_FS_META_FLAG_UNALLOC
+                            : TSK_FS_META_FLAG_ALLOC);
+                    }
+                    else {
+                        myflags = TSK_FS_META_FLAG_UNALLOC;
+                    }
+
+                    if ((a_flags & myflags) != myflags)
+                        continue;
 
-                /* Allocation status
-                 * This is determined first by the sector allocation status
-                 * an then the dentry flag.  When a directory is deleted, the
-                 * contents are not always set to unallocated
-                 */
-                if (clustalloc == 1) {
-                    myflags =
-                        ((dep->name[0] ==
-                            FATFS_SLOT_DELETED) ? TSK_FS_META_FLAG_UNALLOC
-                        : TSK_FS_META_FLAG_ALLOC);
-                }
-                else {
-                    myflags = TSK_FS_META_FLAG_UNALLOC;
-                }
+                    /* Slot has not been used yet */
+                    myflags |= ((dep->name[0] == FATFS_SLOT_EMPTY) ?
+                        TSK_FS_META_FLAG_UNUSED : TSK_FS_META_FLAG_USED);
 
-                if ((a_flags & myflags) != myflags)
-                    continue;
+                    if ((a_flags & myflags) != myflags)
+                        continue;
 
-                /* Slot has not been used yet */
-                myflags |= ((dep->name[0] == FATFS_SLOT_EMPTY) ?
-                    TSK_FS_META_FLAG_UNUSED : TSK_FS_META_FLAG_USED);
+                    /* If we want only orphans, then check if this
+                     * inode is in the seen list
+                     */
+                    if ((myflags & TSK_FS_META_FLAG_UNALLOC) &&
+                        (a_flags & TSK_FS_META_FLAG_ORPHAN) &&
+                        (tsk_fs_dir_find_inum_named(fs, inum))) {
+                        continue;
+                    }
 
-                if ((a_flags & myflags) != myflags)
-                    continue;
+                    /* Do a final sanity check */
+                    if (0 == fatfs_isdentry(fatfs, dep, basicTest))
+                        continue;
 
-                /* If we want only orphans, then check if this
-                 * inode is in the seen list
-                 */
-                if ((myflags & TSK_FS_META_FLAG_UNALLOC) &&
-                    (a_flags & TSK_FS_META_FLAG_ORPHAN) &&
-                    (tsk_fs_dir_find_inum_named(fs, inum))) {
-                    continue;
-                }
+                    if ((retval2 =
+                            fatfs_dinode_copy(fatfs, fs_file->meta, dep, sect,
+                                inum)) != TSK_OK) {
+                        /* Ignore this error and continue */
+                        if (retval2 == TSK_COR) {
+                            if (tsk_verbose)
+                                tsk_error_print(stderr);
+                            tsk_error_reset();
+                            continue;
+                        }
+                        else {
+                            tsk_fs_file_close(fs_file);
+                            free(sect_alloc_free);
+                            free(dino_buf);
+                            free(batch_alloc);
+                            return 1;
+                        }
+                    }
 
-                /* Do a final sanity check */
-                if (0 == fatfs_isdentry(fatfs, dep, basicTest))
-                    continue;
+                    if (tsk_verbose)
+                        tsk_fprintf(stderr,
+                            "fatfs_inode_walk: Directory Entry %" PRIuINUM
+                            " (%u) at sector %" PRIuDADDR "\n", inum, didx,
+                            sect);
 
-                if ((retval2 =
-                        fatfs_dinode_copy(fatfs, fs_file->meta, dep, sect,
-                            inum)) != TSK_OK) {
-                    /* Ignore this error and continue */
-                    if (retval2 == TSK_COR) {
-                        if (tsk_verbose)
-                            tsk_error_print(stderr);
-                        tsk_error_reset();
-                        continue;
+                    retval = a_action(fs_file, a_ptr);
+                    if (retval == TSK_WALK_STOP) {
+                        tsk_fs_file_close(fs_file);
+                        free(sect_alloc_free);
+                        free(dino_buf);
+                        free(batch_alloc);
+                        return 0;
                     }
-                    else {
+                    else if (retval == TSK_WALK_ERROR) {
                         tsk_fs_file_close(fs_file);
-                        free(sect_alloc);
+                        free(sect_alloc_free);
                         free(dino_buf);
+                        free(batch_alloc);
                         return 1;
                     }
-                }
-
-                if (tsk_verbose)
-                    tsk_fprintf(stderr,
-                        "fatfs_inode_walk: Directory Entry %" PRIuINUM
-                        " (%u) at sector %" PRIuDADDR "\n", inum, didx,
-                        sect);
-
-                retval = a_action(fs_file, a_ptr);
-                if (retval == TSK_WALK_STOP) {
-                    tsk_fs_file_close(fs_file);
-                    free(sect_alloc);
-                    free(dino_buf);
-                    return 0;
-                }
-                else if (retval == TSK_WALK_ERROR) {
-                    tsk_fs_file_close(fs_file);
-                    free(sect_alloc);
-                    free(dino_buf);
-                    return 1;
-                }
-            }                   /* dentries */
-            sect++;
+                }                   /* dentries */
+                sect++;
+                if (done)
+                    break;
+            }
             if (done)
                 break;
         }
         if (done)
             break;
+        sect = bsect + bsects;
     }
 
 
-    free(sect_alloc);
+    free(sect_alloc_free);
     free(dino_buf);
+    free(batch_alloc);
 
 
     // handle the virtual orphans folder and FAT files if they asked for them
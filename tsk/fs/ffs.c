@@ -834,6 +834,76 @@ ffs_inode_lookup(TSK_FS_INFO * fs, TSK_FS_FILE * a_fs_file,
 
 
 
+/* Inode table blocks that ffs_inode_walk has read from the current group */
+typedef struct {
+    char *buf;
+    size_t max_blks;            /* number of FFS blocks that fit in buf */
+    size_t blks;                /* number of FFS blocks in buf */
+    TSK_DADDR_T addr;           /* address of first block in buf */
+} FFS_WALK_ITBL;
+
+/* ffs_walk_dinode_load - copy an inode out of the walk's inode table
+ * buffer, first reading the table blocks from inum up to last_inum
+ * (which must be in the same group) if inum is not already in it.
+ *
+ * Return 1 on error and 0 on success
+ */
+static uint8_t
+ffs_walk_dinode_load(FFS_INFO * ffs, FFS_WALK_ITBL * itbl,
+    TSK_INUM_T inum, TSK_INUM_T last_inum, ffs_inode * dino_buf)
+{
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) & ffs->fs_info;
+    TSK_DADDR_T addr;
+    size_t isize;
+    TSK_OFF_T offs;
+
+    if ((fs->ftype == TSK_FS_TYPE_FFS1)
+        || (fs->ftype == TSK_FS_TYPE_FFS1B))
+        isize = sizeof(ffs_inode1);
+    else
+        isize = sizeof(ffs_inode2);
+
+    addr = itod_lcl(fs, ffs->fs.sb1, inum);
+    if ((itbl->blks == 0) || (addr < itbl->addr)
+        || (addr >= itbl->addr + itbl->blks * ffs->ffsbsize_f)) {
+        TSK_DADDR_T last_addr = itod_lcl(fs, ffs->fs.sb1, last_inum);
+        size_t blks;
+        ssize_t cnt;
+
+        blks = (size_t) ((last_addr - addr) / ffs->ffsbsize_f) + 1;
+        if (blks > itbl->max_blks)
+            blks = itbl->max_blks;
+
+        cnt = tsk_fs_read_block(fs, addr, itbl->buf,
+            blks * ffs->ffsbsize_b);
+
+        /* try just the one block that we need before giving up */
+        if ((cnt != (ssize_t) (blks * ffs->ffsbsize_b)) && (blks > 1)) {
+            tsk_error_reset();
+            blks = 1;
+            cnt = tsk_fs_read_block(fs, addr, itbl->buf,
+                ffs->ffsbsize_b);
+        }
+        if (cnt != (ssize_t) (blks * ffs->ffsbsize_b)) {
+            itbl->blks = 0;
+            if (cnt >= 0) {
+                tsk_error_reset();
+                tsk_error_set_errno(TSK_ERR_FS_READ);
+            }
+            tsk_error_set_errstr2
+                ("ffs_inode_walk: inode table at %" PRIuDADDR, addr);
+            return 1;
+        }
+        itbl->addr = addr;
+        itbl->blks = blks;
+    }
+
+    offs = (addr - itbl->addr) * fs->block_size +
+        itoo_lcl(fs, ffs->fs.sb1, inum) * isize;
+    memcpy((char *) dino_buf, itbl->buf + offs, isize);
+    return 0;
+}
+
 /* ffs_inode_walk - inode iterator
  *
  * flags used: TSK_FS_META_FLAG_USED, TSK_FS_META_FLAG_UNUSED,
@@ -856,7 +926,12 @@ ffs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
     int myflags;
     TSK_INUM_T ibase = 0;
     TSK_INUM_T end_inum_tmp;
+    TSK_INUM_T ipg;
+    TSK_INUM_T grp_inited = 0;
     ffs_inode *dino_buf;
+    char *grp_buf;
+    uint8_t grp_loaded = 0;
+    FFS_WALK_ITBL itbl;
 
     // clean up any error messages that are lying around
     tsk_error_reset();
@@ -932,6 +1007,27 @@ ffs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
     if ((dino_buf = (ffs_inode *) tsk_malloc(sizeof(ffs_inode2))) == NULL)
         return 1;
 
+    /* The walk goes one cylinder group at a time.  It keeps its own copy
+     * of the group descriptor and reads the group's inode table in large
+     * chunks instead of loading each inode through the shared caches. */
+    if ((grp_buf = tsk_malloc(ffs->ffsbsize_b)) == NULL) {
+        tsk_fs_file_close(fs_file);
+        free(dino_buf);
+        return 1;
+    }
+    itbl.max_blks = FFS_WALK_READ_SIZE / ffs->ffsbsize_b;
+    if (itbl.max_blks == 0)
+        itbl.max_blks = 1;
+    itbl.blks = 0;
+    itbl.addr = 0;
+    if ((itbl.buf = tsk_malloc(itbl.max_blks * ffs->ffsbsize_b)) == NULL) {
+        tsk_fs_file_close(fs_file);
+        free(dino_buf);
+        free(grp_buf);
+        return 1;
+    }
+    ipg = tsk_gets32(fs->endian, ffs->fs.sb1->cg_inode_num);
+
     /*
      * Iterate. This is easy because inode numbers are contiguous, unlike
      * data blocks which are interleaved with cylinder group blocks.
@@ -944,16 +1040,35 @@ ffs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
          */
         grp_num = itog_lcl(fs, ffs->fs.sb1, inum);
 
-        tsk_take_lock(&ffs->lock);
-        if (ffs_group_load(ffs, grp_num)) {
+        if ((grp_loaded == 0) || (inum < ibase) || (inum >= ibase + ipg)) {
+            tsk_take_lock(&ffs->lock);
+            if (ffs_group_load(ffs, grp_num)) {
+                tsk_release_lock(&ffs->lock);
+                tsk_fs_file_close(fs_file);
+                free(dino_buf);
+                free(grp_buf);
+                free(itbl.buf);
+                return 1;
+            }
+            memcpy(grp_buf, ffs->grp_buf, ffs->ffsbsize_b);
             tsk_release_lock(&ffs->lock);
-            free(dino_buf);
-            return 1;
+
+            grp_loaded = 1;
+            cg = (ffs_cgd *) grp_buf;
+            inosused = (unsigned char *) cg_inosused_lcl(fs, cg);
+            ibase = grp_num * ipg;
+            itbl.blks = 0;
+
+            /* UFS2 does not initialize all inodes when the file system
+             * is created, so only read the ones that the group says are */
+            grp_inited = ipg;
+            if (fs->ftype == TSK_FS_TYPE_FFS2) {
+                ffs_cgd2 *cg2 = (ffs_cgd2 *) grp_buf;
+                if (tsk_getu32(fs->endian, cg2->cg_initediblk) < ipg)
+                    grp_inited =
+                        tsk_getu32(fs->endian, cg2->cg_initediblk);
+            }
         }
-        cg = (ffs_cgd *) ffs->grp_buf;
-        inosused = (unsigned char *) cg_inosused_lcl(fs, cg);
-        ibase =
-            grp_num * tsk_gets32(fs->endian, ffs->fs.sb1->cg_inode_num);
 
         /*
          * Apply the allocated/unallocated restriction.
@@ -961,15 +1076,19 @@ ffs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
         myflags = (isset(inosused, inum - ibase) ?
             TSK_FS_META_FLAG_ALLOC : TSK_FS_META_FLAG_UNALLOC);
 
-        tsk_release_lock(&ffs->lock);
-
         if ((a_flags & myflags) != myflags)
             continue;
 
-
-        if (ffs_dinode_load(ffs, inum, dino_buf)) {
+        if (inum - ibase >= grp_inited) {
+            memset((char *) dino_buf, 0, sizeof(ffs_inode2));
+        }
+        else if (ffs_walk_dinode_load(ffs, &itbl, inum,
+                (ibase + grp_inited - 1 < end_inum_tmp) ?
+                ibase + grp_inited - 1 : end_inum_tmp, dino_buf)) {
             tsk_fs_file_close(fs_file);
             free(dino_buf);
+            free(grp_buf);
+            free(itbl.buf);
             return 1;
         }
 
@@ -1016,6 +1135,8 @@ ffs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
         if (ffs_dinode_copy(ffs, fs_file->meta, inum, dino_buf)) {
             tsk_fs_file_close(fs_file);
             free(dino_buf);
+            free(grp_buf);
+            free(itbl.buf);
             return 1;
         }
 
@@ -1023,11 +1144,15 @@ ffs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
         if (retval == TSK_WALK_STOP) {
             tsk_fs_file_close(fs_file);
             free(dino_buf);
+            free(grp_buf);
+            free(itbl.buf);
             return 0;
         }
         else if (retval == TSK_WALK_ERROR) {
             tsk_fs_file_close(fs_file);
             free(dino_buf);
+            free(grp_buf);
+            free(itbl.buf);
             return 1;
         }
     }
@@ -1041,6 +1166,8 @@ ffs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
         if (tsk_fs_dir_make_orphan_dir_meta(fs, fs_file->meta)) {
             tsk_fs_file_close(fs_file);
             free(dino_buf);
+            free(grp_buf);
+            free(itbl.buf);
             return 1;
         }
         /* call action */
@@ -1048,11 +1175,15 @@ ffs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
         if (retval == TSK_WALK_STOP) {
             tsk_fs_file_close(fs_file);
             free(dino_buf);
+            free(grp_buf);
+            free(itbl.buf);
             return 0;
         }
         else if (retval == TSK_WALK_ERROR) {
             tsk_fs_file_close(fs_file);
             free(dino_buf);
+            free(grp_buf);
+            free(itbl.buf);
             return 1;
         }
     }
@@ -1062,36 +1193,27 @@ ffs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
      */
     tsk_fs_file_close(fs_file);
     free(dino_buf);
+    free(grp_buf);
+    free(itbl.buf);
 
     return 0;
 }
 
 
-TSK_FS_BLOCK_FLAG_ENUM
-ffs_block_getflags(TSK_FS_INFO * a_fs, TSK_DADDR_T a_addr)
+/* ffs_block_getflags_cg - get the flags of a fragment using the
+ * descriptor of the cylinder group that it is in
+ */
+static int
+ffs_block_getflags_cg(TSK_FS_INFO * a_fs, ffs_cgd * cg,
+    FFS_GRPNUM_T grp_num, TSK_DADDR_T a_addr)
 {
     FFS_INFO *ffs = (FFS_INFO *) a_fs;
-    FFS_GRPNUM_T grp_num;
-    ffs_cgd *cg = 0;
     TSK_DADDR_T frag_base = 0;
     TSK_DADDR_T dblock_addr = 0;        /* first data block in group */
     TSK_DADDR_T sblock_addr = 0;        /* super block in group */
     unsigned char *freeblocks = NULL;
     int flags;
 
-    // sparse
-    if (a_addr == 0)
-        return TSK_FS_BLOCK_FLAG_CONT | TSK_FS_BLOCK_FLAG_ALLOC;
-
-    grp_num = dtog_lcl(a_fs, ffs->fs.sb1, a_addr);
-
-    tsk_take_lock(&ffs->lock);
-    if (ffs_group_load(ffs, grp_num)) {
-        tsk_release_lock(&ffs->lock);
-        return 0;
-    }
-
-    cg = (ffs_cgd *) ffs->grp_buf;
     freeblocks = (unsigned char *) cg_blksfree_lcl(a_fs, cg);
 
     // get the base fragment for the group
@@ -1111,8 +1233,6 @@ ffs_block_getflags(TSK_FS_INFO * a_fs, TSK_DADDR_T a_addr)
     flags = (isset(freeblocks, a_addr - frag_base) ?
         TSK_FS_BLOCK_FLAG_UNALLOC : TSK_FS_BLOCK_FLAG_ALLOC);
 
-    tsk_release_lock(&ffs->lock);
-
     if (a_addr >= sblock_addr && a_addr < dblock_addr)
         flags |= TSK_FS_BLOCK_FLAG_META;
     else
@@ -1121,6 +1241,34 @@ ffs_block_getflags(TSK_FS_INFO * a_fs, TSK_DADDR_T a_addr)
     return flags;
 }
 
+
+TSK_FS_BLOCK_FLAG_ENUM
+ffs_block_getflags(TSK_FS_INFO * a_fs, TSK_DADDR_T a_addr)
+{
+    FFS_INFO *ffs = (FFS_INFO *) a_fs;
+    FFS_GRPNUM_T grp_num;
+    int flags;
+
+    // sparse
+    if (a_addr == 0)
+        return TSK_FS_BLOCK_FLAG_CONT | TSK_FS_BLOCK_FLAG_ALLOC;
+
+    grp_num = dtog_lcl(a_fs, ffs->fs.sb1, a_addr);
+
+    tsk_take_lock(&ffs->lock);
+    if (ffs_group_load(ffs, grp_num)) {
+        tsk_release_lock(&ffs->lock);
+        return 0;
+    }
+
+    flags = ffs_block_getflags_cg(a_fs, (ffs_cgd *) ffs->grp_buf,
+        grp_num, a_addr);
+
+    tsk_release_lock(&ffs->lock);
+
+    return flags;
+}
+
 /**************************************************************************
  *
  * BLOCK WALKING
@@ -1148,6 +1296,11 @@ ffs_block_walk(TSK_FS_INFO * fs, TSK_DADDR_T a_start_blk,
     char *cache_blk_buf;        // buffer used for local read cache
     TSK_DADDR_T cache_addr;     // base address in local cache
     int cache_len_f;            // amount of data read into cache (in fragments)
+    int cache_max_f;            // size of the cache (in fragments)
+
+    char *grp_buf;              // copy of the current cylinder group descriptor
+    FFS_GRPNUM_T grp_num = 0;   // group that is in grp_buf
+    uint8_t grp_loaded = 0;
 
     // clean up any error messages that are lying around
     tsk_error_reset();
@@ -1190,7 +1343,21 @@ ffs_block_walk(TSK_FS_INFO * fs, TSK_DADDR_T a_start_blk,
     if ((fs_block = tsk_fs_block_alloc(fs)) == NULL) {
         return 1;
     }
-    if ((cache_blk_buf = tsk_malloc(ffs->ffsbsize_b)) == NULL) {
+
+    /* Data is read in chunks of whole FFS blocks up to FFS_WALK_READ_SIZE
+     * and the flags come from a local copy of each group's descriptor,
+     * so the walk goes through the image one group at a time. */
+    cache_max_f = (int) (FFS_WALK_READ_SIZE / ffs->ffsbsize_b) *
+        ffs->ffsbsize_f;
+    if (cache_max_f < (int) ffs->ffsbsize_f)
+        cache_max_f = ffs->ffsbsize_f;
+    if ((cache_blk_buf = tsk_malloc(cache_max_f * fs->block_size)) == NULL) {
+        tsk_fs_block_free(fs_block);
+        return 1;
+    }
+    if ((grp_buf = tsk_malloc(ffs->ffsbsize_b)) == NULL) {
+        tsk_fs_block_free(fs_block);
+        free(cache_blk_buf);
         return 1;
     }
     cache_len_f = 0;
@@ -1200,7 +1367,31 @@ ffs_block_walk(TSK_FS_INFO * fs, TSK_DADDR_T a_start_blk,
     for (addr = a_start_blk; addr <= a_end_blk; addr++) {
         int retval;
         size_t cache_offset = 0;
-        int myflags = ffs_block_getflags(fs, addr);
+        int myflags;
+
+        if (addr == 0) {
+            // sparse
+            myflags = TSK_FS_BLOCK_FLAG_CONT | TSK_FS_BLOCK_FLAG_ALLOC;
+        }
+        else {
+            FFS_GRPNUM_T addr_grp = dtog_lcl(fs, ffs->fs.sb1, addr);
+
+            if ((grp_loaded == 0) || (addr_grp != grp_num)) {
+                grp_loaded = 0;
+                tsk_take_lock(&ffs->lock);
+                if (ffs_group_load(ffs, addr_grp) == 0) {
+                    memcpy(grp_buf, ffs->grp_buf, ffs->ffsbsize_b);
+                    grp_num = addr_grp;
+                    grp_loaded = 1;
+                }
+                tsk_release_lock(&ffs->lock);
+            }
+            if (grp_loaded)
+                myflags = ffs_block_getflags_cg(fs, (ffs_cgd *) grp_buf,
+                    grp_num, addr);
+            else
+                myflags = 0;
+        }
 
         if ((tsk_verbose) && (myflags & TSK_FS_BLOCK_FLAG_META)
             && (myflags & TSK_FS_BLOCK_FLAG_UNALLOC))
@@ -1230,12 +1421,22 @@ ffs_block_walk(TSK_FS_INFO * fs, TSK_DADDR_T a_start_blk,
                 int frags;
 
                 /* Ideally, we want to read in block sized chunks, verify we can do that */
-                frags = (a_end_blk > addr + ffs->ffsbsize_f - 1 ?
-                    ffs->ffsbsize_f : (int) (a_end_blk + 1 - addr));
+                frags = (a_end_blk > addr + cache_max_f - 1 ?
+                    cache_max_f : (int) (a_end_blk + 1 - addr));
 
                 cnt =
                     tsk_fs_read_block(fs, addr, cache_blk_buf,
                     fs->block_size * frags);
+
+                /* try a single block before giving up */
+                if ((cnt != fs->block_size * frags)
+                    && (frags > (int) ffs->ffsbsize_f)) {
+                    tsk_error_reset();
+                    frags = ffs->ffsbsize_f;
+                    cnt =
+                        tsk_fs_read_block(fs, addr, cache_blk_buf,
+                        fs->block_size * frags);
+                }
                 if (cnt != fs->block_size * frags) {
                     if (cnt >= 0) {
                         tsk_error_reset();
@@ -1245,6 +1446,7 @@ ffs_block_walk(TSK_FS_INFO * fs, TSK_DADDR_T a_start_blk,
                         PRIuDADDR, addr);
                     tsk_fs_block_free(fs_block);
                     free(cache_blk_buf);
+                    free(grp_buf);
                     return 1;
                 }
                 cache_len_f = frags;
@@ -1266,6 +1468,7 @@ ffs_block_walk(TSK_FS_INFO * fs, TSK_DADDR_T a_start_blk,
         else if (retval == TSK_WALK_ERROR) {
             tsk_fs_block_free(fs_block);
             free(cache_blk_buf);
+            free(grp_buf);
             return 1;
         }
     }
@@ -1273,6 +1476,7 @@ ffs_block_walk(TSK_FS_INFO * fs, TSK_DADDR_T a_start_blk,
     /* Cleanup */
     tsk_fs_block_free(fs_block);
     free(cache_blk_buf);
+    free(grp_buf);
     return 0;
 }
 
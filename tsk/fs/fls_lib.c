@@ -36,6 +36,12 @@ typedef struct {
     /*directory prefix for printing mactime output */
     char *macpre;
     int flags;
+
+    /* if set, mactime lines are passed here instead of printed */
+    TSK_FS_FLS_MAC_CB mac_action;
+    void *mac_ptr;
+    char *mac_buf;
+    size_t mac_buf_size;
 } FLS_DATA;
 
 
@@ -46,9 +52,9 @@ typedef struct {
  * 
  * fs_attr should be set to NULL for all non-NTFS file systems
  */
-static void
+static TSK_WALK_RET_ENUM
 printit(TSK_FS_FILE * fs_file, const char *a_path,
-    const TSK_FS_ATTR * fs_attr, const FLS_DATA * fls_data)
+    const TSK_FS_ATTR * fs_attr, FLS_DATA * fls_data)
 {
 	TSK_FS_HASH_RESULTS hash_results;
     unsigned int i;
@@ -67,7 +73,21 @@ printit(TSK_FS_FILE * fs_file, const char *a_path,
     }
 
 
-	if(fls_data->flags & TSK_FS_FLS_MAC){
+	if (fls_data->mac_action) {
+        const unsigned char *hash = NULL;
+
+        if (fls_data->flags & TSK_FS_FLS_HASH) {
+            tsk_fs_file_hash_calc(fs_file, &hash_results,
+                TSK_BASE_HASH_MD5);
+            hash = hash_results.md5_digest;
+        }
+        if (tsk_fs_name_make_mac(&fls_data->mac_buf,
+                &fls_data->mac_buf_size, fs_file, a_path, fs_attr,
+                fls_data->macpre, fls_data->sec_skew, hash))
+            return TSK_WALK_ERROR;
+        return fls_data->mac_action(fls_data->mac_buf, fls_data->mac_ptr);
+    }
+	else if(fls_data->flags & TSK_FS_FLS_MAC){
 		if(fls_data->flags & TSK_FS_FLS_HASH){
 			tsk_fs_file_hash_calc(fs_file, &hash_results, TSK_BASE_HASH_MD5);
 			tsk_fs_name_print_mac_md5(stdout, fs_file, a_path,
@@ -89,6 +109,7 @@ printit(TSK_FS_FILE * fs_file, const char *a_path,
             fs_attr, TSK_FS_FLS_FULL & fls_data->flags ? 1 : 0);
         tsk_printf("\n");
     }
+    return TSK_WALK_CONT;
 }
 
 
@@ -99,6 +120,7 @@ static TSK_WALK_RET_ENUM
 print_dent_act(TSK_FS_FILE * fs_file, const char *a_path, void *ptr)
 {
     FLS_DATA *fls_data = (FLS_DATA *) ptr;
+    TSK_WALK_RET_ENUM retval = TSK_WALK_CONT;
 
     /* only print dirs if TSK_FS_FLS_DIR is set and only print everything
      ** else if TSK_FS_FLS_FILE is set (or we aren't sure what it is)
@@ -143,7 +165,7 @@ print_dent_act(TSK_FS_FILE * fs_file, const char *a_path, void *ptr)
                         }
                     }
 
-                    printit(fs_file, a_path, fs_attr, fls_data);
+                    retval = printit(fs_file, a_path, fs_attr, fls_data);
                 }
                 else if (fs_attr->type == TSK_FS_ATTR_TYPE_NTFS_IDXROOT) {
                     printed = 1;
@@ -154,7 +176,8 @@ print_dent_act(TSK_FS_FILE * fs_file, const char *a_path, void *ptr)
                      */
                     if (!((TSK_FS_ISDOT(fs_file->name->name)) &&
                             ((fls_data->flags & TSK_FS_FLS_DOT) == 0)))
-                        printit(fs_file, a_path, fs_attr, fls_data);
+                        retval =
+                            printit(fs_file, a_path, fs_attr, fls_data);
                 }
                 /* Print the FILE_NAME times if this is the same attribute
                  * that we collected the times from. */
@@ -166,14 +189,17 @@ print_dent_act(TSK_FS_FILE * fs_file, const char *a_path, void *ptr)
                      */
                     if (!((TSK_FS_ISDOT(fs_file->name->name)) &&
                             ((fls_data->flags & TSK_FS_FLS_DOT) == 0)))
-                        printit(fs_file, a_path, fs_attr, fls_data);
+                        retval =
+                            printit(fs_file, a_path, fs_attr, fls_data);
                 }
+                if (retval != TSK_WALK_CONT)
+                    return retval;
             }
 
             /* A user reported that an allocated file had the standard
              * attributes, but no $Data.  We should print something */
             if (printed == 0) {
-                printit(fs_file, a_path, NULL, fls_data);
+                retval = printit(fs_file, a_path, NULL, fls_data);
             }
 
         }
@@ -181,10 +207,10 @@ print_dent_act(TSK_FS_FILE * fs_file, const char *a_path, void *ptr)
             /* skip it if it is . or .. and we don't want them */
             if (!((TSK_FS_ISDOT(fs_file->name->name))
                     && ((fls_data->flags & TSK_FS_FLS_DOT) == 0)))
-                printit(fs_file, a_path, NULL, fls_data);
+                retval = printit(fs_file, a_path, NULL, fls_data);
         }
     }
-    return TSK_WALK_CONT;
+    return retval;
 }
 
 
@@ -198,6 +224,10 @@ tsk_fs_fls(TSK_FS_INFO * fs, TSK_FS_FLS_FLAG_ENUM lclflags,
 
     data.flags = lclflags;
     data.sec_skew = skew;
+    data.mac_action = NULL;
+    data.mac_ptr = NULL;
+    data.mac_buf = NULL;
+    data.mac_buf_size = 0;
 
 #ifdef TSK_WIN32
     {
@@ -247,3 +277,44 @@ tsk_fs_fls(TSK_FS_INFO * fs, TSK_FS_FLS_FLAG_ENUM lclflags,
     return tsk_fs_dir_walk(fs, inode, flags, print_dent_act, &data);
 #endif
 }
+
+
+/**
+ * \ingroup fslib
+ * Walk the directories like tsk_fs_fls() does with the TSK_FS_FLS_MAC
+ * flag, but pass each line of the body file to a callback instead of
+ * printing it.  This allows a timeline to be made without an
+ * intermediate file.
+ *
+ * @param fs File system to analyze
+ * @param lclflags Flags to select which names to process (TSK_FS_FLS_MAC
+ * and TSK_FS_FLS_FULL are always set)
+ * @param inode Directory to start walk at
+ * @param flags Flags to use during the directory walk
+ * @param a_pre Text to add before each path (should end with "/", can be NULL)
+ * @param skew Number of seconds to subtract from each time
+ * @param a_action Callback that gets each NULL terminated line.  Its
+ * return value controls the walk.
+ * @param a_ptr Pointer to pass to the callback
+ * @returns 1 on error and 0 on success
+ */
+uint8_t
+tsk_fs_fls_mac(TSK_FS_INFO * fs, TSK_FS_FLS_FLAG_ENUM lclflags,
+    TSK_INUM_T inode, TSK_FS_DIR_WALK_FLAG_ENUM flags, const char *a_pre,
+    int32_t skew, TSK_FS_FLS_MAC_CB a_action, void *a_ptr)
+{
+    FLS_DATA data;
+    uint8_t retval;
+
+    data.flags = lclflags | TSK_FS_FLS_MAC | TSK_FS_FLS_FULL;
+    data.sec_skew = skew;
+    data.macpre = (char *) (a_pre ? a_pre : "");
+    data.mac_action = a_action;
+    data.mac_ptr = a_ptr;
+    data.mac_buf = NULL;
+    data.mac_buf_size = 0;
+
+    retval = tsk_fs_dir_walk(fs, inode, flags, print_dent_act, &data);
+    free(data.mac_buf);
+    return retval;
+}
@@ -424,3 +424,99 @@ tsk_fs_attrlist_get_len(const TSK_FS_ATTRLIST * a_fs_attrlist)
     }
     return len;
 }
+
+/**
+ * \internal
+ * Make a copy of the attributes that are in use in a list.  The
+ * copies will be in the same order as the original list and will
+ * point to the given file.
+ *
+ * @param a_fs_file File that the new attributes will belong to
+ * @param a_fs_attrlist List to copy
+ *
+ * @return NULL on error or the new list
+ */
+TSK_FS_ATTRLIST *
+tsk_fs_attrlist_copy(TSK_FS_FILE * a_fs_file,
+    const TSK_FS_ATTRLIST * a_fs_attrlist)
+{
+    TSK_FS_ATTRLIST *fs_attrlist;
+    TSK_FS_ATTR *fs_attr_cur, *fs_attr_last = NULL;
+
+    if ((fs_attrlist = tsk_fs_attrlist_alloc()) == NULL)
+        return NULL;
+
+    if (a_fs_attrlist == NULL)
+        return fs_attrlist;
+
+    for (fs_attr_cur = a_fs_attrlist->head; fs_attr_cur;
+        fs_attr_cur = fs_attr_cur->next) {
+        TSK_FS_ATTR *fs_attr;
+        TSK_FS_ATTR_RUN *run_cur, *run_last = NULL;
+
+        if ((fs_attr_cur->flags & TSK_FS_ATTR_INUSE) == 0)
+            continue;
+
+        if ((fs_attr =
+                (TSK_FS_ATTR *) tsk_malloc(sizeof(TSK_FS_ATTR))) == NULL) {
+            tsk_fs_attrlist_free(fs_attrlist);
+            return NULL;
+        }
+        memcpy(fs_attr, fs_attr_cur, sizeof(TSK_FS_ATTR));
+        fs_attr->next = NULL;
+        fs_attr->fs_file = a_fs_file;
+        fs_attr->name = NULL;
+        fs_attr->rd.buf = NULL;
+        fs_attr->nrd.run = NULL;
+        fs_attr->nrd.run_end = NULL;
+
+        // add it now so that it gets freed if there is an error
+        if (fs_attr_last)
+            fs_attr_last->next = fs_attr;
+        else
+            fs_attrlist->head = fs_attr;
+        fs_attr_last = fs_attr;
+
+        if (fs_attr_cur->name_size) {
+            if ((fs_attr->name =
+                    (char *) tsk_malloc(fs_attr_cur->name_size)) == NULL) {
+                tsk_fs_attrlist_free(fs_attrlist);
+                return NULL;
+            }
+            memcpy(fs_attr->name, fs_attr_cur->name,
+                fs_attr_cur->name_size);
+        }
+
+        if (fs_attr_cur->rd.buf_size) {
+            if ((fs_attr->rd.buf =
+                    (uint8_t *) tsk_malloc(fs_attr_cur->rd.buf_size)) ==
+                NULL) {
+                tsk_fs_attrlist_free(fs_attrlist);
+                return NULL;
+            }
+            memcpy(fs_attr->rd.buf, fs_attr_cur->rd.buf,
+                fs_attr_cur->rd.buf_size);
+        }
+
+        for (run_cur = fs_attr_cur->nrd.run; run_cur;
+            run_cur = run_cur->next) {
+            TSK_FS_ATTR_RUN *run;
+            if ((run = tsk_fs_attr_run_alloc()) == NULL) {
+                tsk_fs_attrlist_free(fs_attrlist);
+                return NULL;
+            }
+            run->offset = run_cur->offset;
+            run->addr = run_cur->addr;
+            run->len = run_cur->len;
+            run->flags = run_cur->flags;
+
+            if (run_last)
+                run_last->next = run;
+            else
+                fs_attr->nrd.run = run;
+            run_last = run;
+        }
+        fs_attr->nrd.run_end = run_last;
+    }
+    return fs_attrlist;
+}
@@ -206,3 +206,321 @@ tsk_fs_block_walk(TSK_FS_INFO * a_fs,
     return a_fs->block_walk(a_fs, a_start_blk, a_end_blk, a_flags,
         a_action, a_ptr);
 }
+
+
+/** \internal
+ * Largest number of bytes that tsk_fs_block_range_walk() reads at a time.
+ */
+#define TSK_FS_BLOCK_RANGE_READ_SIZE (1024 * 1024)
+
+/** \internal
+ * Structure to store data for tsk_fs_block_range_walk().
+ */
+typedef struct {
+    TSK_FS_BLOCK_RANGE_WALK_CB action;
+    void *ptr;
+    TSK_DADDR_T start;          ///< First block of the range that has not been passed to action yet
+    TSK_DADDR_T len;            ///< Number of blocks in the range (0 if there is none)
+    TSK_FS_BLOCK_FLAG_ENUM flags;       ///< Flags of the blocks in the range
+    TSK_FS_BLOCK_FLAG_ENUM aonly;       ///< TSK_FS_BLOCK_FLAG_AONLY if the content is not read
+    char *buf;                  ///< Buffer for the content (NULL if AONLY)
+    size_t buf_blks;            ///< Number of blocks that fit in buf
+    uint8_t stop;               ///< Set when action returned TSK_WALK_STOP
+} BLOCK_RANGE_DATA;
+
+
+/* block_range_flush - pass the saved range to the callback.  The content
+ * is read in pieces of up to buf_blks blocks.
+ */
+static TSK_WALK_RET_ENUM
+block_range_flush(TSK_FS_INFO * a_fs, BLOCK_RANGE_DATA * a_data)
+{
+    while (a_data->len) {
+        TSK_DADDR_T len = a_data->len;
+        TSK_WALK_RET_ENUM retval;
+
+        if (a_data->buf) {
+            ssize_t cnt;
+
+            if (len > a_data->buf_blks)
+                len = a_data->buf_blks;
+            cnt = tsk_fs_read_block(a_fs, a_data->start, a_data->buf,
+                (size_t) len * a_fs->block_size);
+            if (cnt != (ssize_t) (len * a_fs->block_size)) {
+                if (cnt >= 0) {
+                    tsk_error_reset();
+                    tsk_error_set_errno(TSK_ERR_FS_READ);
+                }
+                tsk_error_set_errstr2("tsk_fs_block_range_walk: blocks %"
+                    PRIuDADDR " to %" PRIuDADDR, a_data->start,
+                    a_data->start + len - 1);
+                a_data->len = 0;
+                return TSK_WALK_ERROR;
+            }
+        }
+
+        retval = a_data->action(a_fs, a_data->start, len,
+            a_data->flags | a_data->aonly, a_data->buf, a_data->ptr);
+        a_data->start += len;
+        a_data->len -= len;
+        if (retval == TSK_WALK_STOP) {
+            a_data->stop = 1;
+            a_data->len = 0;
+            return TSK_WALK_STOP;
+        }
+        else if (retval == TSK_WALK_ERROR) {
+            a_data->len = 0;
+            return TSK_WALK_ERROR;
+        }
+    }
+    return TSK_WALK_CONT;
+}
+
+/* block_range_add - add blocks to the saved range, or pass the saved range
+ * to the callback and start a new one if they do not extend it.
+ */
+static TSK_WALK_RET_ENUM
+block_range_add(TSK_FS_INFO * a_fs, BLOCK_RANGE_DATA * a_data,
+    TSK_DADDR_T a_addr, TSK_DADDR_T a_len, TSK_FS_BLOCK_FLAG_ENUM a_flags)
+{
+    TSK_WALK_RET_ENUM retval;
+
+    if ((a_data->len) && (a_data->flags == a_flags)
+        && (a_data->start + a_data->len == a_addr)) {
+        a_data->len += a_len;
+        return TSK_WALK_CONT;
+    }
+
+    if ((retval = block_range_flush(a_fs, a_data)) != TSK_WALK_CONT)
+        return retval;
+
+    a_data->start = a_addr;
+    a_data->len = a_len;
+    a_data->flags = a_flags;
+    return TSK_WALK_CONT;
+}
+
+/* block_range_flush_err - pass the saved range to the callback after an
+ * error, but keep the message of the error that ended the walk.
+ */
+static void
+block_range_flush_err(TSK_FS_INFO * a_fs, BLOCK_RANGE_DATA * a_data)
+{
+    uint32_t errnum;
+    char *errstr;
+    char *errstr2;
+
+    if (a_data->len == 0)
+        return;
+
+    errnum = tsk_error_get_errno();
+    errstr = tsk_malloc(TSK_ERROR_STRING_MAX_LENGTH + 1);
+    errstr2 = tsk_malloc(TSK_ERROR_STRING_MAX_LENGTH + 1);
+    if ((errstr != NULL) && (errstr2 != NULL)) {
+        strncpy(errstr, tsk_error_get_errstr(),
+            TSK_ERROR_STRING_MAX_LENGTH);
+        strncpy(errstr2, tsk_error_get_errstr2(),
+            TSK_ERROR_STRING_MAX_LENGTH);
+        if (block_range_flush(a_fs, a_data) == TSK_WALK_CONT) {
+            tsk_error_reset();
+            tsk_error_set_errno(errnum);
+            tsk_error_set_errstr("%s", errstr);
+            if (errstr2[0])
+                tsk_error_set_errstr2("%s", errstr2);
+        }
+    }
+    free(errstr);
+    free(errstr2);
+}
+
+/* block_range_walk_cb - block_walk callback used when the file system does
+ * not have block_getflags_range.  Consecutive blocks are collected into
+ * ranges. */
+static TSK_WALK_RET_ENUM
+block_range_walk_cb(const TSK_FS_BLOCK * a_block, void *a_ptr)
+{
+    return block_range_add(a_block->fs_info, (BLOCK_RANGE_DATA *) a_ptr,
+        a_block->addr, 1,
+        (a_block->flags & ~TSK_FS_BLOCK_FLAG_AONLY) |
+        TSK_FS_BLOCK_FLAG_RAW);
+}
+
+
+/** 
+ * \ingroup fslib
+ *
+ * Cycle through a range of file system blocks and call the callback function
+ * with ranges of consecutive blocks that have the same allocation status
+ * and type.  This visits the same blocks as tsk_fs_block_walk(), but the
+ * callback is called once per range instead of once per block.  When the
+ * file system can look up the flags of a range of blocks (ExtX, FAT, raw, and
+ * swap), the allocation bitmap or table is used directly.  The content of each
+ * range is read with reads of up to 1MB, so a long range is passed to the
+ * callback in more than one piece unless TSK_FS_BLOCK_WALK_FLAG_AONLY is given.
+ * Blocks that are missing from a partial image are an error only when
+ * their content is read.
+ *
+ * @param a_fs File system to analyze
+ * @param a_start_blk Block address to start walking from
+ * @param a_end_blk Block address to walk to
+ * @param a_flags Flags used during walk to determine which blocks to call callback with
+ * @param a_action Callback function
+ * @param a_ptr Pointer that will be passed to callback
+ * @returns 1 on error and 0 on success
+ */
+uint8_t
+tsk_fs_block_range_walk(TSK_FS_INFO * a_fs,
+    TSK_DADDR_T a_start_blk, TSK_DADDR_T a_end_blk,
+    TSK_FS_BLOCK_WALK_FLAG_ENUM a_flags,
+    TSK_FS_BLOCK_RANGE_WALK_CB a_action, void *a_ptr)
+{
+    BLOCK_RANGE_DATA data;
+    TSK_DADDR_T addr;
+
+    if ((a_fs == NULL) || (a_fs->tag != TSK_FS_INFO_TAG)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr
+            ("tsk_fs_block_range_walk: FS_INFO structure is not allocated");
+        return 1;
+    }
+
+    memset(&data, 0, sizeof(data));
+    data.action = a_action;
+    data.ptr = a_ptr;
+    if (a_flags & TSK_FS_BLOCK_WALK_FLAG_AONLY) {
+        data.aonly = TSK_FS_BLOCK_FLAG_AONLY;
+    }
+    else {
+        data.buf_blks = TSK_FS_BLOCK_RANGE_READ_SIZE / a_fs->block_size;
+        if (data.buf_blks == 0)
+            data.buf_blks = 1;
+        if ((data.buf =
+                (char *) tsk_malloc(data.buf_blks * a_fs->block_size)) ==
+            NULL)
+            return 1;
+    }
+
+    /* Use the block walk to find the ranges if the file system cannot
+     * look them up */
+    if (a_fs->block_getflags_range == NULL) {
+        uint8_t retval;
+
+        retval = a_fs->block_walk(a_fs, a_start_blk, a_end_blk,
+            a_flags | TSK_FS_BLOCK_WALK_FLAG_AONLY, block_range_walk_cb,
+            &data);
+        if (retval == 0) {
+            if ((data.stop == 0)
+                && (block_range_flush(a_fs, &data) == TSK_WALK_ERROR))
+                retval = 1;
+        }
+        else {
+            block_range_flush_err(a_fs, &data);
+        }
+        free(data.buf);
+        return retval;
+    }
+
+    /*
+     * Sanity checks.
+     */
+    if (a_start_blk < a_fs->first_block || a_start_blk > a_fs->last_block) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_WALK_RNG);
+        tsk_error_set_errstr("tsk_fs_block_range_walk: start block: %"
+            PRIuDADDR, a_start_blk);
+        free(data.buf);
+        return 1;
+    }
+    if (a_end_blk < a_fs->first_block || a_end_blk > a_fs->last_block
+        || a_end_blk < a_start_blk) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_WALK_RNG);
+        tsk_error_set_errstr("tsk_fs_block_range_walk: end block: %"
+            PRIuDADDR, a_end_blk);
+        free(data.buf);
+        return 1;
+    }
+
+    /* Sanity check on a_flags -- make sure at least one ALLOC is set */
+    if (((a_flags & TSK_FS_BLOCK_WALK_FLAG_ALLOC) == 0) &&
+        ((a_flags & TSK_FS_BLOCK_WALK_FLAG_UNALLOC) == 0)) {
+        a_flags |=
+            (TSK_FS_BLOCK_WALK_FLAG_ALLOC |
+            TSK_FS_BLOCK_WALK_FLAG_UNALLOC);
+    }
+    if (((a_flags & TSK_FS_BLOCK_WALK_FLAG_META) == 0) &&
+        ((a_flags & TSK_FS_BLOCK_WALK_FLAG_CONT) == 0)) {
+        a_flags |=
+            (TSK_FS_BLOCK_WALK_FLAG_CONT | TSK_FS_BLOCK_WALK_FLAG_META);
+    }
+
+    for (addr = a_start_blk; addr <= a_end_blk;) {
+        TSK_FS_BLOCK_FLAG_ENUM myflags = 0;
+        TSK_DADDR_T len;
+        TSK_WALK_RET_ENUM retval;
+
+        len = a_fs->block_getflags_range(a_fs, addr, a_end_blk, &myflags);
+        if (len == 0) {
+            tsk_error_set_errstr2("tsk_fs_block_range_walk: block %"
+                PRIuDADDR, addr);
+            block_range_flush_err(a_fs, &data);
+            free(data.buf);
+            return 1;
+        }
+
+        // test if we should call the callback with this one
+        if (((myflags & TSK_FS_BLOCK_FLAG_META)
+                && (!(a_flags & TSK_FS_BLOCK_WALK_FLAG_META)))
+            || ((myflags & TSK_FS_BLOCK_FLAG_CONT)
+                && (!(a_flags & TSK_FS_BLOCK_WALK_FLAG_CONT)))
+            || ((myflags & TSK_FS_BLOCK_FLAG_ALLOC)
+                && (!(a_flags & TSK_FS_BLOCK_WALK_FLAG_ALLOC)))
+            || ((myflags & TSK_FS_BLOCK_FLAG_UNALLOC)
+                && (!(a_flags & TSK_FS_BLOCK_WALK_FLAG_UNALLOC)))) {
+            addr += len;
+            continue;
+        }
+
+        /* blocks that are not in the image are an error when their
+         * content is read, as they are in tsk_fs_block_walk().  Only the
+         * flags are needed with AONLY, so the whole range is given. */
+        if ((data.aonly == 0) && (addr + len - 1 > a_fs->last_block_act)) {
+            if ((addr > a_fs->last_block_act)
+                || (block_range_add(a_fs, &data, addr,
+                        a_fs->last_block_act - addr + 1,
+                        myflags | TSK_FS_BLOCK_FLAG_RAW) ==
+                    TSK_WALK_CONT)) {
+                if (block_range_flush(a_fs, &data) == TSK_WALK_CONT) {
+                    tsk_error_reset();
+                    tsk_error_set_errno(TSK_ERR_FS_READ);
+                    tsk_error_set_errstr
+                        ("tsk_fs_block_range_walk: Address missing in partial image: %"
+                        PRIuDADDR ")", (addr > a_fs->last_block_act) ?
+                        addr : a_fs->last_block_act + 1);
+                }
+            }
+            free(data.buf);
+            return data.stop ? 0 : 1;
+        }
+
+        retval = block_range_add(a_fs, &data, addr, len,
+            myflags | TSK_FS_BLOCK_FLAG_RAW);
+        if (retval == TSK_WALK_STOP) {
+            free(data.buf);
+            return 0;
+        }
+        else if (retval == TSK_WALK_ERROR) {
+            free(data.buf);
+            return 1;
+        }
+        addr += len;
+    }
+
+    if (block_range_flush(a_fs, &data) == TSK_WALK_ERROR) {
+        free(data.buf);
+        return 1;
+    }
+    free(data.buf);
+    return 0;
+}
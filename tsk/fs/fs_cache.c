@@ -0,0 +1,642 @@
+/*
+ * The Sleuth Kit
+ *
+ * Brian Carrier [carrier <at> sleuthkit [dot] org]
+ * Copyright (c) 2011 Brian Carrier.  All Rights reserved
+ *
+ * This software is distributed under the Common Public License 1.0
+ */
+
+/**
+ * \file fs_cache.c
+ * Contains the optional caches of loaded TSK_FS_META and TSK_FS_DIR
+ * structures.  Both caches are keyed by metadata address and keep a
+ * private copy of each structure.  Callers always get their own copy
+ * back, so the cached structures are never shared between open files,
+ * directories, or threads.  Entries are evicted in least recently used
+ * order once the configured size is exceeded.
+ */
+
+#include "tsk_fs_i.h"
+
+typedef struct TSK_FS_CACHE_ENT TSK_FS_CACHE_ENT;
+struct TSK_FS_CACHE_ENT {
+    TSK_FS_CACHE_ENT *hash_next;        // next entry in the same hash bucket
+    TSK_FS_CACHE_ENT *lru_prev; // more recently used entry
+    TSK_FS_CACHE_ENT *lru_next; // less recently used entry
+    TSK_INUM_T addr;            // metadata address that entry is for
+    size_t size;                // approximate number of bytes used by entry
+    void *data;                 // cached structure (owned by the cache)
+};
+
+struct TSK_FS_CACHE {
+    TSK_FS_CACHE_ENT **hash;
+    size_t hash_len;            // number of buckets (a power of 2)
+    TSK_FS_CACHE_ENT *lru_head; // most recently used entry
+    TSK_FS_CACHE_ENT *lru_tail; // least recently used entry
+    size_t entries;
+    size_t bytes;
+    size_t max_bytes;
+    uint64_t hits;
+    uint64_t misses;
+    void (*free_data) (void *); // function to free an entry's data
+};
+
+/* Estimated size of an entry, used to pick the number of hash buckets */
+#define TSK_FS_CACHE_EST_ENT   1024
+
+
+/*
+ * Allocate a cache.
+ * @param a_max_bytes Maximum size of entries in the cache
+ * @param a_free_data Function to free the data in each entry
+ * @returns NULL on error
+ */
+static TSK_FS_CACHE *
+tsk_fs_cache_alloc(size_t a_max_bytes, void (*a_free_data) (void *))
+{
+    TSK_FS_CACHE *cache;
+    size_t hash_len = 256;
+
+    if ((cache = (TSK_FS_CACHE *) tsk_malloc(sizeof(TSK_FS_CACHE))) ==
+        NULL)
+        return NULL;
+
+    while ((hash_len < ((size_t) 1 << 20))
+        && (hash_len * TSK_FS_CACHE_EST_ENT < a_max_bytes))
+        hash_len <<= 1;
+
+    if ((cache->hash = (TSK_FS_CACHE_ENT **)
+            tsk_malloc(hash_len * sizeof(TSK_FS_CACHE_ENT *))) == NULL) {
+        free(cache);
+        return NULL;
+    }
+    cache->hash_len = hash_len;
+    cache->max_bytes = a_max_bytes;
+    cache->free_data = a_free_data;
+    return cache;
+}
+
+static size_t
+tsk_fs_cache_hash(const TSK_FS_CACHE * a_cache, TSK_INUM_T a_addr)
+{
+    return (size_t) ((a_addr ^ (a_addr >> 17)) & (a_cache->hash_len - 1));
+}
+
+/* Remove an entry from the LRU list. */
+static void
+tsk_fs_cache_lru_remove(TSK_FS_CACHE * a_cache, TSK_FS_CACHE_ENT * a_ent)
+{
+    if (a_ent->lru_prev)
+        a_ent->lru_prev->lru_next = a_ent->lru_next;
+    else
+        a_cache->lru_head = a_ent->lru_next;
+
+    if (a_ent->lru_next)
+        a_ent->lru_next->lru_prev = a_ent->lru_prev;
+    else
+        a_cache->lru_tail = a_ent->lru_prev;
+
+    a_ent->lru_prev = a_ent->lru_next = NULL;
+}
+
+/* Add an entry to the front of the LRU list. */
+static void
+tsk_fs_cache_lru_push(TSK_FS_CACHE * a_cache, TSK_FS_CACHE_ENT * a_ent)
+{
+    a_ent->lru_prev = NULL;
+    a_ent->lru_next = a_cache->lru_head;
+    if (a_cache->lru_head)
+        a_cache->lru_head->lru_prev = a_ent;
+    a_cache->lru_head = a_ent;
+    if (a_cache->lru_tail == NULL)
+        a_cache->lru_tail = a_ent;
+}
+
+/*
+ * Find an entry in the cache and update the hit / miss counts.
+ * A found entry becomes the most recently used one.
+ * @returns NULL if not found
+ */
+static TSK_FS_CACHE_ENT *
+tsk_fs_cache_find(TSK_FS_CACHE * a_cache, TSK_INUM_T a_addr)
+{
+    TSK_FS_CACHE_ENT *ent;
+
+    for (ent = a_cache->hash[tsk_fs_cache_hash(a_cache, a_addr)];
+        ent; ent = ent->hash_next) {
+        if (ent->addr == a_addr) {
+            tsk_fs_cache_lru_remove(a_cache, ent);
+            tsk_fs_cache_lru_push(a_cache, ent);
+            a_cache->hits++;
+            return ent;
+        }
+    }
+    a_cache->misses++;
+    return NULL;
+}
+
+/* Remove an entry from the cache and free it. */
+static void
+tsk_fs_cache_remove(TSK_FS_CACHE * a_cache, TSK_FS_CACHE_ENT * a_ent)
+{
+    TSK_FS_CACHE_ENT **ent_ptr;
+
+    for (ent_ptr = &a_cache->hash[tsk_fs_cache_hash(a_cache, a_ent->addr)];
+        *ent_ptr; ent_ptr = &(*ent_ptr)->hash_next) {
+        if (*ent_ptr == a_ent) {
+            *ent_ptr = a_ent->hash_next;
+            break;
+        }
+    }
+    tsk_fs_cache_lru_remove(a_cache, a_ent);
+
+    a_cache->entries--;
+    a_cache->bytes -= a_ent->size;
+
+    a_cache->free_data(a_ent->data);
+    free(a_ent);
+}
+
+/* Evict entries until the cache is within its size. */
+static void
+tsk_fs_cache_evict(TSK_FS_CACHE * a_cache)
+{
+    while ((a_cache->bytes > a_cache->max_bytes) && (a_cache->lru_tail))
+        tsk_fs_cache_remove(a_cache, a_cache->lru_tail);
+}
+
+/*
+ * Add data to the cache, replacing any existing entry for the same
+ * address.  The cache takes ownership of the data (and frees it if it
+ * is too large to be worth caching or if there is an error).
+ * @returns 1 on error
+ */
+static uint8_t
+tsk_fs_cache_insert(TSK_FS_CACHE * a_cache, TSK_INUM_T a_addr,
+    void *a_data, size_t a_size)
+{
+    TSK_FS_CACHE_ENT *ent;
+    size_t hidx;
+
+    hidx = tsk_fs_cache_hash(a_cache, a_addr);
+    for (ent = a_cache->hash[hidx]; ent; ent = ent->hash_next) {
+        if (ent->addr == a_addr) {
+            tsk_fs_cache_remove(a_cache, ent);
+            break;
+        }
+    }
+
+    // do not bother with entries that would flush most of the cache
+    if (a_size > a_cache->max_bytes / 4) {
+        a_cache->free_data(a_data);
+        return 0;
+    }
+
+    if ((ent = (TSK_FS_CACHE_ENT *)
+            tsk_malloc(sizeof(TSK_FS_CACHE_ENT))) == NULL) {
+        a_cache->free_data(a_data);
+        return 1;
+    }
+    ent->addr = a_addr;
+    ent->size = a_size;
+    ent->data = a_data;
+
+    ent->hash_next = a_cache->hash[hidx];
+    a_cache->hash[hidx] = ent;
+    tsk_fs_cache_lru_push(a_cache, ent);
+
+    a_cache->entries++;
+    a_cache->bytes += a_size;
+    tsk_fs_cache_evict(a_cache);
+    return 0;
+}
+
+/* Free a cache and all of its entries. */
+static void
+tsk_fs_cache_free(TSK_FS_CACHE * a_cache)
+{
+    if (a_cache == NULL)
+        return;
+
+    while (a_cache->lru_tail)
+        tsk_fs_cache_remove(a_cache, a_cache->lru_tail);
+
+    free(a_cache->hash);
+    free(a_cache);
+}
+
+/*
+ * Create, resize, or free a cache.
+ * @param a_cache Pointer to cache to configure (can point to NULL)
+ * @param a_max_bytes New maximum size (0 to free the cache)
+ * @param a_free_data Function to free the data in each entry
+ * @returns 1 on error
+ */
+static uint8_t
+tsk_fs_cache_set_size(TSK_FS_CACHE ** a_cache, size_t a_max_bytes,
+    void (*a_free_data) (void *))
+{
+    if (a_max_bytes == 0) {
+        tsk_fs_cache_free(*a_cache);
+        *a_cache = NULL;
+        return 0;
+    }
+
+    if (*a_cache == NULL) {
+        if ((*a_cache =
+                tsk_fs_cache_alloc(a_max_bytes, a_free_data)) == NULL)
+            return 1;
+        return 0;
+    }
+
+    (*a_cache)->max_bytes = a_max_bytes;
+    tsk_fs_cache_evict(*a_cache);
+    return 0;
+}
+
+static void
+tsk_fs_cache_get_stats(const TSK_FS_CACHE * a_cache,
+    TSK_FS_CACHE_STATS * a_stats)
+{
+    memset(a_stats, 0, sizeof(TSK_FS_CACHE_STATS));
+    if (a_cache == NULL)
+        return;
+
+    a_stats->hits = a_cache->hits;
+    a_stats->misses = a_cache->misses;
+    a_stats->entries = a_cache->entries;
+    a_stats->bytes = a_cache->bytes;
+    a_stats->max_bytes = a_cache->max_bytes;
+}
+
+
+
+/***** Metadata cache *****/
+
+/*
+ * Return the approximate number of bytes used by a metadata structure
+ * and its attributes.
+ */
+static size_t
+tsk_fs_meta_cache_ent_size(const TSK_FS_META * a_fs_meta)
+{
+    size_t size = sizeof(TSK_FS_CACHE_ENT) + sizeof(TSK_FS_FILE) +
+        sizeof(TSK_FS_META) + a_fs_meta->content_len;
+    TSK_FS_META_NAME_LIST *fs_name;
+
+    for (fs_name = a_fs_meta->name2; fs_name; fs_name = fs_name->next)
+        size += sizeof(TSK_FS_META_NAME_LIST);
+
+    if (a_fs_meta->link)
+        size += strlen(a_fs_meta->link) + 1;
+
+    if ((a_fs_meta->attr_state == TSK_FS_META_ATTR_STUDIED)
+        && (a_fs_meta->attr)) {
+        TSK_FS_ATTR *fs_attr;
+        size += sizeof(TSK_FS_ATTRLIST);
+        for (fs_attr = a_fs_meta->attr->head; fs_attr;
+            fs_attr = fs_attr->next) {
+            TSK_FS_ATTR_RUN *fs_attr_run;
+            if ((fs_attr->flags & TSK_FS_ATTR_INUSE) == 0)
+                continue;
+            size += sizeof(TSK_FS_ATTR) + fs_attr->name_size +
+                fs_attr->rd.buf_size;
+            for (fs_attr_run = fs_attr->nrd.run; fs_attr_run;
+                fs_attr_run = fs_attr_run->next)
+                size += sizeof(TSK_FS_ATTR_RUN);
+        }
+    }
+    return size;
+}
+
+/* The cached metadata is stored in a private TSK_FS_FILE so that the
+ * copied attributes have a file to point to. */
+static void
+tsk_fs_meta_cache_free_data(void *a_data)
+{
+    tsk_fs_file_close((TSK_FS_FILE *) a_data);
+}
+
+/** \internal
+ * Free the metadata cache and all of its entries.  Cache lock must be
+ * held or the file system must be getting closed.
+ * @param a_fs File system to free cache of
+ */
+void
+tsk_fs_meta_cache_free(TSK_FS_INFO * a_fs)
+{
+    tsk_fs_cache_free(a_fs->meta_cache);
+    a_fs->meta_cache = NULL;
+}
+
+/**
+ * \ingroup fslib
+ * Enable, resize, or disable the cache of loaded metadata structures.
+ * When enabled, opening a file by its metadata address (and loading
+ * its attributes) will use a copy of a previously loaded structure
+ * instead of reading and parsing it again.  The cache is disabled by
+ * default.
+ *
+ * @param a_fs File system to configure
+ * @param a_max_bytes Approximate maximum number of bytes that cached
+ * structures can use (0 to disable the cache and free its contents)
+ * @returns 1 on error and 0 on success
+ */
+uint8_t
+tsk_fs_meta_cache_set_size(TSK_FS_INFO * a_fs, size_t a_max_bytes)
+{
+    uint8_t retval;
+
+    if ((a_fs == NULL) || (a_fs->tag != TSK_FS_INFO_TAG)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr
+            ("tsk_fs_meta_cache_set_size: called with NULL or unallocated structures");
+        return 1;
+    }
+
+    tsk_take_lock(&a_fs->meta_cache_lock);
+    retval = tsk_fs_cache_set_size(&a_fs->meta_cache, a_max_bytes,
+        tsk_fs_meta_cache_free_data);
+    tsk_release_lock(&a_fs->meta_cache_lock);
+    return retval;
+}
+
+/**
+ * \ingroup fslib
+ * Get the usage statistics of the metadata cache.  All values are 0
+ * if the cache is disabled.
+ *
+ * @param a_fs File system to get statistics for
+ * @param a_stats Structure to store statistics in
+ */
+void
+tsk_fs_meta_cache_get_stats(TSK_FS_INFO * a_fs,
+    TSK_FS_CACHE_STATS * a_stats)
+{
+    if ((a_fs == NULL) || (a_fs->tag != TSK_FS_INFO_TAG)) {
+        memset(a_stats, 0, sizeof(TSK_FS_CACHE_STATS));
+        return;
+    }
+
+    tsk_take_lock(&a_fs->meta_cache_lock);
+    tsk_fs_cache_get_stats(a_fs->meta_cache, a_stats);
+    tsk_release_lock(&a_fs->meta_cache_lock);
+}
+
+/** \internal
+ * Load the metadata for a given address into a file.  A copy of the
+ * cached structure is used if one exists, otherwise the file system
+ * specific file_add_meta function is called and the result is added to
+ * the cache.  Behaves the same as file_add_meta when the cache is
+ * disabled.
+ *
+ * @param a_fs File system to load from
+ * @param a_fs_file File to load metadata into
+ * @param a_addr Metadata address to load
+ * @returns 1 on error and 0 on success
+ */
+uint8_t
+tsk_fs_meta_cache_load(TSK_FS_INFO * a_fs, TSK_FS_FILE * a_fs_file,
+    TSK_INUM_T a_addr)
+{
+    TSK_FS_CACHE_ENT *ent;
+
+    tsk_take_lock(&a_fs->meta_cache_lock);
+    if (a_fs->meta_cache == NULL) {
+        tsk_release_lock(&a_fs->meta_cache_lock);
+        return a_fs->file_add_meta(a_fs, a_fs_file, a_addr);
+    }
+
+    if ((ent = tsk_fs_cache_find(a_fs->meta_cache, a_addr)) != NULL) {
+        uint8_t retval;
+        retval =
+            tsk_fs_meta_copy(a_fs_file,
+            ((TSK_FS_FILE *) ent->data)->meta);
+        tsk_release_lock(&a_fs->meta_cache_lock);
+        return retval;
+    }
+    tsk_release_lock(&a_fs->meta_cache_lock);
+
+    if (a_fs->file_add_meta(a_fs, a_fs_file, a_addr))
+        return 1;
+
+    tsk_fs_meta_cache_update(a_fs, a_fs_file->meta);
+    return 0;
+}
+
+/** \internal
+ * Add a copy of a metadata structure to the cache (if it is enabled).
+ * Called after a structure is loaded or after its attributes are loaded
+ * so that the cached copy includes them.  Errors are not reported
+ * because the structure can always be loaded again.
+ *
+ * @param a_fs File system that structure is from
+ * @param a_fs_meta Structure to add
+ */
+void
+tsk_fs_meta_cache_update(TSK_FS_INFO * a_fs, const TSK_FS_META * a_fs_meta)
+{
+    TSK_FS_FILE *fs_file;
+    uint8_t retval;
+
+    tsk_take_lock(&a_fs->meta_cache_lock);
+    if ((a_fs->meta_cache == NULL) || (a_fs_meta == NULL)) {
+        tsk_release_lock(&a_fs->meta_cache_lock);
+        return;
+    }
+
+    if ((fs_file = tsk_fs_file_alloc(a_fs)) == NULL) {
+        retval = 1;
+    }
+    else if (tsk_fs_meta_copy(fs_file, a_fs_meta)) {
+        tsk_fs_file_close(fs_file);
+        retval = 1;
+    }
+    else {
+        // the cache owns fs_file after this (even on error)
+        retval = tsk_fs_cache_insert(a_fs->meta_cache, a_fs_meta->addr,
+            fs_file, tsk_fs_meta_cache_ent_size(a_fs_meta));
+    }
+
+    if (retval) {
+        if (tsk_verbose)
+            tsk_error_print(stderr);
+        tsk_error_reset();
+    }
+    tsk_release_lock(&a_fs->meta_cache_lock);
+}
+
+
+
+/***** Directory cache *****/
+
+/*
+ * Return the approximate number of bytes used by a directory structure.
+ */
+static size_t
+tsk_fs_dir_cache_ent_size(const TSK_FS_DIR * a_fs_dir)
+{
+    size_t size = sizeof(TSK_FS_CACHE_ENT) + sizeof(TSK_FS_DIR) +
+        a_fs_dir->names_alloc * sizeof(TSK_FS_NAME);
+    size_t i;
+
+    for (i = 0; i < a_fs_dir->names_used; i++)
+        size += a_fs_dir->names[i].name_size +
+            a_fs_dir->names[i].shrt_name_size;
+    return size;
+}
+
+static void
+tsk_fs_dir_cache_free_data(void *a_data)
+{
+    tsk_fs_dir_close((TSK_FS_DIR *) a_data);
+}
+
+/*
+ * Make a copy of a directory without its TSK_FS_FILE.
+ * @returns NULL on error
+ */
+static TSK_FS_DIR *
+tsk_fs_dir_cache_dup(const TSK_FS_DIR * a_fs_dir)
+{
+    TSK_FS_DIR *fs_dir;
+
+    if ((fs_dir = tsk_fs_dir_alloc(a_fs_dir->fs_info, a_fs_dir->addr,
+                a_fs_dir->names_used ? a_fs_dir->names_used : 1)) == NULL)
+        return NULL;
+
+    if (tsk_fs_dir_copy(a_fs_dir, fs_dir)) {
+        tsk_fs_dir_close(fs_dir);
+        return NULL;
+    }
+    return fs_dir;
+}
+
+/** \internal
+ * Free the directory cache and all of its entries.  Cache lock must be
+ * held or the file system must be getting closed.
+ * @param a_fs File system to free cache of
+ */
+void
+tsk_fs_dir_cache_free(TSK_FS_INFO * a_fs)
+{
+    tsk_fs_cache_free(a_fs->dir_cache);
+    a_fs->dir_cache = NULL;
+}
+
+/**
+ * \ingroup fslib
+ * Enable, resize, or disable the cache of loaded directory contents.
+ * When enabled, tsk_fs_dir_open_meta() (and therefore directory walks and
+ * path lookups) will use a copy of the previously loaded names of a
+ * directory instead of reading and parsing the directory again.  The
+ * cache is disabled by default.
+ *
+ * @param a_fs File system to configure
+ * @param a_max_bytes Approximate maximum number of bytes that cached
+ * directories can use (0 to disable the cache and free its contents)
+ * @returns 1 on error and 0 on success
+ */
+uint8_t
+tsk_fs_dir_cache_set_size(TSK_FS_INFO * a_fs, size_t a_max_bytes)
+{
+    uint8_t retval;
+
+    if ((a_fs == NULL) || (a_fs->tag != TSK_FS_INFO_TAG)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr
+            ("tsk_fs_dir_cache_set_size: called with NULL or unallocated structures");
+        return 1;
+    }
+
+    tsk_take_lock(&a_fs->dir_cache_lock);
+    retval = tsk_fs_cache_set_size(&a_fs->dir_cache, a_max_bytes,
+        tsk_fs_dir_cache_free_data);
+    tsk_release_lock(&a_fs->dir_cache_lock);
+    return retval;
+}
+
+/**
+ * \ingroup fslib
+ * Get the usage statistics of the directory cache.  All values are 0
+ * if the cache is disabled.
+ *
+ * @param a_fs File system to get statistics for
+ * @param a_stats Structure to store statistics in
+ */
+void
+tsk_fs_dir_cache_get_stats(TSK_FS_INFO * a_fs,
+    TSK_FS_CACHE_STATS * a_stats)
+{
+    if ((a_fs == NULL) || (a_fs->tag != TSK_FS_INFO_TAG)) {
+        memset(a_stats, 0, sizeof(TSK_FS_CACHE_STATS));
+        return;
+    }
+
+    tsk_take_lock(&a_fs->dir_cache_lock);
+    tsk_fs_cache_get_stats(a_fs->dir_cache, a_stats);
+    tsk_release_lock(&a_fs->dir_cache_lock);
+}
+
+/** \internal
+ * Get a copy of the cached contents of a directory.  The copy does
+ * not have its TSK_FS_DIR::fs_file set.
+ *
+ * @param a_fs File system to search
+ * @param a_addr Metadata address of the directory
+ * @param a_fs_dir Set to the copy if found (caller must close it)
+ * @returns -1 on error, 0 if found, and 1 if not found (or if the cache
+ * is disabled)
+ */
+int8_t
+tsk_fs_dir_cache_get(TSK_FS_INFO * a_fs, TSK_INUM_T a_addr,
+    TSK_FS_DIR ** a_fs_dir)
+{
+    TSK_FS_CACHE_ENT *ent;
+    int8_t retval = 1;
+
+    tsk_take_lock(&a_fs->dir_cache_lock);
+    if ((a_fs->dir_cache)
+        && ((ent = tsk_fs_cache_find(a_fs->dir_cache, a_addr)) != NULL)) {
+        if ((*a_fs_dir =
+                tsk_fs_dir_cache_dup((TSK_FS_DIR *) ent->data)) == NULL)
+            retval = -1;
+        else
+            retval = 0;
+    }
+    tsk_release_lock(&a_fs->dir_cache_lock);
+    return retval;
+}
+
+/** \internal
+ * Add a copy of the contents of a directory to the cache (if it is
+ * enabled).  Errors are not reported because the directory can always
+ * be loaded again.
+ *
+ * @param a_fs File system that directory is from
+ * @param a_fs_dir Directory to add
+ */
+void
+tsk_fs_dir_cache_update(TSK_FS_INFO * a_fs, const TSK_FS_DIR * a_fs_dir)
+{
+    TSK_FS_DIR *fs_dir;
+
+    tsk_take_lock(&a_fs->dir_cache_lock);
+    if (a_fs->dir_cache == NULL) {
+        tsk_release_lock(&a_fs->dir_cache_lock);
+        return;
+    }
+
+    // the cache owns fs_dir after it is inserted (even on error)
+    if (((fs_dir = tsk_fs_dir_cache_dup(a_fs_dir)) == NULL)
+        || (tsk_fs_cache_insert(a_fs->dir_cache, a_fs_dir->addr, fs_dir,
+                tsk_fs_dir_cache_ent_size(fs_dir)))) {
+        if (tsk_verbose)
+            tsk_error_print(stderr);
+        tsk_error_reset();
+    }
+    tsk_release_lock(&a_fs->dir_cache_lock);
+}
@@ -18,6 +18,206 @@
 #include "tsk_fatfs.h"
 
 
+/* The name strings of the entries in a TSK_FS_DIR are not malloc'd one
+ * at a time.  They are carved out of larger blocks that are chained off
+ * of the directory and all released when it is closed or reset.  Blocks
+ * from closed directories are kept in a small per-file system pool so that
+ * a directory walk, which opens and closes a directory per level, does not
+ * go back to malloc for each one. */
+struct TSK_FS_NAME_BLK {
+    TSK_FS_NAME_BLK *next;
+    size_t size;                // size of the data that follows the header
+    size_t used;                // number of bytes of data in use
+};
+
+#define TSK_FS_NAME_BLK_SMALL   4096    // size of the first block in a directory
+#define TSK_FS_NAME_BLK_LARGE   65536   // size of the rest of the blocks
+/* Maximum number of blocks of each size to keep in the pool */
+static const size_t name_blk_pool_max[2] = { 64, 16 };
+
+
+/* Return the index into the pool lists for a block size or -1 if
+ * blocks of that size are not pooled */
+static int
+tsk_fs_dir_name_blk_class(size_t a_size)
+{
+    if (a_size == TSK_FS_NAME_BLK_SMALL)
+        return 0;
+    else if (a_size == TSK_FS_NAME_BLK_LARGE)
+        return 1;
+    return -1;
+}
+
+/*
+ * Release all of the name blocks of a directory (to the pool if there is room)
+ */
+static void
+tsk_fs_dir_name_blk_release(TSK_FS_DIR * a_fs_dir)
+{
+    TSK_FS_NAME_BLK *blk = a_fs_dir->name_blks;
+    TSK_FS_INFO *fs = a_fs_dir->fs_info;
+
+    a_fs_dir->name_blks = NULL;
+    if (blk == NULL)
+        return;
+
+    if (fs)
+        tsk_take_lock(&fs->name_blk_lock);
+    while (blk) {
+        TSK_FS_NAME_BLK *next = blk->next;
+        int cls = tsk_fs_dir_name_blk_class(blk->size);
+
+        if ((fs) && (cls >= 0)
+            && (fs->name_blk_pool_cnt[cls] < name_blk_pool_max[cls])) {
+            blk->next = fs->name_blk_pool[cls];
+            fs->name_blk_pool[cls] = blk;
+            fs->name_blk_pool_cnt[cls]++;
+        }
+        else {
+            free(blk);
+        }
+        blk = next;
+    }
+    if (fs)
+        tsk_release_lock(&fs->name_blk_lock);
+}
+
+/** \internal
+ * Free the pool of name blocks in a file system.  Called when the
+ * file system is closed.
+ */
+void
+tsk_fs_dir_name_blk_pool_free(TSK_FS_INFO * a_fs)
+{
+    int cls;
+
+    for (cls = 0; cls < 2; cls++) {
+        while (a_fs->name_blk_pool[cls]) {
+            TSK_FS_NAME_BLK *blk = a_fs->name_blk_pool[cls];
+            a_fs->name_blk_pool[cls] = blk->next;
+            free(blk);
+        }
+        a_fs->name_blk_pool_cnt[cls] = 0;
+    }
+}
+
+/*
+ * Allocate space for a string from the name blocks of a directory.
+ * @param a_fs_dir Directory that the string is for
+ * @param a_len Number of bytes needed (including the NULL)
+ * @returns NULL on error
+ */
+static char *
+tsk_fs_dir_name_blk_alloc(TSK_FS_DIR * a_fs_dir, size_t a_len)
+{
+    TSK_FS_NAME_BLK *blk = a_fs_dir->name_blks;
+    TSK_FS_INFO *fs = a_fs_dir->fs_info;
+    size_t size;
+    int cls;
+
+    if ((blk) && (blk->size - blk->used >= a_len)) {
+        char *ptr = (char *) (blk + 1) + blk->used;
+        blk->used += a_len;
+        return ptr;
+    }
+
+    // start small so that tiny directories do not take up a large block
+    size = (a_fs_dir->name_blks ==
+        NULL) ? TSK_FS_NAME_BLK_SMALL : TSK_FS_NAME_BLK_LARGE;
+    if (a_len > size)
+        size = a_len;
+
+    blk = NULL;
+    cls = tsk_fs_dir_name_blk_class(size);
+    if ((fs) && (cls >= 0)) {
+        tsk_take_lock(&fs->name_blk_lock);
+        if (fs->name_blk_pool[cls]) {
+            blk = fs->name_blk_pool[cls];
+            fs->name_blk_pool[cls] = blk->next;
+            fs->name_blk_pool_cnt[cls]--;
+        }
+        tsk_release_lock(&fs->name_blk_lock);
+    }
+    if (blk == NULL) {
+        if ((blk =
+                (TSK_FS_NAME_BLK *) tsk_malloc(sizeof(TSK_FS_NAME_BLK) +
+                    size)) == NULL)
+            return NULL;
+        blk->size = size;
+    }
+    blk->used = a_len;
+
+    /* A block that was made just for this string is full, so put it behind
+     * the current block so that we keep filling that one. */
+    if ((size == a_len) && (a_fs_dir->name_blks)) {
+        blk->next = a_fs_dir->name_blks->next;
+        a_fs_dir->name_blks->next = blk;
+    }
+    else {
+        blk->next = a_fs_dir->name_blks;
+        a_fs_dir->name_blks = blk;
+    }
+    return (char *) (blk + 1);
+}
+
+/*
+ * Copy a string into a name of a directory entry.  The existing buffer
+ * is used if it is big enough, otherwise space is taken from the name
+ * blocks of the directory.
+ * @returns 1 on error
+ */
+static uint8_t
+tsk_fs_dir_name_str_copy(TSK_FS_DIR * a_fs_dir, char **a_dst,
+    size_t * a_dst_size, const char *a_src)
+{
+    size_t len;
+
+    if (a_src == NULL) {
+        if (*a_dst_size > 0)
+            (*a_dst)[0] = '\0';
+        else
+            *a_dst = NULL;
+        return 0;
+    }
+
+    len = strlen(a_src) + 1;
+    if (*a_dst_size < len) {
+        if ((*a_dst = tsk_fs_dir_name_blk_alloc(a_fs_dir, len)) == NULL) {
+            *a_dst_size = 0;
+            return 1;
+        }
+        *a_dst_size = len;
+    }
+    memcpy(*a_dst, a_src, len);
+    return 0;
+}
+
+/*
+ * Copy a TSK_FS_NAME into one of the entries of a directory.  This is
+ * tsk_fs_name_copy() for names whose strings are in the directory's
+ * name blocks.
+ * @returns 1 on error
+ */
+static uint8_t
+tsk_fs_dir_name_copy(TSK_FS_DIR * a_fs_dir, TSK_FS_NAME * a_fs_name_to,
+    const TSK_FS_NAME * a_fs_name_from)
+{
+    if (tsk_fs_dir_name_str_copy(a_fs_dir, &a_fs_name_to->name,
+            &a_fs_name_to->name_size, a_fs_name_from->name))
+        return 1;
+    if (tsk_fs_dir_name_str_copy(a_fs_dir, &a_fs_name_to->shrt_name,
+            &a_fs_name_to->shrt_name_size, a_fs_name_from->shrt_name))
+        return 1;
+
+    a_fs_name_to->meta_addr = a_fs_name_from->meta_addr;
+    a_fs_name_to->meta_seq = a_fs_name_from->meta_seq;
+    a_fs_name_to->par_addr = a_fs_name_from->par_addr;
+    a_fs_name_to->type = a_fs_name_from->type;
+    a_fs_name_to->flags = a_fs_name_from->flags;
+    return 0;
+}
+
+
 /** \internal
 * Allocate a FS_DIR structure to load names into.
 *
@@ -95,6 +295,8 @@ tsk_fs_dir_realloc(TSK_FS_DIR * a_fs_dir, size_t a_cnt)
 void
 tsk_fs_dir_reset(TSK_FS_DIR * a_fs_dir)
 {
+    size_t i;
+
     if ((a_fs_dir == NULL) || (a_fs_dir->tag != TSK_FS_DIR_TAG))
         return;
 
@@ -102,6 +304,16 @@ tsk_fs_dir_reset(TSK_FS_DIR * a_fs_dir)
         tsk_fs_file_close(a_fs_dir->fs_file);
         a_fs_dir->fs_file = NULL;
     }
+
+    // the strings go away with the name blocks
+    for (i = 0; i < a_fs_dir->names_alloc; i++) {
+        a_fs_dir->names[i].name = NULL;
+        a_fs_dir->names[i].name_size = 0;
+        a_fs_dir->names[i].shrt_name = NULL;
+        a_fs_dir->names[i].shrt_name_size = 0;
+    }
+    tsk_fs_dir_name_blk_release(a_fs_dir);
+
     a_fs_dir->names_used = 0;
     a_fs_dir->addr = 0;
 }
@@ -111,11 +323,12 @@ tsk_fs_dir_reset(TSK_FS_DIR * a_fs_dir)
 /** \internal
  * Copy the contents of one directory structure to another.
  * Note that this currently does not copy the FS_FILE info.
- * It is only used to make a copy of the orphan directory.
+ * It is used to make copies of the orphan directory and of
+ * cached directories.
  * It does not check for duplicate entries.
  * @returns 1 on error
  */
-static uint8_t
+uint8_t
 tsk_fs_dir_copy(const TSK_FS_DIR * a_src_dir, TSK_FS_DIR * a_dst_dir)
 {
     size_t i;
@@ -129,7 +342,8 @@ tsk_fs_dir_copy(const TSK_FS_DIR * a_src_dir, TSK_FS_DIR * a_dst_dir)
     }
 
     for (i = 0; i < a_src_dir->names_used; i++) {
-        if (tsk_fs_name_copy(&a_dst_dir->names[i], &a_src_dir->names[i]))
+        if (tsk_fs_dir_name_copy(a_dst_dir, &a_dst_dir->names[i],
+                &a_src_dir->names[i]))
             return 1;
     }
 
@@ -177,20 +391,9 @@ tsk_fs_dir_add(TSK_FS_DIR * a_fs_dir, const TSK_FS_NAME * a_fs_name)
                 // if the one in the list is unalloc and we have an alloc, replace it
                 if ((a_fs_dir->names[i].flags & TSK_FS_NAME_FLAG_UNALLOC)
                     && (a_fs_name->flags & TSK_FS_NAME_FLAG_ALLOC)) {
+                    // the strings are overwritten (or re-allocated from
+                    // the name blocks) by the copy below.
                     fs_name_dest = &a_fs_dir->names[i];
-
-                    // free the memory - not the most effecient, but prevents
-                    // duplicate code.
-                    if (fs_name_dest->name) {
-                        free(fs_name_dest->name);
-                        fs_name_dest->name = NULL;
-                        fs_name_dest->name_size = 0;
-                    }
-                    if (fs_name_dest->shrt_name) {
-                        free(fs_name_dest->shrt_name);
-                        fs_name_dest->shrt_name = NULL;
-                        fs_name_dest->shrt_name_size = 0;
-                    }
                     break;
                 }
                 else {
@@ -203,14 +406,18 @@ tsk_fs_dir_add(TSK_FS_DIR * a_fs_dir, const TSK_FS_NAME * a_fs_name)
     if (fs_name_dest == NULL) {
         // make sure we got the room
         if (a_fs_dir->names_used >= a_fs_dir->names_alloc) {
-            if (tsk_fs_dir_realloc(a_fs_dir, a_fs_dir->names_used + 512))
+            // grow geometrically so that large directories are not
+            // copied over and over again
+            if (tsk_fs_dir_realloc(a_fs_dir,
+                    a_fs_dir->names_alloc ? a_fs_dir->names_alloc * 2 :
+                    512))
                 return 1;
         }
 
         fs_name_dest = &a_fs_dir->names[a_fs_dir->names_used++];
     }
 
-    if (tsk_fs_name_copy(fs_name_dest, a_fs_name))
+    if (tsk_fs_dir_name_copy(a_fs_dir, fs_name_dest, a_fs_name))
         return 1;
 
     // add the parent address
@@ -242,10 +449,30 @@ tsk_fs_dir_open_meta(TSK_FS_INFO * a_fs, TSK_INUM_T a_addr)
         return NULL;
     }
 
+    /* Use a copy of the cached names if we have them.  The orphan
+     * directory has its own cache in TSK_FS_INFO::orphan_dir. */
+    if (a_addr != TSK_FS_ORPHANDIR_INUM(a_fs)) {
+        int8_t cache_retval = tsk_fs_dir_cache_get(a_fs, a_addr, &fs_dir);
+        if (cache_retval == -1) {
+            return NULL;
+        }
+        else if (cache_retval == 0) {
+            if ((fs_dir->fs_file =
+                    tsk_fs_file_open_meta(a_fs, NULL, a_addr)) == NULL) {
+                tsk_fs_dir_close(fs_dir);
+                return NULL;
+            }
+            return fs_dir;
+        }
+    }
+
     retval = a_fs->dir_open_meta(a_fs, &fs_dir, a_addr);
     if (retval != TSK_OK)
         return NULL;
 
+    if (a_addr != TSK_FS_ORPHANDIR_INUM(a_fs))
+        tsk_fs_dir_cache_update(a_fs, fs_dir);
+
     return fs_dir;
 }
 
@@ -305,23 +532,12 @@ tsk_fs_dir_open(TSK_FS_INFO * a_fs, const char *a_dir)
 void
 tsk_fs_dir_close(TSK_FS_DIR * a_fs_dir)
 {
-    size_t i;
     if ((a_fs_dir == NULL) || (a_fs_dir->tag != TSK_FS_DIR_TAG)) {
         return;
     }
 
-    for (i = 0; i < a_fs_dir->names_used; i++) {
-        if (a_fs_dir->names[i].name) {
-            free(a_fs_dir->names[i].name);
-            a_fs_dir->names[i].name = NULL;
-            a_fs_dir->names[i].name_size = 0;
-        }
-        if (a_fs_dir->names[i].shrt_name) {
-            free(a_fs_dir->names[i].shrt_name);
-            a_fs_dir->names[i].shrt_name = NULL;
-            a_fs_dir->names[i].shrt_name_size = 0;
-        }
-    }
+    // the name strings are all in the name blocks
+    tsk_fs_dir_name_blk_release(a_fs_dir);
     free(a_fs_dir->names);
 
     if (a_fs_dir->fs_file) {
@@ -397,7 +613,7 @@ tsk_fs_dir_get(const TSK_FS_DIR * a_fs_dir, size_t a_idx)
      * Must have non-zero inode addr or have allocated name (if inode is 0) */
     if (((fs_name->meta_addr)
             || (fs_name->flags & TSK_FS_NAME_FLAG_ALLOC))) {
-        if (a_fs_dir->fs_info->file_add_meta(a_fs_dir->fs_info, fs_file,
+        if (tsk_fs_meta_cache_load(a_fs_dir->fs_info, fs_file,
                 fs_name->meta_addr)) {
             if (tsk_verbose)
                 tsk_error_print(stderr);
@@ -436,7 +652,7 @@ typedef struct {
      * TSK_FS_INFO list_inum_named field.  We're trading off the extra
      * work in each thread for cleaner locking code.
      */
-    TSK_LIST *list_inum_named;
+    TSK_BITMAP *list_inum_named;
 
 } DENT_DINFO;
 
@@ -476,7 +692,7 @@ tsk_fs_dir_walk_lcl(TSK_FS_INFO * a_fs, DENT_DINFO * a_dinfo,
          * Must have non-zero inode addr or have allocated name (if inode is 0) */
         if (((fs_file->name->meta_addr)
                 || (fs_file->name->flags & TSK_FS_NAME_FLAG_ALLOC))) {
-            if (a_fs->file_add_meta(a_fs, fs_file,
+            if (tsk_fs_meta_cache_load(a_fs, fs_file,
                     fs_file->name->meta_addr)) {
                 if (tsk_verbose)
                     tsk_error_print(stderr);
@@ -497,7 +713,7 @@ tsk_fs_dir_walk_lcl(TSK_FS_INFO * a_fs, DENT_DINFO * a_dinfo,
                  * of knowing that we stopped early w/out error.
                  */
                 if (a_dinfo->save_inum_named) {
-                    tsk_list_free(a_dinfo->list_inum_named);
+                    tsk_bitmap_free(a_dinfo->list_inum_named);
                     a_dinfo->list_inum_named = NULL;
                     a_dinfo->save_inum_named = 0;
                 }
@@ -515,11 +731,11 @@ tsk_fs_dir_walk_lcl(TSK_FS_INFO * a_fs, DENT_DINFO * a_dinfo,
         if ((a_dinfo->save_inum_named) && (fs_file->meta)
             && (fs_file->meta->flags & TSK_FS_META_FLAG_UNALLOC)) {
 
-            if (tsk_list_add(&a_dinfo->list_inum_named,
+            if (tsk_bitmap_add(&a_dinfo->list_inum_named,
                     fs_file->meta->addr)) {
 
                 // if there is an error, then clear the list
-                tsk_list_free(a_dinfo->list_inum_named);
+                tsk_bitmap_free(a_dinfo->list_inum_named);
                 a_dinfo->list_inum_named = NULL;
                 a_dinfo->save_inum_named = 0;
             }
@@ -697,7 +913,7 @@ tsk_fs_dir_walk(TSK_FS_INFO * a_fs, TSK_INUM_T a_addr,
             /* There was an error and we stopped early, so we should get
              * rid of the partial list we were making.
              */
-            tsk_list_free(dinfo.list_inum_named);
+            tsk_bitmap_free(dinfo.list_inum_named);
             dinfo.list_inum_named = NULL;
         }
         else {
@@ -711,7 +927,7 @@ tsk_fs_dir_walk(TSK_FS_INFO * a_fs, TSK_INUM_T a_addr,
                 a_fs->list_inum_named = dinfo.list_inum_named;
             }
             else {
-                tsk_list_free(dinfo.list_inum_named);
+                tsk_bitmap_free(dinfo.list_inum_named);
             }
             tsk_release_lock(&a_fs->list_inum_named_lock);
             dinfo.list_inum_named = NULL;
@@ -791,23 +1007,26 @@ tsk_fs_dir_make_orphan_dir_meta(TSK_FS_INFO * a_fs,
 }
 
 /** \internal
- * Searches the list of metadata addresses that are pointed to
+ * Searches the set of metadata addresses that are pointed to
  * by unallocated names.  Used to find orphan files. 
  * @param a_fs File system being analyzed.
- * @param a_inum Metadata address to lookup in list.
+ * @param a_inum Metadata address to lookup in set.
  * @returns 1 if metadata address is pointed to by an unallocated
  * file name or 0 if not.
  */
 uint8_t
 tsk_fs_dir_find_inum_named(TSK_FS_INFO * a_fs, TSK_INUM_T a_inum)
 {
-    uint8_t retval = 0;
+    TSK_BITMAP *inum_named;
+
+    /* The set is never changed once it is assigned, so we only need
+     * the lock to read the pointer.  It can be NULL if no unallocated
+     * file names exist or if it has not been loaded yet. */
     tsk_take_lock(&a_fs->list_inum_named_lock);
-    // list can be null if no unallocated file names exist
-    if (a_fs->list_inum_named)
-        retval = tsk_list_find(a_fs->list_inum_named, a_inum);
+    inum_named = a_fs->list_inum_named;
     tsk_release_lock(&a_fs->list_inum_named_lock);
-    return retval;
+
+    return tsk_bitmap_find(inum_named, a_inum);
 }
 
 
@@ -865,7 +1084,8 @@ tsk_fs_dir_load_inum_named(TSK_FS_INFO * a_fs)
 typedef struct {
     TSK_FS_NAME *fs_name;       // temp name structure used when adding entries to fs_dir
     TSK_FS_DIR *fs_dir;         // unique names are added to this.  represents contents of OrphanFiles directory
-    TSK_LIST *orphan_subdir_list;       // keep track of files that can already be accessed via orphan directory
+    TSK_BITMAP *orphan_subdir_list;     // keep track of files that can already be accessed via orphan directory
+    TSK_BITMAP *inum_named;     // fs->list_inum_named, which is not changed after it is loaded
 } FIND_ORPHAN_DATA;
 
 /* Used to process orphan directories and make sure that their contents
@@ -898,7 +1118,8 @@ load_orphan_dir_walk_cb(TSK_FS_FILE * a_fs_file, const char *a_path,
         /* check if we have already added it as an orphan (in a subdirectory)
          * Not entirely sure how possible this is, but it was added while
          * debugging an infinite loop problem. */
-        if (tsk_list_find(data->orphan_subdir_list, a_fs_file->meta->addr)) {
+        if (tsk_bitmap_find(data->orphan_subdir_list,
+                a_fs_file->meta->addr)) {
             if (tsk_verbose)
                 fprintf(stderr,
                     "load_orphan_dir_walk_cb: Detected loop with address %"
@@ -906,7 +1127,9 @@ load_orphan_dir_walk_cb(TSK_FS_FILE * a_fs_file, const char *a_path,
             return TSK_WALK_STOP;
         }
 
-        tsk_list_add(&data->orphan_subdir_list, a_fs_file->meta->addr);
+        if (tsk_bitmap_add(&data->orphan_subdir_list,
+                a_fs_file->meta->addr))
+            return TSK_WALK_ERROR;
 
         /* FAT file systems spend a lot of time hunting for parent
          * directory addresses, so we put this code in here to save
@@ -932,16 +1155,12 @@ find_orphan_meta_walk_cb(TSK_FS_FILE * a_fs_file, void *a_ptr)
     /* We want only orphans, then check if this
      * inode is in the seen list
      */
-    tsk_take_lock(&fs->list_inum_named_lock);
-    if ((fs->list_inum_named)
-        && (tsk_list_find(fs->list_inum_named, a_fs_file->meta->addr))) {
-        tsk_release_lock(&fs->list_inum_named_lock);
+    if (tsk_bitmap_find(data->inum_named, a_fs_file->meta->addr)) {
         return TSK_WALK_CONT;
     }
-    tsk_release_lock(&fs->list_inum_named_lock);
 
     // check if we have already added it as an orphan (in a subdirectory)
-    if (tsk_list_find(data->orphan_subdir_list, a_fs_file->meta->addr)) {
+    if (tsk_bitmap_find(data->orphan_subdir_list, a_fs_file->meta->addr)) {
         return TSK_WALK_CONT;
     }
 
@@ -1058,6 +1277,9 @@ tsk_fs_dir_find_orphans(TSK_FS_INFO * a_fs, TSK_FS_DIR * a_fs_dir)
         return TSK_ERR;
     }
     // note that list_inum_named could still be NULL if there are no deleted names.
+    tsk_take_lock(&a_fs->list_inum_named_lock);
+    data.inum_named = a_fs->list_inum_named;
+    tsk_release_lock(&a_fs->list_inum_named_lock);
 
     /* Now we walk the unallocated metadata structures and find ones that are
      * not named.  The callback will add the names to the FS_DIR structure.
@@ -1078,6 +1300,7 @@ tsk_fs_dir_find_orphans(TSK_FS_INFO * a_fs, TSK_FS_DIR * a_fs_dir)
             TSK_FS_META_FLAG_UNALLOC | TSK_FS_META_FLAG_USED,
             find_orphan_meta_walk_cb, &data)) {
         tsk_fs_name_free(data.fs_name);
+        tsk_bitmap_free(data.orphan_subdir_list);
         tsk_release_lock(&a_fs->orphan_dir_lock);
         return TSK_ERR;
     }
@@ -1095,10 +1318,10 @@ tsk_fs_dir_find_orphans(TSK_FS_INFO * a_fs, TSK_FS_DIR * a_fs_dir)
      * from subdirectories of the orphan directory.  These entries will exist if
      * they were added before their parent directory was added to the orphan directory. */
     for (i = 0; i < a_fs_dir->names_used; i++) {
-        if (tsk_list_find(data.orphan_subdir_list,
+        if (tsk_bitmap_find(data.orphan_subdir_list,
                 a_fs_dir->names[i].meta_addr)) {
             if (a_fs_dir->names_used > 1) {
-                tsk_fs_name_copy(&a_fs_dir->names[i],
+                tsk_fs_dir_name_copy(a_fs_dir, &a_fs_dir->names[i],
                     &a_fs_dir->names[a_fs_dir->names_used - 1]);
             }
             a_fs_dir->names_used--;
@@ -1106,7 +1329,7 @@ tsk_fs_dir_find_orphans(TSK_FS_INFO * a_fs, TSK_FS_DIR * a_fs_dir)
     }
 
     if (data.orphan_subdir_list) {
-        tsk_list_free(data.orphan_subdir_list);
+        tsk_bitmap_free(data.orphan_subdir_list);
         data.orphan_subdir_list = NULL;
     }
 
@@ -125,7 +125,7 @@ tsk_fs_file_open_meta(TSK_FS_INFO * a_fs,
         tsk_fs_file_reset(fs_file);
     }
 
-    if (a_fs->file_add_meta(a_fs, fs_file, a_addr)) {
+    if (tsk_fs_meta_cache_load(a_fs, fs_file, a_addr)) {
         if (a_fs_file == NULL)
             free(fs_file);
         return NULL;
@@ -232,6 +232,7 @@ tsk_fs_file_attr_check(TSK_FS_FILE * a_fs_file, char *a_func)
         if (fs->load_attrs(a_fs_file)) {
             return 1;
         }
+        tsk_fs_meta_cache_update(fs, a_fs_file->meta);
     }
     return 0;
 }
@@ -174,6 +174,118 @@ tsk_fs_meta_reset(TSK_FS_META * a_fs_meta)
     }
 }
 
+/** \internal
+ * Copy the contents of a TSK_FS_META structure into the metadata
+ * structure of a file.  The existing buffers in the file's structure
+ * are reused when possible.  Attributes are copied only if they have been
+ * loaded and the copies will point to a_fs_file.
+ *
+ * @param a_fs_file File to copy into (its meta structure is allocated if NULL)
+ * @param a_fs_meta Structure to copy from
+ * @returns 1 on error
+ */
+uint8_t
+tsk_fs_meta_copy(TSK_FS_FILE * a_fs_file, const TSK_FS_META * a_fs_meta)
+{
+    TSK_FS_META *fs_meta;
+    void *content_ptr_tmp;
+    size_t content_len_tmp;
+    TSK_FS_ATTRLIST *attr_tmp;
+    TSK_FS_META_NAME_LIST *name2_tmp;
+    TSK_FS_META_NAME_LIST **name2_next;
+    const TSK_FS_META_NAME_LIST *name2_src;
+    char *link_tmp;
+
+    if (a_fs_file->meta == NULL) {
+        if ((a_fs_file->meta =
+                tsk_fs_meta_alloc(a_fs_meta->content_len)) == NULL)
+            return 1;
+    }
+    else if ((a_fs_meta->content_len)
+        && (a_fs_file->meta->content_len != a_fs_meta->content_len)) {
+        if (tsk_fs_meta_realloc(a_fs_file->meta,
+                a_fs_meta->content_len) == NULL)
+            return 1;
+    }
+    fs_meta = a_fs_file->meta;
+
+    // backup pointers
+    content_ptr_tmp = fs_meta->content_ptr;
+    content_len_tmp = fs_meta->content_len;
+    attr_tmp = fs_meta->attr;
+    name2_tmp = fs_meta->name2;
+    link_tmp = fs_meta->link;
+
+    memcpy(fs_meta, a_fs_meta, sizeof(TSK_FS_META));
+    fs_meta->tag = TSK_FS_META_TAG;
+
+    fs_meta->content_ptr = content_ptr_tmp;
+    fs_meta->content_len = content_len_tmp;
+    if (a_fs_meta->content_len)
+        memcpy(fs_meta->content_ptr, a_fs_meta->content_ptr,
+            a_fs_meta->content_len);
+    else if (fs_meta->content_len)
+        memset(fs_meta->content_ptr, 0, fs_meta->content_len);
+
+    fs_meta->attr = attr_tmp;
+    fs_meta->name2 = name2_tmp;
+    fs_meta->link = link_tmp;
+
+    // copy the names into the existing list entries and add more as needed
+    name2_next = &fs_meta->name2;
+    for (name2_src = a_fs_meta->name2; name2_src;
+        name2_src = name2_src->next) {
+        if (*name2_next == NULL) {
+            if ((*name2_next = (TSK_FS_META_NAME_LIST *)
+                    tsk_malloc(sizeof(TSK_FS_META_NAME_LIST))) == NULL)
+                return 1;
+        }
+        strncpy((*name2_next)->name, name2_src->name,
+            TSK_FS_META_NAME_LIST_NSIZE);
+        (*name2_next)->par_inode = name2_src->par_inode;
+        (*name2_next)->par_seq = name2_src->par_seq;
+        name2_next = &(*name2_next)->next;
+    }
+    for (name2_tmp = *name2_next; name2_tmp; name2_tmp = name2_tmp->next) {
+        name2_tmp->name[0] = '\0';
+        name2_tmp->par_inode = 0;
+        name2_tmp->par_seq = 0;
+    }
+
+    if (a_fs_meta->link) {
+        size_t len = strlen(a_fs_meta->link) + 1;
+        if (fs_meta->link)
+            free(fs_meta->link);
+        if ((fs_meta->link = (char *) tsk_malloc(len)) == NULL)
+            return 1;
+        memcpy(fs_meta->link, a_fs_meta->link, len);
+    }
+    else if (fs_meta->link) {
+        fs_meta->link[0] = '\0';
+    }
+
+    if ((a_fs_meta->attr_state == TSK_FS_META_ATTR_STUDIED)
+        && (a_fs_meta->attr)) {
+        TSK_FS_ATTRLIST *fs_attrlist;
+        if ((fs_attrlist =
+                tsk_fs_attrlist_copy(a_fs_file, a_fs_meta->attr)) == NULL) {
+            fs_meta->attr_state = TSK_FS_META_ATTR_EMPTY;
+            return 1;
+        }
+        if (fs_meta->attr)
+            tsk_fs_attrlist_free(fs_meta->attr);
+        fs_meta->attr = fs_attrlist;
+    }
+    else {
+        if (fs_meta->attr)
+            tsk_fs_attrlist_markunused(fs_meta->attr);
+        if (a_fs_meta->attr_state != TSK_FS_META_ATTR_ERROR)
+            fs_meta->attr_state = TSK_FS_META_ATTR_EMPTY;
+    }
+
+    return 0;
+}
+
 /**
  * \ingroup fslib
  * Walk a range of metadata structures and call a callback for each
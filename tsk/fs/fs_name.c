@@ -586,36 +586,94 @@ tsk_fs_name_print_mac(FILE * hFile, const TSK_FS_FILE * fs_file,
 	tsk_fs_name_print_mac_md5(hFile, fs_file, a_path, fs_attr, prefix, time_skew, NULL);
 }
 
+/* Growable buffer that tsk_fs_name_make_mac() builds a line in */
+typedef struct {
+    char **buf;
+    size_t *size;
+    size_t len;
+} MAC_LINE;
+
+static uint8_t
+mac_line_add(MAC_LINE * a_line, const char *a_str, size_t a_len)
+{
+    if (a_line->len + a_len + 1 > *a_line->size) {
+        size_t new_size = *a_line->size ? *a_line->size : 256;
+        char *tmp;
+
+        while (a_line->len + a_len + 1 > new_size)
+            new_size *= 2;
+        if ((tmp = (char *) tsk_realloc(*a_line->buf, new_size)) == NULL)
+            return 1;
+        *a_line->buf = tmp;
+        *a_line->size = new_size;
+    }
+    memcpy(&(*a_line->buf)[a_line->len], a_str, a_len);
+    a_line->len += a_len;
+    (*a_line->buf)[a_line->len] = '\0';
+    return 0;
+}
+
+/* add a name and replace any control chars with '^' */
+static uint8_t
+mac_line_add_name(MAC_LINE * a_line, const char *a_name)
+{
+    size_t i, len = strlen(a_name);
+
+    if (mac_line_add(a_line, a_name, len))
+        return 1;
+    for (i = a_line->len - len; i < a_line->len; i++) {
+        if (TSK_IS_CNTRL((*a_line->buf)[i]))
+            (*a_line->buf)[i] = '^';
+    }
+    return 0;
+}
+
+static uint8_t
+mac_line_add_time(MAC_LINE * a_line, time_t a_time, int32_t a_skew,
+    char a_end)
+{
+    char tmp[32];
+
+    if (a_time)
+        a_time -= a_skew;
+    snprintf(tmp, sizeof(tmp), "%" PRIu32 "%c", (uint32_t) a_time, a_end);
+    return mac_line_add(a_line, tmp, strlen(tmp));
+}
+
 /**
  * \internal
  *
-** Print output in the format that mactime reads.
-**
-** If the flags in the fs_file->meta structure are set to FS_FLAG_ALLOC
-** then it is assumed that the inode has been reallocated and the
-** contents are not displayed
-**
-** fs is not required (only used for block size).
- * @param hFile handle to print results to
- * @param fs_file File to print details about
+ * Make a line in the format that mactime reads (the body file format).
+ * This builds the same line that tsk_fs_name_print_mac_md5() prints, but
+ * into a buffer so that callers can process it without a FILE.
+ *
+ * @param a_buf Pointer to buffer to store line in (realloc'd as needed,
+ * can point to NULL)
+ * @param a_size Pointer to size of a_buf (updated when it grows)
+ * @param fs_file File to make line for
  * @param a_path Parent directory of file (needs to end with "/")
  * @param fs_attr Attribute in file that is being called for (NULL for non-NTFS)
  * @param prefix Path of mounting point for image
  * @param time_skew number of seconds skew to adjust time
- * @param hash_results Holds the calculated md5 hash
-*/
-void
-tsk_fs_name_print_mac_md5(FILE * hFile, const TSK_FS_FILE * fs_file,
-    const char *a_path, const TSK_FS_ATTR * fs_attr,
-    const char *prefix, int32_t time_skew,
-	const unsigned char * hash_results)
+ * @param hash_results Holds the calculated md5 hash (or NULL)
+ * @returns 1 on error (memory allocation) and 0 on success.  The line
+ * in a_buf is NULL terminated and ends with a newline.
+ */
+uint8_t
+tsk_fs_name_make_mac(char **a_buf, size_t * a_size,
+    const TSK_FS_FILE * fs_file, const char *a_path,
+    const TSK_FS_ATTR * fs_attr, const char *prefix, int32_t time_skew,
+    const unsigned char *hash_results)
 {
+    MAC_LINE line;
+    char tmp[128];
     char ls[12];
     size_t i;
     uint8_t isADS = 0;
 
-    if ((!hFile) || (!fs_file))
-        return;
+    line.buf = a_buf;
+    line.size = a_size;
+    line.len = 0;
 
     /* see if we are going to be printing the name of the attribute
      * We don't do it for FNAME attributes, which we handle specially below.
@@ -628,163 +686,157 @@ tsk_fs_name_print_mac_md5(FILE * hFile, const TSK_FS_FILE * fs_file,
     }
 
     /* hash
-	 * Print out the hash buffer (if not null)
-	 */
-	if(hash_results == NULL){
-		tsk_fprintf(hFile, "0|");
-	}
-	else{
-		for(i = 0;i < 16;i++){
-			tsk_fprintf(hFile, "%02x", hash_results[i]);
-		}
-		tsk_fprintf(hFile, "|");
-	}
+     * Print out the hash buffer (if not null)
+     */
+    if (hash_results == NULL) {
+        if (mac_line_add(&line, "0|", 2))
+            return 1;
+    }
+    else {
+        for (i = 0; i < 16; i++)
+            snprintf(&tmp[i * 2], 3, "%02x", hash_results[i]);
+        tmp[32] = '|';
+        if (mac_line_add(&line, tmp, 33))
+            return 1;
+    }
 
     /* file name */
-    tsk_fprintf(hFile, "%s", prefix);
+    if ((prefix) && (mac_line_add(&line, prefix, strlen(prefix))))
+        return 1;
 
     // remove any control chars as we print the names
-    if (a_path != NULL) {
-        for (i = 0; i < strlen(a_path); i++) {
-            if (TSK_IS_CNTRL(a_path[i]))
-                tsk_fprintf(hFile, "^");
-            else
-                tsk_fprintf(hFile, "%c", a_path[i]);
-        }
-    }
+    if ((a_path != NULL) && (mac_line_add_name(&line, a_path)))
+        return 1;
 
-    for (i = 0; i < strlen(fs_file->name->name); i++) {
-        if (TSK_IS_CNTRL(fs_file->name->name[i]))
-            tsk_fprintf(hFile, "^");
-        else
-            tsk_fprintf(hFile, "%c", fs_file->name->name[i]);
-    }
+    if (mac_line_add_name(&line, fs_file->name->name))
+        return 1;
 
     /* print the data stream name if it exists and is not the default NTFS */
     if (isADS) {
-        tsk_fprintf(hFile, ":");
-        for (i = 0; i < strlen(fs_attr->name); i++) {
-            if (TSK_IS_CNTRL(fs_attr->name[i]))
-                tsk_fprintf(hFile, "^");
-            else
-                tsk_fprintf(hFile, "%c", fs_attr->name[i]);
-        }
+        if ((mac_line_add(&line, ":", 1))
+            || (mac_line_add_name(&line, fs_attr->name)))
+            return 1;
     }
 
     // special label if FNAME
     if ((fs_attr) && (fs_attr->type == TSK_FS_ATTR_TYPE_NTFS_FNAME)) {
-        tsk_fprintf(hFile, " ($FILE_NAME)");
+        if (mac_line_add(&line, " ($FILE_NAME)", 13))
+            return 1;
     }
 
     if ((fs_file->meta)
         && (fs_file->meta->type == TSK_FS_META_TYPE_LNK)
         && (fs_file->meta->link)) {
-        tsk_fprintf(hFile, " -> %s", fs_file->meta->link);
+        if ((mac_line_add(&line, " -> ", 4))
+            || (mac_line_add(&line, fs_file->meta->link,
+                    strlen(fs_file->meta->link))))
+            return 1;
     }
 
     /* if filename is deleted add a comment and if the inode is now
      * allocated, then add realloc comment */
-    if (fs_file->name->flags & TSK_FS_NAME_FLAG_UNALLOC)
-        tsk_fprintf(hFile, " (deleted%s)", ((fs_file->meta)
-                && (fs_file->
-                    meta->flags & TSK_FS_META_FLAG_ALLOC)) ? "-realloc" :
-            "");
+    if (fs_file->name->flags & TSK_FS_NAME_FLAG_UNALLOC) {
+        snprintf(tmp, sizeof(tmp), " (deleted%s)", ((fs_file->meta)
+                && (fs_file->meta->flags & TSK_FS_META_FLAG_ALLOC)) ?
+            "-realloc" : "");
+        if (mac_line_add(&line, tmp, strlen(tmp)))
+            return 1;
+    }
 
     /* inode */
-    tsk_fprintf(hFile, "|%" PRIuINUM, fs_file->name->meta_addr);
     if (fs_attr)
-        tsk_fprintf(hFile, "-%" PRIu32 "-%" PRIu16 "", fs_attr->type,
-            fs_attr->id);
-
-    tsk_fprintf(hFile, "|");
+        snprintf(tmp, sizeof(tmp), "|%" PRIuINUM "-%" PRIu32 "-%" PRIu16
+            "|", fs_file->name->meta_addr, fs_attr->type, fs_attr->id);
+    else
+        snprintf(tmp, sizeof(tmp), "|%" PRIuINUM "|",
+            fs_file->name->meta_addr);
+    if (mac_line_add(&line, tmp, strlen(tmp)))
+        return 1;
 
     /* TYPE as specified in the directory entry
      */
     if (fs_file->name->type < TSK_FS_NAME_TYPE_STR_MAX)
-        tsk_fprintf(hFile, "%s/",
+        snprintf(tmp, sizeof(tmp), "%s/",
             tsk_fs_name_type_str[fs_file->name->type]);
     else
-        tsk_fprintf(hFile, "-/");
+        snprintf(tmp, sizeof(tmp), "-/");
+    if (mac_line_add(&line, tmp, strlen(tmp)))
+        return 1;
 
     if (!fs_file->meta) {
-        tsk_fprintf(hFile, "----------|0|0|0|");
+        return mac_line_add(&line, "----------|0|0|0|0|0|0|0\n", 25);
     }
-    else {
-        /* mode as string */
-        tsk_fs_meta_make_ls(fs_file->meta, ls, sizeof(ls));
-        tsk_fprintf(hFile, "%s|", ls);
-
-        /* uid, gid */
-        tsk_fprintf(hFile, "%" PRIuUID "|%" PRIuGID "|",
-            fs_file->meta->uid, fs_file->meta->gid);
 
+    /* mode as string, uid, gid */
+    tsk_fs_meta_make_ls(fs_file->meta, ls, sizeof(ls));
+    snprintf(tmp, sizeof(tmp), "%s|%" PRIuUID "|%" PRIuGID "|%" PRIuOFF
+        "|", ls, fs_file->meta->uid, fs_file->meta->gid,
         /* size - use data stream if we have it */
-        if (fs_attr)
-            tsk_fprintf(hFile, "%" PRIuOFF "|", fs_attr->size);
-        else
-            tsk_fprintf(hFile, "%" PRIuOFF "|", fs_file->meta->size);
-    }
+        (fs_attr) ? fs_attr->size : fs_file->meta->size);
+    if (mac_line_add(&line, tmp, strlen(tmp)))
+        return 1;
 
-    if (!fs_file->meta) {
-        tsk_fprintf(hFile, "0|0|0|0\n");
+    /* atime, mtime, ctime, crtime */
+    // special case for NTFS FILE_NAME attribute
+    if ((fs_attr) && (fs_attr->type == TSK_FS_ATTR_TYPE_NTFS_FNAME)) {
+        if ((mac_line_add_time(&line, fs_file->meta->time2.ntfs.fn_atime,
+                    time_skew, '|'))
+            || (mac_line_add_time(&line,
+                    fs_file->meta->time2.ntfs.fn_mtime, time_skew, '|'))
+            || (mac_line_add_time(&line,
+                    fs_file->meta->time2.ntfs.fn_ctime, time_skew, '|'))
+            || (mac_line_add_time(&line,
+                    fs_file->meta->time2.ntfs.fn_crtime, time_skew,
+                    '\n')))
+            return 1;
     }
     else {
-        // special case for NTFS FILE_NAME attribute
-        if ((fs_attr) && (fs_attr->type == TSK_FS_ATTR_TYPE_NTFS_FNAME)) {
-            /* atime, mtime, ctime, crtime */
-            if (fs_file->meta->time2.ntfs.fn_atime)
-                tsk_fprintf(hFile, "%" PRIu32 "|",
-                    fs_file->meta->time2.ntfs.fn_atime - time_skew);
-            else
-                tsk_fprintf(hFile, "%" PRIu32 "|",
-                    fs_file->meta->time2.ntfs.fn_atime);
-
-            if (fs_file->meta->time2.ntfs.fn_mtime)
-                tsk_fprintf(hFile, "%" PRIu32 "|",
-                    fs_file->meta->time2.ntfs.fn_mtime - time_skew);
-            else
-                tsk_fprintf(hFile, "%" PRIu32 "|",
-                    fs_file->meta->time2.ntfs.fn_mtime);
-
-            if (fs_file->meta->time2.ntfs.fn_ctime)
-                tsk_fprintf(hFile, "%" PRIu32 "|",
-                    fs_file->meta->time2.ntfs.fn_ctime - time_skew);
-            else
-                tsk_fprintf(hFile, "%" PRIu32 "|",
-                    fs_file->meta->time2.ntfs.fn_ctime);
-
-            if (fs_file->meta->time2.ntfs.fn_crtime)
-                tsk_fprintf(hFile, "%" PRIu32 "\n",
-                    fs_file->meta->time2.ntfs.fn_crtime - time_skew);
-            else
-                tsk_fprintf(hFile, "%" PRIu32 "\n",
-                    fs_file->meta->time2.ntfs.fn_crtime);
-        }
-        else {
-            /* atime, mtime, ctime, crtime */
-            if (fs_file->meta->atime)
-                tsk_fprintf(hFile, "%" PRIu32 "|",
-                    fs_file->meta->atime - time_skew);
-            else
-                tsk_fprintf(hFile, "%" PRIu32 "|", fs_file->meta->atime);
+        if ((mac_line_add_time(&line, fs_file->meta->atime, time_skew,
+                    '|'))
+            || (mac_line_add_time(&line, fs_file->meta->mtime, time_skew,
+                    '|'))
+            || (mac_line_add_time(&line, fs_file->meta->ctime, time_skew,
+                    '|'))
+            || (mac_line_add_time(&line, fs_file->meta->crtime, time_skew,
+                    '\n')))
+            return 1;
+    }
+    return 0;
+}
 
-            if (fs_file->meta->mtime)
-                tsk_fprintf(hFile, "%" PRIu32 "|",
-                    fs_file->meta->mtime - time_skew);
-            else
-                tsk_fprintf(hFile, "%" PRIu32 "|", fs_file->meta->mtime);
+/**
+ * \internal
+ *
+** Print output in the format that mactime reads.
+**
+** If the flags in the fs_file->meta structure are set to FS_FLAG_ALLOC
+** then it is assumed that the inode has been reallocated and the
+** contents are not displayed
+**
+** fs is not required (only used for block size).
+ * @param hFile handle to print results to
+ * @param fs_file File to print details about
+ * @param a_path Parent directory of file (needs to end with "/")
+ * @param fs_attr Attribute in file that is being called for (NULL for non-NTFS)
+ * @param prefix Path of mounting point for image
+ * @param time_skew number of seconds skew to adjust time
+ * @param hash_results Holds the calculated md5 hash
+*/
+void
+tsk_fs_name_print_mac_md5(FILE * hFile, const TSK_FS_FILE * fs_file,
+    const char *a_path, const TSK_FS_ATTR * fs_attr,
+    const char *prefix, int32_t time_skew,
+	const unsigned char * hash_results)
+{
+    char *buf = NULL;
+    size_t size = 0;
 
-            if (fs_file->meta->ctime)
-                tsk_fprintf(hFile, "%" PRIu32 "|",
-                    fs_file->meta->ctime - time_skew);
-            else
-                tsk_fprintf(hFile, "%" PRIu32 "|", fs_file->meta->ctime);
+    if ((!hFile) || (!fs_file))
+        return;
 
-            if (fs_file->meta->crtime)
-                tsk_fprintf(hFile, "%" PRIu32 "\n",
-                    fs_file->meta->crtime - time_skew);
-            else
-                tsk_fprintf(hFile, "%" PRIu32 "\n", fs_file->meta->crtime);
-        }
-    }
+    /* the line is built first so that it is printed with a single call */
+    if (tsk_fs_name_make_mac(&buf, &size, fs_file, a_path, fs_attr,
+            prefix, time_skew, hash_results) == 0)
+        tsk_fprintf(hFile, "%s", buf);
+    free(buf);
 }
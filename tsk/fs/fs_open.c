@@ -25,6 +25,14 @@
  --*/
 
 #include "tsk_fs_i.h"
+#include "tsk_ntfs.h"
+#include "tsk_fatfs.h"
+#include "tsk_ext2fs.h"
+#include "tsk_ffs.h"
+#include "tsk_hfs.h"
+#include "tsk_iso9660.h"
+
+#include <stddef.h>
 
 /**
  * \file fs_open.c
@@ -68,6 +76,134 @@ tsk_fs_open_vol(const TSK_VS_PART_INFO * a_part_info,
     return tsk_fs_open_img(a_part_info->vs->img_info, offset, a_ftype);
 }
 
+/* Number of bytes at the start of a volume that are read to look for
+ * file system signatures.  The last location checked is the second
+ * UFS2 super block. */
+#define FS_DETECT_READ_LEN  (UFS2_SBOFF2 + sizeof(ffs_sb2))
+
+/* Returns 1 if the 16-bit value at a_off in a_buf is a_val in either
+ * byte order, the same test that tsk_fs_guessu16() does in the open
+ * routines. */
+static int
+fs_detect_sig16(uint8_t * a_buf, size_t a_len, size_t a_off,
+    uint16_t a_val)
+{
+    TSK_ENDIAN_ENUM endian;
+
+    if (a_off + 2 > a_len)
+        return 0;
+    return tsk_guess_end_u16(&endian, &a_buf[a_off], a_val) ? 0 : 1;
+}
+
+static int
+fs_detect_sig32(uint8_t * a_buf, size_t a_len, size_t a_off,
+    uint32_t a_val)
+{
+    TSK_ENDIAN_ENUM endian;
+
+    if (a_off + 4 > a_len)
+        return 0;
+    return tsk_guess_end_u32(&endian, &a_buf[a_off], a_val) ? 0 : 1;
+}
+
+/**
+ * \internal
+ * Reads the start of a volume in one request and checks the locations
+ * where each file system keeps its magic value.  This is only a filter
+ * for autodetection: a type is returned if the open routine could
+ * accept the volume, and the open routine does the real checks.
+ * YAFFS2 has no super block and is always returned.
+ *
+ * @param a_img_info Disk image to analyze
+ * @param a_offset Byte offset of the volume
+ * @returns Flags of the types to try (TSK_FS_TYPE_UNSUPP if all
+ * should be tried because the read failed)
+ */
+static TSK_FS_TYPE_ENUM
+fs_detect_candidates(TSK_IMG_INFO * a_img_info, TSK_OFF_T a_offset)
+{
+    uint8_t *buf;
+    size_t len;
+    ssize_t cnt;
+    int i;
+    uint32_t cand = TSK_FS_TYPE_YAFFS2_DETECT;
+    /* block pre and post sizes of the layouts that iso9660_open tries */
+    static const size_t iso_pre[] = { 0, 16, 24 };
+    static const size_t iso_post[] = { 0, 288, 280 };
+
+    if ((a_offset < 0) || (a_offset >= a_img_info->size))
+        return TSK_FS_TYPE_UNSUPP;
+
+    len = roundup(FS_DETECT_READ_LEN, a_img_info->sector_size);
+    if ((TSK_OFF_T) len > a_img_info->size - a_offset)
+        len = (size_t) (a_img_info->size - a_offset);
+
+    if ((buf = (uint8_t *) tsk_malloc(len)) == NULL) {
+        tsk_error_reset();
+        return TSK_FS_TYPE_UNSUPP;
+    }
+    cnt = tsk_img_read(a_img_info, a_offset, (char *) buf, len);
+    if (cnt <= 0) {
+        free(buf);
+        tsk_error_reset();
+        return TSK_FS_TYPE_UNSUPP;
+    }
+    if ((size_t) cnt < len)
+        len = (size_t) cnt;
+
+    if (fs_detect_sig16(buf, len, offsetof(ntfs_sb, magic),
+            NTFS_FS_MAGIC))
+        cand |= TSK_FS_TYPE_NTFS_DETECT;
+
+    /* fatfs_open falls back to the backup boot sector in sector 6 */
+    if ((fs_detect_sig16(buf, len, offsetof(fatfs_sb, magic),
+                FATFS_FS_MAGIC))
+        || (fs_detect_sig16(buf, len,
+                6 * a_img_info->sector_size + offsetof(fatfs_sb, magic),
+                FATFS_FS_MAGIC)))
+        cand |= TSK_FS_TYPE_FAT_DETECT;
+
+    if (fs_detect_sig16(buf, len, EXT2FS_SBOFF + offsetof(ext2fs_sb,
+                s_magic), EXT2FS_FS_MAGIC))
+        cand |= TSK_FS_TYPE_EXT_DETECT;
+
+    if ((fs_detect_sig32(buf, len, UFS2_SBOFF + offsetof(ffs_sb2, magic),
+                UFS2_FS_MAGIC))
+        || (fs_detect_sig32(buf, len, UFS2_SBOFF2 + offsetof(ffs_sb2,
+                    magic), UFS2_FS_MAGIC))
+        || (fs_detect_sig32(buf, len, UFS1_SBOFF + offsetof(ffs_sb1,
+                    magic), UFS1_FS_MAGIC)))
+        cand |= TSK_FS_TYPE_FFS_DETECT;
+
+    if ((fs_detect_sig16(buf, len, HFS_VH_OFF + offsetof(hfs_plus_vh,
+                    signature), HFS_VH_SIG_HFSPLUS))
+        || (fs_detect_sig16(buf, len, HFS_VH_OFF + offsetof(hfs_plus_vh,
+                    signature), HFS_VH_SIG_HFSX))
+        || (fs_detect_sig16(buf, len, HFS_VH_OFF + offsetof(hfs_plus_vh,
+                    signature), HFS_VH_SIG_HFS)))
+        cand |= TSK_FS_TYPE_HFS_DETECT;
+
+    /* The first volume descriptor is in block 16 (of 2048 bytes) */
+    for (i = 0; i < 3; i++) {
+        size_t off = ISO9660_SBOFF + 16 * (iso_pre[i] + iso_post[i]) +
+            iso_pre[i] + offsetof(iso9660_gvd, magic);
+        if ((off + 5 <= len)
+            && (memcmp(&buf[off], ISO9660_MAGIC, 5) == 0)) {
+            cand |= TSK_FS_TYPE_ISO9660_DETECT;
+            break;
+        }
+    }
+
+    free(buf);
+
+    if (tsk_verbose)
+        tsk_fprintf(stderr,
+            "fsopen: Signature candidates at offset %" PRIuOFF ": 0x%"
+            PRIx32 "\n", a_offset, cand);
+
+    return (TSK_FS_TYPE_ENUM) cand;
+}
+
 /**
  * \ingroup fslib
  * Tries to process data in a disk image at a given offset as a file system.
@@ -96,13 +232,17 @@ tsk_fs_open_img(TSK_IMG_INFO * a_img_info, TSK_OFF_T a_offset,
     if (a_ftype == TSK_FS_TYPE_DETECT) {
         TSK_FS_INFO *fs_info, *fs_set = NULL;
         char *set = NULL;
+        TSK_FS_TYPE_ENUM cand;
 
         if (tsk_verbose)
             tsk_fprintf(stderr,
                 "fsopen: Auto detection mode at offset %" PRIuOFF "\n",
                 a_offset);
 
-        if ((fs_info =
+        /* Only run the open routines whose magic values are present */
+        cand = fs_detect_candidates(a_img_info, a_offset);
+
+        if ((cand & TSK_FS_TYPE_NTFS_DETECT) && (fs_info =
                 ntfs_open(a_img_info, a_offset, TSK_FS_TYPE_NTFS_DETECT,
                     1)) != NULL) {
             set = "NTFS";
@@ -112,7 +252,7 @@ tsk_fs_open_img(TSK_IMG_INFO * a_img_info, TSK_OFF_T a_offset,
             tsk_error_reset();
         }
 
-        if ((fs_info =
+        if ((cand & TSK_FS_TYPE_FAT_DETECT) && (fs_info =
                 fatfs_open(a_img_info, a_offset, TSK_FS_TYPE_FAT_DETECT,
                     1)) != NULL) {
             if (set == NULL) {
@@ -132,7 +272,7 @@ tsk_fs_open_img(TSK_IMG_INFO * a_img_info, TSK_OFF_T a_offset,
             tsk_error_reset();
         }
 
-        if ((fs_info =
+        if ((cand & TSK_FS_TYPE_EXT_DETECT) && (fs_info =
                 ext2fs_open(a_img_info, a_offset, TSK_FS_TYPE_EXT_DETECT,
                     1)) != NULL) {
             if (set == NULL) {
@@ -152,7 +292,7 @@ tsk_fs_open_img(TSK_IMG_INFO * a_img_info, TSK_OFF_T a_offset,
             tsk_error_reset();
         }
 
-        if ((fs_info =
+        if ((cand & TSK_FS_TYPE_FFS_DETECT) && (fs_info =
                 ffs_open(a_img_info, a_offset,
                     TSK_FS_TYPE_FFS_DETECT)) != NULL) {
             if (set == NULL) {
@@ -172,7 +312,7 @@ tsk_fs_open_img(TSK_IMG_INFO * a_img_info, TSK_OFF_T a_offset,
             tsk_error_reset();
         }
 
-        if ((fs_info =
+        if ((cand & TSK_FS_TYPE_YAFFS2_DETECT) && (fs_info =
                 yaffs2_open(a_img_info, a_offset,
                     TSK_FS_TYPE_YAFFS2_DETECT, 1)) != NULL) {
             if (set == NULL) {
@@ -194,7 +334,7 @@ tsk_fs_open_img(TSK_IMG_INFO * a_img_info, TSK_OFF_T a_offset,
 
 
 #if TSK_USE_HFS
-        if ((fs_info =
+        if ((cand & TSK_FS_TYPE_HFS_DETECT) && (fs_info =
                 hfs_open(a_img_info, a_offset, TSK_FS_TYPE_HFS_DETECT,
                     1)) != NULL) {
             if (set == NULL) {
@@ -215,7 +355,7 @@ tsk_fs_open_img(TSK_IMG_INFO * a_img_info, TSK_OFF_T a_offset,
         }
 #endif
 
-        if ((fs_info =
+        if ((cand & TSK_FS_TYPE_ISO9660_DETECT) && (fs_info =
                 iso9660_open(a_img_info, a_offset,
                     TSK_FS_TYPE_ISO9660_DETECT, 1)) != NULL) {
             if (set != NULL) {
@@ -295,6 +435,10 @@ tsk_fs_malloc(size_t a_len)
         return NULL;
     tsk_init_lock(&fs_info->list_inum_named_lock);
     tsk_init_lock(&fs_info->orphan_dir_lock);
+    tsk_init_lock(&fs_info->meta_cache_lock);
+    tsk_init_lock(&fs_info->dir_cache_lock);
+    tsk_init_lock(&fs_info->name_blk_lock);
+    tsk_init_lock(&fs_info->ifind_index_lock);
 
     fs_info->list_inum_named = NULL;
 
@@ -308,7 +452,7 @@ void
 tsk_fs_free(TSK_FS_INFO * a_fs_info)
 {
     if (a_fs_info->list_inum_named) {
-        tsk_list_free(a_fs_info->list_inum_named);
+        tsk_bitmap_free(a_fs_info->list_inum_named);
         a_fs_info->list_inum_named = NULL;
     }
 
@@ -321,9 +465,20 @@ tsk_fs_free(TSK_FS_INFO * a_fs_info)
         a_fs_info->orphan_dir = NULL;
     }
 
+    tsk_fs_meta_cache_free(a_fs_info);
+    tsk_fs_dir_cache_free(a_fs_info);
+    tsk_fs_ifind_index_free(a_fs_info);
+
+    // must be after everything that can close a directory
+    tsk_fs_dir_name_blk_pool_free(a_fs_info);
+
 
     tsk_deinit_lock(&a_fs_info->list_inum_named_lock);
     tsk_deinit_lock(&a_fs_info->orphan_dir_lock);
+    tsk_deinit_lock(&a_fs_info->meta_cache_lock);
+    tsk_deinit_lock(&a_fs_info->dir_cache_lock);
+    tsk_deinit_lock(&a_fs_info->name_blk_lock);
+    tsk_deinit_lock(&a_fs_info->ifind_index_lock);
 
     free(a_fs_info);
 }
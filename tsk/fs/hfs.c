@@ -424,6 +424,108 @@ hfs_extents_to_attr(TSK_FS_INFO * a_fs, const hfs_ext_desc * a_extents,
 }
 
 
+/** \internal
+ * Copy part of a B-tree node into a buffer.  The nodes of the catalog,
+ * extents, and attributes trees are kept in a cache in HFS_INFO so that
+ * lookups do not re-read the same nodes each time they start at the root.
+ * Index nodes are only replaced if every entry holds an index node, so the
+ * upper levels of the trees stay in memory and leaf nodes are replaced in
+ * LRU order.
+ *
+ * @param hfs File system
+ * @param a_tree Tree that the node is in (HFS_BT_TREE_*)
+ * @param a_attr Data attribute of the tree's file
+ * @param a_nodesize Size of the nodes in the tree
+ * @param a_node Node number
+ * @param a_off Offset in the node to copy from
+ * @param a_buf Buffer to copy to
+ * @param a_len Number of bytes to copy
+ * @returns Number of bytes copied or -1 on error (same as tsk_fs_attr_read())
+ */
+static ssize_t
+hfs_btree_node_copy(HFS_INFO * hfs, uint8_t a_tree,
+    const TSK_FS_ATTR * a_attr, uint16_t a_nodesize, uint32_t a_node,
+    size_t a_off, char *a_buf, size_t a_len)
+{
+    HFS_NODE_CACHE_ENT *ent = NULL;
+    TSK_OFF_T node_off = (TSK_OFF_T) a_node * a_nodesize;
+    ssize_t cnt;
+    char *node;
+    int i;
+
+    if ((a_nodesize == 0) || (a_off + a_len > a_nodesize))
+        return tsk_fs_attr_read(a_attr, node_off + a_off, a_buf, a_len,
+            (TSK_FS_FILE_READ_FLAG_ENUM) 0);
+
+    tsk_take_lock(&(hfs->node_cache_lock));
+    for (i = 0; i < HFS_NODE_CACHE_CNT; i++) {
+        ent = &hfs->node_cache[i];
+        if ((ent->len == a_nodesize) && (ent->tree == a_tree)
+            && (ent->node == a_node)) {
+            ent->age = ++hfs->node_cache_age;
+            memcpy(a_buf, &ent->buf[a_off], a_len);
+            tsk_release_lock(&(hfs->node_cache_lock));
+            return a_len;
+        }
+    }
+    tsk_release_lock(&(hfs->node_cache_lock));
+
+    /* read the node without holding the lock */
+    if ((node = (char *) tsk_malloc(a_nodesize)) == NULL)
+        return -1;
+    cnt = tsk_fs_attr_read(a_attr, node_off, node, a_nodesize,
+        (TSK_FS_FILE_READ_FLAG_ENUM) 0);
+    if (cnt != a_nodesize) {
+        /* the requested range may still be readable */
+        free(node);
+        return tsk_fs_attr_read(a_attr, node_off + a_off, a_buf, a_len,
+            (TSK_FS_FILE_READ_FLAG_ENUM) 0);
+    }
+    memcpy(a_buf, &node[a_off], a_len);
+
+    /* pick an unused entry, or else the least recently used leaf node,
+     * or else the least recently used entry */
+    tsk_take_lock(&(hfs->node_cache_lock));
+    ent = NULL;
+    for (i = 0; i < HFS_NODE_CACHE_CNT; i++) {
+        HFS_NODE_CACHE_ENT *cur = &hfs->node_cache[i];
+        if (cur->len == 0) {
+            ent = cur;
+            break;
+        }
+        if ((ent == NULL) || (ent->is_idx > cur->is_idx)
+            || ((ent->is_idx == cur->is_idx) && (cur->age < ent->age)))
+            ent = cur;
+    }
+    free(ent->buf);
+    ent->buf = node;
+    ent->len = a_nodesize;
+    ent->tree = a_tree;
+    ent->node = a_node;
+    ent->is_idx =
+        (((hfs_btree_node *) node)->type == HFS_BT_NODE_TYPE_IDX) ? 1 : 0;
+    ent->age = ++hfs->node_cache_age;
+    tsk_release_lock(&(hfs->node_cache_lock));
+
+    return a_len;
+}
+
+/** \internal
+ * Free the buffers in the B-tree node cache.
+ */
+static void
+hfs_btree_node_cache_free(HFS_INFO * hfs)
+{
+    int i;
+
+    for (i = 0; i < HFS_NODE_CACHE_CNT; i++) {
+        free(hfs->node_cache[i].buf);
+        hfs->node_cache[i].buf = NULL;
+        hfs->node_cache[i].len = 0;
+    }
+}
+
+
 /**
  * Look in the extents catalog for entries for a given file. Add the runs
  * to the passed attribute structure. 
@@ -549,8 +651,8 @@ hfs_ext_find_extent_record_attr(HFS_INFO * hfs, uint32_t cnid,
                 "hfs_ext_find_extent_record: reading node %" PRIu32
                 " at offset %" PRIuOFF "\n", cur_node, cur_off);
 
-        cnt = tsk_fs_attr_read(hfs->extents_attr, cur_off,
-            node, nodesize, 0);
+        cnt = hfs_btree_node_copy(hfs, HFS_BT_TREE_EXT, hfs->extents_attr,
+            nodesize, cur_node, 0, node, nodesize);
         if (cnt != nodesize) {
             if (cnt >= 0) {
                 tsk_error_reset();
@@ -880,8 +982,8 @@ hfs_cat_traverse(HFS_INFO * hfs, const void *targ_data,
 
         // read the current node
         cur_off = cur_node * nodesize;
-        cnt = tsk_fs_attr_read(hfs->catalog_attr, cur_off,
-            node, nodesize, 0);
+        cnt = hfs_btree_node_copy(hfs, HFS_BT_TREE_CAT, hfs->catalog_attr,
+            nodesize, cur_node, 0, node, nodesize);
         if (cnt != nodesize) {
             if (cnt >= 0) {
                 tsk_error_reset();
@@ -1070,6 +1172,165 @@ hfs_cat_traverse(HFS_INFO * hfs, const void *targ_data,
 }
 
 
+/** \internal
+ * Walk the records in the leaf nodes of the catalog btree in key order.
+ * This starts at the first leaf node and follows the forward links
+ * instead of searching from the root for each key, so each record is
+ * visited once.  Leaf nodes are usually stored in order in the catalog
+ * file, so consecutive nodes are read together.
+ * @param hfs File system
+ * @param a_cb Callback to call for each record
+ * @param ptr Pointer to pass to callback
+ * @returns 1 on error
+ */
+uint8_t
+hfs_cat_leaf_walk(HFS_INFO * hfs, TSK_HFS_CAT_LEAF_CB a_cb, void *ptr)
+{
+    TSK_FS_INFO *fs = &(hfs->fs_info);
+    uint32_t cur_node;          /* node id of the current node */
+    uint32_t total_nodes;
+    uint32_t buf_first = 0;     /* first node in buf */
+    uint32_t buf_cnt = 0;       /* number of nodes in buf */
+    uint32_t buf_max;
+    uint32_t visited = 0;
+    uint16_t nodesize;
+    char *buf;
+
+    tsk_error_reset();
+
+    nodesize = tsk_getu16(fs->endian, hfs->catalog_header.nodesize);
+    total_nodes = tsk_getu32(fs->endian, hfs->catalog_header.totalNodes);
+    cur_node = tsk_getu32(fs->endian, hfs->catalog_header.firstLeafNode);
+
+    // no leaf nodes means no records
+    if ((cur_node == 0) || (nodesize == 0))
+        return 0;
+
+    buf_max = HFS_CAT_SCAN_SIZE / nodesize;
+    if (buf_max == 0)
+        buf_max = 1;
+    if ((buf = (char *) tsk_malloc((size_t) buf_max * nodesize)) == NULL)
+        return 1;
+
+    while (cur_node != 0) {
+        hfs_btree_node *node_desc;
+        uint16_t num_rec;
+        size_t free_off;        /* start of the record offset table */
+        char *node;
+        int rec;
+
+        if ((cur_node >= total_nodes) || (++visited > total_nodes)) {
+            tsk_error_set_errno(TSK_ERR_FS_GENFS);
+            tsk_error_set_errstr
+                ("hfs_cat_leaf_walk: Invalid or looping leaf node %"
+                PRIu32, cur_node);
+            free(buf);
+            return 1;
+        }
+
+        // read the next set of nodes if this one is not loaded
+        if ((cur_node < buf_first) || (cur_node >= buf_first + buf_cnt)) {
+            uint32_t cnt = buf_max;
+            ssize_t len;
+
+            if (cnt > total_nodes - cur_node)
+                cnt = total_nodes - cur_node;
+            len =
+                tsk_fs_attr_read(hfs->catalog_attr,
+                (TSK_OFF_T) cur_node * nodesize, buf,
+                (size_t) cnt * nodesize, (TSK_FS_FILE_READ_FLAG_ENUM) 0);
+            if (len < (ssize_t) nodesize) {
+                if (len >= 0) {
+                    tsk_error_reset();
+                    tsk_error_set_errno(TSK_ERR_FS_READ);
+                }
+                tsk_error_set_errstr2
+                    ("hfs_cat_leaf_walk: Error reading node %" PRIu32,
+                    cur_node);
+                free(buf);
+                return 1;
+            }
+            buf_first = cur_node;
+            buf_cnt = (uint32_t) (len / nodesize);
+        }
+
+        node = &buf[(size_t) (cur_node - buf_first) * nodesize];
+        node_desc = (hfs_btree_node *) node;
+        num_rec = tsk_getu16(fs->endian, node_desc->num_rec);
+
+        if (node_desc->type != HFS_BT_NODE_TYPE_LEAF) {
+            tsk_error_set_errno(TSK_ERR_FS_GENFS);
+            tsk_error_set_errstr("hfs_cat_leaf_walk: btree node %" PRIu32
+                " is not a leaf (%" PRIu8 ")", cur_node, node_desc->type);
+            free(buf);
+            return 1;
+        }
+
+        if (sizeof(hfs_btree_node) + 2 * ((size_t) num_rec + 1) >
+            nodesize) {
+            tsk_error_set_errno(TSK_ERR_FS_GENFS);
+            tsk_error_set_errstr("hfs_cat_leaf_walk: too many records (%"
+                PRIu16 ") in leaf node %" PRIu32, num_rec, cur_node);
+            free(buf);
+            return 1;
+        }
+        free_off = nodesize - 2 * ((size_t) num_rec + 1);
+
+        for (rec = 0; rec < num_rec; rec++) {
+            size_t rec_off, rec_end, data_off;
+            hfs_btree_key_cat *key;
+            TSK_WALK_RET_ENUM retval;
+
+            // get the record offset in the node and the end of the record
+            rec_off =
+                tsk_getu16(fs->endian, &node[nodesize - (rec + 1) * 2]);
+            rec_end =
+                tsk_getu16(fs->endian, &node[nodesize - (rec + 2) * 2]);
+            if ((rec_end > free_off) || (rec_end < rec_off))
+                rec_end = free_off;
+            if (rec_off + 2 > rec_end) {
+                tsk_error_set_errno(TSK_ERR_FS_GENFS);
+                tsk_error_set_errstr
+                    ("hfs_cat_leaf_walk: offset of record %d in leaf node %"
+                    PRIu32 " too large (%d vs %" PRIu16 ")", rec, cur_node,
+                    (int) rec_off, nodesize);
+                free(buf);
+                return 1;
+            }
+            key = (hfs_btree_key_cat *) & node[rec_off];
+
+            data_off = rec_off + 2 + tsk_getu16(fs->endian, key->key_len);
+            if (data_off > rec_end) {
+                tsk_error_set_errno(TSK_ERR_FS_GENFS);
+                tsk_error_set_errstr
+                    ("hfs_cat_leaf_walk: key length of record %d in leaf node %"
+                    PRIu32 " too large (%d vs %d)", rec, cur_node,
+                    (int) data_off, (int) rec_end);
+                free(buf);
+                return 1;
+            }
+
+            retval = a_cb(hfs, key,
+                (TSK_OFF_T) cur_node * nodesize + data_off,
+                &node[data_off], rec_end - data_off, ptr);
+            if (retval == TSK_WALK_STOP) {
+                free(buf);
+                return 0;
+            }
+            else if (retval == TSK_WALK_ERROR) {
+                free(buf);
+                return 1;
+            }
+        }
+
+        cur_node = tsk_getu32(fs->endian, node_desc->flink);
+    }
+
+    free(buf);
+    return 0;
+}
+
+
 static uint8_t
 hfs_cat_get_record_offset_cb(HFS_INFO * hfs, int8_t level_type,
     const void *targ_data, const hfs_btree_key_cat * cur_key,
@@ -1129,6 +1390,33 @@ hfs_cat_get_record_offset(HFS_INFO * hfs, const hfs_btree_key_cat * needle)
 
 
 
+/** \internal
+ * Read data from a catalog record via the B-tree node cache.  Records do
+ * not cross node boundaries, so this is the same as reading the catalog
+ * file at the given offset.
+ * @param hfs File system
+ * @param off Byte offset in the catalog file
+ * @param buf Buffer to read into
+ * @param len Number of bytes to read
+ * @returns Number of bytes read or -1 on error
+ */
+static ssize_t
+hfs_cat_read_rec(HFS_INFO * hfs, TSK_OFF_T off, char *buf, size_t len)
+{
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) & (hfs->fs_info);
+    uint16_t nodesize =
+        tsk_getu16(fs->endian, hfs->catalog_header.nodesize);
+
+    if ((nodesize == 0) || (off < 0))
+        return tsk_fs_attr_read(hfs->catalog_attr, off, buf, len,
+            (TSK_FS_FILE_READ_FLAG_ENUM) 0);
+
+    return hfs_btree_node_copy(hfs, HFS_BT_TREE_CAT, hfs->catalog_attr,
+        nodesize, (uint32_t) (off / nodesize), (size_t) (off % nodesize),
+        buf, len);
+}
+
+
 /** \internal
  * Given a byte offset to a leaf record in teh catalog file, read the data as
  * a thread record. This will zero the buffer and read in the size of the thread
@@ -1146,7 +1434,7 @@ hfs_cat_read_thread_record(HFS_INFO * hfs, TSK_OFF_T off,
     size_t cnt;
 
     memset(thread, 0, sizeof(hfs_thread));
-    cnt = tsk_fs_attr_read(hfs->catalog_attr, off, (char *) thread, 10, 0);
+    cnt = hfs_cat_read_rec(hfs, off, (char *) thread, 10);
     if (cnt != 10) {
         if (cnt >= 0) {
             tsk_error_reset();
@@ -1178,8 +1466,8 @@ hfs_cat_read_thread_record(HFS_INFO * hfs, TSK_OFF_T off,
     }
 
     cnt =
-        tsk_fs_attr_read(hfs->catalog_attr, off + 10,
-        (char *) thread->name.unicode, uni_len * 2, 0);
+        hfs_cat_read_rec(hfs, off + 10,
+        (char *) thread->name.unicode, uni_len * 2);
     if (cnt != uni_len * 2) {
         if (cnt >= 0) {
             tsk_error_reset();
@@ -1212,7 +1500,7 @@ hfs_cat_read_file_folder_record(HFS_INFO * hfs, TSK_OFF_T off,
 
     memset(record, 0, sizeof(hfs_file_folder));
 
-    cnt = tsk_fs_attr_read(hfs->catalog_attr, off, rec_type, 2, 0);
+    cnt = hfs_cat_read_rec(hfs, off, rec_type, 2);
     if (cnt != 2) {
         if (cnt >= 0) {
             tsk_error_reset();
@@ -1226,8 +1514,8 @@ hfs_cat_read_file_folder_record(HFS_INFO * hfs, TSK_OFF_T off,
 
     if (tsk_getu16(fs->endian, rec_type) == HFS_FOLDER_RECORD) {
         cnt =
-            tsk_fs_attr_read(hfs->catalog_attr, off, (char *) record,
-            sizeof(hfs_folder), 0);
+            hfs_cat_read_rec(hfs, off, (char *) record,
+            sizeof(hfs_folder));
         if (cnt != sizeof(hfs_folder)) {
             if (cnt >= 0) {
                 tsk_error_reset();
@@ -1241,8 +1529,8 @@ hfs_cat_read_file_folder_record(HFS_INFO * hfs, TSK_OFF_T off,
     }
     else if (tsk_getu16(fs->endian, rec_type) == HFS_FILE_RECORD) {
         cnt =
-            tsk_fs_attr_read(hfs->catalog_attr, off, (char *) record,
-            sizeof(hfs_file), 0);
+            hfs_cat_read_rec(hfs, off, (char *) record,
+            sizeof(hfs_file));
         if (cnt != sizeof(hfs_file)) {
             if (cnt >= 0) {
                 tsk_error_reset();
@@ -1513,18 +1801,20 @@ hfs_follow_hard_link(HFS_INFO * hfs, hfs_file * cat,
 
 
 /** \internal
- * Lookup an entry in the catalog file and save it into the entry.  Do not
- * call this for the special files that do not have an entry in the catalog. 
- * data structure.
+ * Fill in a catalog entry for a file, given the offsets of its thread and
+ * file/folder records if they are already known.  This is the second half
+ * of hfs_cat_file_lookup().
  * @param hfs File system being analyzed
  * @param inum Address (cnid) of file to open
  * @param entry [out] Structure to read data into
- * @returns 1 on error or not found, 0 on success. Check tsk_errno
- * to differentiate between error and not found.  If it is not found, then the
- * errno will be TSK_ERR_FS_INODE_NUM.  Else, it will be some other value.
+ * @param thread_off Offset of the thread record in the catalog file (or 0 to search for it)
+ * @param rec_off Offset of the file/folder record in the catalog file (or 0 to search for it)
+ * @param follow_hard_link Set to follow a hard link to its target
+ * @returns 1 on error or not found, 0 on success (see hfs_cat_file_lookup())
  */
-uint8_t
-hfs_cat_file_lookup(HFS_INFO * hfs, TSK_INUM_T inum, HFS_ENTRY * entry,
+static uint8_t
+hfs_cat_file_lookup_off(HFS_INFO * hfs, TSK_INUM_T inum, HFS_ENTRY * entry,
+    TSK_OFF_T thread_off, TSK_OFF_T rec_off,
     unsigned char follow_hard_link)
 {
     TSK_FS_INFO *fs = (TSK_FS_INFO *) & (hfs->fs_info);
@@ -1533,26 +1823,6 @@ hfs_cat_file_lookup(HFS_INFO * hfs, TSK_INUM_T inum, HFS_ENTRY * entry,
     hfs_file_folder record;     /* file/folder record */
     TSK_OFF_T off;
 
-    tsk_error_reset();
-
-    if (tsk_verbose)
-        tsk_fprintf(stderr,
-            "hfs_cat_file_lookup: called for inum %" PRIuINUM "\n", inum);
-
-    // Test if this is a special file that is not located in the catalog
-    if ((inum == HFS_EXTENTS_FILE_ID) ||
-        (inum == HFS_CATALOG_FILE_ID) ||
-        (inum == HFS_ALLOCATION_FILE_ID) ||
-        (inum == HFS_STARTUP_FILE_ID) ||
-        (inum == HFS_ATTRIBUTES_FILE_ID)) {
-        tsk_error_set_errno(TSK_ERR_FS_GENFS);
-        tsk_error_set_errstr
-            ("hfs_cat_file_lookup: Called on special file: %" PRIuINUM,
-            inum);
-        return 1;
-    }
-
-
     /* first look up the thread record for the item we're searching for */
 
     /* set up the thread record key */
@@ -1565,7 +1835,9 @@ hfs_cat_file_lookup(HFS_INFO * hfs, TSK_INUM_T inum, HFS_ENTRY * entry,
             ")\n", inum);
 
     /* look up the thread record */
-    off = hfs_cat_get_record_offset(hfs, &key);
+    off = thread_off;
+    if (off == 0)
+        off = hfs_cat_get_record_offset(hfs, &key);
     if (off == 0) {
         // no parsing error, just not found
         if (tsk_error_get_errno() == 0) {
@@ -1604,7 +1876,9 @@ hfs_cat_file_lookup(HFS_INFO * hfs, TSK_INUM_T inum, HFS_ENTRY * entry,
                 key.parent_cnid));
 
     /* look up the record */
-    off = hfs_cat_get_record_offset(hfs, &key);
+    off = rec_off;
+    if (off == 0)
+        off = hfs_cat_get_record_offset(hfs, &key);
     if (off == 0) {
         // no parsing error, just not found
         if (tsk_error_get_errno() == 0) {
@@ -1686,6 +1960,45 @@ hfs_cat_file_lookup(HFS_INFO * hfs, TSK_INUM_T inum, HFS_ENTRY * entry,
 }
 
 
+/** \internal
+ * Lookup an entry in the catalog file and save it into the entry.  Do not
+ * call this for the special files that do not have an entry in the catalog. 
+ * data structure.
+ * @param hfs File system being analyzed
+ * @param inum Address (cnid) of file to open
+ * @param entry [out] Structure to read data into
+ * @returns 1 on error or not found, 0 on success. Check tsk_errno
+ * to differentiate between error and not found.  If it is not found, then the
+ * errno will be TSK_ERR_FS_INODE_NUM.  Else, it will be some other value.
+ */
+uint8_t
+hfs_cat_file_lookup(HFS_INFO * hfs, TSK_INUM_T inum, HFS_ENTRY * entry,
+    unsigned char follow_hard_link)
+{
+    tsk_error_reset();
+
+    if (tsk_verbose)
+        tsk_fprintf(stderr,
+            "hfs_cat_file_lookup: called for inum %" PRIuINUM "\n", inum);
+
+    // Test if this is a special file that is not located in the catalog
+    if ((inum == HFS_EXTENTS_FILE_ID) ||
+        (inum == HFS_CATALOG_FILE_ID) ||
+        (inum == HFS_ALLOCATION_FILE_ID) ||
+        (inum == HFS_STARTUP_FILE_ID) ||
+        (inum == HFS_ATTRIBUTES_FILE_ID)) {
+        tsk_error_set_errno(TSK_ERR_FS_GENFS);
+        tsk_error_set_errstr
+            ("hfs_cat_file_lookup: Called on special file: %" PRIuINUM,
+            inum);
+        return 1;
+    }
+
+    return hfs_cat_file_lookup_off(hfs, inum, entry, 0, 0,
+        follow_hard_link);
+}
+
+
 /** \internal
 * Returns the largest inode number in file system
 * @param hfs File system being analyzed
@@ -2459,6 +2772,37 @@ hfs_dinode_copy(HFS_INFO * a_hfs, const HFS_ENTRY * a_hfs_entry,
 }
 
 
+/** \internal
+ * Copy a catalog entry into the metadata of a file.
+ * @param hfs File system the entry is from
+ * @param a_entry Catalog entry of the file
+ * @param a_fs_file File to copy the entry into (meta must be allocated)
+ * @returns 1 on error
+ */
+static uint8_t
+hfs_inode_load_entry(HFS_INFO * hfs, const HFS_ENTRY * a_entry,
+    TSK_FS_FILE * a_fs_file)
+{
+    /* Copy the structure in hfs to generic fs_inode */
+    if (hfs_dinode_copy(hfs, a_entry, a_fs_file)) {
+        return 1;
+    }
+
+    /* If this is potentially a compressed file, its
+     * actual size is unknown until we examine the
+     * extended attributes */
+    if ((a_fs_file->meta->size == 0) &&
+        (a_fs_file->meta->type == TSK_FS_META_TYPE_REG) &&
+        (a_fs_file->meta->attr_state != TSK_FS_META_ATTR_ERROR) &&
+        ((a_fs_file->meta->attr_state != TSK_FS_META_ATTR_STUDIED) ||
+            (a_fs_file->meta->attr == NULL))) {
+        hfs_load_attrs(a_fs_file);
+    }
+
+    return 0;
+}
+
+
 /** \internal
  * Load a catalog file entry and save it in the TSK_FS_FILE structure. 
  * 
@@ -2573,31 +2917,369 @@ hfs_inode_lookup(TSK_FS_INFO * fs, TSK_FS_FILE * a_fs_file,
         return 1;
     }
 
-    /* Copy the structure in hfs to generic fs_inode */
-    if (hfs_dinode_copy(hfs, &entry, a_fs_file)) {
+    return hfs_inode_load_entry(hfs, &entry, a_fs_file);
+}
+
+#ifdef HAVE_LIBZ
+
+/** \internal
+ * Read the resource fork header and the compression unit offset table of
+ * a file whose compressed data is in its resource fork.
+ *
+ * @param fs File system
+ * @param rAttr Resource fork attribute of the file
+ * @param a_tbl [out] Offset table (a_tbl->table must be freed by the caller)
+ * @returns 1 on error
+ */
+static uint8_t
+hfs_decmpfs_table_load(TSK_FS_INFO * fs, const TSK_FS_ATTR * rAttr,
+    HFS_DECMPFS_TABLE * a_tbl)
+{
+    hfs_resource_fork_header rfHeader;
+    ssize_t attrReadResult;
+    char fourBytes[4];          // Will hold the number of table entries, little endian
+    uint32_t tableSize;         // The number of table entries
+    char *offsetTableData;
+    uint32_t indx;
+
+    // Read the resource fork header
+    attrReadResult = tsk_fs_attr_read(rAttr, 0, (char *) &rfHeader,
+        sizeof(hfs_resource_fork_header), TSK_FS_FILE_READ_FLAG_NONE);
+    if (attrReadResult != sizeof(hfs_resource_fork_header)) {
+        error_returned
+            (" hfs_decmpfs_table_load: trying to read the resource fork header");
         return 1;
     }
 
-    /* If this is potentially a compressed file, its
-     * actual size is unknown until we examine the
-     * extended attributes */
-    if ((a_fs_file->meta->size == 0) &&
-        (a_fs_file->meta->type == TSK_FS_META_TYPE_REG) &&
-        (a_fs_file->meta->attr_state != TSK_FS_META_ATTR_ERROR) &&
-        ((a_fs_file->meta->attr_state != TSK_FS_META_ATTR_STUDIED) ||
-            (a_fs_file->meta->attr == NULL))) {
-        hfs_load_attrs(a_fs_file);
+    // Begin to parse the resource fork.  For now, we just need the data offset.  But
+    // eventually we'll want the other quantities as well.
+    // We are assuming that there is exactly one resource, and that this contains the compressed
+    // data.  This assumption is true in all examples we have seen.  More general code would
+    // parse the Resource Fork map, and find the appropriate entry, then jump to THAT data offset.
+
+    // The resource's data begins with an offset table, which defines blocks
+    // of (optionally) zlib-compressed data (so that the OS can do file seeks
+    // efficiently; each uncompressed block is 64KB).
+    a_tbl->table_off = tsk_getu32(fs->endian, rfHeader.dataOffset) + 4;
+
+    // read 4 bytes, the number of table entries, little endian
+    attrReadResult =
+        tsk_fs_attr_read(rAttr, a_tbl->table_off, fourBytes, 4,
+        TSK_FS_FILE_READ_FLAG_NONE);
+    if (attrReadResult != 4) {
+        error_returned
+            (" hfs_decmpfs_table_load: trying to read the offset table size, "
+            "return value of %d should have been 4", (int) attrReadResult);
+        return 1;
+    }
+    tableSize = tsk_getu32(TSK_LIT_ENDIAN, fourBytes);
+
+    // Each table entry is 8 bytes long, and the table must fit in the fork
+    if ((TSK_OFF_T) tableSize * 8 > rAttr->size) {
+        error_detected(TSK_ERR_FS_INODE_COR,
+            "hfs_decmpfs_table_load: offset table size %" PRIu32
+            " is too large for the resource fork", tableSize);
+        return 1;
+    }
+
+    offsetTableData = (char *) tsk_malloc((size_t) tableSize * 8 + 1);
+    if (offsetTableData == NULL) {
+        error_returned
+            (" hfs_decmpfs_table_load: space for the offset table raw data");
+        return 1;
+    }
+    a_tbl->table =
+        (CMP_OFFSET_ENTRY *) tsk_malloc((size_t) tableSize *
+        sizeof(CMP_OFFSET_ENTRY) + 1);
+    if (a_tbl->table == NULL) {
+        error_returned
+            (" hfs_decmpfs_table_load: space for the offset table");
+        free(offsetTableData);
+        return 1;
+    }
+
+    attrReadResult = tsk_fs_attr_read(rAttr, a_tbl->table_off + 4,
+        offsetTableData, (size_t) tableSize * 8,
+        TSK_FS_FILE_READ_FLAG_NONE);
+    if (attrReadResult != (ssize_t) tableSize * 8) {
+        error_returned
+            (" hfs_decmpfs_table_load: reading in the compression offset table, "
+            "return value %d should have been %u", (int) attrReadResult,
+            tableSize * 8);
+        free(offsetTableData);
+        free(a_tbl->table);
+        a_tbl->table = NULL;
+        return 1;
+    }
+
+    for (indx = 0; indx < tableSize; indx++) {
+        a_tbl->table[indx].offset =
+            tsk_getu32(TSK_LIT_ENDIAN, offsetTableData + indx * 8);
+        a_tbl->table[indx].length =
+            tsk_getu32(TSK_LIT_ENDIAN, offsetTableData + indx * 8 + 4);
     }
+    a_tbl->table_cnt = tableSize;
+    a_tbl->table_first = 0;
 
+    free(offsetTableData);
     return 0;
 }
 
-#ifdef HAVE_LIBZ
+/** \internal
+ * Read a compression unit from the resource fork and decompress it.
+ *
+ * @param rAttr Resource fork attribute of the file
+ * @param a_tbl Offset table of the file (must have the entry for a_unit)
+ * @param a_unit Index of the unit to read
+ * @param rawBuf Buffer of COMPRESSION_UNIT_SIZE + 1 bytes for the compressed data
+ * @param uncBuf [out] Buffer of COMPRESSION_UNIT_SIZE bytes for the uncompressed data
+ * @param uncLen [out] Number of bytes of uncompressed data
+ * @returns 1 on error
+ */
+static uint8_t
+hfs_decmpfs_unit_read(const TSK_FS_ATTR * rAttr,
+    const HFS_DECMPFS_TABLE * a_tbl, uint32_t a_unit, char *rawBuf,
+    char *uncBuf, uint64_t * uncLen)
+{
+    const CMP_OFFSET_ENTRY *ent = &a_tbl->table[a_unit - a_tbl->table_first];
+    uint32_t offset = a_tbl->table_off + ent->offset;
+    uint32_t len = ent->length;
+    ssize_t attrReadResult;
 
-typedef struct {
-    uint32_t offset;
-    uint32_t length;
-} CMP_OFFSET_ENTRY;
+    if (tsk_verbose)
+        tsk_fprintf(stderr,
+            "hfs_decmpfs_unit_read: reading one compression unit, number %"
+            PRIu32 ", length %" PRIu32 "\n", a_unit, len);
+
+    if (len > COMPRESSION_UNIT_SIZE + 1) {
+        error_detected(TSK_ERR_FS_INODE_COR,
+            "hfs_decmpfs_unit_read: compression unit length %" PRIu32
+            " is longer than compression unit size %u", len,
+            COMPRESSION_UNIT_SIZE);
+        return 1;
+    }
+
+    // Read in the chunk of (potentially) compressed data
+    attrReadResult = tsk_fs_attr_read(rAttr, offset,
+        rawBuf, len, TSK_FS_FILE_READ_FLAG_NONE);
+    if (attrReadResult != (ssize_t) len) {
+        if (attrReadResult < 0)
+            error_returned
+                (" hfs_decmpfs_unit_read: reading in the compression unit, "
+                "return value %d should have been %u",
+                (int) attrReadResult, len);
+        else
+            error_detected(TSK_ERR_FS_READ,
+                "hfs_decmpfs_unit_read: reading in the compression unit, "
+                "return value %d should have been %u",
+                (int) attrReadResult, len);
+        return 1;
+    }
+
+    // see if this block is compressed
+    if ((len > 0) && ((rawBuf[0] & 0x0F) != 0x0F)) {
+        unsigned long bytesConsumed;
+        int infResult;
+
+        // Uncompress the chunk of data
+        if (tsk_verbose)
+            tsk_fprintf(stderr,
+                "hfs_decmpfs_unit_read: Inflating the compression unit\n");
+
+        infResult = zlib_inflate(rawBuf, (uint64_t) len,
+            uncBuf, (uint64_t) COMPRESSION_UNIT_SIZE,
+            uncLen, &bytesConsumed);
+        if (infResult != 0) {
+            error_returned
+                (" hfs_decmpfs_unit_read: zlib inflation (uncompression) failed",
+                infResult);
+            return 1;
+        }
+    }
+    else if (len == 0) {
+        *uncLen = 0;
+    }
+    else {
+        // actually an uncompressed block of data; just copy
+        if (tsk_verbose)
+            tsk_fprintf(stderr,
+                "hfs_decmpfs_unit_read: Copying an uncompressed compression unit\n");
+
+        memcpy(uncBuf, rawBuf + 1, len - 1);
+        *uncLen = len - 1;
+    }
+
+    return 0;
+}
+
+/** \internal
+ * Copy the entries for a range of compression units from an offset table.
+ * If the range is not in the table, only the table size is copied.
+ * @returns 1 on error
+ */
+static uint8_t
+hfs_decmpfs_table_copy(const HFS_DECMPFS_TABLE * a_src, uint32_t a_start,
+    uint32_t a_end, HFS_DECMPFS_TABLE * a_tbl)
+{
+    a_tbl->table_off = a_src->table_off;
+    a_tbl->table_cnt = a_src->table_cnt;
+    a_tbl->table_first = a_start;
+    if ((a_start > a_end) || (a_end >= a_src->table_cnt))
+        return 0;
+
+    if ((a_tbl->table =
+            (CMP_OFFSET_ENTRY *) tsk_malloc((size_t) (a_end - a_start +
+                    1) * sizeof(CMP_OFFSET_ENTRY))) == NULL)
+        return 1;
+    memcpy(a_tbl->table, &a_src->table[a_start],
+        (size_t) (a_end - a_start + 1) * sizeof(CMP_OFFSET_ENTRY));
+    return 0;
+}
+
+/** \internal
+ * Get the entries of the offset table of a file with compressed data in
+ * its resource fork for a range of compression units.  Tables are cached
+ * in HFS_INFO, so the resource fork header and table are only read once
+ * when a file is read in small pieces, and each read only copies the
+ * entries that it needs.
+ *
+ * @param hfs File system
+ * @param fs_file File the table is for
+ * @param rAttr Resource fork attribute of the file
+ * @param a_start Index of the first compression unit that is needed
+ * @param a_end Index of the last compression unit that is needed
+ * @param a_tbl [out] Table size and, if a_end is in the table, the entries
+ * from a_start to a_end (a_tbl->table must be freed by the caller)
+ * @returns 1 on error
+ */
+static uint8_t
+hfs_decmpfs_table_get(HFS_INFO * hfs, TSK_FS_FILE * fs_file,
+    const TSK_FS_ATTR * rAttr, uint32_t a_start, uint32_t a_end,
+    HFS_DECMPFS_TABLE * a_tbl)
+{
+    TSK_INUM_T inum = fs_file->meta->addr;
+    HFS_DECMPFS_TABLE *ent = NULL;
+    HFS_DECMPFS_TABLE full;
+    uint8_t retval;
+    int i;
+
+    memset(a_tbl, 0, sizeof(HFS_DECMPFS_TABLE));
+    a_tbl->inum = inum;
+
+    tsk_take_lock(&(hfs->decmpfs_lock));
+    for (i = 0; i < HFS_DECMPFS_TABLE_CNT; i++) {
+        if (hfs->decmpfs_tables[i].inum == inum) {
+            ent = &hfs->decmpfs_tables[i];
+            break;
+        }
+    }
+    if (ent) {
+        ent->age = ++hfs->decmpfs_age;
+        retval = hfs_decmpfs_table_copy(ent, a_start, a_end, a_tbl);
+        tsk_release_lock(&(hfs->decmpfs_lock));
+        return retval;
+    }
+    tsk_release_lock(&(hfs->decmpfs_lock));
+
+    // read the table without holding the lock
+    memset(&full, 0, sizeof(HFS_DECMPFS_TABLE));
+    if (hfs_decmpfs_table_load(&(hfs->fs_info), rAttr, &full))
+        return 1;
+    if (hfs_decmpfs_table_copy(&full, a_start, a_end, a_tbl)) {
+        free(full.table);
+        return 1;
+    }
+
+    // keep the table in the least recently used entry
+    tsk_take_lock(&(hfs->decmpfs_lock));
+    for (i = 0; i < HFS_DECMPFS_TABLE_CNT; i++) {
+        HFS_DECMPFS_TABLE *cur = &hfs->decmpfs_tables[i];
+        if (cur->inum == inum) {
+            // another thread loaded it first
+            ent = NULL;
+            break;
+        }
+        if ((ent == NULL) || (cur->age < ent->age))
+            ent = cur;
+    }
+    if (ent) {
+        free(ent->table);
+        ent->table = full.table;
+        ent->table_off = full.table_off;
+        ent->table_cnt = full.table_cnt;
+        ent->table_first = 0;
+        ent->inum = inum;
+        ent->age = ++hfs->decmpfs_age;
+        full.table = NULL;
+    }
+    tsk_release_lock(&(hfs->decmpfs_lock));
+    free(full.table);
+
+    return 0;
+}
+
+/** \internal
+ * Get a decompressed compression unit of a file from the cache.
+ * @returns 1 if it was found (and copied to uncBuf) and 0 if not
+ */
+static uint8_t
+hfs_decmpfs_unit_cache_get(HFS_INFO * hfs, TSK_INUM_T inum,
+    uint32_t a_unit, char *uncBuf, uint64_t * uncLen)
+{
+    uint8_t found = 0;
+    int i;
+
+    tsk_take_lock(&(hfs->decmpfs_lock));
+    for (i = 0; i < HFS_DECMPFS_UNIT_CNT; i++) {
+        HFS_DECMPFS_UNIT *ent = &hfs->decmpfs_units[i];
+        if ((ent->inum == inum) && (ent->unit == a_unit)) {
+            memcpy(uncBuf, ent->buf, ent->len);
+            *uncLen = ent->len;
+            ent->age = ++hfs->decmpfs_age;
+            found = 1;
+            break;
+        }
+    }
+    tsk_release_lock(&(hfs->decmpfs_lock));
+    return found;
+}
+
+/** \internal
+ * Save a decompressed compression unit of a file in the cache.
+ */
+static void
+hfs_decmpfs_unit_cache_add(HFS_INFO * hfs, TSK_INUM_T inum,
+    uint32_t a_unit, const char *uncBuf, uint64_t uncLen)
+{
+    HFS_DECMPFS_UNIT *ent = NULL;
+    int i;
+
+    tsk_take_lock(&(hfs->decmpfs_lock));
+    for (i = 0; i < HFS_DECMPFS_UNIT_CNT; i++) {
+        HFS_DECMPFS_UNIT *cur = &hfs->decmpfs_units[i];
+        if ((cur->inum == inum) && (cur->unit == a_unit)) {
+            ent = NULL;
+            break;
+        }
+        if ((ent == NULL) || (cur->age < ent->age))
+            ent = cur;
+    }
+    if (ent) {
+        if (ent->buf == NULL)
+            ent->buf = (char *) malloc(COMPRESSION_UNIT_SIZE);
+        if (ent->buf) {
+            memcpy(ent->buf, uncBuf, (size_t) uncLen);
+            ent->len = (uint32_t) uncLen;
+            ent->unit = a_unit;
+            ent->inum = inum;
+            ent->age = ++hfs->decmpfs_age;
+        }
+        else {
+            ent->inum = 0;
+        }
+    }
+    tsk_release_lock(&(hfs->decmpfs_lock));
+}
 
 
 uint8_t
@@ -2605,21 +3287,12 @@ hfs_attr_walk_special(const TSK_FS_ATTR * fs_attr,
     int flags, TSK_FS_FILE_WALK_CB a_action, void *ptr)
 {
     TSK_FS_INFO *fs;
-    TSK_ENDIAN_ENUM endian;
     TSK_FS_FILE *fs_file;
     const TSK_FS_ATTR *rAttr;   // resource fork attribute
     char *rawBuf;               // compressed data
     char *uncBuf;               // uncompressed data
-    hfs_resource_fork_header rfHeader;
-    int attrReadResult;
-    uint32_t offsetTableOffset;
-    char fourBytes[4];          // Will hold the number of table entries, little endian
-    uint32_t tableSize;         // The number of table entries
-    hfs_resource_fork_header *resHead;
-    uint32_t dataOffset;
-    char *offsetTableData;
-    CMP_OFFSET_ENTRY *offsetTable;
-    size_t indx;                // index for looping over the offset table
+    HFS_DECMPFS_TABLE tbl;      // compression unit offset table
+    uint32_t indx;              // index for looping over the offset table
     TSK_OFF_T off = 0;          // the offset in the uncompressed data stream consumed thus far
 
     if (tsk_verbose)
@@ -2649,8 +3322,6 @@ hfs_attr_walk_special(const TSK_FS_ATTR * fs_attr,
     }
 
     fs = fs_attr->fs_file->fs_info;
-    //hfs = (HFS_INFO *) fs;
-    endian = fs->endian;
 
     /* This MUST be a compressed attribute     */
     if (!(fs_attr->flags & TSK_FS_ATTR_COMP)) {
@@ -2675,179 +3346,41 @@ hfs_attr_walk_special(const TSK_FS_ATTR * fs_attr,
     }
 
     // Allocate two buffers of the compression unit size.
-    rawBuf = (char *) tsk_malloc(COMPRESSION_UNIT_SIZE);
+    rawBuf = (char *) tsk_malloc(COMPRESSION_UNIT_SIZE + 1);
     uncBuf = (char *) tsk_malloc(COMPRESSION_UNIT_SIZE);
     if (rawBuf == NULL || uncBuf == NULL) {
-        error_returned
-            (" hfs_attr_walk_special: buffers for reading and uncompressing");
-        return 1;
-    }
-
-    // Read the resource fork header
-    attrReadResult = tsk_fs_attr_read(rAttr, 0, (char *) &rfHeader,
-        sizeof(hfs_resource_fork_header), TSK_FS_FILE_READ_FLAG_NONE);
-    if (attrReadResult != sizeof(hfs_resource_fork_header)) {
-        error_returned
-            (" hfs_attr_walk_special: trying to read the resource fork header");
-        free(rawBuf);
-        free(uncBuf);
-        return 1;
-    }
-
-    // Begin to parse the resource fork.  For now, we just need the data offset.  But
-    // eventually we'll want the other quantities as well.
-    // We are assuming that there is exactly one resource, and that this contains the compressed
-    // data.  This assumption is true in all examples we have seen.  More general code would
-    // parse the Resource Fork map, and find the appropriate entry, then jump to THAT data offset.
-    resHead = &rfHeader;
-    dataOffset = tsk_getu32(endian, resHead->dataOffset);
-    //uint32_t mapOffset = tsk_getu32(endian, resHead->mapOffset);
-    //uint32_t dataLength = tsk_getu32(endian, resHead->dataLength);
-    //uint32_t mapLength = tsk_getu32(endian, resHead->mapLength);
-
-    // The resource's data begins with an offset table, which defines blocks
-    // of (optionally) zlib-compressed data (so that the OS can do file seeks
-    // efficiently; each uncompressed block is 64KB).
-    offsetTableOffset = dataOffset + 4;
-
-    // read 4 bytes, the number of table entries, little endian
-    attrReadResult =
-        tsk_fs_attr_read(rAttr, offsetTableOffset, fourBytes, 4,
-        TSK_FS_FILE_READ_FLAG_NONE);
-    if (attrReadResult != 4) {
-        error_returned
-            (" hfs_attr_walk_special: trying to read the offset table size, "
-            "return value of %u should have been 4", attrReadResult);
-        free(rawBuf);
-        free(uncBuf);
-        return 1;
-    }
-    tableSize = tsk_getu32(TSK_LIT_ENDIAN, fourBytes);
-
-    // Each table entry is 8 bytes long
-    offsetTableData = (char *) tsk_malloc(tableSize * 8);
-    if (offsetTableData == NULL) {
-        error_returned
-            (" hfs_attr_walk_special: space for the offset table raw data");
-        free(rawBuf);
-        free(uncBuf);
-        return 1;
-    }
-    offsetTable =
-        (CMP_OFFSET_ENTRY *) tsk_malloc(tableSize *
-        sizeof(CMP_OFFSET_ENTRY));
-    if (offsetTable == NULL) {
-        error_returned
-            (" hfs_attr_walk_special: space for the offset table");
-        free(offsetTableData);
-        free(rawBuf);
-        free(uncBuf);
-        return 1;
-    }
-
-    attrReadResult = tsk_fs_attr_read(rAttr, offsetTableOffset + 4,
-        offsetTableData, tableSize * 8, TSK_FS_FILE_READ_FLAG_NONE);
-    if (attrReadResult != tableSize * 8) {
-        error_returned
-            (" hfs_attr_walk_special: reading in the compression offset table, "
-            "return value %u should have been %u", attrReadResult,
-            tableSize * 8);
-        free(offsetTableData);
-        free(offsetTable);
-        free(rawBuf);
-        free(uncBuf);
-        return 1;
-    }
-
-    for (indx = 0; indx < tableSize; indx++) {
-        offsetTable[indx].offset =
-            tsk_getu32(TSK_LIT_ENDIAN, offsetTableData + indx * 8);
-        offsetTable[indx].length =
-            tsk_getu32(TSK_LIT_ENDIAN, offsetTableData + indx * 8 + 4);
-    }
-
-    // FOR entry in the table DO
-    for (indx = 0; indx < tableSize; indx++) {
-        uint32_t offset = offsetTableOffset + offsetTable[indx].offset;
-        uint32_t len = offsetTable[indx].length;
-        uint64_t uncLen;        // uncompressed length
-        unsigned int blockSize;
-        uint64_t lumpSize;
-        uint64_t remaining;
-        char *lumpStart;
-
-        if (tsk_verbose)
-            tsk_fprintf(stderr,
-                "hfs_attr_walk_special: reading one compression unit, number %d, length %d\n",
-                indx, len);
-
-        // Read in the chunk of (potentially) compressed data
-        attrReadResult = tsk_fs_attr_read(rAttr, offset,
-            rawBuf, len, TSK_FS_FILE_READ_FLAG_NONE);
-        if (attrReadResult != len) {
-            if (attrReadResult < 0)
-                error_returned
-                    (" hfs_attr_walk_special: reading in the compression offset table, "
-                    "return value %u should have been %u", attrReadResult,
-                    len);
-            else
-                error_detected(TSK_ERR_FS_READ,
-                    "hfs_attr_walk_special: reading in the compression offset table, "
-                    "return value %u should have been %u", attrReadResult,
-                    len);
-            free(offsetTableData);
-            free(offsetTable);
-            free(rawBuf);
-            free(uncBuf);
-            return 1;
-        }
-
-        // see if this block is compressed
-        if ((len > 0) && ((rawBuf[0] & 0x0F) != 0x0F)) {
-
-            unsigned long bytesConsumed;
-            int infResult;
-
-            // Uncompress the chunk of data
-            if (tsk_verbose)
-                tsk_fprintf(stderr,
-                    "hfs_attr_walk_special: Inflating the compression unit\n");
-
-            infResult = zlib_inflate(rawBuf, (uint64_t) len,
-                uncBuf, (uint64_t) COMPRESSION_UNIT_SIZE,
-                &uncLen, &bytesConsumed);
-            if (infResult != 0) {
-                error_returned
-                    (" hfs_attr_walk_special: zlib inflation (uncompression) failed",
-                    infResult);
-                free(offsetTableData);
-                free(offsetTable);
-                free(rawBuf);
-                free(uncBuf);
-                return 1;
-            }
+        error_returned
+            (" hfs_attr_walk_special: buffers for reading and uncompressing");
+        free(rawBuf);
+        free(uncBuf);
+        return 1;
+    }
 
-        }
-        else {
+    // Read the offset table.  The units are each visited once, so they
+    // are not cached.
+    memset(&tbl, 0, sizeof(tbl));
+    if (hfs_decmpfs_table_load(fs, rAttr, &tbl)) {
+        error_returned(" hfs_attr_walk_special");
+        free(rawBuf);
+        free(uncBuf);
+        return 1;
+    }
 
-            // actually an uncompressed block of data; just copy
-            if (tsk_verbose)
-                tsk_fprintf(stderr,
-                    "hfs_attr_walk_special: Copying an uncompressed compression unit\n");
+    // FOR entry in the table DO
+    for (indx = 0; indx < tbl.table_cnt; indx++) {
+        uint64_t uncLen;        // uncompressed length
+        unsigned int blockSize;
+        uint64_t lumpSize;
+        uint64_t remaining;
+        char *lumpStart;
 
-            if ((len - 1) > COMPRESSION_UNIT_SIZE) {
-                error_detected(TSK_ERR_FS_READ,
-                    "hfs_attr_walk_special: uncompressed block length %u is longer "
-                    "than compression unit size %u", len - 1,
-                    COMPRESSION_UNIT_SIZE);
-                free(offsetTableData);
-                free(offsetTable);
-                free(rawBuf);
-                free(uncBuf);
-                return 1;
-            }
-            memcpy(uncBuf, rawBuf + 1, len - 1);
-            uncLen = len - 1;
+        if (hfs_decmpfs_unit_read(rAttr, &tbl, indx, rawBuf, uncBuf,
+                &uncLen)) {
+            error_returned(" hfs_attr_walk_special");
+            free(tbl.table);
+            free(rawBuf);
+            free(uncBuf);
+            return 1;
         }
 
         // Call the a_action callback with "Lumps" that are at most the block size.
@@ -2871,8 +3404,7 @@ hfs_attr_walk_special(const TSK_FS_ATTR * fs_attr,
             if (lumpSize > SIZE_MAX) {
                 error_detected(TSK_ERR_FS_FWALK,
                     " hfs_attr_walk_special: lumpSize is too large for the action");
-                free(offsetTableData);
-                free(offsetTable);
+                free(tbl.table);
                 free(rawBuf);
                 free(uncBuf);
                 return 1;
@@ -2883,8 +3415,7 @@ hfs_attr_walk_special(const TSK_FS_ATTR * fs_attr,
             if (retval == TSK_WALK_ERROR) {
                 error_detected(TSK_ERR_FS | 201,
                     "hfs_attr_walk_special: callback returned an error");
-                free(offsetTableData);
-                free(offsetTable);
+                free(tbl.table);
                 free(rawBuf);
                 free(uncBuf);
                 return 1;
@@ -2900,8 +3431,7 @@ hfs_attr_walk_special(const TSK_FS_ATTR * fs_attr,
     }
 
     // Done, so free up the allocated resources.
-    free(offsetTableData);
-    free(offsetTable);
+    free(tbl.table);
     free(rawBuf);
     free(uncBuf);
     return 0;
@@ -2917,23 +3447,14 @@ hfs_file_read_special(const TSK_FS_ATTR * a_fs_attr,
     TSK_OFF_T a_offset, char *a_buf, size_t a_len)
 {
     TSK_FS_INFO *fs = NULL;
-    TSK_ENDIAN_ENUM endian;
+    HFS_INFO *hfs;
     TSK_FS_FILE *fs_file;
     const TSK_FS_ATTR *rAttr;
     char *rawBuf;
     char *uncBuf;
-    hfs_resource_fork_header rfHeader;
-    int attrReadResult;
-    hfs_resource_fork_header *resHead;
-    uint32_t dataOffset;
-    uint32_t offsetTableOffset;
-    char fourBytes[4];          // Size of the offset table, little endian
-    uint32_t tableSize;         // Size of the offset table
-    char *offsetTableData;
-    CMP_OFFSET_ENTRY *offsetTable;
-    size_t indx;                // index for looping over the offset table
+    HFS_DECMPFS_TABLE tbl;      // compression unit offset table
+    uint32_t indx;              // index for looping over the offset table
     uint64_t sizeUpperBound;
-    uint64_t cummulativeSize = 0;
     uint32_t startUnit = 0;
     uint32_t startUnitOffset = 0;
     uint32_t endUnit = 0;
@@ -2968,8 +3489,7 @@ hfs_file_read_special(const TSK_FS_ATTR * a_fs_attr,
     }
 
     fs = a_fs_attr->fs_file->fs_info;
-    //hfs = (HFS_INFO *) fs;
-    endian = fs->endian;
+    hfs = (HFS_INFO *) fs;
 
     // This should be a compressed file.  If not, that's an error!
     if (!(a_fs_attr->flags & TSK_FS_ATTR_COMP)) {
@@ -3004,133 +3524,57 @@ hfs_file_read_special(const TSK_FS_ATTR * a_fs_attr,
         return -1;
     }
 
-    // Allocate two buffers of the compression unit size.
-    rawBuf = (char *) tsk_malloc(COMPRESSION_UNIT_SIZE);
-    if (rawBuf == NULL) {
-        error_returned
-            (" hfs_file_read_special: buffers for reading and uncompressing");
-        return -1;
-    }
-    uncBuf = (char *) tsk_malloc(COMPRESSION_UNIT_SIZE);
-    if (uncBuf == NULL) {
-        error_returned
-            (" hfs_file_read_special: buffers for reading and uncompressing");
-        free(rawBuf);
-        return -1;
-    }
-
-    // Read the resource fork header
-    attrReadResult = tsk_fs_attr_read(rAttr, 0, (char *) &rfHeader,
-        sizeof(hfs_resource_fork_header), TSK_FS_FILE_READ_FLAG_NONE);
-    if (attrReadResult != sizeof(hfs_resource_fork_header)) {
-        error_returned
-            (" hfs_file_read_special: trying to read the resource fork header");
-        free(rawBuf);
-        free(uncBuf);
+    // Compute the range of compression units needed for the request.
+    // Units past the 32-bit table size are clamped, which puts them
+    // outside of the table and fails the size check below.
+    if ((uint64_t) a_offset / COMPRESSION_UNIT_SIZE > 0xffffffff)
+        startUnit = 0xffffffff;
+    else
+        startUnit = (uint32_t) (a_offset / COMPRESSION_UNIT_SIZE);
+    if ((uint64_t) (a_offset + a_len - 1) / COMPRESSION_UNIT_SIZE >
+        0xffffffff)
+        endUnit = 0xffffffff;
+    else
+        endUnit =
+            (uint32_t) ((a_offset + a_len - 1) / COMPRESSION_UNIT_SIZE);
+    startUnitOffset = (uint32_t) (a_offset % COMPRESSION_UNIT_SIZE);
+
+    // Get the offset table entries for the range (the table is cached
+    // between reads of the same file)
+    if (hfs_decmpfs_table_get(hfs, fs_file, rAttr, startUnit, endUnit,
+            &tbl)) {
+        error_returned(" hfs_file_read_special");
         return -1;
     }
 
-    // Begin to parse the resource fork.  For now, we just need the data offset.  But
-    // eventually we'll want the other quantities as well.
-    resHead = &rfHeader;
-    dataOffset = tsk_getu32(endian, resHead->dataOffset);
-    //uint32_t mapOffset = tsk_getu32(endian, resHead->mapOffset);
-    //uint32_t dataLength = tsk_getu32(endian, resHead->dataLength);
-    //uint32_t mapLength = tsk_getu32(endian, resHead->mapLength);
-
-    // The resource's data begins with an offset table, which defines blocks
-    // of (optionally) zlib-compressed data (so that the OS can do file seeks
-    // efficiently; each uncompressed block is 64KB).
-    offsetTableOffset = dataOffset + 4;
+    sizeUpperBound = (uint64_t) tbl.table_cnt * COMPRESSION_UNIT_SIZE;
 
-    // read 4 bytes, the number of table entries, little endian
-    attrReadResult =
-        tsk_fs_attr_read(rAttr, offsetTableOffset, fourBytes, 4,
-        TSK_FS_FILE_READ_FLAG_NONE);
-    if (attrReadResult != 4) {
-        error_returned
-            (" hfs_file_read_special: trying to read the offset table size, "
-            "return value of %u should have been 4", attrReadResult);
-        free(rawBuf);
-        free(uncBuf);
+    // cast is OK because both a_offset and a_len are >= 0
+    if ((uint64_t) (a_offset + a_len) > sizeUpperBound) {
+        error_detected(TSK_ERR_FS_ARG,
+            "hfs_file_read_special: range of bytes requested %lld - %lld falls outside of the length upper bound of the uncompressed stream %llu\n",
+            a_offset, a_offset + a_len, sizeUpperBound);
+        free(tbl.table);
         return -1;
     }
-    tableSize = tsk_getu32(TSK_LIT_ENDIAN, fourBytes);
 
-    // Each table entry is 8 bytes long
-    offsetTableData = tsk_malloc(tableSize * 8);
-    if (offsetTableData == NULL) {
-        error_returned
-            (" hfs_file_read_special: space for the offset table raw data");
-        free(rawBuf);
-        free(uncBuf);
-        return -1;
-    }
-    offsetTable =
-        (CMP_OFFSET_ENTRY *) tsk_malloc(tableSize *
-        sizeof(CMP_OFFSET_ENTRY));
-    if (offsetTable == NULL) {
+    // Allocate two buffers of the compression unit size.
+    rawBuf = (char *) tsk_malloc(COMPRESSION_UNIT_SIZE + 1);
+    if (rawBuf == NULL) {
         error_returned
-            (" hfs_file_read_special: space for the offset table");
-        free(offsetTableData);
-        free(rawBuf);
-        free(uncBuf);
+            (" hfs_file_read_special: buffers for reading and uncompressing");
+        free(tbl.table);
         return -1;
     }
-
-    attrReadResult = tsk_fs_attr_read(rAttr, offsetTableOffset + 4,
-        offsetTableData, tableSize * 8, TSK_FS_FILE_READ_FLAG_NONE);
-    if (attrReadResult != tableSize * 8) {
+    uncBuf = (char *) tsk_malloc(COMPRESSION_UNIT_SIZE);
+    if (uncBuf == NULL) {
         error_returned
-            (" hfs_file_read_special: reading in the compression offset table, "
-            "return value %u should have been %u", attrReadResult,
-            tableSize * 8);
-        free(offsetTableData);
-        free(offsetTable);
-        free(rawBuf);
-        free(uncBuf);
-        return -1;
-    }
-
-    for (indx = 0; indx < tableSize; indx++) {
-        offsetTable[indx].offset =
-            tsk_getu32(TSK_LIT_ENDIAN, offsetTableData + indx * 8);
-        offsetTable[indx].length =
-            tsk_getu32(TSK_LIT_ENDIAN, offsetTableData + indx * 8 + 4);
-    }
-
-    sizeUpperBound = tableSize * COMPRESSION_UNIT_SIZE;
-
-    // cast is OK because both a_offset and a_len are >= 0
-    if ((uint64_t) (a_offset + a_len) > sizeUpperBound) {
-        error_detected(TSK_ERR_FS_ARG,
-            "hfs_file_read_special: range of bytes requested %lld - %lld falls outside of the length upper bound of the uncompressed stream %llu\n",
-            a_offset, a_offset + a_len, sizeUpperBound);
-        free(offsetTableData);
-        free(offsetTable);
+            (" hfs_file_read_special: buffers for reading and uncompressing");
+        free(tbl.table);
         free(rawBuf);
-        free(uncBuf);
         return -1;
     }
 
-    // Compute the range of compression units needed for the request
-    for (indx = 0; indx < tableSize; indx++) {
-        if (cummulativeSize <= (uint64_t) a_offset &&   // casts OK because a_offset >= 0
-            (cummulativeSize + COMPRESSION_UNIT_SIZE >
-                (uint64_t) a_offset)) {
-            startUnit = indx;
-            startUnitOffset = (uint32_t) (a_offset - cummulativeSize);  // This cast is OK, result can't be too large,
-            // due to enclosing test.
-        }
-
-        if ((cummulativeSize < (uint64_t) (a_offset + a_len)) &&        // casts OK because a_offset and a_len > 0
-            (cummulativeSize + COMPRESSION_UNIT_SIZE >=
-                (uint64_t) (a_offset + a_len))) {
-            endUnit = indx;
-        }
-        cummulativeSize += COMPRESSION_UNIT_SIZE;
-    }
-
     if (tsk_verbose)
         tsk_fprintf(stderr,
             "hfs_file_read_special: reading compression units: %" PRIu32
@@ -3139,8 +3583,6 @@ hfs_file_read_special(const TSK_FS_ATTR * a_fs_attr,
 
     // Read from the indicated comp units
     for (indx = startUnit; indx <= endUnit; indx++) {
-        uint32_t offset = offsetTableOffset + offsetTable[indx].offset;
-        uint32_t len = offsetTable[indx].length;
         uint64_t uncLen;
         char *uncBufPtr = uncBuf;
         size_t bytesToCopy;
@@ -3150,80 +3592,30 @@ hfs_file_read_special(const TSK_FS_ATTR * a_fs_attr,
                 "hfs_file_read_special: Reading compression unit %" PRIu32
                 "\n", indx);
 
-        // Read in the chunk of compressed data
-        attrReadResult = tsk_fs_attr_read(rAttr, offset,
-            rawBuf, len, TSK_FS_FILE_READ_FLAG_NONE);
-        if (attrReadResult != len) {
-            if (attrReadResult < 0)
-                error_returned
-                    (" hfs_file_read_special: reading in the compression offset table, "
-                    "return value %u should have been %u", attrReadResult,
-                    len);
-            else
-                error_detected(TSK_ERR_FS_READ,
-                    "hfs_file_read_special: reading in the compression offset table, "
-                    "return value %u should have been %u", attrReadResult,
-                    len);
-            free(offsetTableData);
-            free(offsetTable);
-            free(rawBuf);
-            free(uncBuf);
-            return -1;
-        }
-
-        // see if this block is compressed
-        if ((len > 0) && ((rawBuf[0] & 0x0F) != 0x0F)) {
-
-            unsigned long bytesConsumed;
-            int infResult;
-
-            // Uncompress the chunk of data
-            if (tsk_verbose)
-                tsk_fprintf(stderr,
-                    "hfs_attr_read_special: Inflating the compression unit\n");
-
-            infResult = zlib_inflate(rawBuf, (uint64_t) len,
-                uncBuf, (uint64_t) COMPRESSION_UNIT_SIZE,
-                &uncLen, &bytesConsumed);
-            if (infResult != 0) {
-                error_returned
-                    (" hfs_attr_walk_special: zlib inflation (uncompression) failed",
-                    infResult);
-                free(offsetTableData);
-                free(offsetTable);
-                free(rawBuf);
-                free(uncBuf);
-                return -1;
-            }
-
-        }
-        else {
-
-            // actually an uncompressed block of data; just copy
-            if (tsk_verbose)
-                tsk_fprintf(stderr,
-                    "hfs_attr_read_special: Copying an uncompressed compression unit\n");
-
-            if ((len - 1) > COMPRESSION_UNIT_SIZE) {
-                error_detected(TSK_ERR_FS_READ,
-                    "hfs_attr_read_special: uncompressed block length %u is longer "
-                    "than compression unit size %u", len - 1,
-                    COMPRESSION_UNIT_SIZE);
-                free(offsetTableData);
-                free(offsetTable);
+        // Reads of a file in small pieces hit the same unit many times,
+        // so keep recently decompressed units.
+        if (hfs_decmpfs_unit_cache_get(hfs, fs_file->meta->addr, indx,
+                uncBuf, &uncLen) == 0) {
+            if (hfs_decmpfs_unit_read(rAttr, &tbl, indx, rawBuf, uncBuf,
+                    &uncLen)) {
+                error_returned(" hfs_file_read_special");
+                free(tbl.table);
                 free(rawBuf);
                 free(uncBuf);
                 return -1;
             }
-            memcpy(uncBuf, rawBuf + 1, len - 1);
-            uncLen = len - 1;
+            hfs_decmpfs_unit_cache_add(hfs, fs_file->meta->addr, indx,
+                uncBuf, uncLen);
         }
 
         // There are now uncLen bytes of uncompressed data available from this comp unit.
 
         // If this is the first comp unit, then we must skip over the startUnitOffset bytes.
         if (indx == startUnit) {
-            uncLen -= startUnitOffset;
+            if (uncLen < startUnitOffset)
+                uncLen = 0;
+            else
+                uncLen -= startUnitOffset;
             uncBufPtr += startUnitOffset;
         }
 
@@ -3252,8 +3644,7 @@ hfs_file_read_special(const TSK_FS_ATTR * a_fs_attr,
         memset(a_buf + bytesCopied, 0, a_len - (size_t) bytesCopied);   // cast OK because diff must be < compression unit size
     }
 
-    free(offsetTableData);
-    free(offsetTable);
+    free(tbl.table);
     free(rawBuf);
     free(uncBuf);
 
@@ -3383,6 +3774,30 @@ close_attr_file(ATTR_FILE_T * attr_file)
 }
 
 
+/** \internal
+ * Read a node of the Attributes btree (via the B-tree node cache).
+ *
+ * @param hfs -- the HFS file system
+ * @param attr_file -- the open Attributes file
+ * @param nodeID -- the node to read
+ * @param nodeData -- buffer of attr_file->nodeSize bytes to read into
+ * @return the number of bytes read or -1 on error
+ */
+static ssize_t
+read_attr_file_node(HFS_INFO * hfs, ATTR_FILE_T * attr_file,
+    uint32_t nodeID, uint8_t * nodeData)
+{
+    const TSK_FS_ATTR *attr;
+
+    if ((attr = tsk_fs_file_attr_get(attr_file->file)) == NULL)
+        return -1;
+
+    return hfs_btree_node_copy(hfs, HFS_BT_TREE_ATTR, attr,
+        attr_file->nodeSize, nodeID, 0, (char *) nodeData,
+        attr_file->nodeSize);
+}
+
+
 static const char *
 hfs_attrTypeName(uint32_t typeNum)
 {
@@ -3497,10 +3912,7 @@ hfs_load_extended_attrs(TSK_FS_FILE * fs_file,
                 PRIu32 "\n", nodeID);
         }
 
-        cnt = tsk_fs_file_read(attrFile.file,
-            nodeID * attrFile.nodeSize,
-            (char *) nodeData,
-            attrFile.nodeSize, (TSK_FS_FILE_READ_FLAG_ENUM) 0);
+        cnt = read_attr_file_node(hfs, &attrFile, nodeID, nodeData);
         if (cnt != attrFile.nodeSize) {
             free(nodeData);
             error_returned
@@ -4008,10 +4420,7 @@ hfs_load_extended_attrs(TSK_FS_FILE * fs_file,
 
             nodeID = newNodeID;
 
-            cnt = tsk_fs_file_read(attrFile.file,
-                nodeID * attrFile.nodeSize,
-                (char *) nodeData,
-                attrFile.nodeSize, (TSK_FS_FILE_READ_FLAG_ENUM) 0);
+            cnt = read_attr_file_node(hfs, &attrFile, nodeID, nodeData);
             if (cnt != attrFile.nodeSize) {
                 error_returned
                     ("hfs_load_extended_attrs: Could not read in the next LEAF node from the Attributes File btree");
@@ -4849,13 +5258,163 @@ hfs_block_walk(TSK_FS_INFO * fs, TSK_DADDR_T start_blk,
 }
 
 
+/* A file/folder or thread record found by the catalog leaf scan in
+ * hfs_inode_walk() */
+typedef struct {
+    uint32_t cnid;              // CNID of the file or folder
+    uint32_t parent;            // CNID of its parent folder
+    TSK_OFF_T off;              // offset of the record in the catalog file
+} HFS_CAT_SCAN_ENT;
+
+typedef struct {
+    TSK_INUM_T start_inum;      // range of CNIDs to collect
+    TSK_INUM_T end_inum;
+    HFS_CAT_SCAN_ENT *threads;  // thread records
+    size_t thread_cnt;
+    size_t thread_alloc;
+    HFS_CAT_SCAN_ENT *recs;     // file and folder records
+    size_t rec_cnt;
+    size_t rec_alloc;
+} HFS_CAT_SCAN;
+
+static int
+hfs_cat_scan_ent_compare(const void *a, const void *b)
+{
+    const HFS_CAT_SCAN_ENT *ent_a = (const HFS_CAT_SCAN_ENT *) a;
+    const HFS_CAT_SCAN_ENT *ent_b = (const HFS_CAT_SCAN_ENT *) b;
+
+    if (ent_a->cnid != ent_b->cnid)
+        return (ent_a->cnid < ent_b->cnid) ? -1 : 1;
+    if (ent_a->off != ent_b->off)
+        return (ent_a->off < ent_b->off) ? -1 : 1;
+    return 0;
+}
+
+/* Add an entry to one of the lists in a HFS_CAT_SCAN
+ * @returns 1 on error */
+static uint8_t
+hfs_cat_scan_add(HFS_CAT_SCAN_ENT ** a_list, size_t * a_cnt,
+    size_t * a_alloc, uint32_t a_cnid, uint32_t a_parent, TSK_OFF_T a_off)
+{
+    if (*a_cnt == *a_alloc) {
+        size_t new_alloc = *a_alloc ? *a_alloc * 2 : 1024;
+        HFS_CAT_SCAN_ENT *tmp;
+
+        if ((tmp = (HFS_CAT_SCAN_ENT *) tsk_realloc(*a_list,
+                    new_alloc * sizeof(HFS_CAT_SCAN_ENT))) == NULL)
+            return 1;
+        *a_list = tmp;
+        *a_alloc = new_alloc;
+    }
+    (*a_list)[*a_cnt].cnid = a_cnid;
+    (*a_list)[*a_cnt].parent = a_parent;
+    (*a_list)[*a_cnt].off = a_off;
+    (*a_cnt)++;
+    return 0;
+}
+
+/* Return the index of the first file/folder record for a CNID (or of
+ * the first one after it) in the sorted record list. */
+static size_t
+hfs_cat_scan_find(const HFS_CAT_SCAN * a_scan, uint32_t a_cnid)
+{
+    size_t lo = 0;
+    size_t hi = a_scan->rec_cnt;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (a_scan->recs[mid].cnid < a_cnid)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Callback for hfs_cat_leaf_walk() that collects the thread and the
+ * file/folder records in the range of a HFS_CAT_SCAN. */
+static TSK_WALK_RET_ENUM
+hfs_inode_walk_scan_cb(HFS_INFO * hfs, const hfs_btree_key_cat * cur_key,
+    TSK_OFF_T rec_off, const char *rec, size_t rec_len, void *ptr)
+{
+    HFS_CAT_SCAN *scan = (HFS_CAT_SCAN *) ptr;
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) & (hfs->fs_info);
+    uint16_t rec_type;
+    uint32_t cnid;
+
+    // the key must hold the parent CNID and name length
+    if ((tsk_getu16(fs->endian, cur_key->key_len) < 6) || (rec_len < 2))
+        return TSK_WALK_CONT;
+
+    rec_type = tsk_getu16(fs->endian, rec);
+    if ((rec_type == HFS_FOLDER_THREAD) || (rec_type == HFS_FILE_THREAD)) {
+        const hfs_thread *thread = (const hfs_thread *) rec;
+
+        // thread records are keyed by the CNID of the file
+        cnid = tsk_getu32(fs->endian, cur_key->parent_cnid);
+        if ((rec_len < 8) || (cnid < scan->start_inum)
+            || (cnid > scan->end_inum))
+            return TSK_WALK_CONT;
+
+        if (hfs_cat_scan_add(&scan->threads, &scan->thread_cnt,
+                &scan->thread_alloc, cnid,
+                tsk_getu32(fs->endian, thread->parent_cnid), rec_off))
+            return TSK_WALK_ERROR;
+    }
+    else if ((rec_type == HFS_FOLDER_RECORD)
+        || (rec_type == HFS_FILE_RECORD)) {
+        const hfs_file_fold_std *std = (const hfs_file_fold_std *) rec;
+
+        if (rec_len < sizeof(hfs_file_fold_std))
+            return TSK_WALK_CONT;
+        cnid = tsk_getu32(fs->endian, std->cnid);
+        if ((cnid < scan->start_inum) || (cnid > scan->end_inum))
+            return TSK_WALK_CONT;
+
+        if (hfs_cat_scan_add(&scan->recs, &scan->rec_cnt,
+                &scan->rec_alloc, cnid,
+                tsk_getu32(fs->endian, cur_key->parent_cnid), rec_off))
+            return TSK_WALK_ERROR;
+    }
+
+    return TSK_WALK_CONT;
+}
+
+/* Load one address for hfs_inode_walk() and call the callback if it
+ * exists and matches the flags. */
+static TSK_WALK_RET_ENUM
+hfs_inode_walk_inum(TSK_FS_INFO * fs, TSK_FS_FILE * fs_file,
+    TSK_INUM_T inum, TSK_FS_META_FLAG_ENUM flags,
+    TSK_FS_META_WALK_CB action, void *ptr)
+{
+    if (hfs_inode_lookup(fs, fs_file, inum)) {
+        // deleted files may not exist in the catalog
+        if (tsk_error_get_errno() == TSK_ERR_FS_INODE_NUM) {
+            tsk_error_reset();
+            return TSK_WALK_CONT;
+        }
+        else {
+            return TSK_WALK_ERROR;
+        }
+    }
+
+    if ((fs_file->meta->flags & flags) != fs_file->meta->flags)
+        return TSK_WALK_CONT;
+
+    /* call action */
+    return action(fs_file, ptr);
+}
+
+
 uint8_t
 hfs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
     TSK_INUM_T end_inum, TSK_FS_META_FLAG_ENUM flags,
     TSK_FS_META_WALK_CB action, void *ptr)
 {
+    HFS_INFO *hfs = (HFS_INFO *) fs;
     TSK_INUM_T inum;
     TSK_FS_FILE *fs_file;
+    TSK_WALK_RET_ENUM retval = TSK_WALK_CONT;
 
     if (tsk_verbose)
         tsk_fprintf(stderr,
@@ -4913,37 +5472,97 @@ hfs_inode_walk(TSK_FS_INFO * fs, TSK_INUM_T start_inum,
     if (start_inum > end_inum)
         XSWAP(start_inum, end_inum);
 
-    for (inum = start_inum; inum <= end_inum; inum++) {
-        int retval;
-
-        if (hfs_inode_lookup(fs, fs_file, inum)) {
-            // deleted files may not exist in the catalog
-            if (tsk_error_get_errno() == TSK_ERR_FS_INODE_NUM) {
-                tsk_error_reset();
-                continue;
-            }
-            else {
-                return 1;
+    /* Large ranges of catalog files are loaded from a single pass over
+     * the catalog leaf nodes instead of a btree search for each address
+     * (most of which are usually not in use).  The special files and
+     * small ranges are looked up one at a time. */
+    if ((end_inum >= HFS_FIRST_USER_CNID) && (end_inum - start_inum >
+            tsk_getu32(fs->endian, hfs->catalog_header.totalNodes))) {
+        HFS_CAT_SCAN scan;
+        size_t i;
+
+        memset(&scan, 0, sizeof(scan));
+        scan.start_inum =
+            (start_inum > HFS_FIRST_USER_CNID) ? start_inum :
+            HFS_FIRST_USER_CNID;
+        scan.end_inum = end_inum;
+
+        if (hfs_cat_leaf_walk(hfs, hfs_inode_walk_scan_cb, &scan) == 0) {
+            qsort(scan.threads, scan.thread_cnt, sizeof(HFS_CAT_SCAN_ENT),
+                hfs_cat_scan_ent_compare);
+            qsort(scan.recs, scan.rec_cnt, sizeof(HFS_CAT_SCAN_ENT),
+                hfs_cat_scan_ent_compare);
+
+            for (inum = start_inum; inum < scan.start_inum; inum++) {
+                retval = hfs_inode_walk_inum(fs, fs_file, inum, flags,
+                    action, ptr);
+                if (retval != TSK_WALK_CONT)
+                    break;
             }
-        }
 
-        if ((fs_file->meta->flags & flags) != fs_file->meta->flags)
-            continue;
+            for (i = 0; (retval == TSK_WALK_CONT) && (i < scan.thread_cnt);
+                i++) {
+                const HFS_CAT_SCAN_ENT *thread = &scan.threads[i];
+                TSK_OFF_T rec_off = 0;
+                HFS_ENTRY entry;
+                size_t r;
 
-        /* call action */
-        retval = action(fs_file, ptr);
-        if (retval == TSK_WALK_STOP) {
-            tsk_fs_file_close(fs_file);
-            return 0;
-        }
-        else if (retval == TSK_WALK_ERROR) {
+                // skip duplicate thread records (the first is used)
+                if ((i > 0) && (scan.threads[i - 1].cnid == thread->cnid))
+                    continue;
+
+                // find the file or folder record in the thread's parent
+                for (r = hfs_cat_scan_find(&scan, thread->cnid);
+                    (r < scan.rec_cnt) && (scan.recs[r].cnid == thread->cnid);
+                    r++) {
+                    if (scan.recs[r].parent == thread->parent) {
+                        rec_off = scan.recs[r].off;
+                        break;
+                    }
+                }
+
+                tsk_fs_meta_reset(fs_file->meta);
+                if (hfs_cat_file_lookup_off(hfs, thread->cnid, &entry,
+                        thread->off, rec_off, TRUE)
+                    || hfs_inode_load_entry(hfs, &entry, fs_file)) {
+                    // deleted files may not exist in the catalog
+                    if (tsk_error_get_errno() == TSK_ERR_FS_INODE_NUM) {
+                        tsk_error_reset();
+                        continue;
+                    }
+                    retval = TSK_WALK_ERROR;
+                    break;
+                }
+
+                if ((fs_file->meta->flags & flags) != fs_file->meta->flags)
+                    continue;
+
+                retval = action(fs_file, ptr);
+            }
+
+            free(scan.threads);
+            free(scan.recs);
             tsk_fs_file_close(fs_file);
-            return 1;
+            return (retval == TSK_WALK_ERROR) ? 1 : 0;
         }
+
+        // fall back to looking up each address
+        if (tsk_verbose)
+            tsk_fprintf(stderr,
+                "hfs_inode_walk: catalog leaf scan failed, looking up each inode\n");
+        tsk_error_reset();
+        free(scan.threads);
+        free(scan.recs);
+    }
+
+    for (inum = start_inum; inum <= end_inum; inum++) {
+        retval = hfs_inode_walk_inum(fs, fs_file, inum, flags, action, ptr);
+        if (retval != TSK_WALK_CONT)
+            break;
     }
 
     tsk_fs_file_close(fs_file);
-    return 0;
+    return (retval == TSK_WALK_ERROR) ? 1 : 0;
 }
 
 /* return the name of a file at a given inode
@@ -5940,6 +6559,8 @@ static void
 hfs_close(TSK_FS_INFO * fs)
 {
     HFS_INFO *hfs = (HFS_INFO *) fs;
+    int i;
+
     // We'll grab this lock a bit early.
     tsk_take_lock(&(hfs->metadata_dir_cache_lock));
     fs->tag = 0;
@@ -5971,6 +6592,15 @@ hfs_close(TSK_FS_INFO * fs)
     tsk_release_lock(&(hfs->metadata_dir_cache_lock));
     tsk_deinit_lock(&(hfs->metadata_dir_cache_lock));
 
+    hfs_btree_node_cache_free(hfs);
+    tsk_deinit_lock(&(hfs->node_cache_lock));
+
+    for (i = 0; i < HFS_DECMPFS_TABLE_CNT; i++)
+        free(hfs->decmpfs_tables[i].table);
+    for (i = 0; i < HFS_DECMPFS_UNIT_CNT; i++)
+        free(hfs->decmpfs_units[i].buf);
+    tsk_deinit_lock(&(hfs->decmpfs_lock));
+
     free(hfs);
 }
 
@@ -6129,8 +6759,10 @@ hfs_open(TSK_IMG_INFO * img_info, TSK_OFF_T offset,
         fs->last_block_act =
             (img_info->size - offset) / fs->block_size - 1;
 
-    // Initialize the lock
+    // Initialize the locks
     tsk_init_lock(&(hfs->metadata_dir_cache_lock));
+    tsk_init_lock(&(hfs->node_cache_lock));
+    tsk_init_lock(&(hfs->decmpfs_lock));
 
     /*
      * Set function pointers
@@ -28,6 +28,8 @@
 #include "tsk_fs_i.h"
 #include "tsk_hfs.h"
 
+#include <stddef.h>
+
 
 /*******************************************************************************
  * Find an unallocated NTFS MFT entry based on its parent directory
@@ -558,20 +560,749 @@ ifind_data_act(TSK_FS_FILE * fs_file, void *ptr)
 
 
 
+/*******************************************************************************
+ * Index of data units to the attributes that use them
+ */
+
+/* One run of consecutive data units in an attribute */
+typedef struct {
+    TSK_DADDR_T start;          /* first data unit in the run */
+    TSK_DADDR_T len;            /* number of data units in the run */
+    TSK_OFF_T offset;           /* byte offset of start in the attribute */
+    TSK_INUM_T inum;            /* file that the attribute is in */
+    uint64_t seq;               /* order of the attribute in the inode walk */
+    uint32_t type;              /* attribute type */
+    uint16_t id;                /* attribute id */
+    uint16_t pad;
+} IFIND_INDEX_RUN;
+
+struct TSK_FS_IFIND_INDEX {
+    IFIND_INDEX_RUN *runs;      /* sorted by start and then seq */
+    TSK_DADDR_T *run_last;      /* largest last data unit in runs[0..i] */
+    size_t cnt;
+};
+
+typedef struct {
+    TSK_FS_IFIND_INDEX *index;
+    size_t alloc;
+    uint64_t seq;               /* seq of the attribute being walked */
+    TSK_INUM_T curinode;
+    uint32_t curtype;
+    uint16_t curid;
+    uint8_t error;
+} IFIND_INDEX_BUILD;
+
+/* Header of the index file.  All values are in the byte order of the
+ * system that wrote it (which is verified with magic). */
+#define IFIND_INDEX_MAGIC   0x544b4958  // "TKIX"
+#define IFIND_INDEX_VER     1
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entry_size;        // sizeof(IFIND_INDEX_RUN)
+    uint32_t ftype;
+    uint32_t block_size;
+    uint32_t fs_id_used;
+    uint64_t block_count;
+    uint64_t last_inum;
+    uint64_t offset;
+    uint8_t fs_id[TSK_FS_INFO_FS_ID_LEN];
+    uint64_t runs_cnt;
+} IFIND_INDEX_HEAD;
+
+
+/*
+ * file_walk action that adds the data units of an attribute to the index
+ */
+static TSK_WALK_RET_ENUM
+ifind_index_file_act(TSK_FS_FILE * fs_file, TSK_OFF_T a_off,
+    TSK_DADDR_T addr, char *buf, size_t size, TSK_FS_BLOCK_FLAG_ENUM flags,
+    void *ptr)
+{
+    TSK_FS_INFO *fs = fs_file->fs_info;
+    IFIND_INDEX_BUILD *data = (IFIND_INDEX_BUILD *) ptr;
+    TSK_FS_IFIND_INDEX *index = data->index;
+    IFIND_INDEX_RUN *run;
+
+    /* Ignore sparse blocks because they do not reside on disk */
+    if (flags & TSK_FS_BLOCK_FLAG_SPARSE)
+        return TSK_WALK_CONT;
+
+    /* add to the last run if this continues it */
+    if (index->cnt) {
+        run = &index->runs[index->cnt - 1];
+        if ((run->seq == data->seq) && (addr == run->start + run->len)
+            && (a_off ==
+                run->offset + (TSK_OFF_T) run->len * fs->block_size)) {
+            run->len++;
+            return TSK_WALK_CONT;
+        }
+    }
+
+    if (index->cnt == data->alloc) {
+        size_t new_alloc = data->alloc ? data->alloc * 2 : 1024;
+        IFIND_INDEX_RUN *tmp;
+        if ((tmp = (IFIND_INDEX_RUN *) tsk_realloc(index->runs,
+                    new_alloc * sizeof(IFIND_INDEX_RUN))) == NULL) {
+            data->error = 1;
+            return TSK_WALK_ERROR;
+        }
+        index->runs = tmp;
+        data->alloc = new_alloc;
+    }
+
+    run = &index->runs[index->cnt++];
+    memset(run, 0, sizeof(IFIND_INDEX_RUN));
+    run->start = addr;
+    run->len = 1;
+    run->offset = a_off;
+    run->inum = data->curinode;
+    run->seq = data->seq;
+    run->type = data->curtype;
+    run->id = data->curid;
+    return TSK_WALK_CONT;
+}
+
+
+/*
+ * inode_walk action that adds the attributes of each file to the index.
+ * This visits the same attributes and data units as ifind_data_act.
+ */
+static TSK_WALK_RET_ENUM
+ifind_index_act(TSK_FS_FILE * fs_file, void *ptr)
+{
+    IFIND_INDEX_BUILD *data = (IFIND_INDEX_BUILD *) ptr;
+    int file_flags =
+        (TSK_FS_FILE_WALK_FLAG_AONLY | TSK_FS_FILE_WALK_FLAG_SLACK);
+    int i, cnt;
+
+    data->curinode = fs_file->meta->addr;
+
+    cnt = tsk_fs_file_attr_getsize(fs_file);
+    for (i = 0; i < cnt; i++) {
+        const TSK_FS_ATTR *fs_attr = tsk_fs_file_attr_get_idx(fs_file, i);
+        if (!fs_attr)
+            continue;
+
+        if ((fs_attr->flags & TSK_FS_ATTR_NONRES) == 0)
+            continue;
+
+        data->curtype = fs_attr->type;
+        data->curid = fs_attr->id;
+        data->seq++;
+        if (tsk_fs_attr_walk(fs_attr,
+                file_flags, ifind_index_file_act, ptr)) {
+            if (data->error)
+                return TSK_WALK_ERROR;
+
+            if (tsk_verbose)
+                tsk_fprintf(stderr,
+                    "Error walking file %" PRIuINUM
+                    " Attribute: %i", fs_file->meta->addr, i);
+
+            /* Ignore these errors */
+            tsk_error_reset();
+        }
+    }
+    return TSK_WALK_CONT;
+}
+
+
+static int
+ifind_index_run_compare(const void *a_a, const void *a_b)
+{
+    const IFIND_INDEX_RUN *a = (const IFIND_INDEX_RUN *) a_a;
+    const IFIND_INDEX_RUN *b = (const IFIND_INDEX_RUN *) a_b;
+
+    if (a->start < b->start)
+        return -1;
+    else if (a->start > b->start)
+        return 1;
+    else if (a->seq < b->seq)
+        return -1;
+    else if (a->seq > b->seq)
+        return 1;
+    return 0;
+}
+
+
+static void
+ifind_index_free(TSK_FS_IFIND_INDEX * a_index)
+{
+    if (a_index == NULL)
+        return;
+    free(a_index->runs);
+    free(a_index->run_last);
+    free(a_index);
+}
+
+
+/*
+ * Fill in run_last for a sorted index.
+ * Return 1 on error
+ */
+static uint8_t
+ifind_index_finish(TSK_FS_IFIND_INDEX * a_index)
+{
+    TSK_DADDR_T last = 0;
+    size_t i;
+
+    if (a_index->cnt == 0)
+        return 0;
+
+    if ((a_index->run_last = (TSK_DADDR_T *)
+            tsk_malloc(a_index->cnt * sizeof(TSK_DADDR_T))) == NULL)
+        return 1;
+
+    for (i = 0; i < a_index->cnt; i++) {
+        TSK_DADDR_T run_end =
+            a_index->runs[i].start + a_index->runs[i].len - 1;
+        if ((i == 0) || (run_end > last))
+            last = run_end;
+        a_index->run_last[i] = last;
+    }
+    return 0;
+}
+
+
+/*
+ * Add an index to a file system, unless one was added while it was being
+ * built or loaded (in which case it is freed).
+ */
+static void
+ifind_index_install(TSK_FS_INFO * a_fs, TSK_FS_IFIND_INDEX * a_index)
+{
+    tsk_take_lock(&a_fs->ifind_index_lock);
+    if (a_fs->ifind_index == NULL) {
+        a_fs->ifind_index = a_index;
+        a_index = NULL;
+    }
+    tsk_release_lock(&a_fs->ifind_index_lock);
+
+    ifind_index_free(a_index);
+}
+
+
+/*
+ * Return the index of a file system or NULL if it has not been built
+ * or loaded.  The index is not changed once it is added, so it can be
+ * searched without the lock.
+ */
+static const TSK_FS_IFIND_INDEX *
+ifind_index_get(TSK_FS_INFO * a_fs)
+{
+    const TSK_FS_IFIND_INDEX *index;
+
+    tsk_take_lock(&a_fs->ifind_index_lock);
+    index = a_fs->ifind_index;
+    tsk_release_lock(&a_fs->ifind_index_lock);
+    return index;
+}
+
+
+/** \internal
+ * Free the data unit index of a file system.
+ * @param a_fs File system being closed
+ */
+void
+tsk_fs_ifind_index_free(TSK_FS_INFO * a_fs)
+{
+    ifind_index_free(a_fs->ifind_index);
+    a_fs->ifind_index = NULL;
+}
+
+
+/**
+ * \ingroup fslib
+ * Build an index of the data units that each file attribute uses so that
+ * tsk_fs_ifind_data(), tsk_fs_ifind_data_batch() and tsk_fs_blkstat() can
+ * find the owners of a data unit without walking every file.  The index
+ * is built from one walk of all allocated and unallocated inodes and is
+ * kept until the file system is closed.  Nothing is done if the index has
+ * already been built or loaded.
+ *
+ * @param a_fs File system to index
+ * @returns 1 on error and 0 on success
+ */
+uint8_t
+tsk_fs_ifind_index_build(TSK_FS_INFO * a_fs)
+{
+    IFIND_INDEX_BUILD data;
+
+    if ((a_fs == NULL) || (a_fs->tag != TSK_FS_INFO_TAG)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr("tsk_fs_ifind_index_build: Invalid arguments");
+        return 1;
+    }
+
+    if (ifind_index_get(a_fs))
+        return 0;
+
+    memset(&data, 0, sizeof(IFIND_INDEX_BUILD));
+    if ((data.index = (TSK_FS_IFIND_INDEX *)
+            tsk_malloc(sizeof(TSK_FS_IFIND_INDEX))) == NULL)
+        return 1;
+
+    if (a_fs->inode_walk(a_fs, a_fs->first_inum, a_fs->last_inum,
+            TSK_FS_META_FLAG_ALLOC | TSK_FS_META_FLAG_UNALLOC,
+            ifind_index_act, &data)) {
+        ifind_index_free(data.index);
+        return 1;
+    }
+
+    if (data.index->cnt)
+        qsort(data.index->runs, data.index->cnt, sizeof(IFIND_INDEX_RUN),
+            ifind_index_run_compare);
+
+    if (ifind_index_finish(data.index)) {
+        ifind_index_free(data.index);
+        return 1;
+    }
+
+    if (tsk_verbose)
+        tsk_fprintf(stderr,
+            "tsk_fs_ifind_index_build: %" PRIuSIZE " runs in %" PRIu64
+            " attributes\n", data.index->cnt, data.seq);
+
+    ifind_index_install(a_fs, data.index);
+    return 0;
+}
+
+
+/*
+ * Fill in the index file header values that identify the file system.
+ */
+static void
+ifind_index_head(TSK_FS_INFO * a_fs, IFIND_INDEX_HEAD * a_head)
+{
+    memset(a_head, 0, sizeof(IFIND_INDEX_HEAD));
+    a_head->magic = IFIND_INDEX_MAGIC;
+    a_head->version = IFIND_INDEX_VER;
+    a_head->entry_size = sizeof(IFIND_INDEX_RUN);
+    a_head->ftype = a_fs->ftype;
+    a_head->block_size = a_fs->block_size;
+    a_head->fs_id_used = (uint32_t) a_fs->fs_id_used;
+    a_head->block_count = a_fs->block_count;
+    a_head->last_inum = a_fs->last_inum;
+    a_head->offset = a_fs->offset;
+    memcpy(a_head->fs_id, a_fs->fs_id, TSK_FS_INFO_FS_ID_LEN);
+}
+
+
+static FILE *
+ifind_index_fopen(const TSK_TCHAR * a_path, int a_write)
+{
+#ifdef TSK_WIN32
+    return _wfopen(a_path, a_write ? L"wb" : L"rb");
+#else
+    return fopen(a_path, a_write ? "wb" : "rb");
+#endif
+}
+
+
+/**
+ * \ingroup fslib
+ * Save the data unit index of a file system to a file so that it can be
+ * loaded with tsk_fs_ifind_index_load() the next time that the file system
+ * is opened.  The index is built if it has not already been.
+ *
+ * @param a_fs File system
+ * @param a_path Path to index file to create
+ * @returns 1 on error and 0 on success
+ */
+uint8_t
+tsk_fs_ifind_index_save(TSK_FS_INFO * a_fs, const TSK_TCHAR * a_path)
+{
+    const TSK_FS_IFIND_INDEX *index;
+    IFIND_INDEX_HEAD head;
+    FILE *hFile;
+
+    if ((a_fs == NULL) || (a_fs->tag != TSK_FS_INFO_TAG)
+        || (a_path == NULL)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr("tsk_fs_ifind_index_save: Invalid arguments");
+        return 1;
+    }
+
+    if (tsk_fs_ifind_index_build(a_fs))
+        return 1;
+    index = ifind_index_get(a_fs);
+
+    if ((hFile = ifind_index_fopen(a_path, 1)) == NULL) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_WRITE);
+        tsk_error_set_errstr("tsk_fs_ifind_index_save: Error creating %"
+            PRIttocTSK, a_path);
+        return 1;
+    }
+
+    ifind_index_head(a_fs, &head);
+    head.runs_cnt = index->cnt;
+
+    if ((fwrite(&head, sizeof(head), 1, hFile) != 1)
+        || ((index->cnt)
+            && (fwrite(index->runs, sizeof(IFIND_INDEX_RUN), index->cnt,
+                    hFile) != index->cnt))) {
+        fclose(hFile);
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_WRITE);
+        tsk_error_set_errstr("tsk_fs_ifind_index_save: Error writing %"
+            PRIttocTSK, a_path);
+        return 1;
+    }
+
+    if (fclose(hFile)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_WRITE);
+        tsk_error_set_errstr("tsk_fs_ifind_index_save: Error writing %"
+            PRIttocTSK, a_path);
+        return 1;
+    }
+    return 0;
+}
+
+
+/**
+ * \ingroup fslib
+ * Load the data unit index of a file system from a file that was created
+ * by tsk_fs_ifind_index_save() so that it does not need to be built.  The
+ * file is verified against the file system before it is used.  Nothing is
+ * done if the index has already been built or loaded.
+ *
+ * @param a_fs File system
+ * @param a_path Path to index file to load
+ * @returns 1 on error (including an index file that is for a different file system) and 0 on success
+ */
+uint8_t
+tsk_fs_ifind_index_load(TSK_FS_INFO * a_fs, const TSK_TCHAR * a_path)
+{
+    TSK_FS_IFIND_INDEX *index;
+    IFIND_INDEX_HEAD head, head_exp;
+    FILE *hFile;
+    size_t i;
+
+    if ((a_fs == NULL) || (a_fs->tag != TSK_FS_INFO_TAG)
+        || (a_path == NULL)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr("tsk_fs_ifind_index_load: Invalid arguments");
+        return 1;
+    }
+
+    if (ifind_index_get(a_fs))
+        return 0;
+
+    if ((hFile = ifind_index_fopen(a_path, 0)) == NULL) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr("tsk_fs_ifind_index_load: Error opening %"
+            PRIttocTSK, a_path);
+        return 1;
+    }
+
+    ifind_index_head(a_fs, &head_exp);
+    if ((fread(&head, sizeof(head), 1, hFile) != 1)
+        || (memcmp(&head, &head_exp, offsetof(IFIND_INDEX_HEAD,
+                    runs_cnt)) != 0)
+        || (head.runs_cnt > SIZE_MAX / sizeof(IFIND_INDEX_RUN))) {
+        fclose(hFile);
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr
+            ("tsk_fs_ifind_index_load: %" PRIttocTSK
+            " is not an index file for this file system", a_path);
+        return 1;
+    }
+
+    if ((index = (TSK_FS_IFIND_INDEX *)
+            tsk_malloc(sizeof(TSK_FS_IFIND_INDEX))) == NULL) {
+        fclose(hFile);
+        return 1;
+    }
+    index->cnt = (size_t) head.runs_cnt;
+
+    if (index->cnt) {
+        if ((index->runs = (IFIND_INDEX_RUN *)
+                tsk_malloc(index->cnt * sizeof(IFIND_INDEX_RUN))) == NULL) {
+            fclose(hFile);
+            ifind_index_free(index);
+            return 1;
+        }
+        if (fread(index->runs, sizeof(IFIND_INDEX_RUN), index->cnt,
+                hFile) != index->cnt) {
+            fclose(hFile);
+            ifind_index_free(index);
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_FS_READ);
+            tsk_error_set_errstr("tsk_fs_ifind_index_load: Error reading %"
+                PRIttocTSK, a_path);
+            return 1;
+        }
+    }
+    fclose(hFile);
+
+    /* sanity check the runs so that a damaged file cannot give
+     * addresses outside of the file system or break the search */
+    for (i = 0; i < index->cnt; i++) {
+        const IFIND_INDEX_RUN *run = &index->runs[i];
+        if ((run->len == 0) || (run->start > a_fs->last_block)
+            || (run->len - 1 > a_fs->last_block - run->start)
+            || (run->inum > a_fs->last_inum)
+            || ((i > 0) && (ifind_index_run_compare(&index->runs[i - 1],
+                        run) > 0))) {
+            ifind_index_free(index);
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_FS_ARG);
+            tsk_error_set_errstr("tsk_fs_ifind_index_load: %" PRIttocTSK
+                " is corrupt", a_path);
+            return 1;
+        }
+    }
+
+    if (ifind_index_finish(index)) {
+        ifind_index_free(index);
+        return 1;
+    }
+
+    ifind_index_install(a_fs, index);
+    return 0;
+}
+
+
+static int
+ifind_index_hit_compare(const void *a_a, const void *a_b)
+{
+    const IFIND_INDEX_RUN *a = *(const IFIND_INDEX_RUN **) a_a;
+    const IFIND_INDEX_RUN *b = *(const IFIND_INDEX_RUN **) a_b;
+
+    if (a->seq < b->seq)
+        return -1;
+    else if (a->seq > b->seq)
+        return 1;
+    else if (a->offset < b->offset)
+        return -1;
+    else if (a->offset > b->offset)
+        return 1;
+    return 0;
+}
+
+
+/*
+ * Call the action for each attribute that uses a data unit, in the order
+ * that the inode walk finds them (once per attribute, with the first
+ * offset in the attribute).
+ *
+ * @param a_hits Buffer that is grown as needed for the matching runs
+ * @param a_hits_alloc Number of entries allocated in a_hits
+ * @returns -1 on error, 1 if the action asked to stop, and 0 otherwise
+ */
+static int
+ifind_index_lookup(TSK_FS_INFO * a_fs, const TSK_FS_IFIND_INDEX * a_index,
+    TSK_DADDR_T a_addr, TSK_FS_IFIND_FLAG_ENUM a_flags,
+    const IFIND_INDEX_RUN *** a_hits, size_t * a_hits_alloc,
+    TSK_FS_IFIND_DATA_CB a_action, void *a_ptr)
+{
+    size_t lo = 0, hi = a_index->cnt, i, hits_cnt = 0;
+
+    /* find the first run that starts after a_addr */
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (a_index->runs[mid].start <= a_addr)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    /* every run before it that ends at or after a_addr covers it */
+    for (i = lo; i > 0 && a_index->run_last[i - 1] >= a_addr; i--) {
+        const IFIND_INDEX_RUN *run = &a_index->runs[i - 1];
+        if (run->start + run->len - 1 < a_addr)
+            continue;
+
+        if (hits_cnt == *a_hits_alloc) {
+            size_t new_alloc = *a_hits_alloc ? *a_hits_alloc * 2 : 16;
+            const IFIND_INDEX_RUN **tmp;
+            if ((tmp = (const IFIND_INDEX_RUN **) tsk_realloc((void *)
+                        *a_hits,
+                        new_alloc * sizeof(IFIND_INDEX_RUN *))) == NULL)
+                return -1;
+            *a_hits = tmp;
+            *a_hits_alloc = new_alloc;
+        }
+        (*a_hits)[hits_cnt++] = run;
+    }
+
+    if (hits_cnt > 1)
+        qsort((void *) *a_hits, hits_cnt, sizeof(IFIND_INDEX_RUN *),
+            ifind_index_hit_compare);
+
+    for (i = 0; i < hits_cnt; i++) {
+        const IFIND_INDEX_RUN *run = (*a_hits)[i];
+        TSK_FS_IFIND_DATA_HIT hit;
+        TSK_WALK_RET_ENUM retval;
+
+        // only report each attribute once
+        if ((i > 0) && ((*a_hits)[i - 1]->seq == run->seq))
+            continue;
+
+        hit.addr = a_addr;
+        hit.inum = run->inum;
+        hit.type = (TSK_FS_ATTR_TYPE_ENUM) run->type;
+        hit.id = run->id;
+        hit.offset = run->offset +
+            (TSK_OFF_T) (a_addr - run->start) * a_fs->block_size;
+
+        retval = a_action(a_fs, &hit, a_ptr);
+        if (retval == TSK_WALK_ERROR)
+            return -1;
+        else if (retval == TSK_WALK_STOP)
+            return 1;
+
+        if ((a_flags & TSK_FS_IFIND_ALL) == 0)
+            break;
+    }
+    return 0;
+}
+
+
+/**
+ * \ingroup fslib
+ * Find the files that use each of a list of data units.  The action is
+ * called for each attribute that uses a data unit, in the order that the
+ * data units are given.  For each data unit, the attributes are given in
+ * the order that tsk_fs_ifind_data() would find them and only the first
+ * one is given unless TSK_FS_IFIND_ALL is set.  Data units that are not
+ * used by any file are skipped.  The data unit index is built with
+ * tsk_fs_ifind_index_build() if it has not been built or loaded.
+ *
+ * @param a_fs File system
+ * @param a_flags TSK_FS_IFIND_ALL to get all of the attributes that use a data unit
+ * @param a_addrs Data unit addresses to look up
+ * @param a_addrs_cnt Number of addresses in a_addrs
+ * @param a_action Callback to call for each owner
+ * @param a_ptr Pointer to pass to the callback
+ * @returns 1 on error and 0 on success
+ */
+uint8_t
+tsk_fs_ifind_data_batch(TSK_FS_INFO * a_fs,
+    TSK_FS_IFIND_FLAG_ENUM a_flags, const TSK_DADDR_T * a_addrs,
+    size_t a_addrs_cnt, TSK_FS_IFIND_DATA_CB a_action, void *a_ptr)
+{
+    const TSK_FS_IFIND_INDEX *index;
+    const IFIND_INDEX_RUN **hits = NULL;
+    size_t hits_alloc = 0;
+    size_t i;
+
+    if ((a_fs == NULL) || (a_fs->tag != TSK_FS_INFO_TAG)
+        || ((a_addrs == NULL) && (a_addrs_cnt))
+        || (a_action == NULL)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr("tsk_fs_ifind_data_batch: Invalid arguments");
+        return 1;
+    }
+
+    if (tsk_fs_ifind_index_build(a_fs))
+        return 1;
+    index = ifind_index_get(a_fs);
+
+    for (i = 0; i < a_addrs_cnt; i++) {
+        int retval = ifind_index_lookup(a_fs, index, a_addrs[i], a_flags,
+            &hits, &hits_alloc, a_action, a_ptr);
+        if (retval == -1) {
+            free((void *) hits);
+            return 1;
+        }
+        else if (retval == 1) {
+            break;
+        }
+    }
+    free((void *) hits);
+    return 0;
+}
+
+
+/*
+ * Print an owner of a data unit the way that ifind -d does
+ */
+static TSK_WALK_RET_ENUM
+ifind_data_print_act(TSK_FS_INFO * a_fs, const TSK_FS_IFIND_DATA_HIT * a_hit,
+    void *a_ptr)
+{
+    uint8_t *found = (uint8_t *) a_ptr;
+
+    if (TSK_FS_TYPE_ISNTFS(a_fs->ftype))
+        tsk_printf("%" PRIuINUM "-%" PRIu32 "-%" PRIu16 "\n",
+            a_hit->inum, (uint32_t) a_hit->type, a_hit->id);
+    else
+        tsk_printf("%" PRIuINUM "\n", a_hit->inum);
+    *found = 1;
+    return TSK_WALK_CONT;
+}
+
+
+/** \internal
+ * Print the files that use a data unit if the data unit index has been
+ * built or loaded.  This is used by tsk_fs_blkstat().
+ *
+ * @param a_fs File system
+ * @param a_addr Data unit address
+ * @returns 1 on error and 0 on success (including if there is no index)
+ */
+uint8_t
+tsk_fs_ifind_index_print(TSK_FS_INFO * a_fs, TSK_DADDR_T a_addr)
+{
+    const TSK_FS_IFIND_INDEX *index;
+    const IFIND_INDEX_RUN **hits = NULL;
+    size_t hits_alloc = 0;
+    uint8_t found = 0;
+
+    if ((index = ifind_index_get(a_fs)) == NULL)
+        return 0;
+
+    tsk_printf("Used By:\n");
+    if (ifind_index_lookup(a_fs, index, a_addr, TSK_FS_IFIND_ALL, &hits,
+            &hits_alloc, ifind_data_print_act, &found) == -1) {
+        free((void *) hits);
+        return 1;
+    }
+    free((void *) hits);
+    if (!found)
+        tsk_printf("None\n");
+    return 0;
+}
+
+
 /* 
- * Find the inode that has allocated block blk
+ * Find the inode that has allocated block blk.  The data unit index is
+ * used if it has been built or loaded, otherwise every file is walked.
  * Return 1 on error, 0 if no error */
 uint8_t
 tsk_fs_ifind_data(TSK_FS_INFO * fs, TSK_FS_IFIND_FLAG_ENUM lclflags,
     TSK_DADDR_T blk)
 {
     IFIND_DATA_DATA data;
+    const TSK_FS_IFIND_INDEX *index;
 
     memset(&data, 0, sizeof(IFIND_DATA_DATA));
     data.flags = lclflags;
     data.block = blk;
 
-    if (fs->inode_walk(fs, fs->first_inum, fs->last_inum,
+    if ((index = ifind_index_get(fs)) != NULL) {
+        const IFIND_INDEX_RUN **hits = NULL;
+        size_t hits_alloc = 0;
+
+        if (ifind_index_lookup(fs, index, blk, lclflags, &hits,
+                &hits_alloc, ifind_data_print_act, &data.found) == -1) {
+            free((void *) hits);
+            return 1;
+        }
+        free((void *) hits);
+    }
+    else if (fs->inode_walk(fs, fs->first_inum, fs->last_inum,
             TSK_FS_META_FLAG_ALLOC | TSK_FS_META_FLAG_UNALLOC,
             ifind_data_act, &data)) {
         return 1;
@@ -67,19 +67,261 @@
 #include <ctype.h>
 
 
-/* free all memory used by inode linked list */
+/* free all memory used by the inode array and its indexes */
 static void
 iso9660_inode_list_free(TSK_FS_INFO * fs)
 {
     ISO_INFO *iso = (ISO_INFO *) fs;
+
+    free(iso->in_list);
+    iso->in_list = NULL;
+    iso->in_cnt = 0;
+    iso->in_alloc = 0;
+
+    free(iso->in_hash);
+    iso->in_hash = NULL;
+    iso->in_hash_size = 0;
+    iso->in_hash_cnt = 0;
+
+    free(iso->in_by_dentry);
+    iso->in_by_dentry = NULL;
+    free(iso->in_by_extent);
+    iso->in_by_extent = NULL;
+    free(iso->in_ext_last);
+    iso->in_ext_last = NULL;
+}
+
+
+/**
+ * Make sure that there is room for one more entry at the end of the
+ * inode array.
+ * @returns 1 on error
+ */
+static uint8_t
+iso9660_inode_reserve(ISO_INFO * iso)
+{
     iso9660_inode_node *tmp;
+    size_t new_alloc;
+
+    if (iso->in_cnt < iso->in_alloc)
+        return 0;
+
+    new_alloc = iso->in_alloc ? iso->in_alloc * 2 : 256;
+    if ((tmp = (iso9660_inode_node *) tsk_realloc(iso->in_list,
+                new_alloc * sizeof(iso9660_inode_node))) == NULL)
+        return 1;
+    iso->in_list = tmp;
+    iso->in_alloc = new_alloc;
+    return 0;
+}
+
 
-    while (iso->in_list) {
-        tmp = iso->in_list;
-        iso->in_list = iso->in_list->next;
-        free(tmp);
+/* slot in in_hash to start looking for an extent offset and size */
+static size_t
+iso9660_inode_hash_slot(ISO_INFO * iso, TSK_OFF_T a_offset, int a_size)
+{
+    uint64_t h = ((uint64_t) a_offset ^ ((uint64_t) a_size << 40)) *
+        0x9E3779B97F4A7C15ULL;
+    return (size_t) (h >> 32) & (iso->in_hash_size - 1);
+}
+
+/**
+ * Find the first entry in the inode array that has the given extent
+ * offset and (non-zero) size.
+ * @returns entry or NULL if none was found
+ */
+static iso9660_inode_node *
+iso9660_inode_hash_find(ISO_INFO * iso, TSK_OFF_T a_offset, int a_size)
+{
+    size_t slot;
+
+    if (iso->in_hash_size == 0)
+        return NULL;
+
+    for (slot = iso9660_inode_hash_slot(iso, a_offset, a_size);
+        iso->in_hash[slot];
+        slot = (slot + 1) & (iso->in_hash_size - 1)) {
+        iso9660_inode_node *in_node = &iso->in_list[iso->in_hash[slot] - 1];
+        if ((in_node->offset == a_offset) && (in_node->size == a_size))
+            return in_node;
     }
-    iso->in_list = NULL;
+    return NULL;
+}
+
+/* add an in_list index to in_hash (the table must have a free slot) */
+static void
+iso9660_inode_hash_insert(ISO_INFO * iso, size_t a_idx)
+{
+    iso9660_inode_node *in_node = &iso->in_list[a_idx];
+    size_t slot;
+
+    /* only the first entry for an extent is kept */
+    if ((in_node->size == 0)
+        || (iso9660_inode_hash_find(iso, in_node->offset, in_node->size)))
+        return;
+
+    slot = iso9660_inode_hash_slot(iso, in_node->offset, in_node->size);
+    while (iso->in_hash[slot])
+        slot = (slot + 1) & (iso->in_hash_size - 1);
+    iso->in_hash[slot] = a_idx + 1;
+    iso->in_hash_cnt++;
+}
+
+/**
+ * Add an entry of the inode array to the duplicate detection table,
+ * growing the table if needed.
+ * @returns 1 on error
+ */
+static uint8_t
+iso9660_inode_hash_add(ISO_INFO * iso, size_t a_idx)
+{
+    if ((iso->in_hash_cnt + 1) * 2 > iso->in_hash_size) {
+        size_t new_size = iso->in_hash_size ? iso->in_hash_size * 2 : 1024;
+        size_t *tmp;
+        size_t i;
+
+        if ((tmp = (size_t *) tsk_malloc(new_size * sizeof(size_t))) ==
+            NULL)
+            return 1;
+        free(iso->in_hash);
+        iso->in_hash = tmp;
+        iso->in_hash_size = new_size;
+        iso->in_hash_cnt = 0;
+        for (i = 0; i < a_idx; i++)
+            iso9660_inode_hash_insert(iso, i);
+    }
+    iso9660_inode_hash_insert(iso, a_idx);
+    return 0;
+}
+
+
+static int
+iso9660_inode_idx_compare(const void *a, const void *b)
+{
+    const iso9660_inode_idx *ia = (const iso9660_inode_idx *) a;
+    const iso9660_inode_idx *ib = (const iso9660_inode_idx *) b;
+
+    if (ia->key != ib->key)
+        return (ia->key < ib->key) ? -1 : 1;
+    if (ia->idx != ib->idx)
+        return (ia->idx < ib->idx) ? -1 : 1;
+    return 0;
+}
+
+/* return the first entry in a sorted index with a key that is >= a_key */
+static size_t
+iso9660_inode_idx_lower(const iso9660_inode_idx * a_index, size_t a_cnt,
+    TSK_OFF_T a_key)
+{
+    size_t lo = 0;
+    size_t hi = a_cnt;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (a_index[mid].key < a_key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/**
+ * Build the sorted indexes of the inode array once all inodes are loaded.
+ * @returns 1 on error
+ */
+static uint8_t
+iso9660_inode_index_build(ISO_INFO * iso)
+{
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) & iso->fs_info;
+    size_t i;
+    TSK_DADDR_T max_last = 0;
+
+    free(iso->in_hash);
+    iso->in_hash = NULL;
+    iso->in_hash_size = 0;
+    iso->in_hash_cnt = 0;
+
+    if (iso->in_cnt == 0)
+        return 0;
+
+    if (((iso->in_by_dentry = (iso9660_inode_idx *)
+                tsk_malloc(iso->in_cnt * sizeof(iso9660_inode_idx))) ==
+            NULL)
+        || ((iso->in_by_extent = (iso9660_inode_idx *)
+                tsk_malloc(iso->in_cnt * sizeof(iso9660_inode_idx))) ==
+            NULL)
+        || ((iso->in_ext_last = (TSK_DADDR_T *)
+                tsk_malloc(iso->in_cnt * sizeof(TSK_DADDR_T))) == NULL))
+        return 1;
+
+    for (i = 0; i < iso->in_cnt; i++) {
+        iso->in_by_dentry[i].key = iso->in_list[i].dentry_offset;
+        iso->in_by_dentry[i].idx = i;
+        iso->in_by_extent[i].key = iso->in_list[i].offset;
+        iso->in_by_extent[i].idx = i;
+    }
+    qsort(iso->in_by_dentry, iso->in_cnt, sizeof(iso9660_inode_idx),
+        iso9660_inode_idx_compare);
+    qsort(iso->in_by_extent, iso->in_cnt, sizeof(iso9660_inode_idx),
+        iso9660_inode_idx_compare);
+
+    for (i = 0; i < iso->in_cnt; i++) {
+        iso9660_inode_node *in_node =
+            &iso->in_list[iso->in_by_extent[i].idx];
+        TSK_DADDR_T first_block = in_node->offset / fs->block_size;
+        TSK_DADDR_T file_size =
+            tsk_getu32(fs->endian, in_node->inode.dr.data_len_m);
+        TSK_DADDR_T last_block =
+            first_block + (file_size / fs->block_size);
+        if (file_size % fs->block_size)
+            last_block++;
+
+        if (last_block > max_last)
+            max_last = last_block;
+        iso->in_ext_last[i] = max_last;
+    }
+    return 0;
+}
+
+/**
+ * Find the first inode (in inum order) whose directory entry is at the
+ * given byte offset.
+ * @returns entry or NULL if none was found
+ */
+iso9660_inode_node *
+iso9660_inode_find_dentry(ISO_INFO * iso, TSK_OFF_T a_dentry_offset)
+{
+    size_t i;
+
+    if (iso->in_by_dentry == NULL)
+        return NULL;
+
+    i = iso9660_inode_idx_lower(iso->in_by_dentry, iso->in_cnt,
+        a_dentry_offset);
+    if ((i < iso->in_cnt) && (iso->in_by_dentry[i].key == a_dentry_offset))
+        return &iso->in_list[iso->in_by_dentry[i].idx];
+    return NULL;
+}
+
+/**
+ * Find the first inode (in inum order) whose extent starts at the
+ * given byte offset.
+ * @returns entry or NULL if none was found
+ */
+iso9660_inode_node *
+iso9660_inode_find_extent(ISO_INFO * iso, TSK_OFF_T a_offset)
+{
+    size_t i;
+
+    if (iso->in_by_extent == NULL)
+        return NULL;
+
+    i = iso9660_inode_idx_lower(iso->in_by_extent, iso->in_cnt,
+        a_offset);
+    if ((i < iso->in_cnt) && (iso->in_by_extent[i].key == a_offset))
+        return &iso->in_list[iso->in_by_extent[i].idx];
+    return NULL;
 }
 
 
@@ -141,7 +383,7 @@ parse_susp(TSK_FS_INFO * fs, char *buf, int count, FILE * hFile)
                 char *buf2;
 
                 off =
-                    tsk_getu32(fs->endian,
+                    (TSK_OFF_T) tsk_getu32(fs->endian,
                     ce->blk_m) * fs->block_size + tsk_getu32(fs->endian,
                     ce->offset_m);
                 buf2 =
@@ -409,7 +651,7 @@ iso9660_load_inodes_dir(TSK_FS_INFO * fs, TSK_OFF_T a_offs, int count,
         // @@@@ We  need to add more checks when reading from buf to make sure b_off is still in the buffer
         /* process the directory entries */
         for (b_offs = 0; b_offs < ISO9660_SSIZE_B;) {
-            iso9660_inode_node *in_node;
+            iso9660_inode_node *in_node, *tmp;
             iso9660_dentry *dentry;
 
             dentry = (iso9660_dentry *) & buf[b_offs];
@@ -428,12 +670,12 @@ iso9660_load_inodes_dir(TSK_FS_INFO * fs, TSK_OFF_T a_offs, int count,
                 continue;
             }
 
-            // allocate a node for this entry
-            in_node = (iso9660_inode_node *)
-                tsk_malloc(sizeof(iso9660_inode_node));
-            if (in_node == NULL) {
+            // use the next slot in the inode array for this entry
+            if (iso9660_inode_reserve(iso)) {
                 return -1;
             }
+            in_node = &iso->in_list[iso->in_cnt];
+            memset(in_node, 0, sizeof(iso9660_inode_node));
 
             // the first entry should have no name and is for the current directory
             if ((i == 0) && (b_offs == 0)) {
@@ -461,7 +703,6 @@ iso9660_load_inodes_dir(TSK_FS_INFO * fs, TSK_OFF_T a_offs, int count,
                  * they duplicate the other entires and the dent_walk code will rely on the offset
                  * for the entry in the parent directory. */
                 if (count != 0) {
-                    free(in_node);
                     in_node = NULL;
                     b_offs += dentry->entry_len;
                     dentry = (iso9660_dentry *) & buf[b_offs];
@@ -549,7 +790,8 @@ iso9660_load_inodes_dir(TSK_FS_INFO * fs, TSK_OFF_T a_offs, int count,
 
             in_node->inode.ea = NULL;
             in_node->offset =
-                tsk_getu32(fs->endian, dentry->ext_loc_m) * fs->block_size;
+                (TSK_OFF_T) tsk_getu32(fs->endian,
+                dentry->ext_loc_m) * fs->block_size;
             in_node->ea_size = dentry->ext_len;
             in_node->dentry_offset = s_offs + b_offs;
 
@@ -589,52 +831,37 @@ iso9660_load_inodes_dir(TSK_FS_INFO * fs, TSK_OFF_T a_offs, int count,
                 in_node->inode.susp_len = 0;
             }
 
-            /* add inode to the list */
-            if (iso->in_list) {
-                iso9660_inode_node *tmp, *prev_tmp;
-
-                for (tmp = iso->in_list; tmp; tmp = tmp->next) {
-                    /* When processing the "first" volume descriptor, all entries get added to the list.
-                     * for the later ones, we skip duplicate ones that overlap with entries from a
-                     * previous volume descriptor. */
-                    if ((in_node->offset == tmp->offset)
-                        && (in_node->size == tmp->size)
-                        && (in_node->size) && (is_first == 0)) {
-                        if (in_node->inode.rr) {
-                            if (tmp->inode.rr == NULL) {
-                                tmp->inode.rr = in_node->inode.rr;
-                                tmp->inode.susp_off =
-                                    in_node->inode.susp_off;
-                                tmp->inode.susp_len =
-                                    in_node->inode.susp_len;
-                                in_node->inode.rr = NULL;
-                            }
-                            else {
-                                free(in_node->inode.rr);
-                            }
-                        }
-
-                        if (tsk_verbose)
-                            tsk_fprintf(stderr,
-                                "iso9660_load_inodes_dir: Removing duplicate entry for: %s\n",
-                                in_node->inode.fn);
-                        free(in_node);
-                        in_node = NULL;
-                        count--;
-                        break;
+            /* add inode to the list
+             * When processing the "first" volume descriptor, all entries get added to the list.
+             * for the later ones, we skip duplicate ones that overlap with entries from a
+             * previous volume descriptor. */
+            if ((in_node->size) && (is_first == 0)
+                && ((tmp = iso9660_inode_hash_find(iso, in_node->offset,
+                            in_node->size)) != NULL)) {
+                if (in_node->inode.rr) {
+                    if (tmp->inode.rr == NULL) {
+                        tmp->inode.rr = in_node->inode.rr;
+                        tmp->inode.susp_off = in_node->inode.susp_off;
+                        tmp->inode.susp_len = in_node->inode.susp_len;
+                        in_node->inode.rr = NULL;
+                    }
+                    else {
+                        free(in_node->inode.rr);
                     }
-                    prev_tmp = tmp;
                 }
 
-                // add it to the end (if we didn't get rid of it above)
-                if (in_node) {
-                    prev_tmp->next = in_node;
-                    in_node->next = NULL;
-                }
+                if (tsk_verbose)
+                    tsk_fprintf(stderr,
+                        "iso9660_load_inodes_dir: Removing duplicate entry for: %s\n",
+                        in_node->inode.fn);
+                in_node = NULL;
+                count--;
             }
             else {
-                iso->in_list = in_node;
-                in_node->next = NULL;
+                if (iso9660_inode_hash_add(iso, iso->in_cnt)) {
+                    return -1;
+                }
+                iso->in_cnt++;
             }
 
             // skip two entries if this was the root directory (the . and ..).
@@ -670,8 +897,8 @@ iso9660_load_inodes_pt_joliet(TSK_FS_INFO * fs, iso9660_svd * svd,
 
     // get the location of the path table
     pt_offs =
-        (TSK_OFF_T) (tsk_getu32(fs->endian,
-            svd->pt_loc_m) * fs->block_size);
+        (TSK_OFF_T) tsk_getu32(fs->endian,
+        svd->pt_loc_m) * fs->block_size;
     pt_len = tsk_getu32(fs->endian, svd->pt_size_m);
 
     while (pt_len > 0) {
@@ -750,8 +977,8 @@ iso9660_load_inodes_pt_joliet(TSK_FS_INFO * fs, iso9660_svd * svd,
         }
 
         extent =
-            (TSK_OFF_T) (tsk_getu32(fs->endian,
-                dir.ext_loc) * fs->block_size);
+            (TSK_OFF_T) tsk_getu32(fs->endian,
+            dir.ext_loc) * fs->block_size;
 
         // process the directory contents
         count =
@@ -792,7 +1019,6 @@ iso9660_load_inodes_pt(ISO_INFO * iso)
 
     /* initialize in case repeatedly called */
     iso9660_inode_list_free(fs);
-    iso->in_list = NULL;
 
     /* The secondary volume descriptor table will contain the
      * longer / unicode files, so we process it first to give them
@@ -818,8 +1044,8 @@ iso9660_load_inodes_pt(ISO_INFO * iso)
     for (p = iso->pvd; p != NULL; p = p->next) {
 
         pt_offs =
-            (TSK_OFF_T) (tsk_getu32(fs->endian,
-                p->pvd.pt_loc_m) * fs->block_size);
+            (TSK_OFF_T) tsk_getu32(fs->endian,
+            p->pvd.pt_loc_m) * fs->block_size;
         pt_len = tsk_getu32(fs->endian, p->pvd.pt_size_m);
 
         while (pt_len > 0) {
@@ -864,8 +1090,8 @@ iso9660_load_inodes_pt(ISO_INFO * iso)
             }
 
             extent =
-                (TSK_OFF_T) (tsk_getu32(fs->endian,
-                    dir.ext_loc) * fs->block_size);
+                (TSK_OFF_T) tsk_getu32(fs->endian,
+                dir.ext_loc) * fs->block_size;
 
             // process the directory contents
             count =
@@ -877,6 +1103,10 @@ iso9660_load_inodes_pt(ISO_INFO * iso)
             }
         }
     }
+
+    if (iso9660_inode_index_build(iso)) {
+        return -1;
+    }
     return count;
 }
 
@@ -893,14 +1123,9 @@ uint8_t
 iso9660_dinode_load(ISO_INFO * iso, TSK_INUM_T inum,
     iso9660_inode * dinode)
 {
-    iso9660_inode_node *n;
-
-    n = iso->in_list;
-    while (n && (n->inum != inum))
-        n = n->next;
-
-    if (n) {
-        memcpy(dinode, &n->inode, sizeof(iso9660_inode));
+    /* the entries are stored in inum order */
+    if ((inum < iso->in_cnt) && (iso->in_list[inum].inum == inum)) {
+        memcpy(dinode, &iso->in_list[inum].inode, sizeof(iso9660_inode));
         return 0;
     }
     else {
@@ -1038,6 +1263,8 @@ iso9660_close(TSK_FS_INFO * fs)
         free(s);
     }
 
+    iso9660_inode_list_free(fs);
+
     tsk_fs_free(fs);
 }
 
@@ -1279,24 +1506,21 @@ static int
 iso9660_is_block_alloc(TSK_FS_INFO * fs, TSK_DADDR_T blk_num)
 {
     ISO_INFO *iso = (ISO_INFO *) fs;
-    iso9660_inode_node *in_node;
+    size_t i;
 
     if (tsk_verbose)
         tsk_fprintf(stderr, "iso9660_is_block_alloc: "
             " blk_num: %" PRIuDADDR "\n", blk_num);
 
-    for (in_node = iso->in_list; in_node; in_node = in_node->next) {
-        TSK_DADDR_T first_block = in_node->offset / fs->block_size;
-        TSK_DADDR_T file_size =
-            tsk_getu32(fs->endian, in_node->inode.dr.data_len_m);
-        TSK_DADDR_T last_block =
-            first_block + (file_size / fs->block_size);
-        if (file_size % fs->block_size)
-            last_block++;
+    if (iso->in_by_extent == NULL)
+        return 0;
 
-        if ((blk_num >= first_block) && (blk_num <= last_block))
-            return 1;
-    }
+    /* find the extents that start at or before the block and see if
+     * any of them run to it */
+    i = iso9660_inode_idx_lower(iso->in_by_extent, iso->in_cnt,
+        (TSK_OFF_T) (blk_num + 1) * fs->block_size);
+    if ((i > 0) && (iso->in_ext_last[i - 1] >= blk_num))
+        return 1;
 
     return 0;
 }
@@ -83,6 +83,17 @@ tsk_fs_nofs_block_getflags(TSK_FS_INFO * a_fs, TSK_DADDR_T a_addr)
     return TSK_FS_BLOCK_FLAG_ALLOC | TSK_FS_BLOCK_FLAG_CONT;
 }
 
+/** \internal
+ * All of the blocks have the same flags.
+ */
+TSK_DADDR_T
+tsk_fs_nofs_block_getflags_range(TSK_FS_INFO * a_fs, TSK_DADDR_T a_addr,
+    TSK_DADDR_T a_end, TSK_FS_BLOCK_FLAG_ENUM * a_flags)
+{
+    *a_flags = TSK_FS_BLOCK_FLAG_ALLOC | TSK_FS_BLOCK_FLAG_CONT;
+    return a_end - a_addr + 1;
+}
+
 
 /** \internal
  *
@@ -116,6 +116,102 @@ nt2nano(uint64_t ntdate)
 
 
 
+/**
+ * Verify and remove the update sequence values from a raw MFT entry.
+ * This is used by ntfs_dinode_lookup() and by the code that reads
+ * the MFT in bulk.
+ *
+ * @param a_ntfs File system that the entry is from
+ * @param a_buf Buffer with raw entry.  Must be of size NTFS_INFO.mft_rsize_b
+ *
+ * @returns Error value (TSK_COR if the entry is corrupt)
+ */
+TSK_RETVAL_ENUM
+ntfs_dinode_fixup(NTFS_INFO * a_ntfs, char *a_buf)
+{
+    int i;
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) & a_ntfs->fs_info;
+    ntfs_upd *upd;
+    uint16_t sig_seq;
+    ntfs_mft *mft;
+
+    /* The MFT entries have error and integrity checks in them
+     * called update sequences.  They must be checked and removed
+     * so that later functions can process the data as normal.
+     * They are located in the last 2 bytes of each 512-byte sector
+     *
+     * We first verify that the the 2-byte value is a give value and
+     * then replace it with what should be there
+     */
+    /* sanity check so we don't run over in the next loop */
+    mft = (ntfs_mft *) a_buf;
+    if ((tsk_getu16(fs->endian, mft->upd_cnt) > 0) &&
+        (((uint32_t) (tsk_getu16(fs->endian,
+                        mft->upd_cnt) - 1) * a_ntfs->ssize_b) >
+            a_ntfs->mft_rsize_b)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
+        tsk_error_set_errstr
+            ("dinode_lookup: More Update Sequence Entries than MFT size");
+        return TSK_COR;
+    }
+    if (tsk_getu16(fs->endian, mft->upd_off) > a_ntfs->mft_rsize_b) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
+        tsk_error_set_errstr
+            ("dinode_lookup: Update sequence offset larger than MFT size");
+        return TSK_COR;
+    }
+
+    /* Apply the update sequence structure template */
+    upd =
+        (ntfs_upd *) ((uintptr_t) a_buf + tsk_getu16(fs->endian,
+            mft->upd_off));
+    /* Get the sequence value that each 16-bit value should be */
+    sig_seq = tsk_getu16(fs->endian, upd->upd_val);
+    /* cycle through each sector */
+    for (i = 1; i < tsk_getu16(fs->endian, mft->upd_cnt); i++) {
+        uint8_t *new_val, *old_val;
+        /* The offset into the buffer of the value to analyze */
+        size_t offset = i * a_ntfs->ssize_b - 2;
+        /* get the current sequence value */
+        uint16_t cur_seq =
+            tsk_getu16(fs->endian, (uintptr_t) a_buf + offset);
+        if (cur_seq != sig_seq) {
+            /* get the replacement value */
+            uint16_t cur_repl =
+                tsk_getu16(fs->endian, &upd->upd_seq + (i - 1) * 2);
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_FS_GENFS);
+
+            tsk_error_set_errstr
+                ("Incorrect update sequence value in MFT entry\nSignature Value: 0x%"
+                PRIx16 " Actual Value: 0x%" PRIx16
+                " Replacement Value: 0x%" PRIx16
+                "\nThis is typically because of a corrupted entry",
+                sig_seq, cur_seq, cur_repl);
+            return TSK_COR;
+        }
+
+        new_val = &upd->upd_seq + (i - 1) * 2;
+        old_val = (uint8_t *) ((uintptr_t) a_buf + offset);
+        /*
+           if (tsk_verbose)
+           tsk_fprintf(stderr,
+           "ntfs_dinode_lookup: upd_seq %i   Replacing: %.4"
+           PRIx16 "   With: %.4" PRIx16 "\n", i,
+           tsk_getu16(fs->endian, old_val), tsk_getu16(fs->endian,
+           new_val));
+         */
+        *old_val++ = *new_val++;
+        *old_val = *new_val;
+    }
+
+    return TSK_OK;
+}
+
+
+
 /**
  * Read an MFT entry and save it in raw form in the given buffer.
  * NOTE: This will remove the update sequence integrity checks in the
@@ -132,12 +228,8 @@ ntfs_dinode_lookup(NTFS_INFO * a_ntfs, char *a_buf, TSK_INUM_T a_mftnum)
 {
     TSK_OFF_T mftaddr_b, mftaddr2_b, offset;
     size_t mftaddr_len = 0;
-    int i;
     TSK_FS_INFO *fs = (TSK_FS_INFO *) & a_ntfs->fs_info;
     TSK_FS_ATTR_RUN *data_run;
-    ntfs_upd *upd;
-    uint16_t sig_seq;
-    ntfs_mft *mft;
 
 
     /* sanity checks */
@@ -345,82 +437,158 @@ ntfs_dinode_lookup(NTFS_INFO * a_ntfs, char *a_buf, TSK_INUM_T a_mftnum)
         return 1;
     }
 #endif
-    /* The MFT entries have error and integrity checks in them
-     * called update sequences.  They must be checked and removed
-     * so that later functions can process the data as normal.
-     * They are located in the last 2 bytes of each 512-byte sector
-     *
-     * We first verify that the the 2-byte value is a give value and
-     * then replace it with what should be there
-     */
-    /* sanity check so we don't run over in the next loop */
-    mft = (ntfs_mft *) a_buf;
-    if ((tsk_getu16(fs->endian, mft->upd_cnt) > 0) &&
-        (((uint32_t) (tsk_getu16(fs->endian,
-                        mft->upd_cnt) - 1) * a_ntfs->ssize_b) >
-            a_ntfs->mft_rsize_b)) {
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
-        tsk_error_set_errstr
-            ("dinode_lookup: More Update Sequence Entries than MFT size");
-        return TSK_COR;
+    return ntfs_dinode_fixup(a_ntfs, a_buf);
+}
+
+
+
+/*
+ * Load a chunk of the $Bitmap file.  The clusters of the bitmap file in
+ * the chunk that cannot be read (or that no run covers) are marked as bad
+ * so that only the lookups that need them fail.  The caller must hold
+ * ntfs->lock.  The chunk is published by setting its buf last, so that
+ * it can be used by threads that test buf without the lock.
+ *
+ * @param ntfs File system to analyze
+ * @param a_chunk Chunk to load into
+ * @param a_idx Index of the chunk
+ * @returns 1 on error
+ */
+static uint8_t
+ntfs_bmap_load_chunk(NTFS_INFO * ntfs, NTFS_BMAP_CHUNK * a_chunk,
+    size_t a_idx)
+{
+    TSK_FS_INFO *fs = &ntfs->fs_info;
+    TSK_FS_ATTR_RUN *run;
+    TSK_DADDR_T clust_cnt = ntfs->bmap_chunk_b / fs->block_size;
+    TSK_DADDR_T first = (TSK_DADDR_T) a_idx * clust_cnt;
+    TSK_DADDR_T c;
+    size_t bad_len = (size_t) ((clust_cnt + 7) / 8);
+    uint8_t *buf, *bad;
+    size_t i;
+    int have_bad = 0;
+
+    if ((buf = (uint8_t *) tsk_malloc(ntfs->bmap_chunk_b)) == NULL) {
+        return 1;
     }
-    if (tsk_getu16(fs->endian, mft->upd_off) > a_ntfs->mft_rsize_b) {
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
-        tsk_error_set_errstr
-            ("dinode_lookup: Update sequence offset larger than MFT size");
-        return TSK_COR;
+    if ((bad = (uint8_t *) tsk_malloc(bad_len)) == NULL) {
+        free(buf);
+        return 1;
     }
+    /* bad is first used to mark the clusters that have been read (so that
+     * clusters that no run covers are bad) and is inverted at the end */
 
-    /* Apply the update sequence structure template */
-    upd =
-        (ntfs_upd *) ((uintptr_t) a_buf + tsk_getu16(fs->endian,
-            mft->upd_off));
-    /* Get the sequence value that each 16-bit value should be */
-    sig_seq = tsk_getu16(fs->endian, upd->upd_val);
-    /* cycle through each sector */
-    for (i = 1; i < tsk_getu16(fs->endian, mft->upd_cnt); i++) {
-        uint8_t *new_val, *old_val;
-        /* The offset into the buffer of the value to analyze */
-        size_t offset = i * a_ntfs->ssize_b - 2;
-        /* get the current sequence value */
-        uint16_t cur_seq =
-            tsk_getu16(fs->endian, (uintptr_t) a_buf + offset);
-        if (cur_seq != sig_seq) {
-            /* get the replacement value */
-            uint16_t cur_repl =
-                tsk_getu16(fs->endian, &upd->upd_seq + (i - 1) * 2);
-            tsk_error_reset();
-            tsk_error_set_errno(TSK_ERR_FS_GENFS);
+    for (run = ntfs->bmap; run; run = run->next) {
+        TSK_DADDR_T start, end;
+        size_t len;
+        ssize_t cnt;
 
-            tsk_error_set_errstr
-                ("Incorrect update sequence value in MFT entry\nSignature Value: 0x%"
-                PRIx16 " Actual Value: 0x%" PRIx16
-                " Replacement Value: 0x%" PRIx16
-                "\nThis is typically because of a corrupted entry",
-                sig_seq, cur_seq, cur_repl);
-            return TSK_COR;
+        /* the clusters of the bitmap file in this run and chunk */
+        if ((run->offset + run->len <= first)
+            || (run->offset >= first + clust_cnt))
+            continue;
+        start = (run->offset > first) ? run->offset : first;
+        end = (run->offset + run->len < first + clust_cnt) ?
+            run->offset + run->len : first + clust_cnt;
+
+        if (run->flags & TSK_FS_ATTR_RUN_FLAG_FILLER) {
+            continue;
+        }
+        else if (run->flags & TSK_FS_ATTR_RUN_FLAG_SPARSE) {
+            /* sparse runs are all zeros */
+            for (c = start; c < end; c++)
+                setbit(bad, c - first);
+            continue;
         }
 
-        new_val = &upd->upd_seq + (i - 1) * 2;
-        old_val = (uint8_t *) ((uintptr_t) a_buf + offset);
-        /*
-           if (tsk_verbose)
-           tsk_fprintf(stderr,
-           "ntfs_dinode_lookup: upd_seq %i   Replacing: %.4"
-           PRIx16 "   With: %.4" PRIx16 "\n", i,
-           tsk_getu16(fs->endian, old_val), tsk_getu16(fs->endian,
-           new_val));
-         */
-        *old_val++ = *new_val++;
-        *old_val = *new_val;
+        len = (size_t) ((end - start) * fs->block_size);
+        cnt = tsk_fs_read(fs,
+            (run->addr + start - run->offset) * fs->block_size,
+            (char *) &buf[(start - first) * fs->block_size], len);
+        if (cnt == (ssize_t) len) {
+            for (c = start; c < end; c++)
+                setbit(bad, c - first);
+            continue;
+        }
+
+        /* read one cluster at a time to find the ones that are bad */
+        for (c = start; c < end; c++) {
+            cnt = tsk_fs_read_block(fs, run->addr + c - run->offset,
+                (char *) &buf[(c - first) * fs->block_size],
+                fs->block_size);
+            if (cnt == (ssize_t) fs->block_size) {
+                setbit(bad, c - first);
+            }
+            else {
+                memset(&buf[(c - first) * fs->block_size], 0,
+                    fs->block_size);
+                if (tsk_verbose)
+                    tsk_fprintf(stderr,
+                        "ntfs_bmap_load_chunk: Error reading bitmap cluster at %"
+                        PRIuDADDR "\n", run->addr + c - run->offset);
+            }
+        }
     }
+    tsk_error_reset();
 
-    return TSK_OK;
+    for (c = 0; c < clust_cnt; c++) {
+        if (!isset(bad, c)) {
+            have_bad = 1;
+            break;
+        }
+    }
+    for (i = 0; i < bad_len; i++)
+        bad[i] = ~bad[i];
+    if (have_bad == 0) {
+        free(bad);
+        bad = NULL;
+    }
+
+    a_chunk->bad = bad;
+    tsk_atomic_store_ptr(&a_chunk->buf, buf);
+    return 0;
 }
 
+/*
+ * Get the chunk of the $Bitmap file that has a cluster's allocation
+ * status (and load it if needed).
+ *
+ * @param ntfs File system to analyze
+ * @param addr Cluster address (must be less than bmap_len)
+ * @returns NULL on error
+ */
+static const NTFS_BMAP_CHUNK *
+ntfs_bmap_get_chunk(NTFS_INFO * ntfs, TSK_DADDR_T addr)
+{
+    size_t idx = (size_t) (addr / ((TSK_DADDR_T) ntfs->bmap_chunk_b * 8));
+    NTFS_BMAP_CHUNK *chunk = &ntfs->bmap_chunks[idx];
+
+    /* a loaded chunk is never changed, so only loading needs the lock */
+    if (tsk_atomic_load_ptr(&chunk->buf) != NULL)
+        return chunk;
+
+    tsk_take_lock(&ntfs->lock);
+    if ((chunk->buf == NULL) && (ntfs_bmap_load_chunk(ntfs, chunk, idx))) {
+        tsk_release_lock(&ntfs->lock);
+        return NULL;
+    }
+    tsk_release_lock(&ntfs->lock);
+    return chunk;
+}
 
+/*
+ * Test if the $Bitmap cluster that has a cluster's allocation status
+ * could not be read.
+ */
+static int
+ntfs_bmap_isbad(NTFS_INFO * ntfs, const NTFS_BMAP_CHUNK * a_chunk,
+    TSK_DADDR_T addr)
+{
+    if (a_chunk->bad == NULL)
+        return 0;
+    return isset(a_chunk->bad, (addr / 8 % ntfs->bmap_chunk_b) /
+        ntfs->fs_info.block_size) ? 1 : 0;
+}
 
 /*
  * given a cluster, return the allocation status or
@@ -429,10 +597,7 @@ ntfs_dinode_lookup(NTFS_INFO * a_ntfs, char *a_buf, TSK_INUM_T a_mftnum)
 static int
 is_clustalloc(NTFS_INFO * ntfs, TSK_DADDR_T addr)
 {
-    int bits_p_clust, b;
-    TSK_DADDR_T base;
-    int8_t ret;
-    bits_p_clust = 8 * ntfs->fs_info.block_size;
+    const NTFS_BMAP_CHUNK *chunk;
 
     /* While we are loading the MFT, assume that everything
      * is allocated.  This should only be needed when we are
@@ -441,7 +606,7 @@ is_clustalloc(NTFS_INFO * ntfs, TSK_DADDR_T addr)
     if (ntfs->loading_the_MFT == 1) {
         return 1;
     }
-    else if (ntfs->bmap == NULL) {
+    else if (ntfs->bmap_chunks == NULL) {
         tsk_error_reset();
         tsk_error_set_errno(TSK_ERR_FS_ARG);
 
@@ -457,71 +622,93 @@ is_clustalloc(NTFS_INFO * ntfs, TSK_DADDR_T addr)
         tsk_error_set_errstr("is_clustalloc: cluster too large");
         return -1;
     }
+    else if (addr >= ntfs->bmap_len) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_BLK_NUM);
+        tsk_error_set_errstr
+            ("is_clustalloc: cluster not found in bitmap: %" PRIuDADDR
+            "", addr);
+        return -1;
+    }
 
-    /* identify the base cluster in the bitmap file */
-    base = addr / bits_p_clust;
-    b = (int) (addr % bits_p_clust);
+    if ((chunk = ntfs_bmap_get_chunk(ntfs, addr)) == NULL) {
+        return -1;
+    }
+    if (ntfs_bmap_isbad(ntfs, chunk, addr)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_READ);
+        tsk_error_set_errstr
+            ("is_clustalloc: Error reading bitmap for cluster %" PRIuDADDR,
+            addr);
+        return -1;
+    }
 
-    tsk_take_lock(&ntfs->lock);
+    /* identify if the cluster is allocated or not */
+    return (isset(chunk->buf, addr % ((TSK_DADDR_T) ntfs->bmap_chunk_b *
+                8))) ? 1 : 0;
+}
 
-    /* is this the same as in the cached buffer? */
-    if (base != ntfs->bmap_buf_off) {
-        TSK_DADDR_T c = base;
-        TSK_FS_ATTR_RUN *run;
-        TSK_DADDR_T fsaddr = 0;
-        ssize_t cnt;
 
-        /* get the file system address of the bitmap cluster */
-        for (run = ntfs->bmap; run; run = run->next) {
-            if (run->len <= c) {
-                c -= run->len;
-            }
-            else {
-                fsaddr = run->addr + c;
-                break;
-            }
-        }
+/*
+ * Find the end of the run of clusters that have the same allocation
+ * status as a given cluster.  Runs of 64 clusters are skipped at
+ * a time.  The run ends at the end of the loaded chunk of the bitmap
+ * and, if the chunk has clusters that could not be read, at the end of
+ * the bitmap cluster.
+ *
+ * @param ntfs File system to analyze
+ * @param a_addr Cluster to start at (is_clustalloc() must have returned 0 or 1 for it)
+ * @param a_end Last cluster to consider
+ * @returns Address of the last cluster in the run (or a_end)
+ */
+static TSK_DADDR_T
+ntfs_bmap_run_end(NTFS_INFO * ntfs, TSK_DADDR_T a_addr, TSK_DADDR_T a_end)
+{
+    const NTFS_BMAP_CHUNK *chunk;
+    const uint8_t *buf;
+    TSK_DADDR_T chunk_bits = (TSK_DADDR_T) ntfs->bmap_chunk_b * 8;
+    TSK_DADDR_T base = a_addr - a_addr % chunk_bits;
+    TSK_DADDR_T addr, last;
+    uint64_t fill;
+    int alloc;
+
+    if ((chunk = ntfs_bmap_get_chunk(ntfs, a_addr)) == NULL) {
+        tsk_error_reset();
+        return a_addr;
+    }
+    buf = chunk->buf;
 
-        if (fsaddr == 0) {
-            tsk_release_lock(&ntfs->lock);
-            tsk_error_reset();
-            tsk_error_set_errno(TSK_ERR_FS_BLK_NUM);
-            tsk_error_set_errstr
-                ("is_clustalloc: cluster not found in bitmap: %" PRIuDADDR
-                "", c);
-            return -1;
-        }
-        if (fsaddr > ntfs->fs_info.last_block) {
-            tsk_release_lock(&ntfs->lock);
-            tsk_error_reset();
-            tsk_error_set_errno(TSK_ERR_FS_BLK_NUM);
-            tsk_error_set_errstr
-                ("is_clustalloc: Cluster in bitmap too large for image: %"
-                PRIuDADDR, fsaddr);
-            return -1;
-        }
-        ntfs->bmap_buf_off = base;
-        cnt = tsk_fs_read_block
-            (&ntfs->fs_info, fsaddr, ntfs->bmap_buf,
-            ntfs->fs_info.block_size);
-        if (cnt != ntfs->fs_info.block_size) {
-            tsk_release_lock(&ntfs->lock);
-            if (cnt >= 0) {
-                tsk_error_reset();
-                tsk_error_set_errno(TSK_ERR_FS_READ);
+    /* last cluster that can be looked up in this chunk */
+    if (chunk->bad) {
+        TSK_DADDR_T clust_bits = (TSK_DADDR_T) ntfs->fs_info.block_size * 8;
+        last = a_addr - a_addr % clust_bits + clust_bits - 1;
+    }
+    else {
+        last = base + chunk_bits - 1;
+    }
+    if (last >= ntfs->bmap_len)
+        last = ntfs->bmap_len - 1;
+    if (a_end > last)
+        a_end = last;
+
+    alloc = isset(buf, a_addr - base) ? 1 : 0;
+    fill = alloc ? ~(uint64_t) 0 : 0;
+    addr = a_addr + 1;
+    while (addr <= a_end) {
+        /* skip over whole words that are all set or all clear */
+        if (((addr % 64) == 0) && (addr + 63 <= a_end)) {
+            uint64_t word;
+            memcpy(&word, &buf[(addr - base) / 8], sizeof(word));
+            if (word == fill) {
+                addr += 64;
+                continue;
             }
-            tsk_error_set_errstr2
-                ("is_clustalloc: Error reading bitmap at %" PRIuDADDR,
-                fsaddr);
-            return -1;
         }
+        if ((isset(buf, addr - base) ? 1 : 0) != alloc)
+            break;
+        addr++;
     }
-
-    /* identify if the cluster is allocated or not */
-    ret = (isset(ntfs->bmap_buf, b)) ? 1 : 0;
-
-    tsk_release_lock(&ntfs->lock);
-    return ret;
+    return addr - 1;
 }
 
 
@@ -763,9 +950,9 @@ typedef struct {
 static void
 ntfs_uncompress_reset(NTFS_COMP_INFO * comp)
 {
-    memset(comp->uncomp_buf, 0, comp->buf_size_b);
+    /* Only the first uncomp_idx and comp_len bytes of the buffers
+     * are used, so they do not need to be cleared */
     comp->uncomp_idx = 0;
-    memset(comp->comp_buf, 0, comp->buf_size_b);
     comp->comp_len = 0;
 }
 
@@ -823,6 +1010,9 @@ ntfs_uncompress_done(NTFS_COMP_INFO * comp)
 static uint8_t
 ntfs_uncompress_compunit(NTFS_COMP_INFO * comp)
 {
+    const unsigned char *cbuf = (const unsigned char *) comp->comp_buf;
+    unsigned char *ubuf = (unsigned char *) comp->uncomp_buf;
+    size_t uidx = 0;
     size_t cl_index;
 
     tsk_error_reset();
@@ -836,13 +1026,14 @@ ntfs_uncompress_compunit(NTFS_COMP_INFO * comp)
     for (cl_index = 0; cl_index + 1 < comp->comp_len;) {
         size_t blk_end;         // index into the buffer to where block ends
         size_t blk_size;        // size of the current block
-        uint8_t iscomp;         // set to 1 if block is compressed
         size_t blk_st_uncomp;   // index into uncompressed buffer where block started
+        int shift;              // number of bits that the offset in phrase tokens is shifted by
+        size_t shift_lim;       // block position at which shift needs to grow
 
         /* The first two bytes of each block contain the size
          * information.*/
-        blk_size = ((((unsigned char) comp->comp_buf[cl_index + 1] << 8) |
-                ((unsigned char) comp->comp_buf[cl_index])) & 0x0FFF) + 3;
+        blk_size = (((cbuf[cl_index + 1] << 8) | cbuf[cl_index]) & 0x0FFF)
+            + 3;
 
         // this seems to indicate end of block
         if (blk_size == 3)
@@ -854,6 +1045,7 @@ ntfs_uncompress_compunit(NTFS_COMP_INFO * comp)
             tsk_error_set_errstr
                 ("ntfs_uncompress_compunit: Block length longer than buffer length: %"
                 PRIuSIZE "", blk_end);
+            comp->uncomp_idx = uidx;
             return 1;
         }
 
@@ -862,176 +1054,173 @@ ntfs_uncompress_compunit(NTFS_COMP_INFO * comp)
                 "ntfs_uncompress_compunit: Block size is %" PRIuSIZE "\n",
                 blk_size);
 
-        /* The MSB identifies if the block is compressed */
-        if ((comp->comp_buf[cl_index + 1] & 0x8000) == 0)
-            iscomp = 0;
-        else
-            iscomp = 1;
-
         // keep track of where this block started in the buffer
-        blk_st_uncomp = comp->uncomp_idx;
-        cl_index += 2;
-
-        // the 4096 size seems to occur at the same times as no compression
-        if ((iscomp) || (blk_size - 2 != 4096)) {
+        blk_st_uncomp = uidx;
+
+        /* The MSB identifies if the block is compressed.
+         * The 4096 size seems to occur at the same times as no compression */
+        if (((cbuf[cl_index + 1] & 0x80) == 0) && (blk_size - 2 == 4096)) {
+            cl_index += 2;
+
+            /* This seems to happen only with corrupt data -- such as
+             * when an unallocated file is being processed... */
+            if (blk_end - cl_index > comp->buf_size_b - uidx) {
+                memcpy(&ubuf[uidx], &cbuf[cl_index],
+                    comp->buf_size_b - uidx);
+                comp->uncomp_idx = comp->buf_size_b;
+                tsk_error_reset();
+                tsk_error_set_errno(TSK_ERR_FS_FWALK);
+                tsk_error_set_errstr
+                    ("ntfs_uncompress_compunit: Trying to write past end of uncompression buffer (1) -- corrupt data?)");
+                return 1;
+            }
 
-            // cycle through the block
-            while (cl_index < blk_end) {
-                int a;
+            // Place data in uncompression_buffer
+            memcpy(&ubuf[uidx], &cbuf[cl_index], blk_end - cl_index);
+            uidx += blk_end - cl_index;
+            cl_index = blk_end;
+            continue;
+        }
+        cl_index += 2;
 
-                // get the header header
-                unsigned char header = comp->comp_buf[cl_index];
-                cl_index++;
+        /* The number of bits for the offset and length in the 2-byte
+         * phrase header change depending on the location in the block.
+         * The offset gets one more bit each time the position passes
+         * a power of 2 (starting at 16). */
+        shift = 0;
+        shift_lim = 0x10;
 
-                if (tsk_verbose)
-                    tsk_fprintf(stderr,
-                        "ntfs_uncompress_compunit: New Tag: %x\n", header);
+        // cycle through the block
+        while (cl_index < blk_end) {
+            int a;
 
-                for (a = 0; a < 8 && cl_index < blk_end; a++) {
+            // get the header header
+            unsigned int header = cbuf[cl_index++];
 
-                    /* Determine token type and parse appropriately. *
-                     * Symbol tokens are the symbol themselves, so copy it
-                     * into the umcompressed buffer
-                     */
-                    if ((header & NTFS_TOKEN_MASK) == NTFS_SYMBOL_TOKEN) {
-                        if (tsk_verbose)
-                            tsk_fprintf(stderr,
-                                "ntfs_uncompress_compunit: Symbol Token: %"
-                                PRIuSIZE "\n", cl_index);
+            /* All 8 tokens are symbols and they are all in the block,
+             * so copy them at once. */
+            if ((header == 0) && (cl_index + 8 <= blk_end)) {
+                if (8 > comp->buf_size_b - uidx) {
+                    tsk_error_set_errno(TSK_ERR_FS_FWALK);
+                    tsk_error_set_errstr
+                        ("ntfs_uncompress_compunit: Trying to write past end of uncompression buffer: %"
+                        PRIuSIZE "", comp->buf_size_b);
+                    comp->uncomp_idx = comp->buf_size_b;
+                    return 1;
+                }
+                memcpy(&ubuf[uidx], &cbuf[cl_index], 8);
+                uidx += 8;
+                cl_index += 8;
+                continue;
+            }
 
-                        if (comp->uncomp_idx >= comp->buf_size_b) {
-                            tsk_error_set_errno(TSK_ERR_FS_FWALK);
-                            tsk_error_set_errstr
-                                ("ntfs_uncompress_compunit: Trying to write past end of uncompression buffer: %"
-                                PRIuSIZE "", comp->uncomp_idx);
-                            return 1;
-                        }
-                        comp->uncomp_buf[comp->uncomp_idx++] =
-                            comp->comp_buf[cl_index];
+            for (a = 0; a < 8 && cl_index < blk_end; a++, header >>= 1) {
+                unsigned int pheader;
+                size_t offset;
+                size_t length;
+                const unsigned char *src;
+                unsigned char *dst;
 
-                        cl_index++;
+                /* Determine token type and parse appropriately. *
+                 * Symbol tokens are the symbol themselves, so copy it
+                 * into the umcompressed buffer
+                 */
+                if ((header & NTFS_TOKEN_MASK) == NTFS_SYMBOL_TOKEN) {
+                    if (uidx >= comp->buf_size_b) {
+                        tsk_error_set_errno(TSK_ERR_FS_FWALK);
+                        tsk_error_set_errstr
+                            ("ntfs_uncompress_compunit: Trying to write past end of uncompression buffer: %"
+                            PRIuSIZE "", uidx);
+                        comp->uncomp_idx = uidx;
+                        return 1;
                     }
+                    ubuf[uidx++] = cbuf[cl_index++];
+                    continue;
+                }
 
-                    /* Otherwise, it is a phrase token, which points back
-                     * to a previous sequence of bytes.
-                     */
-                    else {
-                        size_t i;
-                        int shift;
-                        size_t start_position_index = 0;
-                        size_t end_position_index = 0;
-                        unsigned int offset = 0;
-                        unsigned int length = 0;
-                        uint16_t pheader;
-
-                        if (cl_index + 1 >= blk_end) {
-                            tsk_error_set_errno(TSK_ERR_FS_FWALK);
-                            tsk_error_set_errstr
-                                ("ntfs_uncompress_compunit: Phrase token index is past end of block: %d",
-                                a);
-                            return 1;
-                        }
-
-                        pheader =
-                            ((((comp->comp_buf[cl_index +
-                                            1]) << 8) & 0xFF00) |
-                            (comp->comp_buf[cl_index] & 0xFF));
-                        cl_index += 2;
-
-
-                        /* The number of bits for the start and length
-                         * in the 2-byte header change depending on the
-                         * location in the compression unit.  This identifies
-                         * how many bits each has */
-                        shift = 0;
-                        for (i =
-                            comp->uncomp_idx -
-                            blk_st_uncomp - 1; i >= 0x10; i >>= 1) {
-                            shift++;
-                        }
-
-                        //tsk_fprintf(stderr, "Start: %X  Shift: %d  UnComp_IDX %d  BlkStart: %lu  BlkIdx: %d  BlkSize: %d\n", (int)(comp->uncomp_idx - comp->blk_st - 1), shift, comp->uncomp_idx, comp->blk_st, comp->blk_idx, comp->blk_size);
-
-                        offset = (pheader >> (12 - shift)) + 1;
-                        length = (pheader & (0xFFF >> shift)) + 2;
-
-                        start_position_index = comp->uncomp_idx - offset;
-                        end_position_index = start_position_index + length;
-
-                        if (tsk_verbose)
-                            tsk_fprintf(stderr,
-                                "ntfs_uncompress_compunit: Phrase Token: %"
-                                PRIuSIZE "\t%d\t%d\t%x\n", cl_index,
-                                length, offset, pheader);
-
-                        /* Sanity checks on values */
-                        if (offset > comp->uncomp_idx) {
-                            tsk_error_reset();
-                            tsk_error_set_errno(TSK_ERR_FS_FWALK);
-                            tsk_error_set_errstr
-                                ("ntfs_uncompress_compunit: Phrase token offset is too large:  %d (max: %"
-                                PRIuSIZE ")", offset, comp->uncomp_idx);
-                            return 1;
-                        }
-                        else if (length + start_position_index >
-                            comp->buf_size_b) {
-                            tsk_error_reset();
-                            tsk_error_set_errno(TSK_ERR_FS_FWALK);
-                            tsk_error_set_errstr
-                                ("ntfs_uncompress_compunit: Phrase token length is too large:  %d (max: %zu)",
-                                length,
-                                comp->buf_size_b - start_position_index);
-                            return 1;
-                        }
-                        else if (end_position_index -
-                            start_position_index + 1 >
-                            comp->buf_size_b - comp->uncomp_idx) {
-                            tsk_error_reset();
-                            tsk_error_set_errno(TSK_ERR_FS_FWALK);
-                            tsk_error_set_errstr
-                                ("ntfs_uncompress_compunit: Phrase token length is too large for rest of uncomp buf:  %zu (max: %"
-                                PRIuSIZE ")",
-                                end_position_index - start_position_index +
-                                1, comp->buf_size_b - comp->uncomp_idx);
-                            return 1;
-                        }
+                /* Otherwise, it is a phrase token, which points back
+                 * to a previous sequence of bytes.
+                 */
+                if (cl_index + 1 >= blk_end) {
+                    tsk_error_set_errno(TSK_ERR_FS_FWALK);
+                    tsk_error_set_errstr
+                        ("ntfs_uncompress_compunit: Phrase token index is past end of block: %d",
+                        a);
+                    comp->uncomp_idx = uidx;
+                    return 1;
+                }
+                else if (uidx == blk_st_uncomp) {
+                    tsk_error_set_errno(TSK_ERR_FS_FWALK);
+                    tsk_error_set_errstr
+                        ("ntfs_uncompress_compunit: Phrase token at start of block: %"
+                        PRIuSIZE, cl_index);
+                    comp->uncomp_idx = uidx;
+                    return 1;
+                }
 
-                        for (;
-                            start_position_index <= end_position_index
-                            && comp->uncomp_idx < comp->buf_size_b;
-                            start_position_index++) {
+                pheader = (cbuf[cl_index + 1] << 8) | cbuf[cl_index];
+                cl_index += 2;
 
-                            // Copy the previous data to the current position
-                            comp->uncomp_buf[comp->uncomp_idx++]
-                                = comp->uncomp_buf[start_position_index];
-                        }
-                    }
-                    header >>= 1;
-                }               // end of loop inside of token group
+                while (uidx - blk_st_uncomp - 1 >= shift_lim) {
+                    shift++;
+                    shift_lim <<= 1;
+                }
 
-            }                   // end of loop inside of block
-        }
+                offset = (pheader >> (12 - shift)) + 1;
+                // the token stores the length - 3
+                length = (pheader & (0xFFF >> shift)) + 3;
 
-        // this block contains uncompressed data uncompressed data
-        else {
-            while (cl_index < blk_end && cl_index < comp->comp_len) {
-                /* This seems to happen only with corrupt data -- such as
-                 * when an unallocated file is being processed... */
-                if (comp->uncomp_idx >= comp->buf_size_b) {
+                /* Sanity checks on values */
+                if (offset > uidx) {
+                    tsk_error_reset();
+                    tsk_error_set_errno(TSK_ERR_FS_FWALK);
+                    tsk_error_set_errstr
+                        ("ntfs_uncompress_compunit: Phrase token offset is too large:  %"
+                        PRIuSIZE " (max: %" PRIuSIZE ")", offset, uidx);
+                    comp->uncomp_idx = uidx;
+                    return 1;
+                }
+                else if (length > comp->buf_size_b - uidx) {
                     tsk_error_reset();
                     tsk_error_set_errno(TSK_ERR_FS_FWALK);
                     tsk_error_set_errstr
-                        ("ntfs_uncompress_compunit: Trying to write past end of uncompression buffer (1) -- corrupt data?)");
+                        ("ntfs_uncompress_compunit: Phrase token length is too large for rest of uncomp buf:  %"
+                        PRIuSIZE " (max: %" PRIuSIZE ")", length,
+                        comp->buf_size_b - uidx);
+                    comp->uncomp_idx = uidx;
                     return 1;
                 }
 
-                // Place data in uncompression_buffer
-                comp->uncomp_buf[comp->uncomp_idx++] =
-                    comp->comp_buf[cl_index++];
-            }
-        }
+                // Copy the previous data to the current position
+                dst = &ubuf[uidx];
+                src = dst - offset;
+                uidx += length;
+                if (offset >= length) {
+                    memcpy(dst, src, length);
+                }
+                else if (offset >= 8) {
+                    /* The source and destination overlap, but each 8-byte
+                     * chunk has already been written by the time it is
+                     * read. */
+                    while (length >= 8) {
+                        memcpy(dst, src, 8);
+                        dst += 8;
+                        src += 8;
+                        length -= 8;
+                    }
+                    while (length--)
+                        *dst++ = *src++;
+                }
+                else {
+                    // short repeating pattern
+                    while (length--)
+                        *dst++ = *src++;
+                }
+            }                   // end of loop inside of token group
+        }                       // end of loop inside of block
     }                           // end of loop inside of compression unit
 
+    comp->uncomp_idx = uidx;
     return 0;
 }
 
@@ -1149,6 +1338,111 @@ ntfs_proc_compunit(NTFS_INFO * ntfs, NTFS_COMP_INFO * comp,
 
 
 
+/**
+ * Look for a decompressed compression unit in the cache and copy it
+ * into comp if it is there.
+ *
+ * @param ntfs File system
+ * @param fs_attr Attribute that the unit is in
+ * @param a_vcn Cluster offset in the attribute where the unit starts
+ * @param comp Compression state info (output will be stored in here)
+ * @returns 1 if found and 0 if not
+ */
+static uint8_t
+ntfs_comp_cache_get(NTFS_INFO * ntfs, const TSK_FS_ATTR * fs_attr,
+    TSK_DADDR_T a_vcn, NTFS_COMP_INFO * comp)
+{
+    TSK_FS_META *fs_meta = fs_attr->fs_file->meta;
+    uint8_t found = 0;
+    int i;
+
+    tsk_take_lock(&ntfs->comp_cache_lock);
+    for (i = 0; i < NTFS_COMP_CACHE_CNT; i++) {
+        NTFS_COMP_CACHE *ent = &ntfs->comp_cache[i];
+
+        if ((ent->addr == fs_meta->addr) && (ent->addr != 0)
+            && (ent->seq == fs_meta->seq) && (ent->type == fs_attr->type)
+            && (ent->id == fs_attr->id) && (ent->vcn == a_vcn)
+            && (ent->len <= comp->buf_size_b)) {
+            memcpy(comp->uncomp_buf, ent->buf, ent->len);
+            comp->uncomp_idx = ent->len;
+            ent->used = ++ntfs->comp_cache_age;
+            found = 1;
+            break;
+        }
+    }
+    tsk_release_lock(&ntfs->comp_cache_lock);
+    return found;
+}
+
+/**
+ * Save a decompressed compression unit in the cache (replacing
+ * the least recently used one).  Errors are ignored because the
+ * cache is only an optimization.
+ *
+ * @param ntfs File system
+ * @param fs_attr Attribute that the unit is in
+ * @param a_vcn Cluster offset in the attribute where the unit starts
+ * @param comp Compression state info with the decompressed data
+ */
+static void
+ntfs_comp_cache_put(NTFS_INFO * ntfs, const TSK_FS_ATTR * fs_attr,
+    TSK_DADDR_T a_vcn, const NTFS_COMP_INFO * comp)
+{
+    TSK_FS_META *fs_meta = fs_attr->fs_file->meta;
+    NTFS_COMP_CACHE *ent;
+    int i;
+
+    // address 0 ($MFT) is used to mark unused entries
+    if (fs_meta->addr == 0)
+        return;
+
+    tsk_take_lock(&ntfs->comp_cache_lock);
+    ent = &ntfs->comp_cache[0];
+    for (i = 1; i < NTFS_COMP_CACHE_CNT; i++) {
+        if (ntfs->comp_cache[i].used < ent->used)
+            ent = &ntfs->comp_cache[i];
+    }
+
+    if (ent->buf_size < comp->uncomp_idx) {
+        free(ent->buf);
+        ent->addr = 0;
+        ent->buf_size = 0;
+        if ((ent->buf = (char *) tsk_malloc(comp->buf_size_b)) == NULL) {
+            tsk_release_lock(&ntfs->comp_cache_lock);
+            tsk_error_reset();
+            return;
+        }
+        ent->buf_size = comp->buf_size_b;
+    }
+
+    memcpy(ent->buf, comp->uncomp_buf, comp->uncomp_idx);
+    ent->len = comp->uncomp_idx;
+    ent->addr = fs_meta->addr;
+    ent->seq = fs_meta->seq;
+    ent->type = fs_attr->type;
+    ent->id = fs_attr->id;
+    ent->vcn = a_vcn;
+    ent->used = ++ntfs->comp_cache_age;
+    tsk_release_lock(&ntfs->comp_cache_lock);
+}
+
+/**
+ * Free the buffers in the compression unit cache
+ * @param ntfs File system
+ */
+static void
+ntfs_comp_cache_free(NTFS_INFO * ntfs)
+{
+    int i;
+
+    for (i = 0; i < NTFS_COMP_CACHE_CNT; i++) {
+        free(ntfs->comp_cache[i].buf);
+        memset(&ntfs->comp_cache[i], 0, sizeof(NTFS_COMP_CACHE));
+    }
+}
+
+
 /**
  * Currently ignores the SPARSE flag
  */
@@ -1435,6 +1729,7 @@ ntfs_file_read_special(const TSK_FS_ATTR * a_fs_attr,
         uint32_t comp_unit_idx = 0;
         NTFS_COMP_INFO comp;
         size_t buf_idx = 0;
+        TSK_DADDR_T cu_vcn;     // cluster offset in the attribute of the current compression unit
 
         if (a_fs_attr->nrd.compsize <= 0) {
             tsk_error_set_errno(TSK_ERR_FS_FWALK);
@@ -1490,6 +1785,7 @@ ntfs_file_read_special(const TSK_FS_ATTR * a_fs_attr,
         }
 
         byteoffset = (size_t) (a_offset - cu_blkoffset * fs->block_size);
+        cu_vcn = cu_blkoffset;
 
         // cycle through the run until we find where we can start to process the clusters
         for (data_run_cur = a_fs_attr->nrd.run;
@@ -1528,8 +1824,14 @@ ntfs_file_read_special(const TSK_FS_ATTR * a_fs_attr,
                         && (data_run_cur->next == NULL))) {
                     size_t cpylen;
 
-                    // decompress the unit
-                    if (ntfs_proc_compunit(ntfs, &comp, comp_unit,
+                    // decompress the unit (unless a previous read did)
+                    if (ntfs_comp_cache_get(ntfs, a_fs_attr, cu_vcn, &comp)) {
+                        if (tsk_verbose)
+                            tsk_fprintf(stderr,
+                                "ntfs_file_read_special: Using cached unit at %"
+                                PRIuDADDR "\n", cu_vcn);
+                    }
+                    else if (ntfs_proc_compunit(ntfs, &comp, comp_unit,
                             comp_unit_idx)) {
                         tsk_error_set_errstr2("%" PRIuINUM " - type: %"
                             PRIu32 "  id: %d  Status: %s",
@@ -1542,6 +1844,9 @@ ntfs_file_read_special(const TSK_FS_ATTR * a_fs_attr,
                         ntfs_uncompress_done(&comp);
                         return -1;
                     }
+                    else {
+                        ntfs_comp_cache_put(ntfs, a_fs_attr, cu_vcn, &comp);
+                    }
 
                     // copy uncompressed data to the output buffer
                     if (comp.uncomp_idx < byteoffset) {
@@ -1570,6 +1875,7 @@ ntfs_file_read_special(const TSK_FS_ATTR * a_fs_attr,
                     // reset this in case we need to also read from the next run
                     byteoffset = 0;
                     buf_idx += cpylen;
+                    cu_vcn += comp_unit_idx;
                     comp_unit_idx = 0;
                 }
                 /* If it is a sparse run, don't increment the addr so that
@@ -2813,15 +3119,18 @@ ntfs_attrname_lookup(TSK_FS_INFO * fs, uint16_t type, char *name, int len)
 }
 
 
-/* Load the block bitmap $Data run  and allocate a buffer for a cache
+/* Load the block bitmap $Data run and set up the chunks that its contents
+ * are loaded into
  *
  * return 1 on error and 0 on success
  * */
 static uint8_t
 ntfs_load_bmap(NTFS_INFO * ntfs)
 {
-    ssize_t cnt;
     ntfs_attr *attr;
+    TSK_FS_ATTR_RUN *run;
+    TSK_DADDR_T len = 0;
+    size_t chunk_cnt;
     TSK_FS_INFO *fs = &ntfs->fs_info;
     ntfs_mft *mft;
 
@@ -2870,38 +3179,34 @@ ntfs_load_bmap(NTFS_INFO * ntfs)
         return 1;
     }
 
-    ntfs->bmap_buf = (char *) tsk_malloc(fs->block_size);
-    if (ntfs->bmap_buf == NULL) {
-        free(mft);
-        return 1;
-    }
+    free(mft);
 
-    /* Load the first cluster so that we have something there */
-    ntfs->bmap_buf_off = 0;
     if (ntfs->bmap->addr > fs->last_block) {
         tsk_error_reset();
         tsk_error_set_errno(TSK_ERR_FS_GENFS);
         tsk_error_set_errstr
             ("ntfs_load_bmap: Bitmap too large for image size: %" PRIuDADDR
             "", ntfs->bmap->addr);
-        free(mft);
         return 1;
     }
-    cnt =
-        tsk_fs_read_block(fs,
-        ntfs->bmap->addr, ntfs->bmap_buf, fs->block_size);
-    if (cnt != fs->block_size) {
-        if (cnt >= 0) {
-            tsk_error_reset();
-            tsk_error_set_errno(TSK_ERR_FS_READ);
-        }
-        tsk_error_set_errstr2("ntfs_load_bmap: Error reading block at %"
-            PRIuDADDR, ntfs->bmap->addr);
-        free(mft);
+
+    /* The bitmap is loaded in chunks when lookups need them.  Only the
+     * clusters that the bitmap file covers can be looked up. */
+    for (run = ntfs->bmap; run; run = run->next)
+        len = run->offset + run->len;
+    ntfs->bmap_len = len * fs->block_size * 8;
+    if (ntfs->bmap_len > fs->last_block + 1)
+        ntfs->bmap_len = fs->last_block + 1;
+
+    ntfs->bmap_chunk_b = roundup(NTFS_BMAP_CHUNK_SIZE, fs->block_size);
+    chunk_cnt = (size_t) ((ntfs->bmap_len + ntfs->bmap_chunk_b * 8 - 1) /
+        (ntfs->bmap_chunk_b * 8));
+    if ((ntfs->bmap_chunks =
+            (NTFS_BMAP_CHUNK *) tsk_malloc((chunk_cnt ? chunk_cnt : 1) *
+                sizeof(NTFS_BMAP_CHUNK))) == NULL) {
         return 1;
     }
 
-    free((char *) mft);
     return 0;
 }
 
@@ -3001,7 +3306,7 @@ ntfs_sds_to_str(TSK_FS_INFO * a_fs, const ntfs_attr_sds * a_sds,
     owner_offset =
         tsk_getu32(a_fs->endian, a_sds->self_rel_sec_desc.owner);
 
-    if (((uintptr_t) & a_sds->self_rel_sec_desc + owner_offset) >
+    if (((uintptr_t) & a_sds->self_rel_sec_desc + owner_offset + 8) >
         ((uintptr_t) a_sds + tsk_getu32(a_fs->endian, a_sds->ent_size))) {
         tsk_error_reset();
         tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
@@ -3014,6 +3319,16 @@ ntfs_sds_to_str(TSK_FS_INFO * a_fs, const ntfs_attr_sds * a_sds,
         (ntfs_sid *) ((uint8_t *) & a_sds->self_rel_sec_desc +
         owner_offset);
 
+    // make sure all of the sub authorities are in the entry too
+    if (((uintptr_t) sid + 8 + 4 * (uintptr_t) sid->sub_auth_count) >
+        ((uintptr_t) a_sds + tsk_getu32(a_fs->endian, a_sds->ent_size))) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_INODE_COR);
+        tsk_error_set_errstr
+            ("ntfs_sds_to_str: owner SID larger than a_sds length");
+        return 1;
+    }
+
     //tsk_fprintf(stderr, "Revision: %i\n", sid->revision);
 
     // This check helps not process invalid data, which was noticed while testing
@@ -3037,236 +3352,61 @@ ntfs_sds_to_str(TSK_FS_INFO * a_fs, const ntfs_attr_sds * a_sds,
 
         // Allocate the buffer for the string representation of the SID.
         if ((sid_str = (char *) tsk_malloc(sid_str_len)) == NULL) {
-            return 1;
-        }
-
-        len = sprintf(sid_str, "S-1-%" PRIu64, authority);
-        sid_str_offset = sid_str + len;
-
-        for (i = 0; i < sid->sub_auth_count; i++) {
-            len = sprintf(sid_str_offset, "-%" PRIu32, sid->sub_auth[i]);
-            sid_str_offset += len;
-        }
-        *a_sidstr = sid_str;
-        //tsk_fprintf(stderr, "SID: %s\n", sid_str);
-    }
-    else {
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_FS_GENFS);
-        tsk_error_set_errstr("ntfs_sds_to_str: Invalid SID revision (%d)",
-            sid->revision);
-        return 1;               // Invalid revision number in the SID.
-    }
-
-    return 0;
-}
-
-
-
-
-/** \internal
- * Maps a security id value from a file to its SDS structure
- *
- * Note: This routine assumes &ntfs->sid_lock is locked by the caller.
- *
- * @param fs File system
- * @param secid Security Id to find SDS for.
- * @returns NULL on error
- */
-static const ntfs_attr_sds *
-ntfs_get_sds(TSK_FS_INFO * fs, uint32_t secid)
-{
-    uint32_t i = 0;
-    NTFS_INFO *ntfs = (NTFS_INFO *) fs;
-    ntfs_attr_sii *sii = NULL;
-    ntfs_attr_sds *sds = NULL;
-    uint32_t sii_secid = 0;
-    uint32_t sds_secid = 0;
-    uint32_t sii_sechash = 0;
-    uint32_t sds_sechash = 0;
-    uint64_t sds_file_off = 0;
-    //uint32_t sds_ent_size = 0;
-    uint64_t sii_sds_file_off = 0;
-    uint32_t sii_sds_ent_size = 0;
-
-
-    if ((fs == NULL) || (secid == 0)) {
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_FS_ARG);
-        tsk_error_set_errstr("Invalid argument");
-        return NULL;
-    }
-
-
-    // Loop through all the SII entries looking for the security id matching that found in the file.
-    // This lookup is obviously O(n^2) for all n files. However, since so many files have the exact
-    // same security identifier, it is not really that bad. In reality, 100,000 files may only map to
-    // 10,000 security identifiers. Since SII entries are 0x28 bytes each and security identifiers
-    // increase incrementally, we could go directly to the entry in question ((secid * 0x28) + 256).
-    // SII entries started at 256 on Vista; however, I did not look at the starting secid for other
-    // versions of NTFS.
-    for (i = 0; i < ntfs->sii_data.used; i++) {
-        if (tsk_getu32(fs->endian,
-                ((ntfs_attr_sii *) (ntfs->sii_data.buffer))[i].
-                key_sec_id) == secid) {
-            sii = &((ntfs_attr_sii *) (ntfs->sii_data.buffer))[i];
-            break;
+            return 1;
         }
-    }
-
-    if (sii == NULL) {
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_FS_GENFS);
-        tsk_error_set_errstr("ntfs_get_sds: SII entry not found (%" PRIu32
-            ")", secid);
-        return NULL;
-    }
 
-    sii_secid = tsk_getu32(fs->endian, sii->key_sec_id);
-    sii_sechash = tsk_getu32(fs->endian, sii->data_hash_sec_desc);
-    sii_sds_file_off = tsk_getu64(fs->endian, sii->sec_desc_off);
-    sii_sds_ent_size = tsk_getu32(fs->endian, sii->sec_desc_size);
+        len = sprintf(sid_str, "S-1-%" PRIu64, authority);
+        sid_str_offset = sid_str + len;
 
-    // Check that we do not go out of bounds.
-    if ((uint32_t) sii_sds_file_off > ntfs->sds_data.size) {
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_FS_GENFS);
-        tsk_error_set_errstr("ntfs_get_sds: SII offset too large (%" PRIu64
-            ")", sii_sds_file_off);
-        return NULL;
+        for (i = 0; i < sid->sub_auth_count; i++) {
+            len = sprintf(sid_str_offset, "-%" PRIu32, sid->sub_auth[i]);
+            sid_str_offset += len;
+        }
+        *a_sidstr = sid_str;
+        //tsk_fprintf(stderr, "SID: %s\n", sid_str);
     }
-    else if (!sii_sds_ent_size) {
+    else {
         tsk_error_reset();
         tsk_error_set_errno(TSK_ERR_FS_GENFS);
-        tsk_error_set_errstr("ntfs_get_sds: SII entry size is invalid (%"
-            PRIu32 ")", sii_sds_ent_size);
-        return NULL;
-    }
-
-    sds =
-        (ntfs_attr_sds *) ((uint8_t *) ntfs->sds_data.buffer +
-        sii_sds_file_off);
-    sds_secid = tsk_getu32(fs->endian, sds->sec_id);
-    sds_sechash = tsk_getu32(fs->endian, sds->hash_sec_desc);
-    sds_file_off = tsk_getu64(fs->endian, sds->file_off);
-    //sds_ent_size = tsk_getu32(fs->endian, sds->ent_size);
-
-    // Sanity check to make sure the $SII entry points to
-    // the correct $SDS entry.
-    if ((sds_secid == sii_secid) &&
-        (sds_sechash == sii_sechash) && (sds_file_off == sii_sds_file_off)
-        //&& (sds_ent_size == sii_sds_ent_size)
-        ) {
-        return sds;
+        tsk_error_set_errstr("ntfs_sds_to_str: Invalid SID revision (%d)",
+            sid->revision);
+        return 1;               // Invalid revision number in the SID.
     }
-    else {
-        if (tsk_verbose)
-            tsk_fprintf(stderr,
-                "ntfs_get_sds: entry found was for wrong Security ID (%"
-                PRIu32 " vs %" PRIu32 ")\n", sds_secid, sii_secid);
 
-//        if (sii_secid != 0) {
+    return 0;
+}
 
-        // There is obviously a mismatch between the information in the SII entry and that in the SDS entry.
-        // After looking at these mismatches, it appears there is not a pattern. Perhaps some entries have been reused.
 
-        //printf("\nsecid %d hash %x offset %I64x size %x\n", sii_secid, sii_sechash, sii_sds_file_off, sii_sds_ent_size);
-        //printf("secid %d hash %x offset %I64x size %x\n", sds_secid, sds_sechash, sds_file_off, sds_ent_size);
-        //      }
-    }
 
-    tsk_error_reset();
-    tsk_error_set_errno(TSK_ERR_FS_GENFS);
-    tsk_error_set_errstr("ntfs_get_sds: Got to end w/out data");
-    return NULL;
-}
-#endif
 
 /** \internal
- * NTFS-specific function (pointed to in FS_INFO) that maps a security ID
- * to an ASCII printable string.
- * Read the contents of the STANDARD_INFORMATION attribute of a file
- * to get the security id. Once we have the security id, we will
- * search $Secure:$SII to find a matching security id. That $SII entry
- * will contain the offset within the $SDS stream for the $SDS entry,
- * which contains the owner SID
- *
- * @param a_fs_file File to get security info on
- * @param sid_str [out] location where string representation of security info will be stored.
- Caller must free the string.
- * @returns 1 on error
+ * Compare two NTFS_SID_ENT structures by security id
  */
-static uint8_t
-ntfs_file_get_sidstr(TSK_FS_FILE * a_fs_file, char **sid_str)
+static int
+ntfs_sid_ent_cmp(const void *a_ent1, const void *a_ent2)
 {
-#if TSK_USE_SID
-    const TSK_FS_ATTR *fs_data;
-    ntfs_attr_si *si;
-    const ntfs_attr_sds *sds;
-    NTFS_INFO *ntfs = (NTFS_INFO *) a_fs_file->fs_info;
-
-    *sid_str = NULL;
-
-    if (!a_fs_file->meta->attr) {
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_FS_GENFS);
-        tsk_error_set_errstr
-            ("ntfs_file_get_sidstr: file argument has no meta data");
-        return 1;
-    }
-
-    // Read STANDARD_INFORMATION attribute for the security id of the file.
-    fs_data = tsk_fs_attrlist_get(a_fs_file->meta->attr,
-        TSK_FS_ATTR_TYPE_NTFS_SI);
-    if (!fs_data) {
-        tsk_error_set_errstr2("- ntfs_file_get_sidstr:SI attribute");
-        return 1;
-    }
-
-    si = (ntfs_attr_si *) fs_data->rd.buf;
-    if (!si) {
-        tsk_error_reset();
-        tsk_error_set_errno(TSK_ERR_FS_GENFS);
-        tsk_error_set_errstr("ntfs_file_get_sidstr: SI buf is NULL");
-        return 1;
-    }
+    uint32_t id1 = ((const NTFS_SID_ENT *) a_ent1)->sec_id;
+    uint32_t id2 = ((const NTFS_SID_ENT *) a_ent2)->sec_id;
 
-    tsk_take_lock(&ntfs->sid_lock);
-    // sds points inside ntfs->sds_data, which we've just locked
-    sds =
-        ntfs_get_sds(a_fs_file->fs_info,
-        tsk_getu32(a_fs_file->fs_info->endian, si->sec_id));
-    if (!sds) {
-        tsk_release_lock(&ntfs->sid_lock);
-        tsk_error_set_errstr2("- ntfs_file_get_sidstr:SI attribute");
-        return 1;
-    }
-    if (ntfs_sds_to_str(a_fs_file->fs_info, sds, sid_str)) {
-        tsk_release_lock(&ntfs->sid_lock);
-        tsk_error_set_errstr2("- ntfs_file_get_sidstr:SI attribute");
+    if (id1 < id2)
+        return -1;
+    else if (id1 > id2)
         return 1;
-    }
-    tsk_release_lock(&ntfs->sid_lock);
     return 0;
-#else
-    *sid_str = NULL;
-    tsk_error_reset();
-    tsk_error_set_errno(TSK_ERR_FS_UNSUPFUNC);
-    tsk_error_set_errstr("Unsupported function");
-    return 1;
-#endif
 }
 
+#endif
 
 #if TSK_USE_SID
 /** \internal
  * Process all the $SII entries into a single array by removing all the Attribute Headers.
- * Note: This routine assumes &ntfs->sid_lock is locked by the caller.
- * @param fs File system structure to store results into
+ * @param fs File system
  * @param sii_buffer Buffer of raw $SII entries to parse
+ * @param sii_data Buffer to store the array of entries in
  */
 static void
-ntfs_proc_sii(TSK_FS_INFO * fs, NTFS_SXX_BUFFER * sii_buffer)
+ntfs_proc_sii(TSK_FS_INFO * fs, NTFS_SXX_BUFFER * sii_buffer,
+    NTFS_SXX_BUFFER * sii_data)
 {
     unsigned int total_bytes_processed = 0;
     unsigned int idx_buffer_length = 0;
@@ -3276,7 +3416,7 @@ ntfs_proc_sii(TSK_FS_INFO * fs, NTFS_SXX_BUFFER * sii_buffer)
     ntfs_attr_sii *sii;
 
     if ((fs == NULL) || (sii_buffer == NULL)
-        || (ntfs->sii_data.buffer == NULL))
+        || (sii_data->buffer == NULL))
         return;
 
     /* Loop by cluster size */
@@ -3305,10 +3445,10 @@ ntfs_proc_sii(TSK_FS_INFO * fs, NTFS_SXX_BUFFER * sii_buffer)
 				)
 			{
 */
-            memcpy(ntfs->sii_data.buffer +
-                (ntfs->sii_data.used * sizeof(ntfs_attr_sii)), sii,
+            memcpy(sii_data->buffer +
+                (sii_data->used * sizeof(ntfs_attr_sii)), sii,
                 sizeof(ntfs_attr_sii));
-            ntfs->sii_data.used++;
+            sii_data->used++;
 
 /*
 				printf("Security id %d is at offset 0x%I64x for 0x%x bytes\n", tsk_getu32(fs->endian,sii->key_sec_id),
@@ -3333,11 +3473,119 @@ ntfs_proc_sii(TSK_FS_INFO * fs, NTFS_SXX_BUFFER * sii_buffer)
 }
 
 
+/** \internal
+ * Make the map of security ids to the offsets of their $SDS entries.
+ * The SID strings are made when they are first needed, once per
+ * security id, because many files share the same security id.
+ * Security ids whose $SDS entry is missing or corrupt are added as
+ * not valid.
+ *
+ * @param ntfs File system to store the map in
+ * @param sii_data Array of $SII entries (from ntfs_proc_sii())
+ * @param sds_data Contents of the $SDS stream
+ * @returns 1 on error (which occurs only if malloc fails)
+ */
+static uint8_t
+ntfs_load_sid_map(NTFS_INFO * ntfs, const NTFS_SXX_BUFFER * sii_data,
+    const NTFS_SXX_BUFFER * sds_data)
+{
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) & ntfs->fs_info;
+    size_t i, cnt = 0;
+
+    if (sii_data->used == 0)
+        return 0;
+
+    if ((ntfs->sid_map =
+            (NTFS_SID_ENT *) tsk_malloc(sii_data->used *
+                sizeof(NTFS_SID_ENT))) == NULL)
+        return 1;
+
+    for (i = 0; i < sii_data->used; i++) {
+        const ntfs_attr_sii *sii =
+            &((const ntfs_attr_sii *) sii_data->buffer)[i];
+        const ntfs_attr_sds *sds;
+        uint32_t sii_secid = tsk_getu32(fs->endian, sii->key_sec_id);
+        uint64_t sii_sds_file_off =
+            tsk_getu64(fs->endian, sii->sec_desc_off);
+        uint32_t sii_sds_ent_size =
+            tsk_getu32(fs->endian, sii->sec_desc_size);
+        uint32_t sds_ent_size;
+
+        if (sii_secid == 0)
+            continue;
+
+        ntfs->sid_map[cnt].sec_id = sii_secid;
+        ntfs->sid_map[cnt].valid = 0;
+        ntfs->sid_map[cnt].sds_off = 0;
+        ntfs->sid_map[cnt].sid_str = NULL;
+        cnt++;
+
+        // make sure the $SDS entry is in the buffer
+        if ((sii_sds_ent_size == 0)
+            || (sii_sds_file_off + sizeof(ntfs_attr_sds) >
+                sds_data->size)) {
+            if (tsk_verbose)
+                tsk_fprintf(stderr,
+                    "ntfs_load_sid_map: SII offset or size is invalid for security id %"
+                    PRIu32 "\n", sii_secid);
+            continue;
+        }
+
+        sds =
+            (const ntfs_attr_sds *) ((uint8_t *) sds_data->buffer +
+            sii_sds_file_off);
+        sds_ent_size = tsk_getu32(fs->endian, sds->ent_size);
+
+        // Sanity check to make sure the $SII entry points to
+        // the correct $SDS entry.
+        if ((tsk_getu32(fs->endian, sds->sec_id) != sii_secid)
+            || (tsk_getu32(fs->endian,
+                    sds->hash_sec_desc) != tsk_getu32(fs->endian,
+                    sii->data_hash_sec_desc))
+            || (tsk_getu64(fs->endian, sds->file_off) != sii_sds_file_off)
+            || (sds_ent_size > sds_data->size - sii_sds_file_off)) {
+            if (tsk_verbose)
+                tsk_fprintf(stderr,
+                    "ntfs_load_sid_map: entry found was for wrong Security ID (%"
+                    PRIu32 " vs %" PRIu32 ")\n", tsk_getu32(fs->endian,
+                        sds->sec_id), sii_secid);
+            continue;
+        }
+
+        ntfs->sid_map[cnt - 1].valid = 1;
+        ntfs->sid_map[cnt - 1].sds_off = (size_t) sii_sds_file_off;
+    }
+
+    qsort(ntfs->sid_map, cnt, sizeof(NTFS_SID_ENT), ntfs_sid_ent_cmp);
+
+    /* Remove duplicate security ids, keeping a valid entry if there is one */
+    ntfs->sid_map_cnt = 0;
+    for (i = 0; i < cnt; i++) {
+        NTFS_SID_ENT *last;
+
+        if ((ntfs->sid_map_cnt == 0)
+            || (ntfs->sid_map[ntfs->sid_map_cnt - 1].sec_id !=
+                ntfs->sid_map[i].sec_id)) {
+            ntfs->sid_map[ntfs->sid_map_cnt++] = ntfs->sid_map[i];
+            continue;
+        }
+
+        last = &ntfs->sid_map[ntfs->sid_map_cnt - 1];
+        if (last->valid == 0)
+            *last = ntfs->sid_map[i];
+    }
+
+    return 0;
+}
+
+
 /*
  * Load the $Secure attributes so that we can identify the user.
+ * The $SII data is only used to make the map of security ids to
+ * $SDS entries and is then freed.  The $SDS data is kept until the
+ * file system is closed.
  *
- * Note: This routine is called only from ntfs_open and therefore does
- * not need to lock ntfs->sid_lock.
+ * Note: This routine assumes &ntfs->sid_lock is locked by the caller.
  *
  * @returns 1 on error (which occurs only if malloc or other system error).
  */
@@ -3349,16 +3597,11 @@ ntfs_load_secure(NTFS_INFO * ntfs)
     const TSK_FS_ATTR *fs_attr_sds = NULL;
     const TSK_FS_ATTR *fs_attr_sii = NULL;
     NTFS_SXX_BUFFER sii_buffer;
+    NTFS_SXX_BUFFER sii_data;
+    NTFS_SXX_BUFFER sds_data;
     TSK_FS_FILE *secure = NULL;
     ssize_t cnt;
-
-    ntfs->sii_data.buffer = NULL;
-    ntfs->sii_data.size = 0;
-    ntfs->sii_data.used = 0;
-    ntfs->sds_data.buffer = NULL;
-    ntfs->sds_data.size = 0;
-    ntfs->sds_data.used = 0;
-
+    uint8_t retval;
 
     // Open $Secure. The $SDS stream contains all the security descriptors
     // and is indexed by $SII and $SDH.
@@ -3409,7 +3652,7 @@ ntfs_load_secure(NTFS_INFO * ntfs)
         return 0;
     }
 
-    /* First we read in $SII to a local buffer adn then process it into NTFS_INFO */
+    /* First we read in $SII to a local buffer and then process it into sii_data */
 
     // Allocate local space for the entire $SII stream.
     sii_buffer.size = (size_t) roundup(fs_attr_sii->size, fs->block_size);
@@ -3419,11 +3662,13 @@ ntfs_load_secure(NTFS_INFO * ntfs)
     if (sii_buffer.size > 64000000) {
         if (tsk_verbose)
             tsk_fprintf(stderr,
-                "ntfs_load_secure: sii_buffer.size is too large: %z\n",
-                sii_buffer.size);
+                "ntfs_load_secure: sii_buffer.size is too large: %" PRIuSIZE
+                "\n", sii_buffer.size);
+        tsk_fs_file_close(secure);
         return 0;
     }
     if ((sii_buffer.buffer = tsk_malloc(sii_buffer.size)) == NULL) {
+        tsk_fs_file_close(secure);
         return 1;
     }
 
@@ -3444,47 +3689,39 @@ ntfs_load_secure(NTFS_INFO * ntfs)
     }
 
     // allocate the structure for the processed version of the data   
-    ntfs->sii_data.used = 0;    // use this to count the number of $SII entries
-    if ((ntfs->sii_data.buffer =
-            (char *) tsk_malloc(sii_buffer.size)) == NULL) {
+    sii_data.used = 0;          // use this to count the number of $SII entries
+    if ((sii_data.buffer = (char *) tsk_malloc(sii_buffer.size)) == NULL) {
         free(sii_buffer.buffer);
         tsk_fs_file_close(secure);
         return 1;
     }
-    ntfs->sii_data.size = sii_buffer.size;
+    sii_data.size = sii_buffer.size;
 
-    // parse sii_buffer into ntfs->sii_data.
-    ntfs_proc_sii(fs, &sii_buffer);
+    // parse sii_buffer into sii_data.
+    ntfs_proc_sii(fs, &sii_buffer, &sii_data);
     free(sii_buffer.buffer);
 
 
-    /* Now we copy $SDS into NTFS_INFO. We do not do any processing in this step. */
+    /* Now we read $SDS. We do not do any processing in this step. */
 
     // Allocate space for the entire $SDS stream with all the security
     // descriptors. We should be able to use the $SII offset to index
     // into the $SDS stream.
-    ntfs->sds_data.size = (size_t) fs_attr_sds->size;
+    sds_data.size = (size_t) fs_attr_sds->size;
     // arbitrary check because we had problems before with alloc too much memory
-    if (ntfs->sds_data.size > 64000000) {
+    if (sds_data.size > 64000000) {
         if (tsk_verbose)
             tsk_fprintf(stderr,
-                "ntfs_load_secure: ntfs->sds_data.size is too large: %z\n",
-                ntfs->sds_data.size);
-        free(ntfs->sii_data.buffer);
-        ntfs->sii_data.buffer = NULL;
-        ntfs->sii_data.used = 0;
-        ntfs->sii_data.size = 0;
+                "ntfs_load_secure: sds_data.size is too large: %" PRIuSIZE
+                "\n", sds_data.size);
+        free(sii_data.buffer);
         tsk_fs_file_close(secure);
 
         return 0;
     }
-    ntfs->sds_data.used = 0;
-    if ((ntfs->sds_data.buffer =
-            (char *) tsk_malloc(ntfs->sds_data.size)) == NULL) {
-        free(ntfs->sii_data.buffer);
-        ntfs->sii_data.buffer = NULL;
-        ntfs->sii_data.used = 0;
-        ntfs->sii_data.size = 0;
+    sds_data.used = 0;
+    if ((sds_data.buffer = (char *) tsk_malloc(sds_data.size)) == NULL) {
+        free(sii_data.buffer);
         tsk_fs_file_close(secure);
         return 1;
     }
@@ -3492,32 +3729,161 @@ ntfs_load_secure(NTFS_INFO * ntfs)
     // Read in the raw $SDS ($DATA) stream.
     cnt =
         tsk_fs_attr_read(fs_attr_sds, 0,
-        ntfs->sds_data.buffer, ntfs->sds_data.size,
-        TSK_FS_FILE_READ_FLAG_NONE);
-    if (cnt != ntfs->sds_data.size) {
+        sds_data.buffer, sds_data.size, TSK_FS_FILE_READ_FLAG_NONE);
+    if (cnt != sds_data.size) {
         if (tsk_verbose)
             tsk_fprintf(stderr,
                 "ntfs_load_secure: error reading $Secure:$SDS attribute: %s\n",
                 tsk_error_get_errstr());
         tsk_error_reset();
 
-        free(ntfs->sii_data.buffer);
-        ntfs->sii_data.buffer = NULL;
-        ntfs->sii_data.used = 0;
-        ntfs->sii_data.size = 0;
-        free(ntfs->sds_data.buffer);
-        ntfs->sds_data.buffer = NULL;
-        ntfs->sds_data.used = 0;
-        ntfs->sds_data.size = 0;
+        free(sii_data.buffer);
+        free(sds_data.buffer);
         tsk_fs_file_close(secure);
         return 0;
     }
-
     tsk_fs_file_close(secure);
+
+    retval = ntfs_load_sid_map(ntfs, &sii_data, &sds_data);
+    free(sii_data.buffer);
+    if (retval) {
+        free(sds_data.buffer);
+        return 1;
+    }
+    ntfs->sds_buf = sds_data.buffer;
     return 0;
 }
 
+/** \internal
+ * Free the map of security ids to SIDs and the $SDS data
+ * @param ntfs File system
+ */
+static void
+ntfs_sid_map_free(NTFS_INFO * ntfs)
+{
+    size_t i;
+
+    for (i = 0; i < ntfs->sid_map_cnt; i++)
+        free(ntfs->sid_map[i].sid_str);
+    free(ntfs->sid_map);
+    ntfs->sid_map = NULL;
+    ntfs->sid_map_cnt = 0;
+    free(ntfs->sds_buf);
+    ntfs->sds_buf = NULL;
+    ntfs->sid_loaded = 0;
+}
+
+#endif
+
+/** \internal
+ * NTFS-specific function (pointed to in FS_INFO) that maps a security ID
+ * to an ASCII printable string.
+ * Read the contents of the STANDARD_INFORMATION attribute of a file
+ * to get the security id. Once we have the security id, we look it
+ * up in the map of security ids to owner SIDs that is made from
+ * $Secure:$SII and $Secure:$SDS the first time that this is called.
+ *
+ * @param a_fs_file File to get security info on
+ * @param sid_str [out] location where string representation of security info will be stored.
+ Caller must free the string.
+ * @returns 1 on error
+ */
+static uint8_t
+ntfs_file_get_sidstr(TSK_FS_FILE * a_fs_file, char **sid_str)
+{
+#if TSK_USE_SID
+    const TSK_FS_ATTR *fs_data;
+    ntfs_attr_si *si;
+    NTFS_INFO *ntfs = (NTFS_INFO *) a_fs_file->fs_info;
+    NTFS_SID_ENT key;
+    NTFS_SID_ENT *ent;
+
+    *sid_str = NULL;
+
+    if (!a_fs_file->meta->attr) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_GENFS);
+        tsk_error_set_errstr
+            ("ntfs_file_get_sidstr: file argument has no meta data");
+        return 1;
+    }
+
+    // Read STANDARD_INFORMATION attribute for the security id of the file.
+    fs_data = tsk_fs_attrlist_get(a_fs_file->meta->attr,
+        TSK_FS_ATTR_TYPE_NTFS_SI);
+    if (!fs_data) {
+        tsk_error_set_errstr2("- ntfs_file_get_sidstr:SI attribute");
+        return 1;
+    }
+
+    si = (ntfs_attr_si *) fs_data->rd.buf;
+    if (!si) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_GENFS);
+        tsk_error_set_errstr("ntfs_file_get_sidstr: SI buf is NULL");
+        return 1;
+    }
+
+    key.sec_id = tsk_getu32(a_fs_file->fs_info->endian, si->sec_id);
+
+    tsk_take_lock(&ntfs->sid_lock);
+    if (ntfs->sid_loaded == 0) {
+        if (ntfs_load_secure(ntfs)) {
+            tsk_release_lock(&ntfs->sid_lock);
+            return 1;
+        }
+        ntfs->sid_loaded = 1;
+    }
+
+    if ((key.sec_id == 0) || (ntfs->sid_map == NULL)
+        || ((ent = (NTFS_SID_ENT *) bsearch(&key, ntfs->sid_map,
+                    ntfs->sid_map_cnt, sizeof(NTFS_SID_ENT),
+                    ntfs_sid_ent_cmp)) == NULL)) {
+        tsk_release_lock(&ntfs->sid_lock);
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_GENFS);
+        tsk_error_set_errstr("ntfs_file_get_sidstr: SII entry not found (%"
+            PRIu32 ")", key.sec_id);
+        tsk_error_set_errstr2("- ntfs_file_get_sidstr:SI attribute");
+        return 1;
+    }
+
+    // the string is made the first time it is needed and then reused
+    if ((ent->valid) && (ent->sid_str == NULL)
+        && (ntfs_sds_to_str(a_fs_file->fs_info,
+                (ntfs_attr_sds *) (ntfs->sds_buf + ent->sds_off),
+                &ent->sid_str))) {
+        ent->valid = 0;
+        tsk_release_lock(&ntfs->sid_lock);
+        tsk_error_set_errstr2("- ntfs_file_get_sidstr:SI attribute");
+        return 1;
+    }
+    if (ent->valid == 0) {
+        tsk_release_lock(&ntfs->sid_lock);
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_GENFS);
+        tsk_error_set_errstr
+            ("ntfs_file_get_sidstr: Invalid security descriptor for security id %"
+            PRIu32, key.sec_id);
+        return 1;
+    }
+
+    if ((*sid_str = (char *) tsk_malloc(strlen(ent->sid_str) + 1)) == NULL) {
+        tsk_release_lock(&ntfs->sid_lock);
+        return 1;
+    }
+    strcpy(*sid_str, ent->sid_str);
+    tsk_release_lock(&ntfs->sid_lock);
+    return 0;
+#else
+    *sid_str = NULL;
+    tsk_error_reset();
+    tsk_error_set_errno(TSK_ERR_FS_UNSUPFUNC);
+    tsk_error_set_errstr("Unsupported function");
+    return 1;
 #endif
+}
+
 
 /**********************************************************************
  *
@@ -3620,13 +3986,16 @@ ntfs_block_walk(TSK_FS_INFO * fs,
             myflags = TSK_FS_BLOCK_FLAG_UNALLOC;
         }
 
-        // test if we should call the callback with this one
-        if ((myflags & TSK_FS_BLOCK_FLAG_ALLOC)
-            && (!(a_flags & TSK_FS_BLOCK_WALK_FLAG_ALLOC)))
-            continue;
-        else if ((myflags & TSK_FS_BLOCK_FLAG_UNALLOC)
-            && (!(a_flags & TSK_FS_BLOCK_WALK_FLAG_UNALLOC)))
+        // test if we should call the callback with this one.  If not,
+        // skip the rest of the clusters with the same status.
+        if (((myflags & TSK_FS_BLOCK_FLAG_ALLOC)
+                && (!(a_flags & TSK_FS_BLOCK_WALK_FLAG_ALLOC)))
+            || ((myflags & TSK_FS_BLOCK_FLAG_UNALLOC)
+                && (!(a_flags & TSK_FS_BLOCK_WALK_FLAG_UNALLOC)))) {
+            if (ntfs->loading_the_MFT == 0)
+                addr = ntfs_bmap_run_end(ntfs, addr, a_end_blk);
             continue;
+        }
 
         if (a_flags & TSK_FS_BLOCK_WALK_FLAG_AONLY)
             myflags |= TSK_FS_BLOCK_FLAG_AONLY;
@@ -4641,30 +5010,32 @@ ntfs_close(TSK_FS_INFO * fs)
         return;
 
 #if TSK_USE_SID
-    if (ntfs->sii_data.buffer)
-        free(ntfs->sii_data.buffer);
-    ntfs->sii_data.buffer = NULL;
-
-    if (ntfs->sds_data.buffer)
-        free(ntfs->sds_data.buffer);
-    ntfs->sds_data.buffer = NULL;
-
+    ntfs_sid_map_free(ntfs);
+    tsk_deinit_lock(&ntfs->sid_lock);
 #endif
 
     fs->tag = 0;
     free((char *) ntfs->fs);
     tsk_fs_attr_run_free(ntfs->bmap);
-    free(ntfs->bmap_buf);
+    if (ntfs->bmap_chunks) {
+        size_t i;
+        for (i = 0; i < (ntfs->bmap_len + ntfs->bmap_chunk_b * 8 - 1) /
+            (ntfs->bmap_chunk_b * 8); i++) {
+            free(ntfs->bmap_chunks[i].buf);
+            free(ntfs->bmap_chunks[i].bad);
+        }
+        free(ntfs->bmap_chunks);
+    }
     tsk_fs_file_close(ntfs->mft_file);
 
     if (ntfs->orphan_map)
         ntfs_orphan_map_free(ntfs);
 
+    ntfs_comp_cache_free(ntfs);
+
     tsk_deinit_lock(&ntfs->lock);
     tsk_deinit_lock(&ntfs->orphan_map_lock);
-#if TSK_USE_SID
-    tsk_deinit_lock(&ntfs->sid_lock);
-#endif
+    tsk_deinit_lock(&ntfs->comp_cache_lock);
 
     tsk_fs_free(fs);
 }
@@ -4714,7 +5085,8 @@ ntfs_open(TSK_IMG_INFO * img_info, TSK_OFF_T offset,
 
     ntfs->loading_the_MFT = 0;
     ntfs->bmap = NULL;
-    ntfs->bmap_buf = NULL;
+    ntfs->bmap_chunks = NULL;
+    ntfs->bmap_len = 0;
 
     /* Read the boot sector */
     len = roundup(sizeof(ntfs_sb), img_info->sector_size);
@@ -4908,8 +5280,13 @@ ntfs_open(TSK_IMG_INFO * img_info, TSK_OFF_T offset,
     // set up locks
     tsk_init_lock(&ntfs->lock);
     tsk_init_lock(&ntfs->orphan_map_lock);
+    tsk_init_lock(&ntfs->comp_cache_lock);
 #if TSK_USE_SID
     tsk_init_lock(&ntfs->sid_lock);
+    ntfs->sid_loaded = 0;
+    ntfs->sid_map = NULL;
+    ntfs->sid_map_cnt = 0;
+    ntfs->sds_buf = NULL;
 #endif
 
     /*
@@ -4991,22 +5368,6 @@ ntfs_open(TSK_IMG_INFO * img_info, TSK_OFF_T offset,
         return NULL;
     }
 
-    /* load the SID data into ntfs_info ($Secure - $SDS, $SDH, $SII */
-
-
-#if TSK_USE_SID
-    if (ntfs_load_secure(ntfs)) {
-        fs->tag = 0;
-        tsk_fs_file_close(ntfs->mft_file);
-        free(ntfs->fs);
-        free(ntfs);
-        if (tsk_verbose)
-            fprintf(stderr, "ntfs_open: Error loading Secure Info (%s)\n",
-                tsk_error_get());
-        return NULL;
-    }
-#endif
-
     // initialize the caches
     ntfs->attrdef = NULL;
     ntfs->orphan_map = NULL;
@@ -25,8 +25,9 @@
  * NTFS file name processing internal functions.
  */
 
-#include <map>
+#include <stddef.h>
 #include <vector>
+#include <algorithm>
 
 
 
@@ -35,122 +36,401 @@
  * we were pointed to a case whereby allocated files were not in IDX_ALLOC, but were
  * shown in Windows (when mounted).  They must have been found via the MFT entry, so 
  * we now load all parent to child relationships into the map. 
- * 
- * One of these classes is created per parent folder */
-class NTFS_PAR_MAP  {
-private:
-        // maps sequence number to list of inums for the folder at that seq.
-        std::map <uint32_t, std::vector <TSK_INUM_T> > seq2addrs;
-public:
-        /**
-         * Add a child to this parent.
-         * @param seq Sequence of the parent that this child belonged to
-         * @param inum Address of child in the folder.
-         */
-        void add (uint32_t seq, TSK_INUM_T inum) {
-            seq2addrs[seq].push_back(inum);
+ *
+ * The map is built with a single sequential pass over $MFT (instead of an
+ * inode_walk that fully parses every entry) and is stored as sorted arrays. 
+ * It also keeps the names so that directory listings and the name of a file
+ * (ffind) can be determined without opening each of the entries. 
+ * It can be saved to and loaded from a cache file so that it does not need
+ * to be rebuilt each time the file system is opened. */
+
+/* One of these is created for each $FILE_NAME attribute. */
+typedef struct {
+    TSK_INUM_T par_addr;        // Address of the parent folder
+    TSK_INUM_T child_addr;      // Address of the entry that has the name
+    uint32_t name_off;          // Offset of the UTF-8 name in NTFS_PARENT_MAP::names
+    uint16_t par_seq;           // Sequence of the parent that this child belonged to
+} NTFS_PAR_ENTRY;
+
+/* Flags for NTFS_PAR_META */
+#define NTFS_PAR_META_VALID 0x01        // Entry was read and was a base record
+#define NTFS_PAR_META_ALLOC 0x02        // Entry is allocated
+#define NTFS_PAR_META_DIR   0x04        // Entry is a directory
+
+/* One of these is created for each MFT entry. */
+typedef struct {
+    uint16_t seq;               // Sequence number of the MFT entry
+    uint8_t flags;              // NTFS_PAR_META_ flags
+} NTFS_PAR_META;
+
+/* Sort entries by parent address, parent sequence, and then child */
+static bool
+ntfs_par_entry_lt(const NTFS_PAR_ENTRY & a, const NTFS_PAR_ENTRY & b)
+{
+    if (a.par_addr != b.par_addr)
+        return a.par_addr < b.par_addr;
+    if (a.par_seq != b.par_seq)
+        return a.par_seq < b.par_seq;
+    return a.child_addr < b.child_addr;
+}
+
+class NTFS_PARENT_MAP {
+  public:
+    std::vector < NTFS_PAR_ENTRY > entries;     // sorted with ntfs_par_entry_lt
+    std::vector < uint32_t > by_child;  // indices into entries sorted by child_addr
+    std::vector < NTFS_PAR_META > meta; // indexed by MFT entry address
+    std::vector < char >names;  // NULL-terminated UTF-8 names
+
+    /**
+     * Add a name to the map.
+     * @returns 1 if the name buffer is full
+     */
+    uint8_t add(TSK_INUM_T par, uint16_t par_seq, TSK_INUM_T child,
+        const char *name) {
+        NTFS_PAR_ENTRY ent;
+        size_t len = strlen(name) + 1;
+
+        if (names.size() + len > 0xffffffffULL)
+            return 1;
+        ent.par_addr = par;
+        ent.par_seq = par_seq;
+        ent.child_addr = child;
+        ent.name_off = (uint32_t) names.size();
+        names.insert(names.end(), name, name + len);
+        entries.push_back(ent);
+        return 0;
+    }
+
+    /** Sort the entries and build the child index after they have all been added. */
+    void finish() {
+        std::sort(entries.begin(), entries.end(), ntfs_par_entry_lt);
+        by_child.resize(entries.size());
+        for (size_t i = 0; i < entries.size(); i++)
+            by_child[i] = (uint32_t) i;
+        std::stable_sort(by_child.begin(), by_child.end(),
+            ChildCmp(entries));
+    }
+
+    /**
+     * Get the range of entries for the children of a folder at a given sequence.
+     * @param par Parent inode to find child files for
+     * @param seq Sequence of parent folder
+     * @param a_begin [out] First entry in range
+     * @param a_end [out] One past the last entry in range
+     */
+    void children(TSK_INUM_T par, uint16_t seq, size_t & a_begin,
+        size_t & a_end) const {
+        NTFS_PAR_ENTRY key;
+        key.par_addr = par;
+        key.par_seq = seq;
+        key.child_addr = 0;
+        a_begin = std::lower_bound(entries.begin(), entries.end(), key,
+            ntfs_par_entry_lt) - entries.begin();
+        for (a_end = a_begin; a_end < entries.size(); a_end++) {
+            if ((entries[a_end].par_addr != par)
+                || (entries[a_end].par_seq != seq))
+                break;
         }
+    }
 
-        /**
-         * Test if there are any children for this directory at a given sequence.
-         * @param seq Sequence to test.
-         * @returns true if children exist
-         */
-        bool exists (uint32_t seq) {
-            if (seq2addrs.count(seq) > 0) 
-                return true;
+    /**
+     * Get the range of by_child indices for the names of an entry.
+     * @param child Address of entry to find names for
+     * @param a_begin [out] First index in by_child
+     * @param a_end [out] One past the last index in by_child
+     */
+    void parents(TSK_INUM_T child, size_t & a_begin, size_t & a_end) const {
+        size_t lo = 0, hi = by_child.size();
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (entries[by_child[mid]].child_addr < child)
+                lo = mid + 1;
             else
-                return false;
+                hi = mid;
         }
-
-        /** 
-         * Get the children for this folder at a given sequence.  Use exists first. 
-         * @param seq Sequence number to retrieve children for.
-         * @returns list of INUMS for children.
-         */
-        std::vector <TSK_INUM_T> & get (uint32_t seq) {
-            return seq2addrs[seq];
+        a_begin = lo;
+        for (a_end = a_begin; a_end < by_child.size(); a_end++) {
+            if (entries[by_child[a_end]].child_addr != child)
+                break;
         }
- };
+    }
+
+    const char *name(const NTFS_PAR_ENTRY & ent) const {
+        return &names[ent.name_off];
+    }
 
+  private:
+    struct ChildCmp {
+        const std::vector < NTFS_PAR_ENTRY > &ents;
+        ChildCmp(const std::vector < NTFS_PAR_ENTRY > &a_ents):ents(a_ents) {
+        } bool operator() (uint32_t a, uint32_t b) const {
+            return ents[a].child_addr < ents[b].child_addr;
+    }};
+};
+
+/* $FILE_NAME attributes that were found in extension MFT entries. They
+ * are added to the map after the pass if the base entry still refers to them. */
+typedef struct {
+    TSK_INUM_T base_addr;
+    uint16_t base_seq;
+    TSK_INUM_T par_addr;
+    uint16_t par_seq;
+    uint32_t name_off;
+} NTFS_PAR_EXT;
+
+/* Number of bytes of $MFT to read at a time when building the map */
+#define NTFS_PAR_MAP_READ_SIZE  (1024 * 1024)
 
 
 /** \internal
-* Casts the void * to a map.  This obfuscation is done so that the rest of the library
-* can remain as C and only this code needs to be C++.
-*
-* Assumes that you already have the lock
-*/
-static std::map<TSK_INUM_T, NTFS_PAR_MAP> * getParentMap(NTFS_INFO *ntfs) {
-    // allocate it if it hasn't already been 
-    if (ntfs->orphan_map == NULL) {
-        ntfs->orphan_map = new std::map<TSK_INUM_T, NTFS_PAR_MAP>;
-    }
-    return (std::map<TSK_INUM_T, NTFS_PAR_MAP> *)ntfs->orphan_map;
+ * Return the map stored in NTFS_INFO.  This obfuscation is done so that the rest of the library
+ * can remain as C and only this code needs to be C++.
+ *
+ * @returns NULL if the map has not been built yet
+ */
+static NTFS_PARENT_MAP *
+getParentMap(NTFS_INFO * ntfs)
+{
+    return (NTFS_PARENT_MAP *) ntfs->orphan_map;
 }
 
 
-
 /** \internal
- * Add a parent and child pair to the map stored in NTFS_INFO
+ * Process the $FILE_NAME attributes in a raw MFT entry and add them to the map.
  *
- * Note: This routine assumes &ntfs->orhpan_map_lock is locked by the caller.
- *
- * @param ntfs structure to add the pair to
- * @param par Parent address
- * @param child Child address
+ * @param ntfs File system being analyzed
+ * @param map Map being built
+ * @param ext List to add names to that are in extension entries
+ * @param extnames Name buffer for ext
+ * @param a_buf MFT entry (with the update sequence already removed)
+ * @param a_mftnum Address of MFT entry
  * @returns 1 on error
  */
 static uint8_t
-ntfs_parent_map_add(NTFS_INFO * ntfs, TSK_FS_META_NAME_LIST *name_list, TSK_INUM_T child)
+ntfs_parent_map_proc_entry(NTFS_INFO * ntfs, NTFS_PARENT_MAP * map,
+    std::vector < NTFS_PAR_EXT > &ext, std::vector < char >&extnames,
+    char *a_buf, TSK_INUM_T a_mftnum)
 {
-    std::map<TSK_INUM_T, NTFS_PAR_MAP> *tmpParentMap = getParentMap(ntfs);
-    NTFS_PAR_MAP &tmpParMap = (*tmpParentMap)[name_list->par_inode];
-    tmpParMap.add(name_list->par_seq, child);
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) & ntfs->fs_info;
+    ntfs_mft *mft = (ntfs_mft *) a_buf;
+    uintptr_t end = (uintptr_t) a_buf + ntfs->mft_rsize_b;
+    uint16_t attr_off = tsk_getu16(fs->endian, mft->attr_off);
+    TSK_INUM_T base_addr = tsk_getu48(fs->endian, mft->base_ref);
+    char name[NTFS_MAXNAMLEN_UTF8 + 1];
+    ntfs_attr *attr;
+
+    if ((attr_off < sizeof(ntfs_mft)) || (attr_off >= ntfs->mft_rsize_b))
+        return 0;
+
+    if (base_addr == NTFS_MFT_BASE) {
+        NTFS_PAR_META & pm = map->meta[a_mftnum];
+        uint16_t mflags = tsk_getu16(fs->endian, mft->flags);
+        pm.seq = tsk_getu16(fs->endian, mft->seq);
+        pm.flags = NTFS_PAR_META_VALID;
+        if (mflags & NTFS_MFT_INUSE)
+            pm.flags |= NTFS_PAR_META_ALLOC;
+        if (mflags & NTFS_MFT_DIR)
+            pm.flags |= NTFS_PAR_META_DIR;
+    }
+
+    for (attr = (ntfs_attr *) ((uintptr_t) a_buf + attr_off);
+        (uintptr_t) attr + 16 <= end;
+        attr =
+        (ntfs_attr *) ((uintptr_t) attr + tsk_getu32(fs->endian,
+                attr->len))) {
+        uint32_t type = tsk_getu32(fs->endian, attr->type);
+        uint32_t len = tsk_getu32(fs->endian, attr->len);
+        ntfs_attr_fname *fname;
+        UTF16 *name16;
+        UTF8 *name8;
+        int retVal;
+
+        if ((type == 0xffffffff) || (len == 0)
+            || ((uintptr_t) attr + len > end))
+            break;
+        if ((type != NTFS_ATYPE_FNAME) || (attr->res != NTFS_MFT_RES)
+            || (len < 24))
+            continue;
+
+        fname =
+            (ntfs_attr_fname *) ((uintptr_t) attr +
+            tsk_getu16(fs->endian, attr->c.r.soff));
+        if (((uintptr_t) & fname->name > (uintptr_t) attr + len) ||
+            ((uintptr_t) & fname->name + fname->nlen * 2 >
+                (uintptr_t) attr + len))
+            continue;
+        if (fname->nspace == NTFS_FNAME_DOS)
+            continue;
+
+        name16 = (UTF16 *) & fname->name;
+        name8 = (UTF8 *) name;
+        retVal = tsk_UTF16toUTF8(fs->endian, (const UTF16 **) &name16,
+            (UTF16 *) ((uintptr_t) name16 + fname->nlen * 2),
+            &name8, (UTF8 *) ((uintptr_t) name8 + sizeof(name) - 1),
+            TSKlenientConversion);
+        if (retVal != TSKconversionOK) {
+            if (tsk_verbose)
+                tsk_fprintf(stderr,
+                    "ntfs_parent_map_proc_entry: Error converting NTFS name in $FNAME to UTF8: %d",
+                    retVal);
+            name8 = (UTF8 *) name;
+        }
+        *name8 = '\0';
+
+        if (base_addr == NTFS_MFT_BASE) {
+            if (map->add(tsk_getu48(fs->endian, fname->par_ref),
+                    tsk_getu16(fs->endian, fname->par_seq), a_mftnum,
+                    name)) {
+                tsk_error_reset();
+                tsk_error_set_errno(TSK_ERR_FS_GENFS);
+                tsk_error_set_errstr
+                    ("ntfs_parent_map_proc_entry: Too many names in file system");
+                return 1;
+            }
+        }
+        else {
+            NTFS_PAR_EXT e;
+            size_t nlen = strlen(name) + 1;
+            e.base_addr = base_addr;
+            e.base_seq = tsk_getu16(fs->endian, mft->base_seq);
+            e.par_addr = tsk_getu48(fs->endian, fname->par_ref);
+            e.par_seq = tsk_getu16(fs->endian, fname->par_seq);
+            e.name_off = (uint32_t) extnames.size();
+            extnames.insert(extnames.end(), name, name + nlen);
+            ext.push_back(e);
+        }
+    }
     return 0;
 }
 
+
 /** \internal
- * Returns if a parent has children or not.
+ * Build the parent map by reading the $MFT sequentially in large chunks
+ * and processing only the $FILE_NAME attributes.
  *
- * Note: This routine assumes &ntfs->orhpan_map_lock is locked by the caller.
+ * Note: This routine assumes &ntfs->orphan_map_lock is locked by the caller.
  *
- * @param ntfs File system that has already been analyzed
- * @param par Parent inode to find child files for
- * @seq seq Sequence of parent folder 
- * @returns true if parent has children.
+ * @param ntfs File system to analyze
+ * @returns NULL on error
  */
-static bool 
-ntfs_parent_map_exists(NTFS_INFO *ntfs, TSK_INUM_T par, uint32_t seq) 
+static NTFS_PARENT_MAP *
+ntfs_parent_map_build(NTFS_INFO * ntfs)
 {
-    std::map<TSK_INUM_T, NTFS_PAR_MAP> *tmpParentMap = getParentMap(ntfs);
-    if (tmpParentMap->count(par) > 0) {
-        NTFS_PAR_MAP &tmpParMap = (*tmpParentMap)[par];
-        if (tmpParMap.exists(seq))
-            return true;
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) & ntfs->fs_info;
+    TSK_INUM_T mft_cnt = fs->last_inum;    // last_inum is the virtual orphan dir
+    size_t per_read;
+    char *buf;
+    NTFS_PARENT_MAP *map;
+    std::vector < NTFS_PAR_EXT > ext;
+    std::vector < char >extnames;
+
+    per_read = NTFS_PAR_MAP_READ_SIZE / ntfs->mft_rsize_b;
+    if (per_read == 0)
+        per_read = 1;
+    if ((buf = (char *) tsk_malloc(per_read * ntfs->mft_rsize_b)) == NULL)
+        return NULL;
+
+    map = new NTFS_PARENT_MAP;
+    NTFS_PAR_META empty = { 0, 0 };
+    map->meta.assign((size_t) mft_cnt, empty);
+
+    for (TSK_INUM_T base = 0; base < mft_cnt; base += per_read) {
+        size_t cnt = per_read;
+        size_t len;
+        ssize_t ret;
+
+        if (base + cnt > mft_cnt)
+            cnt = (size_t) (mft_cnt - base);
+        len = cnt * ntfs->mft_rsize_b;
+
+        ret = tsk_fs_attr_read(ntfs->mft_data,
+            (TSK_OFF_T) base * ntfs->mft_rsize_b, buf, len,
+            TSK_FS_FILE_READ_FLAG_NONE);
+
+        for (size_t i = 0; i < cnt; i++) {
+            char *entry = &buf[i * ntfs->mft_rsize_b];
+            TSK_RETVAL_ENUM retval;
+
+            /* If the large read failed, fall back to reading one entry at
+             * a time so that a single bad sector does not stop us */
+            if (ret != (ssize_t) len) {
+                retval = ntfs_dinode_lookup(ntfs, entry, base + i);
+            }
+            else {
+                retval = ntfs_dinode_fixup(ntfs, entry);
+            }
+
+            if (retval == TSK_COR) {
+                if (tsk_verbose)
+                    tsk_error_print(stderr);
+                tsk_error_reset();
+                continue;
+            }
+            else if (retval != TSK_OK) {
+                free(buf);
+                delete map;
+                return NULL;
+            }
+
+            if (ntfs_parent_map_proc_entry(ntfs, map, ext, extnames,
+                    entry, base + i)) {
+                free(buf);
+                delete map;
+                return NULL;
+            }
+        }
+    }
+    free(buf);
+
+    /* Add the names from the extension entries if their base entry 
+     * is still using them */
+    for (size_t i = 0; i < ext.size(); i++) {
+        const NTFS_PAR_EXT & e = ext[i];
+        if ((e.base_addr >= mft_cnt)
+            || ((map->meta[e.base_addr].flags & NTFS_PAR_META_VALID) == 0)
+            || (map->meta[e.base_addr].seq != e.base_seq))
+            continue;
+
+        if (map->add(e.par_addr, e.par_seq, e.base_addr,
+                &extnames[e.name_off])) {
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_FS_GENFS);
+            tsk_error_set_errstr
+                ("ntfs_parent_map_build: Too many names in file system");
+            delete map;
+            return NULL;
+        }
     }
-    return false;
+
+    map->finish();
+
+    if (tsk_verbose)
+        tsk_fprintf(stderr,
+            "ntfs_parent_map_build: %" PRIuSIZE " names for %" PRIuINUM
+            " MFT entries\n", map->entries.size(), mft_cnt);
+    return map;
 }
 
+
 /** \internal
- * Look up a map entry by the parent address. You should call ntfs_parent_map_exists() before this, otherwise
- * an empty entry could be created. 
- *
- * Note: This routine assumes &ntfs->orhpan_map_lock is locked by the caller.
+ * Get the map, building it if it has not already been built. 
  *
- * @param ntfs File system that has already been analyzed
- * @param par Parent inode to find child files for
- * @param seq Sequence of parent inode 
- * @returns address of children files in the parent directory
+ * @param ntfs File system to analyze
+ * @returns NULL on error
  */
-static std::vector <TSK_INUM_T> &
-ntfs_parent_map_get(NTFS_INFO * ntfs, TSK_INUM_T par, uint32_t seq)
+static const NTFS_PARENT_MAP *
+ntfs_parent_map_load_int(NTFS_INFO * ntfs)
 {
-    std::map<TSK_INUM_T, NTFS_PAR_MAP> *tmpParentMap = getParentMap(ntfs);
-    NTFS_PAR_MAP &tmpParMap = (*tmpParentMap)[par];
-    return tmpParMap.get(seq);
-}
+    NTFS_PARENT_MAP *map;
 
+    tsk_take_lock(&ntfs->orphan_map_lock);
+    if ((map = getParentMap(ntfs)) == NULL) {
+        map = ntfs_parent_map_build(ntfs);
+        ntfs->orphan_map = map;
+    }
+    tsk_release_lock(&ntfs->orphan_map_lock);
+    return map;
+}
 
 
 // note that for consistency, this should be called parent_map_free, but
@@ -170,7 +450,7 @@ ntfs_orphan_map_free(NTFS_INFO * a_ntfs)
         tsk_release_lock(&a_ntfs->orphan_map_lock);
         return;
     }
-    std::map<TSK_INUM_T, NTFS_PAR_MAP> *tmpParentMap = getParentMap(a_ntfs);
+    NTFS_PARENT_MAP *tmpParentMap = getParentMap(a_ntfs);
 
     delete tmpParentMap;
     a_ntfs->orphan_map = NULL;
@@ -178,23 +458,345 @@ ntfs_orphan_map_free(NTFS_INFO * a_ntfs)
 }
 
 
-/* inode_walk callback that is used to populate the orphan_map
- * structure in NTFS_INFO */
-static TSK_WALK_RET_ENUM
-ntfs_parent_act(TSK_FS_FILE * fs_file, void *ptr)
+
+/* Layout of the parent map cache file.  It is written with fixed-width
+ * little endian fields (and no padding) so that it can be moved between 
+ * systems:
+ *
+ *   header (NTFS_PAR_CACHE_HEAD_LEN bytes):
+ *     0: magic (uint32), 4: version (uint32), 8: MFT entry size (uint32),
+ *     12: reserved (uint32), 16: MFT entry count (uint64), 
+ *     24: size of $MFT $Data (uint64), 32: root MFT entry (uint64), 
+ *     40: file system id (TSK_FS_INFO_FS_ID_LEN bytes),
+ *     72: number of names (uint64), 80: length of the names (uint64)
+ *   one NTFS_PAR_CACHE_META_LEN record per MFT entry:
+ *     0: sequence (uint16), 2: NTFS_PAR_META_ flags (uint8)
+ *   one NTFS_PAR_CACHE_ENTRY_LEN record per name:
+ *     0: parent address (uint64), 8: child address (uint64), 
+ *     16: offset of name (uint32), 20: parent sequence (uint16)
+ *   the NULL-terminated UTF-8 names
+ *
+ * The first NTFS_PAR_CACHE_ID_LEN bytes of the header identify the file 
+ * system and must match for the file to be loaded. */
+#define NTFS_PAR_CACHE_MAGIC    0x544b504d      // "TKPM"
+#define NTFS_PAR_CACHE_VER      2
+#define NTFS_PAR_CACHE_HEAD_LEN 88
+#define NTFS_PAR_CACHE_ID_LEN   72
+#define NTFS_PAR_CACHE_META_LEN 3
+#define NTFS_PAR_CACHE_ENTRY_LEN 22
+
+/* Number of bytes to buffer when writing and reading the cache file */
+#define NTFS_PAR_CACHE_BUF_SIZE (64 * 1024)
+
+static void
+ntfs_par_put16(uint8_t * a_buf, uint16_t a_val)
 {
-    NTFS_INFO *ntfs = (NTFS_INFO *) fs_file->fs_info;
-    TSK_FS_META_NAME_LIST *fs_name_list;
+    a_buf[0] = (uint8_t) a_val;
+    a_buf[1] = (uint8_t) (a_val >> 8);
+}
+
+static void
+ntfs_par_put32(uint8_t * a_buf, uint32_t a_val)
+{
+    ntfs_par_put16(a_buf, (uint16_t) a_val);
+    ntfs_par_put16(&a_buf[2], (uint16_t) (a_val >> 16));
+}
 
-    /* go through each file name structure */
-    fs_name_list = fs_file->meta->name2;
-    while (fs_name_list) {
-        if (ntfs_parent_map_add(ntfs, fs_name_list,
-                fs_file->meta->addr))
-            return TSK_WALK_ERROR;
-        fs_name_list = fs_name_list->next;
+static void
+ntfs_par_put64(uint8_t * a_buf, uint64_t a_val)
+{
+    ntfs_par_put32(a_buf, (uint32_t) a_val);
+    ntfs_par_put32(&a_buf[4], (uint32_t) (a_val >> 32));
+}
+
+
+/** \internal
+ * Fill in the cache header.  The values that identify the file system
+ * come from ntfs and the counts come from the arguments.
+ */
+static void
+ntfs_parent_cache_head(NTFS_INFO * ntfs, uint64_t a_entries_cnt,
+    uint64_t a_names_len, uint8_t * a_head)
+{
+    TSK_FS_INFO *fs = (TSK_FS_INFO *) & ntfs->fs_info;
+
+    memset(a_head, 0, NTFS_PAR_CACHE_HEAD_LEN);
+    ntfs_par_put32(&a_head[0], NTFS_PAR_CACHE_MAGIC);
+    ntfs_par_put32(&a_head[4], NTFS_PAR_CACHE_VER);
+    ntfs_par_put32(&a_head[8], ntfs->mft_rsize_b);
+    ntfs_par_put64(&a_head[16], fs->last_inum);
+    ntfs_par_put64(&a_head[24], ntfs->mft_data->size);
+    ntfs_par_put64(&a_head[32], ntfs->root_mft_addr);
+    memcpy(&a_head[40], fs->fs_id, TSK_FS_INFO_FS_ID_LEN);
+    ntfs_par_put64(&a_head[72], a_entries_cnt);
+    ntfs_par_put64(&a_head[80], a_names_len);
+}
+
+static FILE *
+ntfs_parent_cache_open(const TSK_TCHAR * a_path, int a_write)
+{
+#ifdef TSK_WIN32
+    return _wfopen(a_path, a_write ? L"wb" : L"rb");
+#else
+    return fopen(a_path, a_write ? "wb" : "rb");
+#endif
+}
+
+
+/** \internal
+ * Write the buffer to the cache file when it is full (or a_final is set)
+ * @returns 1 on error
+ */
+static uint8_t
+ntfs_parent_cache_flush(FILE * hFile, std::vector < uint8_t > &a_buf,
+    int a_final)
+{
+    if ((a_buf.size() < NTFS_PAR_CACHE_BUF_SIZE) && (a_final == 0))
+        return 0;
+    if ((a_buf.size())
+        && (fwrite(&a_buf[0], 1, a_buf.size(), hFile) != a_buf.size()))
+        return 1;
+    a_buf.clear();
+    return 0;
+}
+
+
+/**
+ * \ingroup fslib
+ * Save the NTFS parent to child map to a file so that it can be 
+ * loaded with ntfs_parent_map_load() the next time that the file system
+ * is opened.  The map is built if it has not already been.
+ *
+ * @param a_fs NTFS file system
+ * @param a_path Path to cache file to create
+ * @returns 1 on error and 0 on success
+ */
+uint8_t
+ntfs_parent_map_save(TSK_FS_INFO * a_fs, const TSK_TCHAR * a_path)
+{
+    NTFS_INFO *ntfs = (NTFS_INFO *) a_fs;
+    const NTFS_PARENT_MAP *map;
+    std::vector < uint8_t > buf;
+    uint8_t rec[NTFS_PAR_CACHE_HEAD_LEN];
+    FILE *hFile;
+    uint8_t failed = 0;
+
+    if ((a_fs == NULL) || (a_fs->tag != TSK_FS_INFO_TAG)
+        || (TSK_FS_TYPE_ISNTFS(a_fs->ftype) == 0) || (a_path == NULL)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr("ntfs_parent_map_save: Invalid arguments");
+        return 1;
+    }
+
+    if ((map = ntfs_parent_map_load_int(ntfs)) == NULL)
+        return 1;
+
+    if ((hFile = ntfs_parent_cache_open(a_path, 1)) == NULL) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_WRITE);
+        tsk_error_set_errstr("ntfs_parent_map_save: Error creating %"
+            PRIttocTSK, a_path);
+        return 1;
+    }
+
+    buf.reserve(NTFS_PAR_CACHE_BUF_SIZE + NTFS_PAR_CACHE_HEAD_LEN);
+    ntfs_parent_cache_head(ntfs, map->entries.size(), map->names.size(),
+        rec);
+    buf.insert(buf.end(), rec, rec + NTFS_PAR_CACHE_HEAD_LEN);
+
+    for (size_t i = 0; (i < map->meta.size()) && (failed == 0); i++) {
+        ntfs_par_put16(&rec[0], map->meta[i].seq);
+        rec[2] = map->meta[i].flags;
+        buf.insert(buf.end(), rec, rec + NTFS_PAR_CACHE_META_LEN);
+        failed = ntfs_parent_cache_flush(hFile, buf, 0);
+    }
+    for (size_t i = 0; (i < map->entries.size()) && (failed == 0); i++) {
+        const NTFS_PAR_ENTRY & ent = map->entries[i];
+        ntfs_par_put64(&rec[0], ent.par_addr);
+        ntfs_par_put64(&rec[8], ent.child_addr);
+        ntfs_par_put32(&rec[16], ent.name_off);
+        ntfs_par_put16(&rec[20], ent.par_seq);
+        buf.insert(buf.end(), rec, rec + NTFS_PAR_CACHE_ENTRY_LEN);
+        failed = ntfs_parent_cache_flush(hFile, buf, 0);
+    }
+    if ((failed == 0) && (ntfs_parent_cache_flush(hFile, buf, 1)
+            || ((map->names.size())
+                && (fwrite(&map->names[0], 1, map->names.size(),
+                        hFile) != map->names.size()))))
+        failed = 1;
+
+    if (fclose(hFile))
+        failed = 1;
+    if (failed) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_WRITE);
+        tsk_error_set_errstr("ntfs_parent_map_save: Error writing %"
+            PRIttocTSK, a_path);
+        return 1;
+    }
+    return 0;
+}
+
+
+/** \internal
+ * Read a_cnt records of a_len bytes from the cache file in pieces 
+ * and pass each to a_func. 
+ * @returns 1 if the file is too short
+ */
+template < class T > static uint8_t
+ntfs_parent_cache_read(FILE * hFile, size_t a_cnt, size_t a_len,
+    std::vector < T > &a_out, void (*a_func) (const uint8_t *, T &))
+{
+    std::vector < uint8_t > buf;
+    size_t per_read = NTFS_PAR_CACHE_BUF_SIZE / a_len;
+
+    a_out.resize(a_cnt);
+    buf.resize(per_read * a_len);
+    for (size_t i = 0; i < a_cnt; i += per_read) {
+        size_t cnt = per_read;
+        if (i + cnt > a_cnt)
+            cnt = a_cnt - i;
+        if (fread(&buf[0], a_len, cnt, hFile) != cnt)
+            return 1;
+        for (size_t j = 0; j < cnt; j++)
+            a_func(&buf[j * a_len], a_out[i + j]);
+    }
+    return 0;
+}
+
+static void
+ntfs_parent_cache_get_meta(const uint8_t * a_rec, NTFS_PAR_META & a_meta)
+{
+    a_meta.seq = tsk_getu16(TSK_LIT_ENDIAN, &a_rec[0]);
+    a_meta.flags = a_rec[2];
+}
+
+static void
+ntfs_parent_cache_get_entry(const uint8_t * a_rec, NTFS_PAR_ENTRY & a_ent)
+{
+    a_ent.par_addr = tsk_getu64(TSK_LIT_ENDIAN, &a_rec[0]);
+    a_ent.child_addr = tsk_getu64(TSK_LIT_ENDIAN, &a_rec[8]);
+    a_ent.name_off = tsk_getu32(TSK_LIT_ENDIAN, &a_rec[16]);
+    a_ent.par_seq = tsk_getu16(TSK_LIT_ENDIAN, &a_rec[20]);
+}
+
+
+/**
+ * \ingroup fslib
+ * Load the NTFS parent to child map from a file that was created by 
+ * ntfs_parent_map_save() so that it does not need to be built from 
+ * $MFT.  The file is verified against the file system before it is used.
+ * Nothing is done if the map has already been built. 
+ *
+ * @param a_fs NTFS file system
+ * @param a_path Path to cache file to load
+ * @returns 1 on error (including a cache file that is for a different file system) and 0 on success
+ */
+uint8_t
+ntfs_parent_map_load(TSK_FS_INFO * a_fs, const TSK_TCHAR * a_path)
+{
+    NTFS_INFO *ntfs = (NTFS_INFO *) a_fs;
+    NTFS_PARENT_MAP *map;
+    uint8_t head[NTFS_PAR_CACHE_HEAD_LEN];
+    uint8_t head_exp[NTFS_PAR_CACHE_HEAD_LEN];
+    uint64_t entries_cnt, names_len;
+    FILE *hFile;
+
+    if ((a_fs == NULL) || (a_fs->tag != TSK_FS_INFO_TAG)
+        || (TSK_FS_TYPE_ISNTFS(a_fs->ftype) == 0) || (a_path == NULL)) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr("ntfs_parent_map_load: Invalid arguments");
+        return 1;
+    }
+
+    if ((hFile = ntfs_parent_cache_open(a_path, 0)) == NULL) {
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr("ntfs_parent_map_load: Error opening %"
+            PRIttocTSK, a_path);
+        return 1;
+    }
+
+    ntfs_parent_cache_head(ntfs, 0, 0, head_exp);
+    if ((fread(head, NTFS_PAR_CACHE_HEAD_LEN, 1, hFile) != 1)
+        || (memcmp(head, head_exp, NTFS_PAR_CACHE_ID_LEN) != 0)) {
+        fclose(hFile);
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr
+            ("ntfs_parent_map_load: %" PRIttocTSK
+            " is not a cache file for this file system", a_path);
+        return 1;
+    }
+    entries_cnt = tsk_getu64(TSK_LIT_ENDIAN, &head[72]);
+    names_len = tsk_getu64(TSK_LIT_ENDIAN, &head[80]);
+
+    map = new NTFS_PARENT_MAP;
+    if ((entries_cnt > 0xffffffffULL) || (names_len > 0xffffffffULL)
+        || ntfs_parent_cache_read(hFile, (size_t) a_fs->last_inum,
+            NTFS_PAR_CACHE_META_LEN, map->meta,
+            ntfs_parent_cache_get_meta)
+        || ntfs_parent_cache_read(hFile, (size_t) entries_cnt,
+            NTFS_PAR_CACHE_ENTRY_LEN, map->entries,
+            ntfs_parent_cache_get_entry)) {
+        fclose(hFile);
+        delete map;
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr("ntfs_parent_map_load: %" PRIttocTSK
+            " is corrupt", a_path);
+        return 1;
+    }
+    map->names.resize((size_t) names_len);
+    if ((map->names.size())
+        && (fread(&map->names[0], 1, map->names.size(),
+                hFile) != map->names.size())) {
+        fclose(hFile);
+        delete map;
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr("ntfs_parent_map_load: %" PRIttocTSK
+            " is corrupt", a_path);
+        return 1;
+    }
+    fclose(hFile);
+
+    /* sanity check the names and addresses so that a damaged cache
+     * file cannot cause us to read outside of the buffers */
+    for (size_t i = 0; i < map->entries.size(); i++) {
+        if ((map->entries[i].name_off >= map->names.size())
+            || (map->entries[i].child_addr >= a_fs->last_inum)) {
+            delete map;
+            tsk_error_reset();
+            tsk_error_set_errno(TSK_ERR_FS_ARG);
+            tsk_error_set_errstr("ntfs_parent_map_load: %" PRIttocTSK
+                " is corrupt", a_path);
+            return 1;
+        }
     }
-    return TSK_WALK_CONT;
+    if ((map->names.size()) && (map->names[map->names.size() - 1] != '\0')) {
+        delete map;
+        tsk_error_reset();
+        tsk_error_set_errno(TSK_ERR_FS_ARG);
+        tsk_error_set_errstr("ntfs_parent_map_load: %" PRIttocTSK
+            " is corrupt", a_path);
+        return 1;
+    }
+    map->finish();
+
+    tsk_take_lock(&ntfs->orphan_map_lock);
+    if (ntfs->orphan_map == NULL) {
+        ntfs->orphan_map = map;
+        map = NULL;
+    }
+    tsk_release_lock(&ntfs->orphan_map_lock);
+
+    // someone else built it while we were loading
+    if (map)
+        delete map;
+    return 0;
 }
 
 
@@ -1053,21 +1655,11 @@ ntfs_dir_open_meta(TSK_FS_INFO * a_fs, TSK_FS_DIR ** a_fs_dir,
 
     // get the orphan files
     // load and cache the map if it has not already been done
-    tsk_take_lock(&ntfs->orphan_map_lock);
-    if (ntfs->orphan_map == NULL) {
-        // we do this to make it non-NULL. WE had some images that
-        // had no orphan files and it repeatedly did inode_walks
-        // because orphan_map was always NULL
-        getParentMap(ntfs);
-
-        if (a_fs->inode_walk(a_fs, a_fs->first_inum, a_fs->last_inum,
-                (TSK_FS_META_FLAG_ENUM)(TSK_FS_META_FLAG_UNALLOC | TSK_FS_META_FLAG_ALLOC), ntfs_parent_act, NULL)) {
-            tsk_release_lock(&ntfs->orphan_map_lock);
-            return TSK_ERR;
-        }
+    const NTFS_PARENT_MAP *map = ntfs_parent_map_load_int(ntfs);
+    if (map == NULL) {
+        return TSK_ERR;
     }
 
-    
     /* see if there are any entries for this dir.
      * NTFS Updates the sequence when a directory is deleted and not when 
      * it is allocated.  So, if we have a deleted directory, then use
@@ -1083,49 +1675,32 @@ ntfs_dir_open_meta(TSK_FS_INFO * a_fs, TSK_FS_DIR ** a_fs_dir,
             seqToSrch = 0;
     }
 
-    if (ntfs_parent_map_exists(ntfs, a_addr, seqToSrch)) {
+    size_t child_beg, child_end;
+    map->children(a_addr, seqToSrch, child_beg, child_end);
+    if (child_beg < child_end) {
         TSK_FS_NAME *fs_name;
-        
-
-        std::vector <TSK_INUM_T> &childFiles = ntfs_parent_map_get(ntfs, a_addr, seqToSrch);
 
         if ((fs_name = tsk_fs_name_alloc(256, 0)) == NULL)
             return TSK_ERR;
 
         fs_name->type = TSK_FS_NAME_TYPE_UNDEF;
 
-        for (size_t a = 0; a < childFiles.size(); a++) {
-            TSK_FS_FILE *fs_file_orp = NULL;
-            /* Fill in the basics of the fs_name entry
-             * so we can print in the fls formats */
-            fs_name->meta_addr = childFiles[a];
-
-            // lookup the file to get its name (we did not cache that)
-            fs_file_orp =
-                tsk_fs_file_open_meta(a_fs, fs_file_orp, fs_name->meta_addr);
-            if (fs_file_orp) {
-                if ((fs_file_orp->meta) && (fs_file_orp->meta->name2)) {
-                    TSK_FS_META_NAME_LIST *n2 = fs_file_orp->meta->name2;
-                    if (fs_file_orp->meta->flags & TSK_FS_META_FLAG_ALLOC)
-                        fs_name->flags = TSK_FS_NAME_FLAG_ALLOC;
-                    else
-                        fs_name->flags = TSK_FS_NAME_FLAG_UNALLOC;
-
-                    while (n2) {
-                        if (n2->par_inode == a_addr) {
-                            strncpy(fs_name->name, n2->name, fs_name->name_size);
-                            tsk_fs_dir_add(fs_dir, fs_name);
-                        }
-                        n2 = n2->next;
-                    }
-                }
-                //free
-                tsk_fs_file_close(fs_file_orp);
-            }
+        /* The map has the name and allocation status of each child, 
+         * so we do not need to open them. */
+        for (size_t a = child_beg; a < child_end; a++) {
+            const NTFS_PAR_ENTRY & ent = map->entries[a];
+
+            fs_name->meta_addr = ent.child_addr;
+            if (map->meta[ent.child_addr].flags & NTFS_PAR_META_ALLOC)
+                fs_name->flags = TSK_FS_NAME_FLAG_ALLOC;
+            else
+                fs_name->flags = TSK_FS_NAME_FLAG_UNALLOC;
+
+            strncpy(fs_name->name, map->name(ent), fs_name->name_size);
+            tsk_fs_dir_add(fs_dir, fs_name);
         }
         tsk_fs_name_free(fs_name);
     }
-    tsk_release_lock(&ntfs->orphan_map_lock);
 
     // if we are listing the root directory, add the Orphan directory entry
     if (a_addr == a_fs->root_inum) {
@@ -1175,8 +1750,17 @@ typedef struct {
 } NTFS_DINFO;
 
 
+/* A name of a parent folder that ntfs_find_file_rec() needs to prepend */
+typedef struct {
+    const char *name;
+    TSK_INUM_T par_inode;
+    uint32_t par_seq;
+} NTFS_FIND_PAR;
+
 /*
- * Looks up the parent inode described in fs_name.
+ * Looks up the parent inode described in a_par_inode and a_par_seq.
+ * If the parent map has already been built, the names come from it. 
+ * Otherwise, the parent is loaded.
  *
  * fs_name was filled in by ntfs_find_file and will get the final path
  * added to it before action is called
@@ -1185,30 +1769,72 @@ typedef struct {
  */
 static uint8_t
 ntfs_find_file_rec(TSK_FS_INFO * fs, NTFS_DINFO * dinfo,
-    TSK_FS_FILE * fs_file, TSK_FS_META_NAME_LIST * fs_name_list,
+    TSK_FS_FILE * fs_file, TSK_INUM_T a_par_inode, uint32_t a_par_seq,
     TSK_FS_DIR_WALK_CB action, void *ptr)
 {
-    TSK_FS_FILE *fs_file_par;
-    TSK_FS_META_NAME_LIST *fs_name_list_par;
+    NTFS_INFO *ntfs = (NTFS_INFO *) fs;
+    const NTFS_PARENT_MAP *map;
+    TSK_FS_FILE *fs_file_par = NULL;
+    std::vector < NTFS_FIND_PAR > par_names;
+    bool par_is_dir;
+    uint32_t par_seq;
     uint8_t decrem = 0;
     size_t len = 0, i;
     char *begin = NULL;
     int retval;
 
 
-    if (fs_name_list->par_inode < fs->first_inum ||
-        fs_name_list->par_inode > fs->last_inum) {
+    if (a_par_inode < fs->first_inum || a_par_inode > fs->last_inum) {
         tsk_error_reset();
         tsk_error_set_errno(TSK_ERR_FS_ARG);
         tsk_error_set_errstr("invalid inode value: %" PRIuINUM "\n",
-            fs_name_list->par_inode);
+            a_par_inode);
         return 1;
     }
 
-    fs_file_par = tsk_fs_file_open_meta(fs, NULL, fs_name_list->par_inode);
-    if (fs_file_par == NULL) {
-        tsk_error_errstr2_concat(" - ntfs_find_file_rec");
-        return 1;
+    /* The lock is only needed to read the pointer. The map is not modified after it is built. */
+    tsk_take_lock(&ntfs->orphan_map_lock);
+    map = getParentMap(ntfs);
+    tsk_release_lock(&ntfs->orphan_map_lock);
+
+    if ((map) && (a_par_inode < map->meta.size())
+        && (map->meta[a_par_inode].flags & NTFS_PAR_META_VALID)) {
+        size_t p_beg, p_end;
+
+        par_is_dir = (map->meta[a_par_inode].flags & NTFS_PAR_META_DIR) ?
+            true : false;
+        par_seq = map->meta[a_par_inode].seq;
+
+        map->parents(a_par_inode, p_beg, p_end);
+        for (size_t p = p_beg; p < p_end; p++) {
+            const NTFS_PAR_ENTRY & ent = map->entries[map->by_child[p]];
+            NTFS_FIND_PAR fp;
+            fp.name = map->name(ent);
+            fp.par_inode = ent.par_addr;
+            fp.par_seq = ent.par_seq;
+            par_names.push_back(fp);
+        }
+    }
+    else {
+        TSK_FS_META_NAME_LIST *fs_name_list_par;
+
+        fs_file_par = tsk_fs_file_open_meta(fs, NULL, a_par_inode);
+        if (fs_file_par == NULL) {
+            tsk_error_errstr2_concat(" - ntfs_find_file_rec");
+            return 1;
+        }
+        par_is_dir = (fs_file_par->meta->type == TSK_FS_META_TYPE_DIR);
+        par_seq = fs_file_par->meta->seq;
+
+        for (fs_name_list_par = fs_file_par->meta->name2;
+            fs_name_list_par != NULL;
+            fs_name_list_par = fs_name_list_par->next) {
+            NTFS_FIND_PAR fp;
+            fp.name = fs_name_list_par->name;
+            fp.par_inode = fs_name_list_par->par_inode;
+            fp.par_seq = fs_name_list_par->par_seq;
+            par_names.push_back(fp);
+        }
     }
 
     /*
@@ -1217,8 +1843,7 @@ ntfs_find_file_rec(TSK_FS_INFO * fs, NTFS_DINFO * dinfo,
      * - The parent is no longer a directory
      * - The sequence number of the parent is no longer correct
      */
-    if ((fs_file_par->meta->type != TSK_FS_META_TYPE_DIR)
-        || (fs_file_par->meta->seq != fs_name_list->par_seq)) {
+    if ((par_is_dir == false) || (par_seq != a_par_seq)) {
         const char *str = TSK_FS_ORPHAN_STR;
         len = strlen(str);
 
@@ -1243,15 +1868,15 @@ ntfs_find_file_rec(TSK_FS_INFO * fs, NTFS_DINFO * dinfo,
         if (decrem)
             dinfo->depth--;
 
-        tsk_fs_file_close(fs_file_par);
+        if (fs_file_par)
+            tsk_fs_file_close(fs_file_par);
         return (retval == TSK_WALK_ERROR) ? 1 : 0;
     }
 
-    for (fs_name_list_par = fs_file_par->meta->name2;
-        fs_name_list_par != NULL;
-        fs_name_list_par = fs_name_list_par->next) {
+    for (size_t n = 0; n < par_names.size(); n++) {
+        const NTFS_FIND_PAR & fp = par_names[n];
 
-        len = strlen(fs_name_list_par->name);
+        len = strlen(fp.name);
 
         /* do some length checks on the dir structure
          * if we can't fit it then forget about it */
@@ -1267,7 +1892,7 @@ ntfs_find_file_rec(TSK_FS_INFO * fs, NTFS_DINFO * dinfo,
 
             *begin = '/';
             for (i = 0; i < len; i++)
-                begin[i + 1] = fs_name_list_par->name[i];
+                begin[i + 1] = fp.name[i];
         }
         else {
             begin = dinfo->didx[dinfo->depth];
@@ -1278,23 +1903,25 @@ ntfs_find_file_rec(TSK_FS_INFO * fs, NTFS_DINFO * dinfo,
         /* if we are at the root, then fill out the rest of fs_name with
          * the full path and call the action
          */
-        if (fs_name_list_par->par_inode == NTFS_ROOTINO) {
+        if (fp.par_inode == NTFS_ROOTINO) {
             /* increase the path by one so that we do not pass the '/'
              * if we do then the printed result will have '//' at
              * the beginning
              */
             if (TSK_WALK_ERROR == action(fs_file,
                     (const char *) ((uintptr_t) begin + 1), ptr)) {
-                tsk_fs_file_close(fs_file_par);
+                if (fs_file_par)
+                    tsk_fs_file_close(fs_file_par);
                 return 1;
             }
         }
 
         /* otherwise, recurse some more */
         else {
-            if (ntfs_find_file_rec(fs, dinfo, fs_file, fs_name_list_par,
-                    action, ptr)) {
-                tsk_fs_file_close(fs_file_par);
+            if (ntfs_find_file_rec(fs, dinfo, fs_file, fp.par_inode,
+                    fp.par_seq, action, ptr)) {
+                if (fs_file_par)
+                    tsk_fs_file_close(fs_file_par);
                 return 1;
             }
         }
@@ -1304,7 +1931,8 @@ ntfs_find_file_rec(TSK_FS_INFO * fs, NTFS_DINFO * dinfo,
             dinfo->depth--;
     }
 
-    tsk_fs_file_close(fs_file_par);
+    if (fs_file_par)
+        tsk_fs_file_close(fs_file_par);
 
     return 0;
 }
@@ -1469,7 +2097,8 @@ ntfs_find_file(TSK_FS_INFO * fs, TSK_INUM_T inode_toid, uint32_t type_toid,
         }
         /* call the recursive function on the parent to get the full path */
         else {
-            if (ntfs_find_file_rec(fs, &dinfo, fs_file, fs_name_list,
+            if (ntfs_find_file_rec(fs, &dinfo, fs_file,
+                    fs_name_list->par_inode, fs_name_list->par_seq,
                     action, ptr)) {
                 tsk_fs_file_close(fs_file);
                 free(mft);
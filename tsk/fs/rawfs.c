@@ -76,6 +76,7 @@ rawfs_open(TSK_IMG_INFO * img_info, TSK_OFF_T offset)
 
     fs->block_walk = tsk_fs_nofs_block_walk;
     fs->block_getflags = tsk_fs_nofs_block_getflags;
+    fs->block_getflags_range = tsk_fs_nofs_block_getflags_range;
 
     fs->inode_walk = tsk_fs_nofs_inode_walk;
     fs->file_add_meta = tsk_fs_nofs_file_add_meta;
@@ -634,6 +634,24 @@ extern "C" {
 
 
 
+#define EXT2FS_BMAP_CACHE_CNT   32      ///< Number of block (and inode) bitmaps to cache
+#define EXT2FS_BMAP_READ_MAX    16      ///< Max number of adjacent bitmaps to read at once
+#define EXT2FS_ITBL_CACHE_CNT   16      ///< Number of inode table chunks to cache
+#define EXT2FS_ITBL_CACHE_BLKS  16      ///< Number of inode table blocks in each cached chunk
+#define EXT2FS_ISCAN_BLKS       256     ///< Number of inode table blocks read at a time by inode_walk
+#define EXT2FS_EXTENT_READ_MAX  16      ///< Max number of adjacent extent tree blocks to read at once
+#define EXT2FS_EXTENT_MAX_DEPTH 5       ///< Max depth of an extent tree
+
+    /*
+     * Entry in one of the bitmap or inode table caches.
+     */
+    typedef struct {
+        uint8_t *buf;           /* cached data (allocated on first use) */
+        TSK_DADDR_T key;        /* group number for bitmaps, first block for inode tables */
+        size_t len;             /* number of valid bytes in buf (0 if the entry is not used) */
+        uint64_t age;           /* value of cache_age when the entry was last used */
+    } EXT2FS_CACHE_ENT;
+
     /*
      * Structure of an ext2fs file system handle.
      */
@@ -641,7 +659,7 @@ extern "C" {
         TSK_FS_INFO fs_info;    /* super class */
         ext2fs_sb *fs;          /* super block */
 
-        /* lock protects grp_buf, grp_num, bmap_buf, bmap_grp_num, imap_buf, imap_grp_num */
+        /* lock protects grp_buf, grp_num, bmap_cache, imap_cache, itbl_cache, cache_age */
         tsk_lock_t lock;
 
         void *v_grp_buf;
@@ -650,11 +668,15 @@ extern "C" {
 
         EXT2_GRPNUM_T grp_num;  /* cached group number r/w shared - lock */
 
-        uint8_t *bmap_buf;      /* cached block allocation bitmap r/w shared - lock */
-        EXT2_GRPNUM_T bmap_grp_num;     /* cached block bitmap nr r/w shared - lock */
+        /* gd_buf is loaded at open and not modified after that, so it is read without a lock */
+        uint8_t *gd_buf;        /* all group descriptors */
+        uint16_t gd_size;       /* size of each descriptor in gd_buf */
+        EXT2_GRPNUM_T gd_count; /* number of descriptors that could be read into gd_buf */
 
-        uint8_t *imap_buf;      /* cached inode allocation bitmap r/w shared - lock */
-        EXT2_GRPNUM_T imap_grp_num;     /* cached inode bitmap nr r/w shared - lock */
+        EXT2FS_CACHE_ENT bmap_cache[EXT2FS_BMAP_CACHE_CNT];     /* cached block allocation bitmaps r/w shared - lock */
+        EXT2FS_CACHE_ENT imap_cache[EXT2FS_BMAP_CACHE_CNT];     /* cached inode allocation bitmaps r/w shared - lock */
+        EXT2FS_CACHE_ENT itbl_cache[EXT2FS_ITBL_CACHE_CNT];     /* cached inode table blocks r/w shared - lock */
+        uint64_t cache_age;     /* incremented on each cache hit (for LRU) r/w shared - lock */
 
         TSK_OFF_T groups_offset;        /* offset to first group desc */
         EXT2_GRPNUM_T groups_count;     /* nr of descriptor group blocks */
@@ -58,6 +58,12 @@ extern "C" {
 #define FAT_CACHE_B		4096
 #define FAT_CACHE_S		8       // number of sectors in cache
 
+/* The first FAT is also kept decoded in memory (one uint32_t per cluster)
+ * when the file system has no more than FATFS_TABLE_MAX clusters.  The
+ * table is filled in chunks of FATFS_TABLE_CHUNK entries as they are used. */
+#define FATFS_TABLE_MAX		(64 * 1024 * 1024)
+#define FATFS_TABLE_CHUNK	16384   // must be even for FAT12
+
 /* MASK values for FAT entries */
 #define FATFS_12_MASK	0x00000fff
 #define FATFS_16_MASK	0x0000ffff
@@ -105,6 +111,9 @@ extern "C" {
 #define FATFS_SECT_2_INODE(fatfs, s)    \
     (TSK_INUM_T)((s - fatfs->firstdatasect) * fatfs->dentry_cnt_se + FATFS_FIRST_NORMINO)
 
+/* Maximum number of bytes of clusters that inode_walk reads at once */
+#define FATFS_WALK_READ_SIZE	(1024 * 1024)
+
 
 
 /*
@@ -302,11 +311,13 @@ extern "C" {
         //TSK_DATA_BUF *table;      /* cached section of file allocation table */
 
         /* FAT cache */
-        /* cache_lock protects fatc_buf, fatc_addr, fatc_ttl */
+        /* cache_lock protects fatc_buf, fatc_addr, fatc_ttl, fat_table, fat_table_loaded */
         tsk_lock_t cache_lock;
         char fatc_buf[FAT_CACHE_N][FAT_CACHE_B];        //r/w shared - lock
         TSK_DADDR_T fatc_addr[FAT_CACHE_N];     // r/w shared - lock
         uint8_t fatc_ttl[FAT_CACHE_N];  //r/w shared - lock
+        uint32_t *fat_table;    // decoded FAT entries, indexed by cluster (NULL if not used) (r/w shared - lock)
+        uint8_t *fat_table_loaded;      // per chunk of fat_table: 0 if not read yet, 1 if filled in, 2 if it could not be read (r/w shared - lock)
 
         fatfs_sb *sb;
 
@@ -343,8 +354,9 @@ extern "C" {
         uint16_t numroot;       /* number of 32-byte dentries in root dir */
         uint32_t mask;          /* the mask to use for the sectors */
 
-        tsk_lock_t dir_lock;    //< Lock that protects inum2par.
+        tsk_lock_t dir_lock;    //< Lock that protects inum2par and dir_sect_map.
         void *inum2par;         //< Maps subfolder metadata address to parent folder metadata addresses.
+        uint8_t *dir_sect_map;  //< Bitmap of sectors used by allocated directories (filled in by the first inode_walk that needs it)
     } FATFS_INFO;
 
 
@@ -468,6 +468,9 @@ extern "C" {
 #define cg_blksfree_lcl(fsi, cgp) \
 	((uint8_t *)((uint8_t *)(cgp) + tsk_gets32(fsi->endian, (cgp)->cg_freeoff)))
 
+/* Maximum number of bytes of inode table or data that the walks read at once */
+#define FFS_WALK_READ_SIZE	(1024 * 1024)
+
 
 
 
@@ -49,6 +49,8 @@ extern "C" {
 
     typedef struct TSK_FS_INFO TSK_FS_INFO;
     typedef struct TSK_FS_FILE TSK_FS_FILE;
+    typedef struct TSK_FS_CACHE TSK_FS_CACHE;
+    typedef struct TSK_FS_IFIND_INDEX TSK_FS_IFIND_INDEX;
 
 
 
@@ -130,6 +132,26 @@ extern "C" {
         TSK_FS_BLOCK_WALK_FLAG_ENUM a_flags, TSK_FS_BLOCK_WALK_CB a_action,
         void *a_ptr);
 
+    /**
+    * Function definition used for callback to tsk_fs_block_range_walk().
+    *
+    * @param a_fs File system that the blocks are in
+    * @param a_addr Address of the first block in the range
+    * @param a_len Number of blocks in the range
+    * @param a_flags Flags of every block in the range
+    * @param a_buf Content of the blocks (a_len * block_size bytes) or NULL if TSK_FS_BLOCK_WALK_FLAG_AONLY was given
+    * @param a_ptr Pointer that was supplied by the caller who called tsk_fs_block_range_walk
+    * @returns Value to identify if walk should continue, stop, or stop because of error
+    */
+    typedef TSK_WALK_RET_ENUM(*TSK_FS_BLOCK_RANGE_WALK_CB) (TSK_FS_INFO *
+        a_fs, TSK_DADDR_T a_addr, TSK_DADDR_T a_len,
+        TSK_FS_BLOCK_FLAG_ENUM a_flags, const char *a_buf, void *a_ptr);
+
+    extern uint8_t tsk_fs_block_range_walk(TSK_FS_INFO * a_fs,
+        TSK_DADDR_T a_start_blk, TSK_DADDR_T a_end_blk,
+        TSK_FS_BLOCK_WALK_FLAG_ENUM a_flags,
+        TSK_FS_BLOCK_RANGE_WALK_CB a_action, void *a_ptr);
+
     //@}
 
     /**************** DATA and DATA_LIST Structures ************/
@@ -611,6 +633,8 @@ extern "C" {
 
 
 #define TSK_FS_DIR_TAG  0x97531246
+    typedef struct TSK_FS_NAME_BLK TSK_FS_NAME_BLK;
+
     /**
     * A handle to a directory so that its files can be individually accessed.
     */
@@ -626,6 +650,8 @@ extern "C" {
         TSK_INUM_T addr;        ///< Metadata address of this directory 
 
         TSK_FS_INFO *fs_info;   ///< Pointer to file system the directory is located in
+
+        TSK_FS_NAME_BLK *name_blks;     ///< \internal Blocks that the name strings in names are allocated from (freed together when the directory is closed)
     } TSK_FS_DIR;
 
     /**
@@ -917,21 +943,42 @@ extern "C" {
 
         /* list_inum_named_lock protects list_inum_named */
         tsk_lock_t list_inum_named_lock;        // taken when r/w the list_inum_named list
-        TSK_LIST *list_inum_named;      /**< List of unallocated inodes that
+        TSK_BITMAP *list_inum_named;    /**< Set of unallocated inodes that
                                         * are pointed to by a file name -- 
                                         * Used to find orphan files.  Is filled 
                                         * after looking for orphans
                                         * or afer a full name_walk is performed.
+                                        * Not modified once it is set, so it can
+                                        * be searched without the lock.
                                         * (r/w shared - lock) */
 
         /* orphan_hunt_lock protects orphan_dir */
         tsk_lock_t orphan_dir_lock;     // taken for the duration of orphan hunting (not just when updating orphan_dir)
         TSK_FS_DIR *orphan_dir; ///< Files and dirs in the top level of the $OrphanFiles directory.  NULL if orphans have not been hunted for yet. (r/w shared - lock) 
 
+        /* meta_cache_lock protects meta_cache */
+        tsk_lock_t meta_cache_lock;     // taken when r/w the meta_cache
+        TSK_FS_CACHE *meta_cache;       ///< \internal Cache of loaded metadata structures.  NULL if caching is disabled (the default). Set with tsk_fs_meta_cache_set_size(). (r/w shared - lock)
+
+        /* dir_cache_lock protects dir_cache */
+        tsk_lock_t dir_cache_lock;      // taken when r/w the dir_cache
+        TSK_FS_CACHE *dir_cache;        ///< \internal Cache of loaded directory contents.  NULL if caching is disabled (the default). Set with tsk_fs_dir_cache_set_size(). (r/w shared - lock)
+
+        /* ifind_index_lock protects ifind_index */
+        tsk_lock_t ifind_index_lock;    // taken when r/w the ifind_index pointer
+        TSK_FS_IFIND_INDEX *ifind_index;        ///< \internal Index of the data units used by each file attribute.  NULL until tsk_fs_ifind_index_build() or tsk_fs_ifind_index_load() is called.  Not modified once it is set. (r/w shared - lock)
+
+        /* name_blk_lock protects name_blk_pool */
+        tsk_lock_t name_blk_lock;       // taken when r/w the name_blk_pool
+        TSK_FS_NAME_BLK *name_blk_pool[2];      ///< \internal Name string blocks from closed directories that can be reused (small and large blocks). (r/w shared - lock)
+        size_t name_blk_pool_cnt[2];    ///< \internal Number of blocks in each list of name_blk_pool
+
          uint8_t(*block_walk) (TSK_FS_INFO * fs, TSK_DADDR_T start, TSK_DADDR_T end, TSK_FS_BLOCK_WALK_FLAG_ENUM flags, TSK_FS_BLOCK_WALK_CB cb, void *ptr);    ///< FS-specific function: Call tsk_fs_block_walk() instead. 
 
          TSK_FS_BLOCK_FLAG_ENUM(*block_getflags) (TSK_FS_INFO * a_fs, TSK_DADDR_T a_addr);      ///< \internal
 
+         TSK_DADDR_T(*block_getflags_range) (TSK_FS_INFO * a_fs, TSK_DADDR_T a_addr, TSK_DADDR_T a_end, TSK_FS_BLOCK_FLAG_ENUM * a_flags);   ///< \internal Optional. Sets the flags of a_addr and returns how many blocks from a_addr to a_end have them (0 on error).  NULL if the file system does not have it.
+
          uint8_t(*inode_walk) (TSK_FS_INFO * fs, TSK_INUM_T start, TSK_INUM_T end, TSK_FS_META_FLAG_ENUM flags, TSK_FS_META_WALK_CB cb, void *ptr);     ///< FS-specific function: Call tsk_fs_meta_walk() instead. 
 
          uint8_t(*file_add_meta) (TSK_FS_INFO * fs, TSK_FS_FILE * fs_file, TSK_INUM_T addr);    ///< \internal
@@ -988,6 +1035,26 @@ extern "C" {
     extern const char *tsk_fs_type_toname(TSK_FS_TYPE_ENUM);
     extern TSK_FS_TYPE_ENUM tsk_fs_type_supported();
 
+    /**
+    * Statistics on the use of a cache.
+    */
+    typedef struct {
+        uint64_t hits;          ///< Number of lookups that were found in the cache
+        uint64_t misses;        ///< Number of lookups that had to be loaded from the file system
+        size_t entries;         ///< Number of entries currently in the cache
+        size_t bytes;           ///< Approximate number of bytes used by the entries
+        size_t max_bytes;       ///< Maximum number of bytes that the entries can use (0 if disabled)
+    } TSK_FS_CACHE_STATS;
+
+    extern uint8_t tsk_fs_meta_cache_set_size(TSK_FS_INFO * a_fs,
+        size_t a_max_bytes);
+    extern void tsk_fs_meta_cache_get_stats(TSK_FS_INFO * a_fs,
+        TSK_FS_CACHE_STATS * a_stats);
+    extern uint8_t tsk_fs_dir_cache_set_size(TSK_FS_INFO * a_fs,
+        size_t a_max_bytes);
+    extern void tsk_fs_dir_cache_get_stats(TSK_FS_INFO * a_fs,
+        TSK_FS_CACHE_STATS * a_stats);
+
     extern ssize_t tsk_fs_read(TSK_FS_INFO * a_fs, TSK_OFF_T a_off,
         char *a_buf, size_t a_len);
     extern ssize_t tsk_fs_read_block(TSK_FS_INFO * a_fs,
@@ -1030,6 +1097,10 @@ extern "C" {
     extern uint8_t tsk_fs_blkls(TSK_FS_INFO * fs,
         TSK_FS_BLKLS_FLAG_ENUM lclflags, TSK_DADDR_T bstart,
         TSK_DADDR_T bend, TSK_FS_BLOCK_WALK_FLAG_ENUM flags);
+    extern uint8_t tsk_fs_blkls_threads(TSK_FS_INFO * fs,
+        TSK_FS_BLKLS_FLAG_ENUM lclflags, TSK_DADDR_T bstart,
+        TSK_DADDR_T bend, TSK_FS_BLOCK_WALK_FLAG_ENUM flags,
+        unsigned int threads);
 
     extern uint8_t tsk_fs_blkstat(TSK_FS_INFO * fs, TSK_DADDR_T addr);
 
@@ -1057,6 +1128,19 @@ extern "C" {
     extern uint8_t tsk_fs_fls(TSK_FS_INFO * fs,
         TSK_FS_FLS_FLAG_ENUM lclflags, TSK_INUM_T inode,
         TSK_FS_DIR_WALK_FLAG_ENUM flags, TSK_TCHAR * pre, int32_t skew);
+    /**
+    * Function definition for callback in tsk_fs_fls_mac().
+    *
+    * @param a_line NULL terminated body file line (ends with a newline)
+    * @param a_ptr Pointer that was passed to tsk_fs_fls_mac()
+    * @returns Value to control the directory walk
+    */
+    typedef TSK_WALK_RET_ENUM(*TSK_FS_FLS_MAC_CB) (const char *a_line,
+        void *a_ptr);
+    extern uint8_t tsk_fs_fls_mac(TSK_FS_INFO * fs,
+        TSK_FS_FLS_FLAG_ENUM lclflags, TSK_INUM_T inode,
+        TSK_FS_DIR_WALK_FLAG_ENUM flags, const char *pre, int32_t skew,
+        TSK_FS_FLS_MAC_CB a_action, void *a_ptr);
 
     extern uint8_t tsk_fs_icat(TSK_FS_INFO * fs,
         TSK_INUM_T inum,
@@ -1077,6 +1161,37 @@ extern "C" {
     extern uint8_t tsk_fs_ifind_par(TSK_FS_INFO * fs,
         TSK_FS_IFIND_FLAG_ENUM flags, TSK_INUM_T par);
 
+    /**
+    * An attribute that uses a data unit, as found by tsk_fs_ifind_data_batch().
+    */
+    typedef struct {
+        TSK_DADDR_T addr;       ///< Data unit that was looked up
+        TSK_INUM_T inum;        ///< Address of the file that uses it
+        TSK_FS_ATTR_TYPE_ENUM type;     ///< Type of the attribute that uses it
+        uint16_t id;            ///< Id of the attribute that uses it
+        TSK_OFF_T offset;       ///< Byte offset of the data unit in the attribute
+    } TSK_FS_IFIND_DATA_HIT;
+
+    /**
+    * Function definition used for callback to tsk_fs_ifind_data_batch().
+    *
+    * @param a_fs File system
+    * @param a_hit Attribute that uses the data unit
+    * @param a_ptr Pointer that was supplied by the caller
+    * @returns Value to identify if the lookup should continue, stop, or stop because of an error
+    */
+    typedef TSK_WALK_RET_ENUM(*TSK_FS_IFIND_DATA_CB) (TSK_FS_INFO * a_fs,
+        const TSK_FS_IFIND_DATA_HIT * a_hit, void *a_ptr);
+
+    extern uint8_t tsk_fs_ifind_index_build(TSK_FS_INFO * fs);
+    extern uint8_t tsk_fs_ifind_index_save(TSK_FS_INFO * fs,
+        const TSK_TCHAR * path);
+    extern uint8_t tsk_fs_ifind_index_load(TSK_FS_INFO * fs,
+        const TSK_TCHAR * path);
+    extern uint8_t tsk_fs_ifind_data_batch(TSK_FS_INFO * fs,
+        TSK_FS_IFIND_FLAG_ENUM flags, const TSK_DADDR_T * addrs,
+        size_t addrs_cnt, TSK_FS_IFIND_DATA_CB action, void *ptr);
+
 
     enum TSK_FS_ILS_FLAG_ENUM {
         TSK_FS_ILS_NONE = 0x00,
@@ -108,6 +108,8 @@ extern "C" {
     extern TSK_FS_ATTR *tsk_fs_attrlist_getnew(TSK_FS_ATTRLIST *,
         TSK_FS_ATTR_FLAG_ENUM a_atype);
     extern void tsk_fs_attrlist_markunused(TSK_FS_ATTRLIST *);
+    extern TSK_FS_ATTRLIST *tsk_fs_attrlist_copy(TSK_FS_FILE *,
+        const TSK_FS_ATTRLIST *);
     extern const TSK_FS_ATTR *tsk_fs_attrlist_get(const TSK_FS_ATTRLIST *,
         TSK_FS_ATTR_TYPE_ENUM);
     extern const TSK_FS_ATTR *tsk_fs_attrlist_get_id(const TSK_FS_ATTRLIST
@@ -128,6 +130,22 @@ extern "C" {
     extern TSK_FS_META *tsk_fs_meta_realloc(TSK_FS_META *, size_t);
     extern void tsk_fs_meta_reset(TSK_FS_META *);
     extern void tsk_fs_meta_close(TSK_FS_META * fs_meta);
+    extern uint8_t tsk_fs_meta_copy(TSK_FS_FILE * a_fs_file,
+        const TSK_FS_META * a_fs_meta);
+
+    /* Metadata cache */
+    extern uint8_t tsk_fs_meta_cache_load(TSK_FS_INFO * a_fs,
+        TSK_FS_FILE * a_fs_file, TSK_INUM_T a_addr);
+    extern void tsk_fs_meta_cache_update(TSK_FS_INFO * a_fs,
+        const TSK_FS_META * a_fs_meta);
+    extern void tsk_fs_meta_cache_free(TSK_FS_INFO * a_fs);
+
+    /* Directory cache */
+    extern int8_t tsk_fs_dir_cache_get(TSK_FS_INFO * a_fs,
+        TSK_INUM_T a_addr, TSK_FS_DIR ** a_fs_dir);
+    extern void tsk_fs_dir_cache_update(TSK_FS_INFO * a_fs,
+        const TSK_FS_DIR * a_fs_dir);
+    extern void tsk_fs_dir_cache_free(TSK_FS_INFO * a_fs);
 
     /* FS_FILE */
     extern TSK_FS_FILE *tsk_fs_file_alloc(TSK_FS_INFO *);
@@ -136,6 +154,9 @@ extern "C" {
     extern TSK_FS_DIR *tsk_fs_dir_alloc(TSK_FS_INFO * a_fs,
         TSK_INUM_T a_addr, size_t a_cnt);
     extern uint8_t tsk_fs_dir_realloc(TSK_FS_DIR * a_fs_dir, size_t a_cnt);
+    extern uint8_t tsk_fs_dir_copy(const TSK_FS_DIR * a_src_dir,
+        TSK_FS_DIR * a_dst_dir);
+    extern void tsk_fs_dir_name_blk_pool_free(TSK_FS_INFO * a_fs);
     extern uint8_t tsk_fs_dir_add(TSK_FS_DIR * a_fs_dir,
         const TSK_FS_NAME * a_fs_dent);
     extern void tsk_fs_dir_reset(TSK_FS_DIR * a_fs_dir);
@@ -151,6 +172,11 @@ extern "C" {
     extern TSK_RETVAL_ENUM tsk_fs_dir_find_orphans(TSK_FS_INFO * a_fs,
         TSK_FS_DIR * a_fs_dir);
 
+    /* Data unit to attribute index */
+    extern void tsk_fs_ifind_index_free(TSK_FS_INFO * a_fs);
+    extern uint8_t tsk_fs_ifind_index_print(TSK_FS_INFO * a_fs,
+        TSK_DADDR_T a_addr);
+
     /* FS_DENT */
     extern TSK_FS_NAME *tsk_fs_name_alloc(size_t, size_t);
     extern uint8_t tsk_fs_name_realloc(TSK_FS_NAME *, size_t);
@@ -165,6 +191,9 @@ extern "C" {
     extern void tsk_fs_name_print_mac_md5(FILE *, const TSK_FS_FILE *,
         const char *, const TSK_FS_ATTR * fs_attr, const char *, int32_t,
 		const unsigned char *);
+    extern uint8_t tsk_fs_name_make_mac(char **, size_t *,
+        const TSK_FS_FILE *, const char *, const TSK_FS_ATTR * fs_attr,
+        const char *, int32_t, const unsigned char *);
     extern uint8_t tsk_fs_name_copy(TSK_FS_NAME * a_fs_name_to,
         const TSK_FS_NAME * a_fs_name_from);
     extern void tsk_fs_name_reset(TSK_FS_NAME * a_fs_name);
@@ -207,6 +236,9 @@ extern "C" {
         const char *);
     extern TSK_FS_BLOCK_FLAG_ENUM tsk_fs_nofs_block_getflags(TSK_FS_INFO
         * a_fs, TSK_DADDR_T a_addr);
+    extern TSK_DADDR_T tsk_fs_nofs_block_getflags_range(TSK_FS_INFO
+        * a_fs, TSK_DADDR_T a_addr, TSK_DADDR_T a_end,
+        TSK_FS_BLOCK_FLAG_ENUM * a_flags);
     extern uint8_t tsk_fs_nofs_block_walk(TSK_FS_INFO * fs,
         TSK_DADDR_T a_start_blk, TSK_DADDR_T a_end_blk,
         TSK_FS_BLOCK_WALK_FLAG_ENUM a_flags,
@@ -624,6 +624,51 @@ typedef union {
     hfs_file file;
 } hfs_file_folder;
 
+#define HFS_BT_TREE_CAT     1   ///< Catalog B-tree (for the node cache)
+#define HFS_BT_TREE_EXT     2   ///< Extents overflow B-tree (for the node cache)
+#define HFS_BT_TREE_ATTR    3   ///< Attributes B-tree (for the node cache)
+
+#define HFS_NODE_CACHE_CNT  64  ///< Number of B-tree nodes to cache
+#define HFS_CAT_SCAN_SIZE   (1024 * 1024)    ///< Max bytes of catalog leaf nodes to read at once
+
+// entry in the B-tree node cache
+typedef struct {
+    char *buf;                  /* contents of the node */
+    uint16_t len;               /* size of buf (0 if the entry is not used) */
+    uint8_t tree;               /* HFS_BT_TREE_* that the node is from */
+    uint8_t is_idx;             /* 1 if the node is an index node */
+    uint32_t node;              /* node number */
+    uint64_t age;               /* value of node_cache_age when last used */
+} HFS_NODE_CACHE_ENT;
+
+#define HFS_DECMPFS_TABLE_CNT   4       ///< Number of compression unit offset tables to cache
+#define HFS_DECMPFS_UNIT_CNT    8       ///< Number of decompressed compression units to cache
+
+// location of a compression unit in the resource fork (offset is relative to the offset table)
+typedef struct {
+    uint32_t offset;
+    uint32_t length;
+} CMP_OFFSET_ENTRY;
+
+// compression unit offset table of a file with its compressed data in the resource fork
+typedef struct {
+    TSK_INUM_T inum;            /* file the table is for (0 if the entry is not used) */
+    uint32_t table_off;         /* offset of the table in the resource fork */
+    uint32_t table_cnt;         /* number of entries in the whole table */
+    uint32_t table_first;       /* index of the first entry in table (non-zero if only part of the table was copied) */
+    CMP_OFFSET_ENTRY *table;
+    uint64_t age;               /* value of decmpfs_age when last used */
+} HFS_DECMPFS_TABLE;
+
+// decompressed compression unit
+typedef struct {
+    TSK_INUM_T inum;            /* file the unit is from (0 if the entry is not used) */
+    uint32_t unit;              /* index of the unit in the file */
+    uint32_t len;               /* number of bytes of decompressed data in buf */
+    char *buf;                  /* decompressed data (COMPRESSION_UNIT_SIZE bytes) */
+    uint64_t age;               /* value of decmpfs_age when last used */
+} HFS_DECMPFS_UNIT;
+
 typedef struct {
     TSK_FS_INFO fs_info;        /* SUPER CLASS */
 
@@ -674,6 +719,17 @@ typedef struct {
     unsigned char has_startup_file;
     unsigned char has_attributes_file;
 
+    // node_cache_lock protects node_cache and node_cache_age
+    tsk_lock_t node_cache_lock;
+    HFS_NODE_CACHE_ENT node_cache[HFS_NODE_CACHE_CNT];  // nodes of the B-trees (r/w shared - lock)
+    uint64_t node_cache_age;    // incremented on each cache use (r/w shared - lock)
+
+    // decmpfs_lock protects decmpfs_tables, decmpfs_units, and decmpfs_age
+    tsk_lock_t decmpfs_lock;
+    HFS_DECMPFS_TABLE decmpfs_tables[HFS_DECMPFS_TABLE_CNT];    // offset tables of compressed files (r/w shared - lock)
+    HFS_DECMPFS_UNIT decmpfs_units[HFS_DECMPFS_UNIT_CNT];       // recently decompressed units for hfs_file_read_special() (r/w shared - lock)
+    uint64_t decmpfs_age;       // incremented on each cache use (r/w shared - lock)
+
 } HFS_INFO;
 
 typedef struct {
@@ -787,5 +843,15 @@ typedef uint8_t(*TSK_HFS_BTREE_CB) (HFS_INFO *, int8_t level_type,
 extern uint8_t hfs_cat_traverse(HFS_INFO * hfs, const void *targ_data,
     TSK_HFS_BTREE_CB a_cb, void *ptr);
 
+/* Callback for hfs_cat_leaf_walk().  rec_off is the offset of the record
+ * data (after the key) in the catalog file and rec / rec_len are the record
+ * data in the node. */
+typedef TSK_WALK_RET_ENUM(*TSK_HFS_CAT_LEAF_CB) (HFS_INFO *,
+    const hfs_btree_key_cat * cur_key, TSK_OFF_T rec_off,
+    const char *rec, size_t rec_len, void *);
+
+extern uint8_t hfs_cat_leaf_walk(HFS_INFO * hfs, TSK_HFS_CAT_LEAF_CB a_cb,
+    void *ptr);
+
 
 #endif
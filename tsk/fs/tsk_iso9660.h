@@ -368,7 +368,7 @@ typedef struct {
     TSK_OFF_T susp_len;         ///< Length in bytes of SUSP
 } iso9660_inode;
 
-/* inode linked list node */
+/* inode array entry */
 typedef struct iso9660_inode_node {
     iso9660_inode inode;
     TSK_OFF_T offset;           /* byte offset of first block of file in file system */
@@ -376,9 +376,14 @@ typedef struct iso9660_inode_node {
     TSK_INUM_T inum;            /* identifier of inode (assigned by TSK) */
     int size;                   /* number of bytes in file */
     int ea_size;                /* length of ext attributes */
-    struct iso9660_inode_node *next;
 } iso9660_inode_node;
 
+/* entry in a sorted index of the inode array */
+typedef struct {
+    TSK_OFF_T key;              /* byte offset that the index is sorted by */
+    size_t idx;                 /* index of entry in in_list */
+} iso9660_inode_idx;
+
 /* The all important ISO_INFO struct */
 typedef struct {
     TSK_FS_INFO fs_info;        /* SUPER CLASS */
@@ -386,7 +391,15 @@ typedef struct {
     uint32_t root_addr;         /* address of root dir extent */
     iso9660_pvd_node *pvd;      ///< Head of primary volume descriptor list (there should be only one...)
     iso9660_svd_node *svd;      ///< Head of secondary volume descriptor list 
-    iso9660_inode_node *in_list;        /* list of inodes */
+    iso9660_inode_node *in_list;        /* array of inodes, indexed by inum */
+    size_t in_cnt;              /* number of entries used in in_list */
+    size_t in_alloc;            /* number of entries allocated in in_list */
+    size_t *in_hash;            /* in_list index + 1 of entries by extent and size (used while loading) */
+    size_t in_hash_size;        /* number of slots in in_hash (power of 2) */
+    size_t in_hash_cnt;         /* number of slots used in in_hash */
+    iso9660_inode_idx *in_by_dentry;    /* in_list sorted by dentry_offset */
+    iso9660_inode_idx *in_by_extent;    /* in_list sorted by offset */
+    TSK_DADDR_T *in_ext_last;   /* largest last block of the in_by_extent entries up to each one */
     uint8_t rr_found;           /* 1 if rockridge found */
 } ISO_INFO;
 
@@ -398,6 +411,11 @@ extern uint8_t iso9660_dinode_load(ISO_INFO * iso, TSK_INUM_T inum,
 
 extern int iso9660_name_cmp(TSK_FS_INFO *, const char *, const char *);
 
+extern iso9660_inode_node *iso9660_inode_find_dentry(ISO_INFO * iso,
+    TSK_OFF_T a_dentry_offset);
+extern iso9660_inode_node *iso9660_inode_find_extent(ISO_INFO * iso,
+    TSK_OFF_T a_offset);
+
 /**********************************************************
  *
  * RockRidge Extensions
@@ -528,6 +528,16 @@ extern "C" {
         size_t used;            ///< Number of records used in the buffer (size depends on type of data stored)
     } NTFS_SXX_BUFFER;
 
+/************************************************************************
+ * Security id to owner SID map entry
+ */
+    typedef struct {
+        uint32_t sec_id;        ///< Security id (from $SII)
+        uint8_t valid;          ///< 0 if the security descriptor is missing or invalid
+        size_t sds_off;         ///< Offset of the security descriptor in the $SDS buffer
+        char *sid_str;          ///< Owner SID as a string (NULL until it is first needed)
+    } NTFS_SID_ENT;
+
 
 
 /************************************************************************
@@ -608,6 +618,33 @@ extern "C" {
 
 /************************************************************************
 */
+
+/* Number of bytes of the $Bitmap file that are loaded at a time (rounded up
+ * to a whole number of clusters) */
+#define NTFS_BMAP_CHUNK_SIZE 65536
+
+    /* A part of the $Bitmap file that has been loaded */
+    typedef struct {
+        uint8_t *buf;           // contents of the chunk (NULL if not loaded yet)
+        uint8_t *bad;           // bitmap of the $Bitmap clusters in the chunk that could not be read (NULL if all were read)
+    } NTFS_BMAP_CHUNK;
+
+/* Number of decompressed compression units that are cached per file system */
+#define NTFS_COMP_CACHE_CNT 4
+
+    /* A decompressed compression unit of a compressed attribute */
+    typedef struct {
+        TSK_INUM_T addr;        // address of the file (0 if entry is unused)
+        uint32_t seq;           // sequence of the file
+        uint32_t type;          // type of the attribute
+        uint16_t id;            // id of the attribute
+        TSK_DADDR_T vcn;        // first cluster of the unit in the attribute
+        char *buf;              // decompressed data
+        size_t buf_size;        // size of buf
+        size_t len;             // number of bytes of decompressed data in buf
+        uint64_t used;          // value of comp_cache_age when last used
+    } NTFS_COMP_CACHE;
+
     typedef struct {
         TSK_FS_INFO fs_info;    /* super class */
         ntfs_sb *fs;
@@ -624,24 +661,33 @@ extern "C" {
 
         TSK_FS_ATTR_RUN *bmap;  /* Run of bitmap for clusters (linked list) */
 
-        /* lock protects bmap_buf, bmap_buf_off */
+        /* lock is taken to load a chunk in bmap_chunks.  A chunk is not changed once it is loaded, so loaded chunks are read without it. */
         tsk_lock_t lock;
-        char *bmap_buf;         /* buffer to hold cached copy of bitmap (r/w shared - lock)  */
-        TSK_DADDR_T bmap_buf_off;       /* offset cluster in cached bitmap  (r/w shared - lock) */
+        NTFS_BMAP_CHUNK *bmap_chunks;   /* chunks of the $Bitmap file, loaded when first needed (r/w shared - lock) */
+        size_t bmap_chunk_b;    /* number of bytes in each chunk */
+        TSK_DADDR_T bmap_len;   /* number of clusters covered by the $Bitmap file */
 
         ntfs_attrdef *attrdef;  // buffer of attrdef file contents
         size_t attrdef_len;     // length of addrdef buffer
 
-        /* orphan_map_lock protects orphan_map */
+        /* orphan_map_lock protects orphan_map while it is being built.
+         * It is not modified after it has been built and is then read without the lock. */
         tsk_lock_t orphan_map_lock;
-        void *orphan_map;       // map that lists par directory to its orphans. (r/w shared - lock) 
+        void *orphan_map;       // NTFS_PARENT_MAP that lists par directory to its children, built from one pass of $MFT. (r/w shared - lock) 
 
 #if TSK_USE_SID
-        /* sid_lock protects sii_data, sds_data */
+        /* sid_lock protects sid_loaded, sid_map, and sds_buf.  The map is made the first time that an owner SID is needed. */
         tsk_lock_t sid_lock;
-        NTFS_SXX_BUFFER sii_data;       // (r/w shared - lock) 
-        NTFS_SXX_BUFFER sds_data;       // (r/w shared - lock) 
+        uint8_t sid_loaded;     // set to 1 once $Secure has been loaded (r/w shared - lock)
+        NTFS_SID_ENT *sid_map;  // security ids and owner SIDs from $Secure, sorted by security id (r/w shared - lock)
+        size_t sid_map_cnt;     // number of entries in sid_map
+        char *sds_buf;          // contents of $Secure:$SDS (r/w shared - lock)
 #endif
+
+        /* comp_cache_lock protects comp_cache and comp_cache_age */
+        tsk_lock_t comp_cache_lock;
+        NTFS_COMP_CACHE comp_cache[NTFS_COMP_CACHE_CNT];        // recently decompressed units for ntfs_file_read_special() (r/w shared - lock)
+        uint64_t comp_cache_age;        // (r/w shared - lock)
     } NTFS_INFO;
 
 
@@ -650,10 +696,15 @@ extern "C" {
         int);
     extern TSK_RETVAL_ENUM ntfs_dinode_lookup(NTFS_INFO *, char *,
         TSK_INUM_T);
+    extern TSK_RETVAL_ENUM ntfs_dinode_fixup(NTFS_INFO *, char *);
     extern TSK_RETVAL_ENUM ntfs_dir_open_meta(TSK_FS_INFO * a_fs,
         TSK_FS_DIR ** a_fs_dir, TSK_INUM_T a_addr);
 
     extern void ntfs_orphan_map_free(NTFS_INFO * a_ntfs);
+    extern uint8_t ntfs_parent_map_save(TSK_FS_INFO * a_fs,
+        const TSK_TCHAR * a_path);
+    extern uint8_t ntfs_parent_map_load(TSK_FS_INFO * a_fs,
+        const TSK_TCHAR * a_path);
 
     extern int ntfs_name_cmp(TSK_FS_INFO *, const char *, const char *);
 
@@ -17,9 +17,6 @@
 #ifndef _TSK_YAFFSFS_H
 #define _TSK_YAFFSFS_H
 
-#include <map>
-#include <utility>
-
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -32,6 +29,9 @@ extern "C" {
 #define YAFFS_DEFAULT_PAGE_SIZE     2048
 #define YAFFS_DEFAULT_SPARE_SIZE    64
 
+/* Number of bytes of pages and spares that are read at once when scanning the image */
+#define YAFFS_SCAN_SIZE             (1024 * 1024)
+
 /*
 ** Yaffs Object Flags
 */
@@ -183,11 +183,6 @@ extern "C" {
         uint32_t ycc_n_bytes;
     } YaffsCacheChunk;
 
-    typedef struct _YaffsCacheChunkGroup {
-        YaffsCacheChunk *cache_chunks_head;
-        YaffsCacheChunk *cache_chunks_tail;
-    } YaffsCacheChunkGroup;
-
     /*
      * Structure of an yaffsfs file system handle.
      */
@@ -209,7 +204,10 @@ extern "C" {
 
         tsk_lock_t cache_lock;
         YaffsCacheObject *cache_objects;
-         std::map < uint32_t, YaffsCacheChunkGroup > *chunkMap;
+        YaffsCacheObject **cache_obj_index;     // cache_objects as an array (sorted by obj_id)
+        size_t cache_obj_cnt;
+        YaffsCacheChunk *cache_chunks;  // all chunks, sorted by obj_id, seq number and offset
+        size_t cache_chunk_cnt;
 
         // If the user specified that the image is YAFFS2, print out additional verbose error messages
         int autoDetect;
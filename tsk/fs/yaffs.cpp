@@ -28,6 +28,7 @@ v** Copyright (c) 2002-2003 Brian Carrier, @stake Inc.  All rights reserved
 --*/
 
 #include <vector>
+#include <algorithm>
 
 #include "tsk_fs_i.h"
 #include "tsk_yaffs.h"
@@ -99,196 +100,113 @@ static TSK_RETVAL_ENUM
 /*
 * Order it like yaffs2.git does -- sort by (seq_num, offset/block)
 */
-static int
-    yaffscache_chunk_compare(YaffsCacheChunk *curr, uint32_t addee_obj_id, TSK_OFF_T addee_offset, uint32_t addee_seq_number)
+static bool
+    yaffscache_chunk_less(const YaffsCacheChunk &a, const YaffsCacheChunk &b)
 {
-    if (curr->ycc_obj_id == addee_obj_id) {
-        if (curr->ycc_seq_number == addee_seq_number) {
-            if (curr->ycc_offset == addee_offset) {
-                return 0;
-            }
-            else if (curr->ycc_offset < addee_offset) {
-                return -1;
-            }
-            else {
-                return 1;
-            }
-        }
-        else if (curr->ycc_seq_number < addee_seq_number) {
-            return -1;
-        }
-        else {
-            return 1;
-        }
-    }
-    else if (curr->ycc_obj_id < addee_obj_id) {
-        return -1;
+    if (a.ycc_obj_id != b.ycc_obj_id) {
+        return a.ycc_obj_id < b.ycc_obj_id;
     }
-    else {
-        return 1;
+    if (a.ycc_seq_number != b.ycc_seq_number) {
+        return a.ycc_seq_number < b.ycc_seq_number;
     }
+    return a.ycc_offset < b.ycc_offset;
 }
 
+/*
+* Add a chunk to the end of yfs->cache_chunks.  The chunks are put in order
+* and linked by yaffscache_chunks_sort() once the whole image has been scanned.
+*
+* @param chunk_alloc Number of entries allocated in yfs->cache_chunks
+*/
 static TSK_RETVAL_ENUM
-    yaffscache_chunk_find_insertion_point(YAFFSFS_INFO *yfs, uint32_t obj_id, TSK_OFF_T offset, uint32_t seq_number, YaffsCacheChunk **chunk)
+    yaffscache_chunk_add(YAFFSFS_INFO *yfs, size_t *chunk_alloc, TSK_OFF_T offset,
+    uint32_t seq_number, uint32_t obj_id, uint32_t chunk_id, uint32_t parent_id)
 {
-    YaffsCacheChunk *curr, *prev;
-
-    // Have we seen this obj_id? If not, add an entry for it
-    if(yfs->chunkMap->find(obj_id) == yfs->chunkMap->end()){
-        fflush(stderr);
-        YaffsCacheChunkGroup chunkGroup;
-        chunkGroup.cache_chunks_head = NULL;
-        chunkGroup.cache_chunks_tail = NULL;
-        yfs->chunkMap->insert(std::make_pair(obj_id, chunkGroup));
-    }
-
-    curr = yfs->chunkMap->operator[](obj_id).cache_chunks_head;
-    prev = NULL;
-
-    if (chunk == NULL) {
-        return TSK_ERR;
-    }
+    YaffsCacheChunk *chunk;
 
-    while(curr != NULL) {
-        // Compares obj id, then seq num, then offset. -1 => current < new
-        int cmp = yaffscache_chunk_compare(curr, obj_id, offset, seq_number);
+    if (yfs->cache_chunk_cnt == *chunk_alloc) {
+        size_t new_alloc = *chunk_alloc ? *chunk_alloc * 2 : 1024;
+        YaffsCacheChunk *tmp;
 
-        if (cmp == 0) {
-            *chunk = curr;
-            return TSK_OK;
-        }
-        else if (cmp == 1) {
-            *chunk = prev;
-            return TSK_STOP;
+        if ((tmp = (YaffsCacheChunk *) tsk_realloc(yfs->cache_chunks,
+            new_alloc * sizeof(YaffsCacheChunk))) == NULL) {
+                return TSK_ERR;
         }
-
-        prev = curr;
-        curr = curr->ycc_next;
-    }
-
-    *chunk = prev;
-    return TSK_STOP;
-}
-
-static TSK_RETVAL_ENUM
-    yaffscache_chunk_add(YAFFSFS_INFO *yfs, TSK_OFF_T offset, uint32_t seq_number,
-    uint32_t obj_id, uint32_t chunk_id, uint32_t parent_id)
-{
-    TSK_RETVAL_ENUM result;
-    YaffsCacheChunk *prev;
-    YaffsCacheChunk *chunk;
-    if ((chunk = (YaffsCacheChunk*)tsk_malloc(sizeof(YaffsCacheChunk))) == NULL) {
-        return TSK_ERR;
+        yfs->cache_chunks = tmp;
+        *chunk_alloc = new_alloc;
     }
 
+    chunk = &yfs->cache_chunks[yfs->cache_chunk_cnt++];
+    memset(chunk, 0, sizeof(YaffsCacheChunk));
     chunk->ycc_offset = offset;
     chunk->ycc_seq_number = seq_number;
     chunk->ycc_obj_id = obj_id;
     chunk->ycc_chunk_id = chunk_id;
     chunk->ycc_parent_id = parent_id;
 
-    // Find the chunk that should go right before the new chunk
-    result = yaffscache_chunk_find_insertion_point(yfs, obj_id, offset, seq_number, &prev);
-
-    if (result == TSK_ERR) {
-        return TSK_ERR;
-    }
-
-    if (prev == NULL) {
-        // No previous chunk - new chunk is the lowest we've seen and the new start of the list
-        chunk->ycc_prev = NULL;
-        chunk->ycc_next = yfs->chunkMap->operator[](obj_id).cache_chunks_head;
-    }
-    else {
-        chunk->ycc_prev = prev;
-        chunk->ycc_next = prev->ycc_next;
-    }
-
-    if (chunk->ycc_next != NULL) {
-        // If we're not at the end, set the prev pointer on the next chunk to point to our new one
-        chunk->ycc_next->ycc_prev = chunk;
-    }
-    else {
-        yfs->chunkMap->operator[](obj_id).cache_chunks_tail = chunk;
-    }
-
-    if (chunk->ycc_prev != NULL) {
-        // If we're not at the beginning, set the next pointer on the previous chunk to point at our new one
-        chunk->ycc_prev->ycc_next = chunk;
-    }
-    else {
-        yfs->chunkMap->operator[](obj_id).cache_chunks_head = chunk;
-    }
-
     return TSK_OK;
 }
 
-static TSK_RETVAL_ENUM
-    yaffscache_object_find(YAFFSFS_INFO *yfs, uint32_t obj_id, YaffsCacheObject **obj)
+/*
+* Sort yfs->cache_chunks and link the chunks of each object together
+* (the first and last chunks of an object have NULL prev and next pointers)
+*/
+static void
+    yaffscache_chunks_sort(YAFFSFS_INFO *yfs)
 {
-    YaffsCacheObject *curr, *prev;
-    curr = yfs->cache_objects;
-    prev = NULL;
+    size_t i;
 
-    if (obj == NULL) {
-        return TSK_ERR;
-    }
+    std::sort(yfs->cache_chunks, yfs->cache_chunks + yfs->cache_chunk_cnt,
+        yaffscache_chunk_less);
 
-    while(curr != NULL) {
-        if (curr->yco_obj_id == obj_id) {
-            *obj = curr;
-            return TSK_OK;
+    for (i = 0; i < yfs->cache_chunk_cnt; i++) {
+        YaffsCacheChunk *chunk = &yfs->cache_chunks[i];
+
+        if ((i > 0) && (chunk[-1].ycc_obj_id == chunk->ycc_obj_id)) {
+            chunk->ycc_prev = &chunk[-1];
         }
-        else if (curr->yco_obj_id > obj_id) {
-            *obj = prev;
-            return TSK_STOP;
+        else {
+            chunk->ycc_prev = NULL;
         }
 
-        prev = curr;
-        curr = curr->yco_next;
+        if ((i + 1 < yfs->cache_chunk_cnt) && (chunk[1].ycc_obj_id == chunk->ycc_obj_id)) {
+            chunk->ycc_next = &chunk[1];
+        }
+        else {
+            chunk->ycc_next = NULL;
+        }
     }
-
-    *obj = prev;
-    return TSK_STOP;
 }
 
 static TSK_RETVAL_ENUM
-    yaffscache_object_find_or_add(YAFFSFS_INFO *yfs, uint32_t obj_id, YaffsCacheObject **obj)
+    yaffscache_object_find(YAFFSFS_INFO *yfs, uint32_t obj_id, YaffsCacheObject **obj)
 {
-    YaffsCacheObject *prev;
-    TSK_RETVAL_ENUM result;
+    size_t lo = 0;
+    size_t hi = yfs->cache_obj_cnt;
 
     if (obj == NULL) {
         return TSK_ERR;
     }
 
-    // Look for this obj_id in yfs->cache_objects
-    // If not found, add it in the correct spot
-    // yaffscache_object_find returns the last object with obj_id less than the one
-    // we were searching for, so use that to insert the new one in the list
-    result = yaffscache_object_find(yfs, obj_id, &prev);
-    if (result == TSK_OK) {
-        *obj = prev;
-        return TSK_OK;
-    }
-    else if (result == TSK_STOP) {
-        *obj = (YaffsCacheObject *) tsk_malloc(sizeof(YaffsCacheObject));
-        (*obj)->yco_obj_id = obj_id;
-        if (prev == NULL) {
-            (*obj)->yco_next = yfs->cache_objects;
-            yfs->cache_objects = *obj;
+    // binary search on the object index for the first object with an id >= obj_id
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (yfs->cache_obj_index[mid]->yco_obj_id < obj_id) {
+            lo = mid + 1;
         }
         else {
-            (*obj)->yco_next = prev->yco_next;
-            prev->yco_next = (*obj);
+            hi = mid;
         }
-        return TSK_OK;
     }
-    else {
-        *obj = NULL;
-        return TSK_ERR;
+
+    if ((lo < yfs->cache_obj_cnt) && (yfs->cache_obj_index[lo]->yco_obj_id == obj_id)) {
+        *obj = yfs->cache_obj_index[lo];
+        return TSK_OK;
     }
+
+    // return the last object with an id less than the one we were searching for
+    *obj = (lo > 0) ? yfs->cache_obj_index[lo - 1] : NULL;
+    return TSK_STOP;
 }
 
 static TSK_RETVAL_ENUM
@@ -364,17 +282,10 @@ static TSK_RETVAL_ENUM
 }
 
 static TSK_RETVAL_ENUM
-    yaffscache_versions_insert_chunk(YAFFSFS_INFO *yfs, YaffsCacheChunk *chunk)
+    yaffscache_versions_insert_chunk(YAFFSFS_INFO *yfs, YaffsCacheObject *obj, YaffsCacheChunk *chunk)
 {
-    YaffsCacheObject *obj;
-    TSK_RETVAL_ENUM result;
     YaffsCacheVersion *version;
 
-    // Building a list in yfs->cache_objects, sorted by obj_id
-    result = yaffscache_object_find_or_add(yfs, chunk->ycc_obj_id, &obj);
-    if (result != TSK_OK) {
-        return TSK_ERR;
-    }
     version = obj->yco_latest;
 
     /* First chunk in this object? */
@@ -445,16 +356,45 @@ static TSK_RETVAL_ENUM
 static TSK_RETVAL_ENUM
     yaffscache_versions_compute(YAFFSFS_INFO *yfs)
 {
-    std::map<unsigned int,YaffsCacheChunkGroup>::iterator iter;
-    for( iter = yfs->chunkMap->begin(); iter != yfs->chunkMap->end(); ++iter ) {
-        YaffsCacheChunk *chunk_curr = yfs->chunkMap->operator[](iter->first).cache_chunks_head;
+    YaffsCacheObject *obj = NULL;
+    YaffsCacheObject *tail = NULL;
+    size_t obj_alloc = 0;
+    size_t i;
+
+    // The chunks are sorted by obj_id, so the objects are created in order and
+    // added to the end of yfs->cache_objects and the object index
+    for (i = 0; i < yfs->cache_chunk_cnt; i++) {
+        YaffsCacheChunk *chunk_curr = &yfs->cache_chunks[i];
+
+        if ((obj == NULL) || (obj->yco_obj_id != chunk_curr->ycc_obj_id)) {
+            if (yfs->cache_obj_cnt == obj_alloc) {
+                size_t new_alloc = obj_alloc ? obj_alloc * 2 : 256;
+                YaffsCacheObject **tmp;
+
+                if ((tmp = (YaffsCacheObject **) tsk_realloc(yfs->cache_obj_index,
+                    new_alloc * sizeof(YaffsCacheObject *))) == NULL) {
+                        return TSK_ERR;
+                }
+                yfs->cache_obj_index = tmp;
+                obj_alloc = new_alloc;
+            }
 
-        while(chunk_curr != NULL) {
-            if (yaffscache_versions_insert_chunk(yfs, chunk_curr) != TSK_OK) {
+            if ((obj = (YaffsCacheObject *) tsk_malloc(sizeof(YaffsCacheObject))) == NULL) {
                 return TSK_ERR;
             }
+            obj->yco_obj_id = chunk_curr->ycc_obj_id;
+            if (tail == NULL) {
+                yfs->cache_objects = obj;
+            }
+            else {
+                tail->yco_next = obj;
+            }
+            tail = obj;
+            yfs->cache_obj_index[yfs->cache_obj_cnt++] = obj;
+        }
 
-            chunk_curr = chunk_curr->ycc_next;
+        if (yaffscache_versions_insert_chunk(yfs, obj, chunk_curr) != TSK_OK) {
+            return TSK_ERR;
         }
     }
 
@@ -625,20 +565,19 @@ static void
         obj = obj->yco_next;
         free(to_free);
     }
+    yfs->cache_objects = NULL;
+
+    free(yfs->cache_obj_index);
+    yfs->cache_obj_index = NULL;
+    yfs->cache_obj_cnt = 0;
 }
 
 static void
     yaffscache_chunks_free(YAFFSFS_INFO *yfs)
 {
-    std::map<unsigned int,YaffsCacheChunkGroup>::iterator iter;
-    for( iter = yfs->chunkMap->begin(); iter != yfs->chunkMap->end(); ++iter ) {
-        YaffsCacheChunk *chunk = yfs->chunkMap->operator[](iter->first).cache_chunks_head;
-        while(chunk != NULL) {
-            YaffsCacheChunk *to_free = chunk;
-            chunk = chunk->ycc_next;
-            free(to_free);
-        }
-    }
+    free(yfs->cache_chunks);
+    yfs->cache_chunks = NULL;
+    yfs->cache_chunk_cnt = 0;
 }
 
 
@@ -1027,6 +966,48 @@ static uint8_t
     return 0;
 }
 
+/**
+* Parse the YAFFS2 tags in NAND spare bytes that have already been read.
+*
+* @param yfs is a YAFFS fs handle
+* @param spr Spare bytes (at least yfs->spare_size bytes)
+* @param sp YaffsSpare object to be populated
+*/
+static void
+    yaffsfs_parse_spare(YAFFSFS_INFO *yfs, const unsigned char *spr, YaffsSpare *sp)
+{
+    uint32_t seq_number;
+    uint32_t object_id;
+    uint32_t chunk_id;
+
+    memset(sp, 0, sizeof(YaffsSpare));
+
+    // The format of the spare area should have been determined earlier
+    memcpy(&seq_number, &spr[yfs->spare_seq_offset], 4);
+    memcpy(&object_id, &spr[yfs->spare_obj_id_offset], 4);
+    memcpy(&chunk_id, &spr[yfs->spare_chunk_id_offset], 4);
+
+    if ((YAFFS_SPARE_FLAGS_IS_HEADER & chunk_id) != 0) {
+
+        sp->seq_number = seq_number;
+        sp->object_id = object_id & ~YAFFS_SPARE_OBJECT_TYPE_MASK;
+        sp->chunk_id = 0;
+
+        sp->has_extra_fields = 1;
+        sp->extra_parent_id = chunk_id & YAFFS_SPARE_PARENT_ID_MASK;
+        sp->extra_object_type =
+            (object_id & YAFFS_SPARE_OBJECT_TYPE_MASK)
+            >> YAFFS_SPARE_OBJECT_TYPE_SHIFT;
+    }
+    else {
+        sp->seq_number = seq_number;
+        sp->object_id = object_id;
+        sp->chunk_id = chunk_id;
+
+        sp->has_extra_fields = 0;
+    }
+}
+
 /**
 * Read and parse the YAFFS2 tags in the NAND spare bytes.
 *
@@ -1044,10 +1025,6 @@ static uint8_t
     YaffsSpare *sp;
     TSK_FS_INFO *fs = &(yfs->fs_info);
 
-    uint32_t seq_number;
-    uint32_t object_id;
-    uint32_t chunk_id;
-
     if ((spr = (unsigned char*) tsk_malloc(yfs->spare_size)) == NULL) {
         return 1;
     }
@@ -1074,37 +1051,10 @@ static uint8_t
         return 1;
     }
 
-    memset(sp, 0, sizeof(YaffsSpare));
-
     /*
     * Complete read of the YAFFS2 spare
     */
-
-
-    // The format of the spare area should have been determined earlier
-    memcpy(&seq_number, &spr[yfs->spare_seq_offset], 4);
-    memcpy(&object_id, &spr[yfs->spare_obj_id_offset], 4);
-    memcpy(&chunk_id, &spr[yfs->spare_chunk_id_offset], 4);
-
-    if ((YAFFS_SPARE_FLAGS_IS_HEADER & chunk_id) != 0) {
-
-        sp->seq_number = seq_number;
-        sp->object_id = object_id & ~YAFFS_SPARE_OBJECT_TYPE_MASK;
-        sp->chunk_id = 0;
-
-        sp->has_extra_fields = 1;
-        sp->extra_parent_id = chunk_id & YAFFS_SPARE_PARENT_ID_MASK;
-        sp->extra_object_type =
-            (object_id & YAFFS_SPARE_OBJECT_TYPE_MASK)
-            >> YAFFS_SPARE_OBJECT_TYPE_SHIFT;
-    }
-    else {
-        sp->seq_number = seq_number;
-        sp->object_id = object_id;
-        sp->chunk_id = chunk_id;
-
-        sp->has_extra_fields = 0;
-    }
+    yaffsfs_parse_spare(yfs, spr, sp);
 
     free(spr);
     *spare = sp;
@@ -1157,68 +1107,103 @@ static uint8_t
 static uint8_t 
     yaffsfs_cache_fs(YAFFSFS_INFO * yfs)
 {
-    uint8_t status = TSK_OK;
-    size_t offset = 0;
+    TSK_OFF_T offset = 0;
     uint32_t nentries = 0;
-    YaffsSpare *spare = NULL;
+    YaffsSpare spare;
+    size_t rec_size = yfs->page_size + yfs->spare_size;
+    size_t recs_per_read;
+    size_t chunk_alloc = 0;
+    unsigned char *buf;
+    uint8_t done = 0;
 
-    uint8_t tempBuf[8];
     uint32_t parentID;
 
     if (yfs->cache_objects)
         return 0;
 
-    offset = 0;
-    while (1) {
+    /* The pages and spares are read YAFFS_SCAN_SIZE bytes at a time and
+     * the spares in each buffer are parsed in one pass.  The page data is
+     * only needed for the parent ID of headers that do not have it in the
+     * spare. */
+    recs_per_read = YAFFS_SCAN_SIZE / rec_size;
+    if (recs_per_read == 0)
+        recs_per_read = 1;
 
-        status = yaffsfs_read_spare( yfs, &spare, offset + yfs->page_size);
-        if (status != TSK_OK) {
+    if ((buf = (unsigned char *) tsk_malloc(recs_per_read * rec_size)) == NULL) {
+        return TSK_ERR;
+    }
+
+    // yaffsfs_read_spare() would fail for every chunk
+    if (yfs->spare_size < 46) {
+        done = 1;
+    }
+
+    while (! done) {
+        ssize_t cnt;
+        size_t i;
+        size_t read_len = recs_per_read * rec_size;
+
+        // do not ask for more than what is left in the image
+        if (offset >= yfs->fs_info.img_info->size) {
             break;
         }
+        if ((TSK_OFF_T) read_len > yfs->fs_info.img_info->size - offset) {
+            read_len = (size_t) (yfs->fs_info.img_info->size - offset);
+        }
 
-        if (yaffsfs_is_spare_valid(yfs, spare) == TSK_OK) {
+        cnt = tsk_img_read(yfs->fs_info.img_info, offset, (char *) buf,
+            read_len);
+        if (cnt == -1) {
+            // try again one chunk at a time to get as far as we can
+            if (recs_per_read > 1) {
+                tsk_error_reset();
+                recs_per_read = 1;
+                continue;
+            }
+            break;
+        }
 
+        for (i = 0; i < recs_per_read; i++) {
+            unsigned char *page = &buf[i * rec_size];
 
-            if((spare->has_extra_fields) || (spare->chunk_id != 0)){
-                yaffscache_chunk_add(yfs,
-                    offset, 
-                    spare->seq_number, 
-                    spare->object_id, 
-                    spare->chunk_id, 
-                    spare->extra_parent_id);
+            // stop at the first chunk whose spare was not fully read
+            if ((size_t) cnt < (i + 1) * rec_size) {
+                done = 1;
+                break;
             }
-            else{
-                // If we have a header block and didn't extract it already from the spare, get the parent ID from
-                // the non-spare data
-                if(8 == tsk_img_read(yfs->fs_info.img_info, offset, (char*) tempBuf, 8)){
-                    memcpy(&parentID, &tempBuf[4], 4);
-
-                    yaffscache_chunk_add(yfs,
-                        offset, 
-                        spare->seq_number, 
-                        spare->object_id, 
-                        spare->chunk_id, 
-                        parentID);
+
+            yaffsfs_parse_spare(yfs, page + yfs->page_size, &spare);
+
+            if (yaffsfs_is_spare_valid(yfs, &spare) == TSK_OK) {
+
+                if((spare.has_extra_fields) || (spare.chunk_id != 0)){
+                    parentID = spare.extra_parent_id;
                 }
                 else{
-                    // Really shouldn't happen
-                    fprintf(stderr, "Error reading header to get parent id at offset %x\n", offset);
-                    yaffscache_chunk_add(yfs,
-                        offset, 
-                        spare->seq_number, 
-                        spare->object_id, 
-                        spare->chunk_id, 
-                        0);
+                    // If we have a header block and didn't extract it already from the spare, get the parent ID from
+                    // the non-spare data
+                    memcpy(&parentID, &page[4], 4);
                 }
-            }
-        }
 
-        free(spare);
-        spare = NULL;
+                if (yaffscache_chunk_add(yfs, &chunk_alloc,
+                    offset, 
+                    spare.seq_number, 
+                    spare.object_id, 
+                    spare.chunk_id, 
+                    parentID) != TSK_OK) {
+                        free(buf);
+                        return TSK_ERR;
+                }
+            }
 
-        ++nentries;
-        offset += yfs->page_size + yfs->spare_size;
+            ++nentries;
+            offset += rec_size;
+        }
     }
+    free(buf);
+
+    // put the chunks in order (by obj id, seq number, and offset)
+    yaffscache_chunks_sort(yfs);
 
     if (tsk_verbose)
         fprintf(stderr, "yaffsfs_cache_fs: read %d entries\n", nentries);
@@ -2639,7 +2624,6 @@ TSK_FS_INFO *
     yaffsfs->page_size = psize == 0 ? YAFFS_DEFAULT_PAGE_SIZE : psize;
     yaffsfs->spare_size = ssize == 0 ? YAFFS_DEFAULT_SPARE_SIZE : ssize;
     yaffsfs->chunks_per_block = 64;
-    yaffsfs->chunkMap = new std::map<uint32_t, YaffsCacheChunkGroup>;
     yaffsfs->max_obj_id = 1;
     yaffsfs->max_version = 0;
 
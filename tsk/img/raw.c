@@ -260,6 +260,11 @@ raw_read(TSK_IMG_INFO * img_info, TSK_OFF_T offset, char *buf, size_t len)
                 len -= read_len;
 
                 while (len > 0) {
+                    /* the read goes past the end of the last segment */
+                    if (i + 1 >= raw_info->num_img) {
+                        break;
+                    }
+
                     /* go to the next image segment */
                     i++;
 
@@ -0,0 +1,137 @@
+/*
+ * tsk_bitmap_test.cpp
+ *
+ *  Tests for the TSK_BITMAP sparse set in tsk/base/tsk_bitmap.c
+ */
+
+#include <libtsk.h>
+#include <set>
+
+#include "tsk_bitmap_test.h"
+
+// Registers the fixture into the 'registry'
+CPPUNIT_TEST_SUITE_REGISTRATION( TskBitmapTest );
+
+void TskBitmapTest::setUp() {}
+void TskBitmapTest::tearDown() {}
+
+void TskBitmapTest::testEmpty() {
+	TSK_BITMAP *map = NULL;
+
+	// NULL is a valid empty map
+	CPPUNIT_ASSERT(0 == tsk_bitmap_find(map, 0));
+	CPPUNIT_ASSERT(0 == tsk_bitmap_find(map, 12345));
+	CPPUNIT_ASSERT(0 == tsk_bitmap_count(map));
+	tsk_bitmap_free(map);
+}
+
+void TskBitmapTest::testAddFind() {
+	TSK_BITMAP *map = NULL;
+
+	CPPUNIT_ASSERT(0 == tsk_bitmap_add(&map, 100));
+	CPPUNIT_ASSERT(map != NULL);
+	CPPUNIT_ASSERT(0 == tsk_bitmap_add(&map, 5));
+	CPPUNIT_ASSERT(0 == tsk_bitmap_add(&map, 70000));
+
+	CPPUNIT_ASSERT(1 == tsk_bitmap_find(map, 5));
+	CPPUNIT_ASSERT(1 == tsk_bitmap_find(map, 100));
+	CPPUNIT_ASSERT(1 == tsk_bitmap_find(map, 70000));
+	CPPUNIT_ASSERT(0 == tsk_bitmap_find(map, 0));
+	CPPUNIT_ASSERT(0 == tsk_bitmap_find(map, 4));
+	CPPUNIT_ASSERT(0 == tsk_bitmap_find(map, 6));
+	CPPUNIT_ASSERT(0 == tsk_bitmap_find(map, 99));
+	CPPUNIT_ASSERT(0 == tsk_bitmap_find(map, 101));
+	CPPUNIT_ASSERT(0 == tsk_bitmap_find(map, 70000 - 65536));
+	CPPUNIT_ASSERT(3 == tsk_bitmap_count(map));
+	tsk_bitmap_free(map);
+}
+
+void TskBitmapTest::testDuplicates() {
+	TSK_BITMAP *map = NULL;
+
+	for (unsigned x = 0; x < 10; x++) {
+		CPPUNIT_ASSERT(0 == tsk_bitmap_add(&map, 42));
+	}
+	CPPUNIT_ASSERT(1 == tsk_bitmap_count(map));
+
+	// duplicates in a chunk that has been converted to a bitmap
+	for (uint64_t x = 0; x < 10000; x++) {
+		CPPUNIT_ASSERT(0 == tsk_bitmap_add(&map, x * 2 + 1));
+	}
+	CPPUNIT_ASSERT(10001 == tsk_bitmap_count(map));
+	for (uint64_t x = 0; x < 10000; x++) {
+		CPPUNIT_ASSERT(0 == tsk_bitmap_add(&map, x * 2 + 1));
+	}
+	CPPUNIT_ASSERT(10001 == tsk_bitmap_count(map));
+	tsk_bitmap_free(map);
+}
+
+void TskBitmapTest::testChunkBoundaries() {
+	TSK_BITMAP *map = NULL;
+	const uint64_t keys[] = { 0, 65535, 65536, 131071, 131072,
+		(uint64_t) 1 << 32, ((uint64_t) 1 << 32) - 1,
+		(uint64_t) 0xffffffffffffffffULL, (uint64_t) 0xffffffffffff0000ULL };
+	const unsigned nkeys = sizeof(keys) / sizeof(keys[0]);
+
+	for (unsigned x = 0; x < nkeys; x++) {
+		CPPUNIT_ASSERT(0 == tsk_bitmap_add(&map, keys[x]));
+	}
+	CPPUNIT_ASSERT(nkeys == tsk_bitmap_count(map));
+	for (unsigned x = 0; x < nkeys; x++) {
+		CPPUNIT_ASSERT(1 == tsk_bitmap_find(map, keys[x]));
+	}
+	CPPUNIT_ASSERT(0 == tsk_bitmap_find(map, 1));
+	CPPUNIT_ASSERT(0 == tsk_bitmap_find(map, 65534));
+	CPPUNIT_ASSERT(0 == tsk_bitmap_find(map, 65537));
+	CPPUNIT_ASSERT(0 == tsk_bitmap_find(map, 131070));
+	CPPUNIT_ASSERT(0 == tsk_bitmap_find(map, 131073));
+	CPPUNIT_ASSERT(0 == tsk_bitmap_find(map, ((uint64_t) 1 << 32) + 1));
+	CPPUNIT_ASSERT(0 == tsk_bitmap_find(map, (uint64_t) 0xfffffffffffffffeULL));
+	CPPUNIT_ASSERT(0 == tsk_bitmap_find(map, (uint64_t) 0xfffffffffffeffffULL));
+	tsk_bitmap_free(map);
+}
+
+void TskBitmapTest::testDenseRange() {
+	TSK_BITMAP *map = NULL;
+	const uint64_t start = 65536 * 3 - 1000;
+	const uint64_t end = 65536 * 5 + 1000;
+
+	// a range that fills whole chunks (which are stored as bitmaps)
+	// and parts of the chunks on either side
+	for (uint64_t x = start; x <= end; x++) {
+		CPPUNIT_ASSERT(0 == tsk_bitmap_add(&map, x));
+	}
+	CPPUNIT_ASSERT(end - start + 1 == tsk_bitmap_count(map));
+	for (uint64_t x = start - 100; x <= end + 100; x++) {
+		CPPUNIT_ASSERT((x >= start && x <= end) == (tsk_bitmap_find(map, x) == 1));
+	}
+	CPPUNIT_ASSERT(0 == tsk_bitmap_find(map, 0));
+	CPPUNIT_ASSERT(0 == tsk_bitmap_find(map, 65536 * 2));
+	CPPUNIT_ASSERT(0 == tsk_bitmap_find(map, 65536 * 6));
+	tsk_bitmap_free(map);
+}
+
+void TskBitmapTest::testRandomOrder() {
+	TSK_BITMAP *map = NULL;
+	std::set<uint64_t> keys;
+	uint64_t seed = 12345;
+
+	// keys added out of order and spread over a few chunks, with some
+	// chunks reaching the size where they are converted to bitmaps
+	for (unsigned x = 0; x < 30000; x++) {
+		seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+		uint64_t key = (seed >> 33) % (65536 * 4);
+		if (x % 3 == 0)
+			key = (seed >> 20);
+		keys.insert(key);
+		CPPUNIT_ASSERT(0 == tsk_bitmap_add(&map, key));
+		CPPUNIT_ASSERT(keys.size() == tsk_bitmap_count(map));
+	}
+	for (std::set<uint64_t>::iterator it = keys.begin(); it != keys.end(); it++) {
+		CPPUNIT_ASSERT(1 == tsk_bitmap_find(map, *it));
+	}
+	for (uint64_t x = 0; x < 65536 * 4; x++) {
+		CPPUNIT_ASSERT((keys.count(x) == 1) == (tsk_bitmap_find(map, x) == 1));
+	}
+	tsk_bitmap_free(map);
+}
@@ -0,0 +1,36 @@
+/*
+ * tsk_bitmap_test.h
+ *
+ *  Tests for the TSK_BITMAP sparse set in tsk/base/tsk_bitmap.c
+ */
+
+#ifndef TSK_BITMAP_TEST_H_
+#define TSK_BITMAP_TEST_H_
+
+#include <cppunit/extensions/HelperMacros.h>
+
+class TskBitmapTest : public CppUnit::TestFixture
+{
+  CPPUNIT_TEST_SUITE( TskBitmapTest );
+  CPPUNIT_TEST(testEmpty);
+  CPPUNIT_TEST(testAddFind);
+  CPPUNIT_TEST(testDuplicates);
+  CPPUNIT_TEST(testChunkBoundaries);
+  CPPUNIT_TEST(testDenseRange);
+  CPPUNIT_TEST(testRandomOrder);
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp();
+  void tearDown();
+
+  void testEmpty();
+  void testAddFind();
+  void testDuplicates();
+  void testChunkBoundaries();
+  void testDenseRange();
+  void testRandomOrder();
+};
+
+
+#endif /* TSK_BITMAP_TEST_H_ */